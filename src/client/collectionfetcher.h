@@ -23,6 +23,7 @@
 #include "collectiontrackinfo.h"
 
 #include <QObject>
+#include <QUuid>
 #include <QVector>
 
 namespace PMP::Client
@@ -36,6 +37,8 @@ namespace PMP::Client
 
     Q_SIGNALS:
         void receivedData(QVector<CollectionTrackInfo> data);
+        void receivedJournalVersion(bool isFullCollection, QUuid journalId,
+                                    quint64 journalVersion);
         void completed();
         void errorOccurred();
     };
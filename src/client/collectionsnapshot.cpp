@@ -0,0 +1,163 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "collectionsnapshot.h"
+
+#include "common/filehash.h"
+
+#include "localhashidrepository.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtDebug>
+
+namespace PMP::Client
+{
+    namespace
+    {
+        const quint32 fileMagic = 0x504D5043; /* "PMPC" */
+        const quint16 fileFormatVersion = 1;
+    }
+
+    ResultOrError<CollectionSnapshot, FailureType> CollectionSnapshot::load(
+                                                QUuid databaseId,
+                                                LocalHashIdRepository* hashIdRepository)
+    {
+        QFile file(getFilePath(databaseId));
+        if (!file.exists())
+            return failure;
+
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qWarning() << "CollectionSnapshot: could not open" << file.fileName();
+            return failure;
+        }
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_12);
+
+        quint32 magic;
+        quint16 formatVersion;
+        stream >> magic >> formatVersion;
+        if (magic != fileMagic || formatVersion != fileFormatVersion)
+        {
+            qWarning() << "CollectionSnapshot: unsupported file:" << file.fileName();
+            return failure;
+        }
+
+        QUuid journalId;
+        quint64 journalVersion;
+        quint32 trackCount;
+        stream >> journalId >> journalVersion >> trackCount;
+
+        QVector<CollectionTrackInfo> tracks;
+        tracks.reserve(int(qMin(trackCount, quint32(1000000))));
+
+        for (quint32 i = 0; i < trackCount && stream.status() == QDataStream::Ok; ++i)
+        {
+            quint32 hashLength;
+            QByteArray sha1, md5;
+            bool isAvailable;
+            qint32 lengthInMilliseconds;
+            QString title, artist, album, albumArtist;
+
+            stream >> hashLength >> sha1 >> md5 >> isAvailable >> lengthInMilliseconds
+                   >> title >> artist >> album >> albumArtist;
+
+            auto hashId =
+                    hashIdRepository->getOrRegisterId(FileHash(hashLength, sha1, md5));
+
+            tracks.append(
+                CollectionTrackInfo(hashId, isAvailable, title, artist, album,
+                                    albumArtist, lengthInMilliseconds)
+            );
+        }
+
+        if (stream.status() != QDataStream::Ok)
+        {
+            qWarning() << "CollectionSnapshot: file is damaged:" << file.fileName();
+            return failure;
+        }
+
+        qDebug() << "CollectionSnapshot: loaded" << tracks.size() << "tracks;"
+                 << "journal:" << journalId << "; version:" << journalVersion;
+
+        return CollectionSnapshot(journalId, journalVersion, tracks);
+    }
+
+    SuccessOrFailure CollectionSnapshot::save(QUuid databaseId,
+                                              CollectionSnapshot const& snapshot,
+                                              LocalHashIdRepository* hashIdRepository)
+    {
+        auto filePath = getFilePath(databaseId);
+        QDir().mkpath(QFileInfo(filePath).absolutePath());
+
+        /* write to a temporary file first, so we never leave a half-written file */
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "CollectionSnapshot: could not open" << filePath;
+            return failure;
+        }
+
+        QDataStream stream(&file);
+        stream.setVersion(QDataStream::Qt_5_12);
+
+        auto const& tracks = snapshot.tracks();
+
+        stream << fileMagic << fileFormatVersion;
+        stream << snapshot.journalId() << snapshot.journalVersion()
+               << quint32(tracks.size());
+
+        for (auto const& track : tracks)
+        {
+            auto hash = hashIdRepository->getHash(track.hashId());
+
+            stream << quint32(hash.length()) << hash.SHA1() << hash.MD5()
+                   << track.isAvailable() << track.lengthInMilliseconds()
+                   << track.title() << track.artist() << track.album()
+                   << track.albumArtist();
+        }
+
+        if (stream.status() != QDataStream::Ok || !file.commit())
+        {
+            qWarning() << "CollectionSnapshot: could not write" << filePath;
+            return failure;
+        }
+
+        qDebug() << "CollectionSnapshot: saved" << tracks.size() << "tracks;"
+                 << "journal:" << snapshot.journalId()
+                 << "; version:" << snapshot.journalVersion();
+
+        return success;
+    }
+
+    QString CollectionSnapshot::getFilePath(QUuid databaseId)
+    {
+        auto directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+
+        return directory + "/collection-"
+                + databaseId.toString(QUuid::WithoutBraces) + ".dat";
+    }
+}
@@ -0,0 +1,68 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PMP_CLIENT_COLLECTIONSNAPSHOT_H
+#define PMP_CLIENT_COLLECTIONSNAPSHOT_H
+
+#include "common/resultorerror.h"
+
+#include "collectiontrackinfo.h"
+
+#include <QUuid>
+#include <QVector>
+
+namespace PMP::Client
+{
+    class LocalHashIdRepository;
+
+    /* Copy of the server's music collection that is kept on disk between sessions, so
+       that only the changes need to be fetched when connecting to the server again. */
+    class CollectionSnapshot
+    {
+    public:
+        CollectionSnapshot() : _journalVersion(0) {}
+
+        CollectionSnapshot(QUuid journalId, quint64 journalVersion,
+                           QVector<CollectionTrackInfo> tracks)
+         : _journalId(journalId), _journalVersion(journalVersion), _tracks(tracks)
+        {
+            //
+        }
+
+        QUuid journalId() const { return _journalId; }
+        quint64 journalVersion() const { return _journalVersion; }
+        QVector<CollectionTrackInfo> const& tracks() const { return _tracks; }
+
+        static ResultOrError<CollectionSnapshot, FailureType> load(
+                                                QUuid databaseId,
+                                                LocalHashIdRepository* hashIdRepository);
+        static SuccessOrFailure save(QUuid databaseId,
+                                     CollectionSnapshot const& snapshot,
+                                     LocalHashIdRepository* hashIdRepository);
+
+    private:
+        static QString getFilePath(QUuid databaseId);
+
+        QUuid _journalId;
+        quint64 _journalVersion;
+        QVector<CollectionTrackInfo> _tracks;
+    };
+}
+#endif
@@ -19,7 +19,11 @@
 
 #include "collectionwatcherimpl.h"
 
+#include "common/concurrent.h"
+#include "common/stringpool.h"
+
 #include "collectionfetcher.h"
+#include "collectionsnapshot.h"
 #include "localhashidrepository.h"
 #include "servercapabilities.h"
 #include "serverconnection.h"
@@ -32,7 +36,9 @@ namespace PMP::Client
      : CollectionWatcher(connection),
        _connection(connection),
        _autoDownload(false),
-       _downloading(false)
+       _downloading(false),
+       _journalVersion(0),
+       _haveNewJournalVersion(false)
     {
         connect(
             connection, &ServerConnection::collectionTracksAvailabilityChanged,
@@ -42,6 +48,10 @@ namespace PMP::Client
             connection, &ServerConnection::collectionTracksChanged,
             this, &CollectionWatcherImpl::onCollectionTracksChanged
         );
+        connect(
+            connection, &ServerConnection::receivedDatabaseIdentifier,
+            this, &CollectionWatcherImpl::onDatabaseIdentifierReceived
+        );
 
         if (_connection->isConnected())
             onConnected();
@@ -123,26 +133,59 @@ namespace PMP::Client
             startDownload();
     }
 
+    void CollectionWatcherImpl::onDatabaseIdentifierReceived(QUuid databaseId)
+    {
+        if (!_databaseId.isNull() || databaseId.isNull())
+            return; /* we only need it once */
+
+        _databaseId = databaseId;
+
+        if (_downloading)
+            loadSnapshotAndFetchChanges();
+    }
+
     void CollectionWatcherImpl::onCollectionPartReceived(
                                                       QVector<CollectionTrackInfo> tracks)
     {
         qDebug() << "download: received part with" << tracks.size() << "tracks";
 
+        /* the data we receive here is never older than what we have already; we might
+           have tracks from a snapshot that need to be updated */
         for (auto const& track : tracks)
         {
-            if (_collectionHash.contains(track.hashId()))
-                continue; /* don't update */
-
-            _collectionHash.insert(track.hashId(), track);
-            Q_EMIT newTrackReceived(track);
+            _tracksReceivedInDownload.insert(track.hashId());
+            updateTrackData(track);
         }
     }
 
+    void CollectionWatcherImpl::onCollectionJournalVersionReceived(bool isFullCollection,
+                                                                   QUuid journalId,
+                                                                   quint64 journalVersion)
+    {
+        qDebug() << "received" << (isFullCollection ? "full collection" : "changes")
+                 << "up to version" << journalVersion << "of journal" << journalId;
+
+        /* tracks from a snapshot that were not part of a full collection download are
+           gone from the server, so they must not be kept (and saved again) */
+        if (isFullCollection)
+            removeTracksNotReceivedInDownload();
+
+        _journalId = journalId;
+        _journalVersion = journalVersion;
+        _haveNewJournalVersion = true;
+    }
+
     void CollectionWatcherImpl::onCollectionDownloadCompleted()
     {
         qDebug() << "collection download completed";
         _downloading = false;
         Q_EMIT downloadingInProgressChanged();
+
+        if (_haveNewJournalVersion)
+        {
+            _haveNewJournalVersion = false;
+            saveSnapshot();
+        }
     }
 
     void CollectionWatcherImpl::onCollectionDownloadError()
@@ -207,13 +250,110 @@ namespace PMP::Client
     {
         if (_downloading) return;
 
-        qDebug() << "starting collection download";
+        _downloading = true;
+        _tracksReceivedInDownload.clear();
+        Q_EMIT downloadingInProgressChanged();
+
+        if (!_connection->serverCapabilities().supportsIncrementalCollectionFetching())
+        {
+            qDebug() << "starting collection download";
+            _connection->fetchCollection(createFetcher());
+            return;
+        }
+
+        if (_databaseId.isNull())
+        {
+            /* we need to know which database the collection belongs to first */
+            _connection->sendDatabaseIdentifierRequest();
+            return; /* will continue when the identifier has been received */
+        }
+
+        loadSnapshotAndFetchChanges();
+    }
+
+    void CollectionWatcherImpl::loadSnapshotAndFetchChanges()
+    {
+        auto databaseId = _databaseId;
+        auto hashIdRepository = _connection->hashIdRepository();
+
+        auto future =
+            Concurrent::runOnThreadPool<CollectionSnapshot, FailureType>(
+                globalThreadPool,
+                [databaseId, hashIdRepository]()
+                {
+                    return CollectionSnapshot::load(databaseId, hashIdRepository);
+                }
+            );
+
+        future.handleOnEventLoop(
+            this,
+            [this](ResultOrError<CollectionSnapshot, FailureType> outcome)
+            {
+                if (outcome.succeeded())
+                    applySnapshot(outcome.result());
+
+                fetchChanges();
+            }
+        );
+    }
+
+    void CollectionWatcherImpl::applySnapshot(CollectionSnapshot const& snapshot)
+    {
+        qDebug() << "applying collection snapshot with" << snapshot.tracks().size()
+                 << "tracks";
+
+        for (auto const& track : snapshot.tracks())
+        {
+            updateTrackData(track);
+        }
+
+        _journalId = snapshot.journalId();
+        _journalVersion = snapshot.journalVersion();
+    }
+
+    void CollectionWatcherImpl::fetchChanges()
+    {
+        qDebug() << "starting collection download; have version" << _journalVersion
+                 << "of journal" << _journalId;
+
+        _connection->fetchCollectionChanges(createFetcher(), _journalId, _journalVersion);
+    }
+
+    void CollectionWatcherImpl::saveSnapshot()
+    {
+        if (_databaseId.isNull())
+            return;
+
+        auto databaseId = _databaseId;
+        auto journalId = _journalId;
+        auto journalVersion = _journalVersion;
+        auto collection = _collectionHash; /* implicitly shared, so cheap to copy */
+        auto hashIdRepository = _connection->hashIdRepository();
+
+        Concurrent::runOnThreadPool<SuccessType, FailureType>(
+            globalThreadPool,
+            [databaseId, journalId, journalVersion, collection, hashIdRepository]()
+            {
+                CollectionSnapshot snapshot(journalId, journalVersion,
+                                            collection.values().toVector());
+
+                return CollectionSnapshot::save(databaseId, snapshot, hashIdRepository);
+            }
+        );
+    }
+
+    CollectionFetcher* CollectionWatcherImpl::createFetcher()
+    {
         auto fetcher = new CollectionFetcher();
 
         connect(
             fetcher, &CollectionFetcher::receivedData,
             this, &CollectionWatcherImpl::onCollectionPartReceived
         );
+        connect(
+            fetcher, &CollectionFetcher::receivedJournalVersion,
+            this, &CollectionWatcherImpl::onCollectionJournalVersionReceived
+        );
         connect(
             fetcher, &CollectionFetcher::completed,
             this, &CollectionWatcherImpl::onCollectionDownloadCompleted
@@ -223,10 +363,7 @@ namespace PMP::Client
             this, &CollectionWatcherImpl::onCollectionDownloadError
         );
 
-        _connection->fetchCollection(fetcher);
-        _downloading = true;
-
-        Q_EMIT downloadingInProgressChanged();
+        return fetcher;
     }
 
     void CollectionWatcherImpl::updateTrackAvailability(QVector<LocalHashId> hashes,
@@ -263,8 +400,42 @@ namespace PMP::Client
         }
     }
 
-    void CollectionWatcherImpl::updateTrackData(const CollectionTrackInfo& track)
+    void CollectionWatcherImpl::removeTracksNotReceivedInDownload()
+    {
+        QVector<LocalHashId> tracksToRemove;
+
+        const auto knownTracks = _collectionHash.keys();
+        for (auto const& hashId : knownTracks)
+        {
+            if (!_tracksReceivedInDownload.contains(hashId))
+                tracksToRemove.append(hashId);
+        }
+
+        if (tracksToRemove.isEmpty())
+            return;
+
+        qDebug() << "removing" << tracksToRemove.size()
+                 << "tracks that were not part of the full collection";
+
+        for (auto const& hashId : qAsConst(tracksToRemove))
+        {
+            auto track = _collectionHash.take(hashId);
+
+            if (track.isAvailable())
+                Q_EMIT trackAvailabilityChanged(hashId, false);
+        }
+    }
+
+    void CollectionWatcherImpl::updateTrackData(const CollectionTrackInfo& receivedTrack)
     {
+        auto& pool = StringPool::tagStrings();
+        CollectionTrackInfo track(receivedTrack.hashId(), receivedTrack.isAvailable(),
+                                  pool.intern(receivedTrack.title()),
+                                  pool.intern(receivedTrack.artist()),
+                                  pool.intern(receivedTrack.album()),
+                                  pool.intern(receivedTrack.albumArtist()),
+                                  receivedTrack.lengthInMilliseconds());
+
         auto it = _collectionHash.find(track.hashId());
 
         if (it == _collectionHash.end()) /* the track is unknown to us */
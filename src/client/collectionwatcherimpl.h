@@ -23,10 +23,14 @@
 #include "collectionwatcher.h"
 
 #include <QHash>
+#include <QSet>
+#include <QUuid>
 #include <QVector>
 
 namespace PMP::Client
 {
+    class CollectionFetcher;
+    class CollectionSnapshot;
     class ServerConnection;
 
     class CollectionWatcherImpl : public CollectionWatcher
@@ -49,7 +53,10 @@ namespace PMP::Client
 
     private Q_SLOTS:
         void onConnected();
+        void onDatabaseIdentifierReceived(QUuid databaseId);
         void onCollectionPartReceived(QVector<CollectionTrackInfo> tracks);
+        void onCollectionJournalVersionReceived(bool isFullCollection, QUuid journalId,
+                                                quint64 journalVersion);
         void onCollectionDownloadCompleted();
         void onCollectionDownloadError();
         void onCollectionTracksAvailabilityChanged(
@@ -63,13 +70,24 @@ namespace PMP::Client
         Future<CollectionTrackInfo, AnyResultMessageCode> getTrackInfoInternal(
                                                                     FileHash const& hash);
         void startDownload();
+        void loadSnapshotAndFetchChanges();
+        void applySnapshot(CollectionSnapshot const& snapshot);
+        void fetchChanges();
+        void saveSnapshot();
+        CollectionFetcher* createFetcher();
         void updateTrackAvailability(QVector<LocalHashId> hashes, bool available);
-        void updateTrackData(CollectionTrackInfo const& track);
+        void updateTrackData(CollectionTrackInfo const& receivedTrack);
+        void removeTracksNotReceivedInDownload();
 
         ServerConnection* _connection;
         QHash<LocalHashId, CollectionTrackInfo> _collectionHash;
         bool _autoDownload;
         bool _downloading;
+        QUuid _databaseId;
+        QUuid _journalId;
+        quint64 _journalVersion;
+        bool _haveNewJournalVersion;
+        QSet<LocalHashId> _tracksReceivedInDownload;
     };
 }
 #endif
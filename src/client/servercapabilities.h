@@ -37,6 +37,8 @@ namespace PMP::Client
         virtual bool supportsAlbumArtist() const = 0;
         virtual bool supportsRequestingPersonalTrackHistory() const = 0;
         virtual bool supportsRequestingIndividualTrackInfo() const = 0;
+        virtual bool supportsIncrementalCollectionFetching() const = 0;
+        virtual bool supportsFetchingUserDataForAllHashes() const = 0;
 
     protected:
         ServerCapabilities() {}
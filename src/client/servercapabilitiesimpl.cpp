@@ -81,4 +81,14 @@ namespace PMP::Client
     {
         return _serverProtocolNumber >= 27;
     }
+
+    bool ServerCapabilitiesImpl::supportsIncrementalCollectionFetching() const
+    {
+        return _serverProtocolNumber >= 28;
+    }
+
+    bool ServerCapabilitiesImpl::supportsFetchingUserDataForAllHashes() const
+    {
+        return _serverProtocolNumber >= 29;
+    }
 }
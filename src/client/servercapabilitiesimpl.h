@@ -41,6 +41,8 @@ namespace PMP::Client
         bool supportsAlbumArtist() const override;
         bool supportsRequestingPersonalTrackHistory() const override;
         bool supportsRequestingIndividualTrackInfo() const override;
+        bool supportsIncrementalCollectionFetching() const override;
+        bool supportsFetchingUserDataForAllHashes() const override;
 
     private:
         int _serverProtocolNumber;
@@ -20,6 +20,7 @@
 #include "serverconnection.h"
 
 #include "common/async.h"
+#include "common/binarycursor.h"
 #include "common/networkprotocol.h"
 #include "common/networkutil.h"
 #include "common/startstopeventstatus.h"
@@ -645,7 +646,7 @@ namespace PMP::Client
 
     /* ============================================================================ */
 
-    const quint16 ServerConnection::ClientProtocolNo = 27;
+    const quint16 ServerConnection::ClientProtocolNo = 29;
 
     const int ServerConnection::KeepAliveIntervalMs = 30 * 1000;
     const int ServerConnection::KeepAliveReplyTimeoutMs = 5 * 1000;
@@ -667,6 +668,10 @@ namespace PMP::Client
     {
         _extensionsThis.registerExtensionSupport({NetworkProtocolExtension::Scrobbling,
                                                   255, 2});
+        _extensionsThis.registerExtensionSupport({NetworkProtocolExtension::Compression,
+                                                  254, 1});
+        _extensionsThis.registerExtensionSupport({NetworkProtocolExtension::HashIds,
+                                                  253, 1});
 
         connect(&_socket, &QTcpSocket::connected, this, &ServerConnection::onConnected);
         connect(
@@ -696,6 +701,7 @@ namespace PMP::Client
         qDebug() << "connecting to" << host << "on port" << port;
         _state = Connecting;
         _readBuffer.clear();
+        _frameReader.clear();
         _socket.connectToHost(host, port);
     }
 
@@ -745,6 +751,8 @@ namespace PMP::Client
         _state = NotConnected;
 
         _readBuffer.clear();
+        _frameReader.clear();
+        _serverHashIdToLocalId.clear();
         _binarySendingMode = false;
         _serverProtocolNo = -1;
 
@@ -976,6 +984,8 @@ namespace PMP::Client
 
         _keepAliveTimer->stop();
         _readBuffer.clear();
+        _frameReader.clear();
+        _serverHashIdToLocalId.clear();
         _binarySendingMode = false;
         _serverProtocolNo = -1;
     }
@@ -1062,14 +1072,30 @@ namespace PMP::Client
             return;
         }
 
+        auto compressed = compressMessageIfWorthwhile(message);
+        auto const& messageToSend = compressed.isEmpty() ? message : compressed;
+
         QByteArray lengthBytes;
-        NetworkUtil::append4BytesSigned(lengthBytes, messageLength);
+        NetworkUtil::append4BytesSigned(lengthBytes, messageToSend.length());
 
         _socket.write(lengthBytes);
-        _socket.write(message);
+        _socket.write(messageToSend);
         _socket.flush();
     }
 
+    QByteArray ServerConnection::compressMessageIfWorthwhile(
+                                                        QByteArray const& message) const
+    {
+        if (message.length() < NetworkProtocolExtensionMessages::CompressionThreshold
+            || _extensionsOther.isNotSupported(NetworkProtocolExtension::Compression, 1))
+        {
+            return {};
+        }
+
+        return NetworkProtocolExtensionMessages::generateCompressedMessage(_extensionsThis,
+                                                                           message);
+    }
+
     void ServerConnection::sendKeepAliveMessage()
     {
         QByteArray message;
@@ -1539,6 +1565,31 @@ namespace PMP::Client
         sendBinaryMessage(message);
     }
 
+    SimpleFuture<AnyResultMessageCode> ServerConnection::sendUserDataForAllHashesRequest(
+                                                                           quint32 userId)
+    {
+        if (!serverCapabilities().supportsFetchingUserDataForAllHashes())
+            return serverTooOldFutureResult();
+
+        auto handler = QSharedPointer<PromiseResultHandler>::create(this);
+        auto ref = registerResultHandler(handler);
+
+        qDebug() << "sending user data request for all hashes for user" << userId
+                 << "; ref:" << ref;
+
+        QByteArray message;
+        message.reserve(2 + 2 + 4 + 4);
+        NetworkProtocol::append2Bytes(message,
+                                  ClientMessageType::UserDataForAllHashesRequestMessage);
+        NetworkUtil::append2Bytes(message, 2 | 1); /* request prev. heard & score */
+        NetworkUtil::append4Bytes(message, ref);
+        NetworkUtil::append4Bytes(message, userId);
+
+        sendBinaryMessage(message);
+
+        return handler->future();
+    }
+
     Future<CollectionTrackInfo, AnyResultMessageCode>
         ServerConnection::sendHashInfoRequest(FileHash const& hash)
     {
@@ -2044,6 +2095,20 @@ namespace PMP::Client
         sendCollectionFetchRequestMessage(fetcherReference);
     }
 
+    void ServerConnection::fetchCollectionChanges(CollectionFetcher* fetcher,
+                                                  QUuid journalId, quint64 journalVersion)
+    {
+        fetcher->setParent(this);
+
+        auto handler =
+            QSharedPointer<CollectionFetchResultHandler>::create(this, fetcher);
+        auto fetcherReference = registerResultHandler(handler);
+        _collectionFetchers[fetcherReference] = fetcher;
+
+        sendCollectionChangesFetchRequestMessage(fetcherReference, journalId,
+                                                 journalVersion);
+    }
+
     void ServerConnection::sendInitiateNewUserAccountMessage(QString login,
                                                              quint32 clientReference)
     {
@@ -2136,29 +2201,37 @@ namespace PMP::Client
         sendBinaryMessage(message);
     }
 
-    void ServerConnection::readBinaryCommands()
+    void ServerConnection::sendCollectionChangesFetchRequestMessage(uint clientReference,
+                                                                  QUuid journalId,
+                                                                  quint64 journalVersion)
     {
-        char lengthBytes[4];
-
-        while
-            (_socket.isOpen()
-            && _socket.peek(lengthBytes, sizeof(lengthBytes)) == sizeof(lengthBytes))
-        {
-            quint32 messageLength = NetworkUtil::get4Bytes(lengthBytes);
+        QByteArray message;
+        message.reserve(2 + 2 + 4 + 16 + 8);
+        NetworkProtocol::append2Bytes(message,
+                                 ClientMessageType::CollectionChangesFetchRequestMessage);
+        NetworkUtil::append2Bytes(message, 0); /* unused */
+        NetworkUtil::append4Bytes(message, clientReference);
+        message.append(journalId.toRfc4122());
+        NetworkUtil::append8Bytes(message, journalVersion);
 
-            if (_socket.bytesAvailable() - sizeof(lengthBytes) < messageLength)
-            {
-                qDebug() << "waiting for incoming message with length" << messageLength
-                         << " --- only partially received";
-                break; /* message not complete yet */
-            }
+        sendBinaryMessage(message);
+    }
 
-            //qDebug() << "received complete binary message with length" << messageLength;
+    void ServerConnection::readBinaryCommands()
+    {
+        _frameReader.readFrom(_socket);
 
-            _socket.read(lengthBytes, sizeof(lengthBytes)); /* consume the length */
-            QByteArray message = _socket.read(messageLength);
+        BinaryFrame frame;
+        while (_socket.isOpen() && _frameReader.nextFrame(frame))
+        {
+            handleBinaryMessage(frame.message());
+        }
 
-            handleBinaryMessage(message);
+        quint32 messageLength;
+        if (_frameReader.waitingForIncompleteFrame(messageLength))
+        {
+            qDebug() << "waiting for incoming message with length" << messageLength
+                     << " --- only partially received";
         }
     }
 
@@ -2277,6 +2350,9 @@ namespace PMP::Client
         case ServerMessageType::HashInfoReply:
             parseHashInfoReply(message);
             return;
+        case ServerMessageType::CollectionFetchCompletionMessage:
+            parseCollectionFetchCompletionMessage(message);
+            return;
         case ServerMessageType::HistoryFragmentMessage:
             parseHistoryFragmentMessage(message);
             return;
@@ -2335,6 +2411,35 @@ namespace PMP::Client
         //    }
         //}
 
+        if (extension == NetworkProtocolExtension::Compression)
+        {
+            switch (static_cast<CompressionMessageType>(messageType))
+            {
+            case CompressionMessageType::CompressedMessage:
+                parseCompressedMessage(message);
+                return;
+            }
+        }
+
+        if (extension == NetworkProtocolExtension::HashIds)
+        {
+            switch (static_cast<HashIdsServerMessageType>(messageType))
+            {
+            case HashIdsServerMessageType::HashDefinitionsMessage:
+                parseHashDefinitionsMessage(message);
+                return;
+            case HashIdsServerMessageType::HashUserDataMessage:
+                parseHashIdsUserDataMessage(message);
+                return;
+            case HashIdsServerMessageType::TrackInfoBatchMessage:
+                parseHashIdsTrackInfoBatchMessage(message);
+                return;
+            case HashIdsServerMessageType::TrackAvailabilityChangeBatchMessage:
+                parseHashIdsTrackAvailabilityChangeBatchMessage(message);
+                return;
+            }
+        }
+
         if (extension == NetworkProtocolExtension::Scrobbling)
         {
             switch (static_cast<ScrobblingServerMessageType>(messageType))
@@ -2383,6 +2488,23 @@ namespace PMP::Client
                    << "; result code:" << uint(resultCode);
     }
 
+    void ServerConnection::parseCompressedMessage(QByteArray const& message)
+    {
+        /* the server does not queue more than this for a single client */
+        const quint32 maxUncompressedSize = 64 * 1024 * 1024;
+
+        auto decompressed =
+            NetworkProtocolExtensionMessages::decompressMessage(message,
+                                                                maxUncompressedSize);
+        if (decompressed == null)
+        {
+            invalidMessageReceived(message, "compressed");
+            return;
+        }
+
+        handleBinaryMessage(decompressed.value());
+    }
+
     void ServerConnection::parseKeepAliveMessage(QByteArray const& message)
     {
         if (message.length() != 4)
@@ -3537,17 +3659,17 @@ namespace PMP::Client
 
     void ServerConnection::parseHashUserDataMessage(const QByteArray& message)
     {
-        int messageLength = message.length();
-        if (messageLength < 12)
+        if (message.length() < 12)
         {
             qWarning() << "ServerConnection::parseHashUserDataMessage : invalid msg (1)";
             return; /* invalid message */
         }
 
-        int hashCount = NetworkUtil::get2BytesUnsignedToInt(message, 2);
-        quint16 fields = NetworkUtil::get2Bytes(message, 6);
-        quint32 userId = NetworkUtil::get4Bytes(message, 8);
-        int offset = 12;
+        BinaryCursor cursor(message, 2);
+        int hashCount = cursor.read2BytesUnsignedToInt();
+        cursor.skip(2); /* filler */
+        quint16 fields = cursor.read2Bytes();
+        quint32 userId = cursor.read4Bytes();
 
         if ((fields & 3) != fields || fields == 0)
             return; /* has unsupported fields or none */
@@ -3560,7 +3682,7 @@ namespace PMP::Client
                 + (havePreviouslyHeard ? 8 : 0)
                 + (haveScore ? 2 : 0);
 
-        if ((messageLength - offset) != hashCount * bytesPerHash)
+        if (cursor.remaining() != hashCount * bytesPerHash)
         {
             qWarning() << "ServerConnection::parseHashUserDataMessage: invalid msg (2)";
             return; /* invalid message */
@@ -3572,27 +3694,18 @@ namespace PMP::Client
         bool ok;
         for (int i = 0; i < hashCount; ++i)
         {
-            FileHash hash = NetworkProtocol::getHash(message, offset, &ok);
+            FileHash hash = NetworkProtocol::getHash(message, cursor.position(), &ok);
             if (!ok) return; /* invalid message */
-            offset += NetworkProtocol::FILEHASH_BYTECOUNT;
+            cursor.skip(NetworkProtocol::FILEHASH_BYTECOUNT);
 
             QDateTime previouslyHeard;
             qint16 score = -1;
 
             if (havePreviouslyHeard)
-            {
-                previouslyHeard =
-                    NetworkUtil::getMaybeEmptyQDateTimeFrom8ByteMsSinceEpoch(
-                        message, offset
-                    );
-                offset += 8;
-            }
+                previouslyHeard = cursor.readMaybeEmptyQDateTimeFrom8ByteMsSinceEpoch();
 
             if (haveScore)
-            {
-                score = NetworkUtil::get2BytesSigned(message, offset);
-                offset += 2;
-            }
+                score = cursor.read2BytesSigned();
 
             if (hash.isNull())
             {
@@ -3611,6 +3724,239 @@ namespace PMP::Client
         }
     }
 
+    void ServerConnection::parseHashDefinitionsMessage(QByteArray const& message)
+    {
+        BinaryCursor cursor(message, 2);
+        cursor.skip(2); /* filler */
+        quint32 count = cursor.read4Bytes();
+
+        const int bytesPerDefinition = 4 + NetworkProtocol::FILEHASH_BYTECOUNT;
+        if (cursor.failed()
+            || static_cast<qint64>(cursor.remaining()) != qint64(count) * bytesPerDefinition)
+        {
+            invalidMessageReceived(message, "hash-definitions");
+            return;
+        }
+
+        qDebug() << "received" << count << "hash definitions";
+
+        _serverHashIdToLocalId.reserve(_serverHashIdToLocalId.size() + int(count));
+
+        for (quint32 i = 0; i < count; ++i)
+        {
+            quint32 serverHashId = cursor.read4Bytes();
+
+            bool ok;
+            FileHash hash = NetworkProtocol::getHash(message, cursor.position(), &ok);
+            if (!ok)
+            {
+                invalidMessageReceived(message, "hash-definitions");
+                return;
+            }
+            cursor.skip(NetworkProtocol::FILEHASH_BYTECOUNT);
+
+            if (serverHashId == 0 || hash.isNull())
+                continue;
+
+            auto hashId = _hashIdRepository->getOrRegisterId(hash);
+            _serverHashIdToLocalId.insert(serverHashId, hashId);
+        }
+    }
+
+    void ServerConnection::parseHashIdsUserDataMessage(QByteArray const& message)
+    {
+        BinaryCursor cursor(message, 2);
+        int count = cursor.read2BytesUnsignedToInt();
+        quint16 fields = cursor.read2Bytes();
+        quint32 userId = cursor.read4Bytes();
+
+        const int bytesPerHash = 4 + 8 + 2;
+        if (cursor.failed() || fields != (1 | 2)
+            || cursor.remaining() != count * bytesPerHash)
+        {
+            invalidMessageReceived(message, "hash-ids-user-data");
+            return;
+        }
+
+        qDebug() << "received user data for" << count << "hash IDs; user:" << userId;
+
+        for (int i = 0; i < count; ++i)
+        {
+            quint32 serverHashId = cursor.read4Bytes();
+            auto previouslyHeard = cursor.readMaybeEmptyQDateTimeFrom8ByteMsSinceEpoch();
+            qint16 score = cursor.read2BytesSigned();
+
+            auto hashId = _serverHashIdToLocalId.value(serverHashId);
+            if (hashId.isZero())
+            {
+                qWarning() << "received user data for undefined server hash ID"
+                           << serverHashId << "; ignoring";
+                continue;
+            }
+
+            Q_EMIT receivedHashUserData(hashId, userId, previouslyHeard, score);
+        }
+    }
+
+    void ServerConnection::parseHashIdsTrackInfoBatchMessage(QByteArray const& message)
+    {
+        BinaryCursor cursor(message, 2);
+        quint8 flags = cursor.readByte();
+        cursor.skip(1); /* filler */
+        int count = cursor.read2BytesUnsignedToInt();
+        quint32 clientReference = cursor.read4Bytes();
+
+        if (cursor.failed())
+        {
+            invalidMessageReceived(message, "hash-ids-track-info-batch");
+            return;
+        }
+
+        bool isNotification = flags & 1;
+
+        CollectionFetcher* collectionFetcher = nullptr;
+        if (!isNotification)
+        {
+            collectionFetcher = _collectionFetchers.value(clientReference, nullptr);
+            if (!collectionFetcher)
+                return; /* irrelevant or invalid message */
+        }
+
+        QVector<CollectionTrackInfo> infos;
+        infos.reserve(count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            quint32 serverHashId = cursor.read4Bytes();
+            quint8 availabilityByte = cursor.readByte();
+            int titleSize = cursor.read2BytesUnsignedToInt();
+            int artistSize = cursor.read2BytesUnsignedToInt();
+            int albumSize = cursor.read2BytesUnsignedToInt();
+            int albumArtistSize = cursor.read2BytesUnsignedToInt();
+            qint32 trackLengthInMs = cursor.read4BytesSigned();
+            QString title = cursor.readUtf8String(titleSize);
+            QString artist = cursor.readUtf8String(artistSize);
+            QString album = cursor.readUtf8String(albumSize);
+            QString albumArtist = cursor.readUtf8String(albumArtistSize);
+
+            if (cursor.failed())
+            {
+                invalidMessageReceived(message, "hash-ids-track-info-batch");
+                return;
+            }
+
+            auto hashId = _serverHashIdToLocalId.value(serverHashId);
+            if (hashId.isZero())
+            {
+                qWarning() << "received track info for undefined server hash ID"
+                           << serverHashId << "; ignoring";
+                continue;
+            }
+
+            CollectionTrackInfo info(hashId, availabilityByte & 1, title, artist, album,
+                                     albumArtist, trackLengthInMs);
+            infos.append(info);
+        }
+
+        if (!cursor.atEnd())
+        {
+            invalidMessageReceived(message, "hash-ids-track-info-batch");
+            return;
+        }
+
+        qDebug() << "received info of" << infos.size() << "tracks using hash IDs;"
+                 << "notification:" << isNotification;
+
+        if (infos.isEmpty())
+            return;
+
+        if (isNotification)
+            Q_EMIT collectionTracksChanged(infos);
+        else
+            Q_EMIT collectionFetcher->receivedData(infos);
+    }
+
+    void ServerConnection::parseHashIdsTrackAvailabilityChangeBatchMessage(
+                                                                QByteArray const& message)
+    {
+        BinaryCursor cursor(message, 2);
+        cursor.skip(2); /* filler */
+        int availableCount = cursor.read2BytesUnsignedToInt();
+        int unavailableCount = cursor.read2BytesUnsignedToInt();
+
+        if (cursor.failed()
+            || cursor.remaining() != (availableCount + unavailableCount) * 4)
+        {
+            invalidMessageReceived(message, "hash-ids-track-availability-change-batch");
+            return;
+        }
+
+        auto readHashIds =
+            [this, &cursor](int count)
+            {
+                QVector<LocalHashId> hashIds;
+                hashIds.reserve(count);
+
+                for (int i = 0; i < count; ++i)
+                {
+                    quint32 serverHashId = cursor.read4Bytes();
+
+                    auto hashId = _serverHashIdToLocalId.value(serverHashId);
+                    if (hashId.isZero())
+                    {
+                        qWarning() << "received availability for undefined server hash ID"
+                                   << serverHashId << "; ignoring";
+                        continue;
+                    }
+
+                    hashIds.append(hashId);
+                }
+
+                return hashIds;
+            };
+
+        auto available = readHashIds(availableCount);
+        auto unavailable = readHashIds(unavailableCount);
+
+        qDebug() << "got track availability changes using hash IDs:"
+                 << available.size() << "available," << unavailable.size()
+                 << "unavailable";
+
+        if (available.isEmpty() && unavailable.isEmpty())
+            return;
+
+        Q_EMIT collectionTracksAvailabilityChanged(available, unavailable);
+    }
+
+    void ServerConnection::parseCollectionFetchCompletionMessage(
+                                                                QByteArray const& message)
+    {
+        if (message.length() != 2 + 2 + 4 + 16 + 8)
+        {
+            invalidMessageReceived(message, "collection-fetch-completion");
+            return;
+        }
+
+        BinaryCursor cursor(message, 3);
+        quint8 flags = cursor.readByte();
+        quint32 clientReference = cursor.read4Bytes();
+        QUuid journalId = QUuid::fromRfc4122(cursor.readBytes(16));
+        quint64 journalVersion = cursor.read8Bytes();
+
+        bool isFullCollection = flags & 1;
+
+        qDebug() << "received collection fetch completion; ref:" << clientReference
+                 << "; full collection:" << isFullCollection
+                 << "; journal:" << journalId << "; version:" << journalVersion;
+
+        auto collectionFetcher = _collectionFetchers.value(clientReference, nullptr);
+        if (!collectionFetcher)
+            return; /* irrelevant or invalid message */
+
+        Q_EMIT collectionFetcher->receivedJournalVersion(isFullCollection, journalId,
+                                                         journalVersion);
+    }
+
     void ServerConnection::parseHashInfoReply(const QByteArray& message)
     {
         if (message.length() < 20)
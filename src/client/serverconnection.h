@@ -20,6 +20,7 @@
 #ifndef PMP_CLIENT_SERVERCONNECTION_H
 #define PMP_CLIENT_SERVERCONNECTION_H
 
+#include "common/binaryframereader.h"
 #include "common/disconnectreason.h"
 #include "common/filehash.h"
 #include "common/future.h"
@@ -121,6 +122,8 @@ namespace PMP::Client
         TriBool doingQuickScanForNewFiles() const { return _doingQuickScanForNewFiles; }
 
         void fetchCollection(CollectionFetcher* fetcher);
+        void fetchCollectionChanges(CollectionFetcher* fetcher, QUuid journalId,
+                                    quint64 journalVersion);
 
         SimpleFuture<AnyResultMessageCode> reloadServerSettings();
         SimpleFuture<AnyResultMessageCode> startFullIndexation();
@@ -187,6 +190,8 @@ namespace PMP::Client
         void sendQueueEntryHashRequest(QList<uint> const& queueIDs);
 
         void sendHashUserDataRequest(quint32 userId, QList<LocalHashId> const& hashes);
+        SimpleFuture<AnyResultMessageCode> sendUserDataForAllHashesRequest(
+                                                                          quint32 userId);
         Future<CollectionTrackInfo, AnyResultMessageCode> sendHashInfoRequest(
                                                                     const FileHash& hash);
         Future<HistoryFragment, AnyResultMessageCode> sendHashHistoryRequest(
@@ -302,6 +307,7 @@ namespace PMP::Client
         void appendScrobblingMessageStart(QByteArray& buffer,
                                           ScrobblingClientMessageType messageType);
         void sendBinaryMessage(QByteArray const& message);
+        QByteArray compressMessageIfWorthwhile(QByteArray const& message) const;
         void sendKeepAliveMessage();
         void sendProtocolExtensionsMessage();
         void sendSingleByteAction(quint8 action);
@@ -351,6 +357,7 @@ namespace PMP::Client
 
         void onFullIndexationRunningStatusReceived(bool running);
 
+        void parseCompressedMessage(QByteArray const& message);
         void parseKeepAliveMessage(QByteArray const& message);
 
         void parseSimpleResultMessage(QByteArray const& message);
@@ -394,7 +401,12 @@ namespace PMP::Client
                                         ServerMessageType messageType);
 
         void parseHashUserDataMessage(QByteArray const& message);
+        void parseHashDefinitionsMessage(QByteArray const& message);
+        void parseHashIdsUserDataMessage(QByteArray const& message);
+        void parseHashIdsTrackInfoBatchMessage(QByteArray const& message);
+        void parseHashIdsTrackAvailabilityChangeBatchMessage(QByteArray const& message);
         void parseHashInfoReply(QByteArray const& message);
+        void parseCollectionFetchCompletionMessage(QByteArray const& message);
         void parseHistoryFragmentMessage(QByteArray const& message);
         void parseNewHistoryEntryMessage(QByteArray const& message);
         void parsePlayerHistoryMessage(QByteArray const& message);
@@ -404,6 +416,9 @@ namespace PMP::Client
         void parseScrobblingProviderEnabledChangeMessage(QByteArray const& message);
 
         void sendCollectionFetchRequestMessage(uint clientReference);
+        void sendCollectionChangesFetchRequestMessage(uint clientReference,
+                                                      QUuid journalId,
+                                                      quint64 journalVersion);
 
         void invalidMessageReceived(QByteArray const& message, QString messageType = "",
                                     QString extraInfo = "");
@@ -423,10 +438,12 @@ namespace PMP::Client
         State _state;
         QTcpSocket _socket;
         QByteArray _readBuffer;
+        BinaryFrameReader _frameReader;
         bool _binarySendingMode;
         int _serverProtocolNo;
         NetworkProtocolExtensionSupportMap _extensionsThis;
         NetworkProtocolExtensionSupportMap _extensionsOther;
+        QHash<quint32, LocalHashId> _serverHashIdToLocalId;
         uint _nextRef;
         uint _userAccountRegistrationRef;
         QString _userAccountRegistrationLogin;
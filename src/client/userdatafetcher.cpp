@@ -20,6 +20,7 @@
 #include "userdatafetcher.h"
 
 #include "collectionwatcher.h"
+#include "servercapabilities.h"
 #include "serverconnection.h"
 
 #include <QtDebug>
@@ -61,19 +62,12 @@ namespace PMP::Client
 
         userData.setAutoFetchEnabled(true);
 
-        // TODO : create a new server command to automate this
-
-        /* manual fetch process: iterate through the entire collection and make sure that
-                                 each track is fetched */
-
         _collectionWatcher->enableCollectionDownloading();
-        auto const collection = _collectionWatcher->getCollection();
 
-        for (auto it = collection.constBegin(); it != collection.constEnd(); ++it)
-        {
-            if (!userData.haveHash(it.key()))
-                needToRequestData(userId, it.key());
-        }
+        if (_connection->serverCapabilities().supportsFetchingUserDataForAllHashes())
+            requestDataForAllHashes(userId);
+        else
+            requestDataForCollection(userId);
     }
 
     //void UserDataFetcherImpl::connected()
@@ -102,8 +96,18 @@ namespace PMP::Client
             auto userId = it.key();
             auto& userData = it.value();
 
-            if (userData.isAutoFetchEnabled() && !userData.haveHash(track.hashId()))
-                needToRequestData(userId, track.hashId());
+            if (!userData.isAutoFetchEnabled() || userData.haveHash(track.hashId()))
+                continue;
+
+            /* the bulk fetch probably covers this track already */
+            auto bulkFetchIt = _newHashesDuringBulkFetchForUsers.find(userId);
+            if (bulkFetchIt != _newHashesDuringBulkFetchForUsers.end())
+            {
+                bulkFetchIt.value() << track.hashId();
+                continue;
+            }
+
+            needToRequestData(userId, track.hashId());
         }
     }
 
@@ -155,6 +159,53 @@ namespace PMP::Client
         _pendingNotificationsUsers.clear();
     }
 
+    void UserDataFetcherImpl::requestDataForAllHashes(quint32 userId)
+    {
+        _newHashesDuringBulkFetchForUsers[userId];
+
+        auto future = _connection->sendUserDataForAllHashesRequest(userId);
+
+        future.handleOnEventLoop(
+            this,
+            [this, userId](AnyResultMessageCode code)
+            {
+                auto newHashes = _newHashesDuringBulkFetchForUsers.take(userId);
+
+                if (!succeeded(code))
+                {
+                    qWarning() << "UserDataFetcher: fetching data of all tracks failed"
+                               << "for user" << userId << "; falling back to per-track"
+                               << "requests";
+                    requestDataForCollection(userId);
+                    return;
+                }
+
+                /* tracks that were added during the bulk fetch might have been missed */
+                auto const& userData = _userData[userId];
+                for (auto hashId : qAsConst(newHashes))
+                {
+                    if (!userData.haveHash(hashId))
+                        needToRequestData(userId, hashId);
+                }
+            }
+        );
+    }
+
+    void UserDataFetcherImpl::requestDataForCollection(quint32 userId)
+    {
+        /* iterate through the entire collection and make sure that each track is
+           fetched */
+
+        auto const& userData = _userData[userId];
+        auto const collection = _collectionWatcher->getCollection();
+
+        for (auto it = collection.constBegin(); it != collection.constEnd(); ++it)
+        {
+            if (!userData.haveHash(it.key()))
+                needToRequestData(userId, it.key());
+        }
+    }
+
     void UserDataFetcherImpl::needToRequestData(quint32 userId, LocalHashId hashId)
     {
         bool first = _hashesToFetchForUsers.isEmpty();
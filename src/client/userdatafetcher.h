@@ -109,12 +109,15 @@ namespace PMP::Client
             bool _autoFetchEnabled;
         };
 
+        void requestDataForAllHashes(quint32 userId);
+        void requestDataForCollection(quint32 userId);
         void needToRequestData(quint32 userId, LocalHashId hashId);
 
         CollectionWatcher* _collectionWatcher;
         ServerConnection* _connection;
         QHash<quint32, UserData> _userData;
         QHash<quint32, QSet<LocalHashId>> _hashesToFetchForUsers;
+        QHash<quint32, QSet<LocalHashId>> _newHashesDuringBulkFetchForUsers;
         QSet<quint32> _pendingNotificationsUsers;
     };
 
@@ -0,0 +1,133 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_COMMON_BINARYCURSOR_H
+#define PMP_COMMON_BINARYCURSOR_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+#include <QtEndian>
+
+#include <limits>
+
+namespace PMP
+{
+    /** Sequential reader for the fields of a binary protocol message.
+
+        The length of the message is checked once for every field that is read, instead
+        of checking each individual byte.  Reading beyond the end of the message does
+        not crash; it returns zero and sets the failed() flag, which stays set.  This
+        makes it possible to read all fields first and check for errors only once.
+    */
+    class BinaryCursor
+    {
+    public:
+        explicit BinaryCursor(QByteArray const& message, int position = 0)
+         : _data(message.constData()), _size(message.size()), _position(position),
+           _failed(position < 0 || position > message.size())
+        {
+            if (_failed) _position = _size;
+        }
+
+        bool failed() const { return _failed; }
+        int position() const { return _position; }
+        int remaining() const { return _size - _position; }
+        bool atEnd() const { return _position >= _size; }
+
+        void skip(int byteCount)
+        {
+            if (ensureAvailable(byteCount))
+                _position += byteCount;
+        }
+
+        quint8 readByte()
+        {
+            if (!ensureAvailable(1)) return 0;
+
+            return static_cast<quint8>(_data[_position++]);
+        }
+
+        quint16 read2Bytes() { return readBigEndian<quint16>(); }
+        quint32 read4Bytes() { return readBigEndian<quint32>(); }
+        quint64 read8Bytes() { return readBigEndian<quint64>(); }
+
+        qint16 read2BytesSigned() { return static_cast<qint16>(read2Bytes()); }
+        qint32 read4BytesSigned() { return static_cast<qint32>(read4Bytes()); }
+        qint64 read8BytesSigned() { return static_cast<qint64>(read8Bytes()); }
+
+        int readByteUnsignedToInt() { return readByte(); }
+        int read2BytesUnsignedToInt() { return read2Bytes(); }
+
+        QDateTime readMaybeEmptyQDateTimeFrom8ByteMsSinceEpoch()
+        {
+            auto msecs = read8BytesSigned();
+            if (_failed || msecs == std::numeric_limits<qint64>::min())
+                return QDateTime(); /* invalid QDateTime */
+
+            return QDateTime::fromMSecsSinceEpoch(msecs, Qt::UTC);
+        }
+
+        /** Returns a deep copy of the next 'byteCount' bytes. */
+        QByteArray readBytes(int byteCount)
+        {
+            if (!ensureAvailable(byteCount)) return {};
+
+            QByteArray bytes(_data + _position, byteCount);
+            _position += byteCount;
+            return bytes;
+        }
+
+        QString readUtf8String(int byteCount)
+        {
+            if (!ensureAvailable(byteCount)) return {};
+
+            auto string = QString::fromUtf8(_data + _position, byteCount);
+            _position += byteCount;
+            return string;
+        }
+
+    private:
+        bool ensureAvailable(int byteCount)
+        {
+            if (!_failed && byteCount >= 0 && byteCount <= _size - _position)
+                return true;
+
+            _failed = true;
+            _position = _size;
+            return false;
+        }
+
+        template<class T>
+        T readBigEndian()
+        {
+            if (!ensureAvailable(static_cast<int>(sizeof(T)))) return 0;
+
+            auto value = qFromBigEndian<T>(_data + _position);
+            _position += sizeof(T);
+            return value;
+        }
+
+        char const* _data;
+        int _size;
+        int _position;
+        bool _failed;
+    };
+}
+#endif
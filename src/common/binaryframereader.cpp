@@ -0,0 +1,109 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "binaryframereader.h"
+
+#include "networkutil.h"
+
+#include <QIODevice>
+
+namespace PMP
+{
+    namespace
+    {
+        const int frameLengthByteCount = 4;
+        const qint64 maxReadChunkSize = 4 * 1024 * 1024;
+    }
+
+    void BinaryFrameReader::readFrom(QIODevice& device)
+    {
+        /* Read everything that is available, because a socket will not signal the
+           bytes that we leave behind a second time */
+        qint64 available;
+        while ((available = device.bytesAvailable()) > 0)
+        {
+            auto chunkSize = qMin(available, maxReadChunkSize);
+
+            /* drop the frames that were consumed already, then read directly into the
+               buffer; if a frame still refers to the buffer, it will be detached first
+               so that the frame keeps the original bytes */
+            if (_position > 0)
+            {
+                _buffer.remove(0, _position);
+                _position = 0;
+            }
+
+            auto oldSize = _buffer.size();
+            _buffer.resize(oldSize + static_cast<int>(chunkSize));
+            auto bytesRead = device.read(_buffer.data() + oldSize, chunkSize);
+            _buffer.resize(oldSize + static_cast<int>(qMax(bytesRead, qint64(0))));
+
+            if (bytesRead <= 0)
+                break;
+        }
+    }
+
+    void BinaryFrameReader::append(QByteArray const& data)
+    {
+        if (_position > 0)
+        {
+            _buffer.remove(0, _position);
+            _position = 0;
+        }
+
+        _buffer.append(data);
+    }
+
+    bool BinaryFrameReader::nextFrame(BinaryFrame& frame)
+    {
+        int remaining = _buffer.size() - _position;
+        if (remaining < frameLengthByteCount)
+            return false;
+
+        char const* data = _buffer.constData() + _position;
+        quint32 messageLength = NetworkUtil::get4Bytes(data);
+
+        if (static_cast<quint32>(remaining - frameLengthByteCount) < messageLength)
+            return false; /* frame not complete yet */
+
+        frame._storage = _buffer; /* shallow copy, keeps the bytes alive */
+        frame._message =
+            QByteArray::fromRawData(data + frameLengthByteCount,
+                                    static_cast<int>(messageLength));
+
+        _position += frameLengthByteCount + static_cast<int>(messageLength);
+        return true;
+    }
+
+    bool BinaryFrameReader::waitingForIncompleteFrame(quint32& expectedLength) const
+    {
+        int remaining = _buffer.size() - _position;
+        if (remaining < frameLengthByteCount)
+            return false;
+
+        expectedLength = NetworkUtil::get4Bytes(_buffer.constData() + _position);
+        return static_cast<quint32>(remaining - frameLengthByteCount) < expectedLength;
+    }
+
+    void BinaryFrameReader::clear()
+    {
+        _buffer.clear();
+        _position = 0;
+    }
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_COMMON_BINARYFRAMEREADER_H
+#define PMP_COMMON_BINARYFRAMEREADER_H
+
+#include <QByteArray>
+
+QT_FORWARD_DECLARE_CLASS(QIODevice)
+
+namespace PMP
+{
+    /** A single length-prefixed message that was received on a connection.
+
+        The message bytes are not copied out of the buffer they were received in; the
+        frame keeps a reference to that buffer so that the message stays valid for as
+        long as the frame object is alive, even if the reader moves on in the meantime.
+        The message() QByteArray is a raw view on that buffer and must therefore not be
+        stored beyond the lifetime of the frame.
+    */
+    class BinaryFrame
+    {
+    public:
+        BinaryFrame() {}
+
+        QByteArray const& message() const { return _message; }
+
+    private:
+        friend class BinaryFrameReader;
+
+        QByteArray _storage;
+        QByteArray _message;
+    };
+
+    /** Splits an incoming byte stream into frames of the binary protocol. Each frame
+        consists of a 4-byte length followed by that many bytes of message data.
+
+        Everything that is available on the device is read in one go, so a burst of
+        small messages does not lead to one read call and one allocation per message.
+    */
+    class BinaryFrameReader
+    {
+    public:
+        BinaryFrameReader() {}
+
+        void readFrom(QIODevice& device);
+        void append(QByteArray const& data);
+
+        bool nextFrame(BinaryFrame& frame);
+
+        int bytesBuffered() const { return _buffer.size() - _position; }
+        bool waitingForIncompleteFrame(quint32& expectedLength) const;
+
+        void clear();
+
+    private:
+        QByteArray _buffer;
+        int _position { 0 };
+    };
+}
+#endif
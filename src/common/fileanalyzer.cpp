@@ -26,15 +26,162 @@
 /* TagLib includes */
 #include "taglib/flacfile.h"
 #include "taglib/id3v2framefactory.h"
+#include "taglib/id3v2header.h"
 #include "taglib/id3v2tag.h"
 #include "taglib/mpegfile.h"
 #include "taglib/taglib.h"
 #include "taglib/tbytevector.h"
 #include "taglib/tbytevectorstream.h"
+#include "taglib/tfilestream.h"
 #include "taglib/tpropertymap.h"
 
+#include <algorithm>
+#include <limits>
+
 namespace PMP
 {
+    namespace
+    {
+        /* size of the chunks that are fed to the hash algorithms */
+        const uint hashingChunkSize = 256 * 1024;
+
+        /* the number of bytes at the end of the audio data that is read into memory
+           for checking for trailing tags; must be enough for two ID3v1 tags and an
+           APE footer */
+        const uint tailSize = 1024;
+
+        class Hasher
+        {
+        public:
+            Hasher()
+             : _md5Hasher(QCryptographicHash::Md5),
+               _sha1Hasher(QCryptographicHash::Sha1),
+               _length(0)
+            {
+                //
+            }
+
+            void addData(const char* data, uint length)
+            {
+                _md5Hasher.addData(data, int(length));
+                _sha1Hasher.addData(data, int(length));
+                _length += length;
+            }
+
+            FileHash result() const
+            {
+                return FileHash(_length, _sha1Hasher.result(), _md5Hasher.result());
+            }
+
+        private:
+            QCryptographicHash _md5Hasher;
+            QCryptographicHash _sha1Hasher;
+            uint _length;
+        };
+
+        /* The last part of a range of a stream. Positions are relative to the start
+           of the range. */
+        class Tail
+        {
+        public:
+            Tail(TagLib::IOStream& stream, qint64 rangeStart, uint rangeLength)
+             : _offset(rangeLength - std::min(rangeLength, tailSize))
+            {
+                stream.seek(long(rangeStart + _offset));
+                _data = stream.readBlock(rangeLength - _offset);
+            }
+
+            bool isComplete(uint rangeLength) const
+            {
+                return _offset + _data.size() == rangeLength;
+            }
+
+            TagLib::ByteVector mid(uint position, uint length) const
+            {
+                return _data.mid(position - _offset, length);
+            }
+
+            uint toUInt(uint position) const
+            {
+                return _data.toUInt(position - _offset, false);
+            }
+
+        private:
+            uint _offset;
+            TagLib::ByteVector _data;
+        };
+
+        /* same as FileAnalyzer::stripID3v1, but only adjusts the length */
+        bool trimID3v1(Tail const& tail, uint& length)
+        {
+            if (length < 128U) return false;
+
+            auto position = length - 128;
+            if (tail.mid(position, 3) != "TAG")
+                return false; /* ID3v1 not found */
+
+            if (position >= 3 && tail.mid(position - 3, 8) == "APETAGEX")
+                return false; /* this tag is an APEv2, not an ID3v1 */
+
+            length = position;
+            return true;
+        }
+
+        /* same as FileAnalyzer::stripAPE, but only adjusts the length */
+        bool trimAPE(Tail const& tail, uint& length)
+        {
+            const unsigned int headerOrFooterSize = 32;
+
+            if (length < headerOrFooterSize) return false;
+
+            auto footerPosition = length - headerOrFooterSize;
+            if (tail.mid(footerPosition, 8) != "APETAGEX")
+                return false; /* APE not found */
+
+            auto tagSizeExcludingHeader = tail.toUInt(footerPosition + 12);
+            auto flags = tail.toUInt(footerPosition + 20);
+            auto headerPresent = bool((flags & 0x80000000) == 0x80000000);
+
+            auto apeStartPosition =
+                    footerPosition + headerOrFooterSize - tagSizeExcludingHeader;
+
+            if (headerPresent)
+                apeStartPosition -= headerOrFooterSize;
+
+            length = std::min(length, apeStartPosition);
+            return true;
+        }
+
+        /* Hashes a range of the stream in a single pass. The second hasher (optional)
+           only gets the first 'prefixLength' bytes of the range. */
+        bool hashRange(TagLib::IOStream& stream, qint64 rangeStart, uint rangeLength,
+                       Hasher& hasher, Hasher* prefixHasher, uint prefixLength)
+        {
+            stream.seek(long(rangeStart));
+
+            uint position = 0;
+            while (position < rangeLength)
+            {
+                auto chunk =
+                    stream.readBlock(std::min(hashingChunkSize, rangeLength - position));
+                if (chunk.isEmpty())
+                    return false; /* file was truncated? */
+
+                hasher.addData(chunk.data(), chunk.size());
+
+                if (prefixHasher && position < prefixLength)
+                {
+                    auto prefixPart = std::min(chunk.size(), prefixLength - position);
+                    prefixHasher->addData(chunk.data(), prefixPart);
+                }
+
+                position += chunk.size();
+            }
+
+            return true;
+        }
+    }
+
     FileAnalyzer::FileAnalyzer(const QString& filename)
      : FileAnalyzer(QFileInfo(filename))
     {
@@ -78,10 +225,31 @@ namespace PMP
                && isExtensionSupported(fileInfo.suffix(), enableExperimentalFileFormats);
     }
 
-    void FileAnalyzer::analyze()
+    void FileAnalyzer::analyze(AnalysisMode mode)
     {
         if (_error || _analyzed) return;
 
+        if (mode == AnalysisMode::Streaming)
+        {
+            auto result = analyzeStreaming();
+
+            if (result == StreamingResult::Completed)
+            {
+                _analyzed = true;
+                return;
+            }
+
+            if (result == StreamingResult::Failed)
+            {
+                _error = true;
+                return;
+            }
+
+            /* unusual file, do it the old way */
+            _audio = AudioData();
+            _tags = TagData();
+        }
+
         if (!_haveReadFile)
         {
             if (!_file.open(QIODevice::ReadOnly))
@@ -207,6 +375,45 @@ namespace PMP
         return true; /* success */
     }
 
+    bool FileAnalyzer::getPlaybackDataOffset(QString const& filePath,
+                                             QString const& extension, qint64& offset)
+    {
+        offset = 0;
+
+        /* only MP3 files are changed by preprocessFileForPlayback */
+        if (getExtension(extension) != Extension::MP3) return true;
+
+#ifdef Q_OS_WIN
+        TagLib::FileStream stream(reinterpret_cast<const wchar_t*>(filePath.utf16()),
+                                  true);
+#else
+        auto encodedFilePath = QFile::encodeName(filePath);
+        TagLib::FileStream stream(encodedFilePath.constData(), true);
+#endif
+
+        if (!stream.isOpen())
+            return false;
+
+        TagLib::MPEG::File tagFile(&stream, TagLib::ID3v2::FrameFactory::instance());
+        if (!tagFile.isValid())
+            return false;
+
+        if (!tagFile.hasID3v2Tag())
+            return true; /* nothing to strip */
+
+        /* TagLib does not tell us where the tag is if it isn't at the start */
+        stream.seek(0);
+        if (stream.readBlock(3) != "ID3")
+            return false;
+
+        qint64 tagSize = tagFile.ID3v2Tag()->header()->completeTagSize();
+        if (tagSize > stream.length())
+            return false;
+
+        offset = tagSize;
+        return true;
+    }
+
     FileAnalyzer::Extension FileAnalyzer::getExtension(QString extension)
     {
         auto lower = extension.toLower();
@@ -368,16 +575,7 @@ namespace PMP
             return;
         }
 
-        _audio.setFormat(AudioData::MP3);
-
-        getDataFromTag(tagFile.tag());
-        getExtraDataFromId3v2Tag(_tags, tagFile.ID3v2Tag());
-
-        auto* audioProperties = tagFile.audioProperties();
-        if (audioProperties)
-        {
-            _audio.setTrackLengthMilliseconds(audioProperties->lengthInMilliseconds());
-        }
+        getMp3AudioDataAndTags(tagFile);
 
         /* strip only ID3v2 */
         tagFile.strip(TagLib::MPEG::File::ID3v2);
@@ -417,15 +615,7 @@ namespace PMP
             return;
         }
 
-        _audio.setFormat(AudioData::FLAC);
-
-        getDataFromTag(tagFile.tag());
-
-        auto* audioProperties = tagFile.audioProperties();
-        if (audioProperties)
-        {
-            _audio.setTrackLengthMilliseconds(audioProperties->lengthInMilliseconds());
-        }
+        getFlacAudioDataAndTags(tagFile);
 
         /* strip all tags (hopefully) */
         tagFile.strip();
@@ -446,6 +636,214 @@ namespace PMP
         _hash = getHashFrom(scratch);
     }
 
+    FileAnalyzer::StreamingResult FileAnalyzer::analyzeStreaming()
+    {
+        if (_haveReadFile)
+        {
+            /* the stream shares the data with _fileContents, it does not copy it */
+            TagLib::ByteVectorStream stream(_fileContents);
+
+            switch (_extension)
+            {
+                case Extension::MP3:
+                    return analyzeMp3Streaming(stream);
+
+                case Extension::FLAC:
+                    return analyzeFlacStreaming(stream);
+
+                default:
+                case Extension::None:
+                    return StreamingResult::Failed;
+            }
+        }
+
+#ifdef Q_OS_WIN
+        TagLib::FileStream stream(reinterpret_cast<const wchar_t*>(_filePath.utf16()),
+                                  true);
+#else
+        auto encodedFilePath = QFile::encodeName(_filePath);
+        TagLib::FileStream stream(encodedFilePath.constData(), true);
+#endif
+
+        if (!stream.isOpen())
+            return StreamingResult::Failed;
+
+        switch (_extension)
+        {
+            case Extension::MP3:
+                return analyzeMp3Streaming(stream);
+
+            case Extension::FLAC:
+                return analyzeFlacStreaming(stream);
+
+            default:
+            case Extension::None:
+                return StreamingResult::Failed;
+        }
+    }
+
+    FileAnalyzer::StreamingResult FileAnalyzer::analyzeMp3Streaming(
+                                                                TagLib::IOStream& stream)
+    {
+        TagLib::MPEG::File tagFile(&stream, TagLib::ID3v2::FrameFactory::instance());
+        if (!tagFile.isValid())
+            return StreamingResult::Failed;
+
+        getMp3AudioDataAndTags(tagFile);
+
+        qint64 streamLength = stream.length();
+        if (streamLength <= 0 || streamLength > std::numeric_limits<uint>::max())
+            return StreamingResult::NeedsWholeFile;
+
+        /* the legacy hash is calculated over everything except the ID3v2 tag */
+        qint64 payloadStart = 0;
+        if (tagFile.hasID3v2Tag())
+        {
+            /* TagLib does not tell us where the tag is if it isn't at the start */
+            stream.seek(0);
+            if (stream.readBlock(3) != "ID3")
+                return StreamingResult::NeedsWholeFile;
+
+            payloadStart = tagFile.ID3v2Tag()->header()->completeTagSize();
+            if (payloadStart > streamLength)
+                return StreamingResult::NeedsWholeFile;
+        }
+
+        uint legacyLength = uint(streamLength - payloadStart);
+        Tail tail(stream, payloadStart, legacyLength);
+        if (!tail.isComplete(legacyLength))
+            return StreamingResult::NeedsWholeFile;
+
+        bool finalDifferentFromLegacy = false;
+        uint finalLength = legacyLength;
+
+        /* strip the rest (ID3v1 and APE) */
+        finalDifferentFromLegacy |= trimID3v1(tail, finalLength);
+        finalDifferentFromLegacy |= trimID3v1(tail, finalLength); /* might occur twice */
+        finalDifferentFromLegacy |= trimAPE(tail, finalLength);
+
+        Hasher legacyHasher;
+        Hasher finalHasher;
+        if (!hashRange(stream, payloadStart, legacyLength, legacyHasher,
+                       finalDifferentFromLegacy ? &finalHasher : nullptr, finalLength))
+        {
+            return StreamingResult::Failed;
+        }
+
+        if (finalDifferentFromLegacy)
+        {
+            _hash = finalHasher.result();
+            _legacyHash = legacyHasher.result();
+        }
+        else
+        {
+            _hash = legacyHasher.result();
+            /* no 'legacy' hash */
+        }
+
+        return StreamingResult::Completed;
+    }
+
+    FileAnalyzer::StreamingResult FileAnalyzer::analyzeFlacStreaming(
+                                                                TagLib::IOStream& stream)
+    {
+        TagLib::FLAC::File tagFile(&stream, TagLib::ID3v2::FrameFactory::instance());
+        if (!tagFile.isValid())
+            return StreamingResult::Failed;
+
+        getFlacAudioDataAndTags(tagFile);
+
+        qint64 streamLength = stream.length();
+        if (streamLength <= 0 || streamLength > std::numeric_limits<uint>::max())
+            return StreamingResult::NeedsWholeFile;
+
+        qint64 flacStart = 0;
+        if (tagFile.hasID3v2Tag())
+        {
+            stream.seek(0);
+            if (stream.readBlock(3) != "ID3")
+                return StreamingResult::NeedsWholeFile;
+
+            flacStart = tagFile.ID3v2Tag()->header()->completeTagSize();
+        }
+
+        /* anything between the ID3v2 tag and the FLAC signature would not be stripped
+           by the old approach */
+        stream.seek(long(flacStart));
+        if (stream.readBlock(4) != "fLaC")
+            return StreamingResult::NeedsWholeFile;
+
+        /* skip the metadata blocks; see stripFlacHeaders */
+        const int metadataBlockHeaderSize = 4;
+        qint64 audioStart = flacStart + 4;
+        while (true)
+        {
+            stream.seek(long(audioStart));
+            TagLib::ByteVector blockHeader = stream.readBlock(metadataBlockHeaderSize);
+            if (blockHeader.size() != metadataBlockHeaderSize)
+                return StreamingResult::NeedsWholeFile;
+
+            bool lastBlockFlag = blockHeader[0] & '\x80';
+            unsigned int blockSize = blockHeader.toUInt(1u, 3u);
+
+            audioStart += metadataBlockHeaderSize + blockSize;
+            if (audioStart >= streamLength)
+                return StreamingResult::NeedsWholeFile;
+
+            if (lastBlockFlag) break;
+        }
+
+        /* TagLib removes the ID3v1 tag it found, then we strip up to two more */
+        qint64 audioEnd = streamLength;
+        if (tagFile.hasID3v1Tag())
+            audioEnd -= 128;
+
+        if (audioEnd - audioStart < qint64(tailSize))
+            return StreamingResult::NeedsWholeFile; /* too small to be sure */
+
+        uint audioLength = uint(audioEnd - audioStart);
+        Tail tail(stream, audioStart, audioLength);
+        if (!tail.isComplete(audioLength))
+            return StreamingResult::NeedsWholeFile;
+
+        trimID3v1(tail, audioLength);
+        trimID3v1(tail, audioLength); /* ID3v1 might occur twice */
+
+        Hasher hasher;
+        if (!hashRange(stream, audioStart, audioLength, hasher, nullptr, 0))
+            return StreamingResult::Failed;
+
+        _hash = hasher.result();
+        return StreamingResult::Completed;
+    }
+
+    void FileAnalyzer::getMp3AudioDataAndTags(TagLib::MPEG::File& tagFile)
+    {
+        _audio.setFormat(AudioData::MP3);
+
+        getDataFromTag(tagFile.tag());
+        getExtraDataFromId3v2Tag(_tags, tagFile.ID3v2Tag());
+
+        auto* audioProperties = tagFile.audioProperties();
+        if (audioProperties)
+        {
+            _audio.setTrackLengthMilliseconds(audioProperties->lengthInMilliseconds());
+        }
+    }
+
+    void FileAnalyzer::getFlacAudioDataAndTags(TagLib::FLAC::File& tagFile)
+    {
+        _audio.setFormat(AudioData::FLAC);
+
+        getDataFromTag(tagFile.tag());
+
+        auto* audioProperties = tagFile.audioProperties();
+        if (audioProperties)
+        {
+            _audio.setTrackLengthMilliseconds(audioProperties->lengthInMilliseconds());
+        }
+    }
+
     bool FileAnalyzer::stripFlacHeaders(TagLib::ByteVector& flacData)
     {
         const int metadataBlockHeaderSize = 4;
@@ -35,7 +35,11 @@ namespace TagLib
 {
     class ByteVector;
     class ByteVectorStream;
+    class IOStream;
     class Tag;
+
+    namespace FLAC { class File; }
+    namespace MPEG { class File; }
 }
 
 namespace PMP
@@ -43,6 +47,17 @@ namespace PMP
     class FileAnalyzer
     {
     public:
+        enum class AnalysisMode
+        {
+            /* Reads only the tags and the audio payload, and calculates all hashes in a
+               single pass over the payload; falls back to WholeFile for unusual files */
+            Streaming,
+
+            /* Loads the entire file into memory, strips the tags from copies of the
+               file contents and hashes the result */
+            WholeFile,
+        };
+
         FileAnalyzer(const QString& filename);
         FileAnalyzer(const QFileInfo& file);
         FileAnalyzer(const QByteArray& fileContents,
@@ -58,7 +73,13 @@ namespace PMP
         static bool preprocessFileForPlayback(QByteArray& fileContents,
                                               QString extension);
 
-        void analyze();
+        /* Finds out where the data starts that preprocessFileForPlayback would keep,
+           by reading only the tags; an offset of zero means the file can be played
+           as-is; returns false if the offset cannot be determined this way */
+        static bool getPlaybackDataOffset(QString const& filePath,
+                                          QString const& extension, qint64& offset);
+
+        void analyze(AnalysisMode mode = AnalysisMode::Streaming);
 
         bool hadError() const;
         bool analysisDone() const;
@@ -76,6 +97,13 @@ namespace PMP
             MP3, FLAC
         };
 
+        enum class StreamingResult
+        {
+            Completed,
+            Failed,
+            NeedsWholeFile,
+        };
+
         static void logTagLibVersionOnce();
 
         static Extension getExtension(QString extension);
@@ -96,6 +124,12 @@ namespace PMP
         void analyzeMp3();
         void analyzeFlac();
 
+        StreamingResult analyzeStreaming();
+        StreamingResult analyzeMp3Streaming(TagLib::IOStream& stream);
+        StreamingResult analyzeFlacStreaming(TagLib::IOStream& stream);
+        void getMp3AudioDataAndTags(TagLib::MPEG::File& tagFile);
+        void getFlacAudioDataAndTags(TagLib::FLAC::File& tagFile);
+
         QString _filePath;
         Extension _extension;
         QFile _file;
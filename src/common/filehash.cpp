@@ -23,6 +23,9 @@
 
 #include <QCryptographicHash>
 
+#include <algorithm>
+#include <type_traits>
+
 namespace PMP
 {
     namespace
@@ -104,11 +107,16 @@ namespace PMP
         }
     }
 
+    static_assert(std::is_trivially_copyable<FileHash>::value,
+                  "FileHash should be cheap to copy");
+    static_assert(sizeof(FileHash) == 40, "FileHash should not contain padding");
+
     FileHash::FileHash(uint length, const QByteArray& sha1,
         const QByteArray& md5)
-     : _length(length), _sha1(sha1), _md5(md5)
+     : _length(length), _sha1 {}, _md5 {}
     {
-        //
+        std::memcpy(_sha1, sha1.constData(), std::min(sha1.size(), SHA1ByteCount));
+        std::memcpy(_md5, md5.constData(), std::min(md5.size(), MD5ByteCount));
     }
 
     FileHash FileHash::create(const QByteArray& dataToHash)
@@ -143,8 +151,8 @@ namespace PMP
             return "(null)";
 
         return "(" + QString::number(_length) + "; "
-            + _sha1.toHex() + "; "
-            + _md5.toHex() + ")";
+            + SHA1().toHex() + "; "
+            + MD5().toHex() + ")";
     }
 
     FileHash FileHash::tryParse(const QString& text)
@@ -26,24 +26,41 @@
 #include <QString>
 #include <QtDebug>
 
+#include <cstring>
+
 namespace PMP
 {
+    /** Identifies the audio contents of a file by its length, SHA-1 and MD5 hash.
+
+        The hashes are stored inline, so copying a FileHash is as cheap as copying a
+        40-byte struct and comparing two of them does not need to follow pointers.
+        Hashes of the wrong size are truncated or padded with zero bytes.
+
+        A hash is null when its length and all of its bytes are zero.  This includes
+        a hash that was constructed from all-zero bytes instead of from empty byte
+        arrays, which is not null in older versions.  Such a hash is what the network
+        protocol sends for a missing hash; a real file never hashes to all zeroes.
+    */
     class FileHash
     {
     public:
-        FileHash() : _length(0) { }
+        static constexpr int SHA1ByteCount = 20;
+        static constexpr int MD5ByteCount = 16;
+
+        FileHash() : _length(0), _sha1 {}, _md5 {} { }
         FileHash(uint length, const QByteArray& sha1, const QByteArray& md5);
 
         static FileHash create(const QByteArray& dataToHash);
 
         bool isNull() const
         {
-            return _length == 0 && _sha1.size() == 0 && _md5.size() == 0;
+            return _length == 0 && isAllZeroes(_sha1, SHA1ByteCount)
+                && isAllZeroes(_md5, MD5ByteCount);
         }
 
         uint length() const { return _length; }
-        const QByteArray& SHA1() const { return _sha1; }
-        const QByteArray& MD5() const { return _md5; }
+        QByteArray SHA1() const { return toByteArray(_sha1, SHA1ByteCount); }
+        QByteArray MD5() const { return toByteArray(_md5, MD5ByteCount); }
 
         QString toString() const;
         QString toFancyString() const;
@@ -51,17 +68,36 @@ namespace PMP
 
         static FileHash tryParse(QString const& text);
 
+        friend bool operator==(const FileHash& me, const FileHash& other);
+        friend uint qHash(const FileHash& hash, uint seed);
+        friend int compare(const FileHash& me, const FileHash& other);
+
     private:
+        static bool isAllZeroes(unsigned char const* bytes, int count)
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (bytes[i] != 0) return false;
+            }
+
+            return true;
+        }
+
+        static QByteArray toByteArray(unsigned char const* bytes, int count)
+        {
+            return QByteArray(reinterpret_cast<char const*>(bytes), count);
+        }
+
         uint _length;
-        QByteArray _sha1;
-        QByteArray _md5;
+        unsigned char _sha1[SHA1ByteCount];
+        unsigned char _md5[MD5ByteCount];
     };
 
     inline bool operator==(const FileHash& me, const FileHash& other)
     {
-        return me.length() == other.length()
-            && me.SHA1() == other.SHA1()
-            && me.MD5() == other.MD5();
+        return me._length == other._length
+            && std::memcmp(me._sha1, other._sha1, FileHash::SHA1ByteCount) == 0
+            && std::memcmp(me._md5, other._md5, FileHash::MD5ByteCount) == 0;
     }
 
     inline bool operator!=(const FileHash& me, const FileHash& other)
@@ -69,23 +105,24 @@ namespace PMP
         return !(me == other);
     }
 
-    inline uint qHash(const FileHash& hashID)
+    inline uint qHash(const FileHash& hash, uint seed = 0)
     {
-        return hashID.length()
-            ^ qHash(hashID.SHA1())
-            ^ qHash(hashID.MD5());
+        /* the bytes of a SHA-1 hash are uniformly distributed already */
+        uint value;
+        std::memcpy(&value, hash._sha1, sizeof(value));
+        return value ^ hash._length ^ seed;
     }
 
     inline int compare(const FileHash& me, const FileHash& other)
     {
-        if (me.length() < other.length()) return -1;
-        if (other.length() < me.length()) return 1;
+        if (me._length < other._length) return -1;
+        if (other._length < me._length) return 1;
 
-        if (me.SHA1() < other.SHA1()) return -1;
-        if (other.SHA1() < me.SHA1()) return 1;
+        int result = std::memcmp(me._sha1, other._sha1, FileHash::SHA1ByteCount);
+        if (result != 0) return result < 0 ? -1 : 1;
 
-        if (me.MD5() < other.MD5()) return -1;
-        if (other.MD5() < me.MD5()) return 1;
+        result = std::memcmp(me._md5, other._md5, FileHash::MD5ByteCount);
+        if (result != 0) return result < 0 ? -1 : 1;
 
         return 0;
     }
@@ -129,5 +166,6 @@ namespace PMP
 }
 
 Q_DECLARE_METATYPE(PMP::FileHash)
+Q_DECLARE_TYPEINFO(PMP::FileHash, Q_PRIMITIVE_TYPE);
 
 #endif
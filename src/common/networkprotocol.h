@@ -64,6 +64,8 @@ Changes for each version:
   25: client msg 27, server msg 36, error codes 26 & 120 & 121: fetch personal track history
   26: parameterless actions 60 & 61, server msg 37: full indexation and quick scan for new files
   27: client msg 28, server msg 38: requesting individual track info
+  28: client msg 29, server msg 39: incremental collection fetching
+  29: client msg 30: fetching user data for all hashes at once
 */
 
 namespace PMP
@@ -113,6 +115,7 @@ namespace PMP
         HistoryFragmentMessage = 36,
         IndexationStatusMessage = 37,
         HashInfoReply = 38,
+        CollectionFetchCompletionMessage = 39,
     };
 
     enum class ScrobblingServerMessageType : quint8
@@ -153,6 +156,8 @@ namespace PMP
         ActivateDelayedStartRequest = 26,
         PersonalHistoryRequest = 27,
         HashInfoRequest = 28,
+        CollectionChangesFetchRequestMessage = 29,
+        UserDataForAllHashesRequestMessage = 30,
     };
 
     enum class ScrobblingClientMessageType : quint8
@@ -162,6 +167,19 @@ namespace PMP
         AuthenticationRequestMessage = 3,
     };
 
+    enum class CompressionMessageType : quint8
+    {
+        CompressedMessage = 1,
+    };
+
+    enum class HashIdsServerMessageType : quint8
+    {
+        HashDefinitionsMessage = 1,
+        HashUserDataMessage = 2,
+        TrackInfoBatchMessage = 3,
+        TrackAvailabilityChangeBatchMessage = 4,
+    };
+
     enum class ServerEventCode
     {
         Reserved = 0,
@@ -48,6 +48,8 @@ namespace PMP
     NetworkProtocolExtensionTags::NetworkProtocolExtensionTags()
     {
         registerTag(NetworkProtocolExtension::Scrobbling, "scrobbling");
+        registerTag(NetworkProtocolExtension::Compression, "compression");
+        registerTag(NetworkProtocolExtension::HashIds, "hashids");
     }
 
     void NetworkProtocolExtensionTags::registerTag(NetworkProtocolExtension extension,
@@ -311,6 +313,63 @@ namespace PMP
         return message;
     }
 
+    QByteArray NetworkProtocolExtensionMessages::generateCompressedMessage(
+                               const NetworkProtocolExtensionSupportMap& extensionSupport,
+                               const QByteArray& message)
+    {
+        if (message.size() < CompressionThreshold)
+            return {};
+
+        QByteArray compressed =
+            generateExtensionMessageStart(
+                NetworkProtocolExtension::Compression, extensionSupport,
+                static_cast<quint8>(CompressionMessageType::CompressedMessage)
+            );
+
+        /* qCompress output starts with the uncompressed length as 4 bytes */
+        compressed += qCompress(message);
+
+        if (compressed.size() >= message.size())
+            return {}; /* compression did not help */
+
+        return compressed;
+    }
+
+    Nullable<QByteArray> NetworkProtocolExtensionMessages::decompressMessage(
+                                                             const QByteArray& message,
+                                                             quint32 maxUncompressedSize)
+    {
+        if (message.size() <= 2 + 4)
+            return null;
+
+        auto uncompressedSize = NetworkUtil::get4Bytes(message, 2);
+        if (uncompressedSize < 2 || uncompressedSize > maxUncompressedSize)
+        {
+            qWarning() << "compressed message has invalid uncompressed size:"
+                       << uncompressedSize;
+            return null;
+        }
+
+        auto uncompressed =
+            qUncompress(reinterpret_cast<uchar const*>(message.constData()) + 2,
+                        message.size() - 2);
+
+        if (static_cast<quint32>(uncompressed.size()) != uncompressedSize)
+        {
+            qWarning() << "failed to decompress message";
+            return null;
+        }
+
+        /* a compressed message must not contain another compressed message */
+        if (NetworkUtil::get2Bytes(uncompressed, 0) == NetworkUtil::get2Bytes(message, 0))
+        {
+            qWarning() << "compressed message contains a compressed message";
+            return null;
+        }
+
+        return uncompressed;
+    }
+
     quint16 NetworkProtocolExtensionMessages::encodeMessageTypeForExtension(
                                                                        quint8 extensionId,
                                                                        quint8 messageType)
@@ -36,6 +36,8 @@ namespace PMP
     {
         NoneOrInvalid = 0,
         Scrobbling,
+        Compression,
+        HashIds,
         // ExtensionName1,
         // ExtensionName2,
     };
@@ -50,6 +52,12 @@ namespace PMP
         case NetworkProtocolExtension::Scrobbling:
             return "Scrobbling";
 
+        case NetworkProtocolExtension::Compression:
+            return "Compression";
+
+        case NetworkProtocolExtension::HashIds:
+            return "HashIds";
+
         //case NetworkProtocolExtension::ExtensionName1:
         //    return "ExtensionName1";
 
@@ -74,6 +82,14 @@ namespace PMP
             debug << "NetworkProtocolExtension::Scrobbling";
             return debug;
 
+        case NetworkProtocolExtension::Compression:
+            debug << "NetworkProtocolExtension::Compression";
+            return debug;
+
+        case NetworkProtocolExtension::HashIds:
+            debug << "NetworkProtocolExtension::HashIds";
+            return debug;
+
         //case NetworkProtocolExtension::ExtensionName1:
         //    debug << "NetworkProtocolExtension::ExtensionName1";
         //    return debug;
@@ -165,6 +181,15 @@ namespace PMP
                                                          quint8 resultCode,
                                                          quint32 clientReference);
 
+        /* Messages smaller than this are never compressed */
+        static const int CompressionThreshold = 4096;
+
+        static QByteArray generateCompressedMessage(
+                               NetworkProtocolExtensionSupportMap const& extensionSupport,
+                               QByteArray const& message);
+        static Nullable<QByteArray> decompressMessage(QByteArray const& message,
+                                                      quint32 maxUncompressedSize);
+
     private:
         static quint16 encodeMessageTypeForExtension(quint8 extensionId,
                                                      quint8 messageType);
@@ -0,0 +1,56 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "stringpool.h"
+
+namespace PMP
+{
+    QString StringPool::intern(QString const& string)
+    {
+        /* all empty strings become the same null string */
+        if (string.isEmpty())
+            return {};
+
+        QMutexLocker lock(&_mutex);
+
+        auto it = _strings.constFind(string);
+        if (it != _strings.constEnd())
+            return *it;
+
+        /* don't keep a larger buffer alive than needed */
+        QString copy = string;
+        if (copy.capacity() > copy.size())
+            copy.squeeze();
+
+        _strings.insert(copy);
+        return copy;
+    }
+
+    int StringPool::size() const
+    {
+        QMutexLocker lock(&_mutex);
+        return _strings.size();
+    }
+
+    StringPool& StringPool::tagStrings()
+    {
+        static StringPool pool;
+        return pool;
+    }
+}
@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_STRINGPOOL_H
+#define PMP_STRINGPOOL_H
+
+#include <QMutex>
+#include <QSet>
+#include <QString>
+
+namespace PMP
+{
+    /** Keeps a single copy of strings that occur many times, like artist and album
+        names.
+
+        The same artists and albums occur for many tracks in a collection, so keeping
+        one copy of each name saves a lot of memory.  Interning a string returns the
+        copy that is in the pool, so all interned copies of the same text share the
+        same (implicitly shared) data.  Interned strings can therefore be compared by
+        pointer using isSameInternedString.  Strings are never removed from the pool;
+        this is meant for tag data, where the number of distinct strings is small
+        compared to the number of tracks.  A pool can be used from multiple threads at
+        once.
+
+        Interning an empty string returns a null QString, e.g. intern(QString("")) is
+        null.  As a consequence, the tag fields of a CollectionTrackInfo can be null
+        where they used to be empty; use isEmpty() rather than isNull() to check for a
+        missing value.
+    */
+    class StringPool
+    {
+    public:
+        StringPool() {}
+
+        QString intern(QString const& string);
+
+        int size() const;
+
+        /* only valid for strings that were interned by the same pool */
+        static bool isSameInternedString(QString const& string1,
+                                         QString const& string2)
+        {
+            return string1.constData() == string2.constData();
+        }
+
+        /* the pool for track titles, artists, albums etc. */
+        static StringPool& tagStrings();
+
+    private:
+        Q_DISABLE_COPY(StringPool)
+
+        mutable QMutex _mutex;
+        QSet<QString> _strings;
+    };
+}
+#endif
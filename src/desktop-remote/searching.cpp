@@ -20,6 +20,7 @@
 #include "searching.h"
 
 #include "common/searchutil.h"
+#include "common/stringpool.h"
 
 #include "client/collectionwatcher.h"
 
@@ -113,9 +114,24 @@ namespace PMP
     {
         auto& trackData = _trackData[track.hashId()];
 
-        trackData.title = SearchUtil::toSearchString(track.title());
-        trackData.artist = SearchUtil::toSearchString(track.artist());
-        trackData.album = SearchUtil::toSearchString(track.album());
-        trackData.albumArtist = SearchUtil::toSearchString(track.albumArtist());
+        trackData.title = toSearchString(track.title());
+        trackData.artist = toSearchString(track.artist());
+        trackData.album = toSearchString(track.album());
+        trackData.albumArtist = toSearchString(track.albumArtist());
+    }
+
+    QString SearchData::toSearchString(QString const& text)
+    {
+        /* each distinct text is only converted once */
+
+        auto it = _searchStrings.constFind(text);
+        if (it != _searchStrings.constEnd())
+            return it.value();
+
+        auto searchString =
+                StringPool::tagStrings().intern(SearchUtil::toSearchString(text));
+
+        _searchStrings.insert(text, searchString);
+        return searchString;
     }
 }
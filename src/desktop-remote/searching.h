@@ -66,6 +66,7 @@ namespace PMP
 
     private:
         void updateTrackData(Client::CollectionTrackInfo const& track);
+        QString toSearchString(QString const& text);
 
         struct TrackSearchStrings
         {
@@ -76,6 +77,7 @@ namespace PMP
         };
 
         QHash<Client::LocalHashId, TrackSearchStrings> _trackData;
+        QHash<QString, QString> _searchStrings;
     };
 }
 #endif
@@ -0,0 +1,352 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "analysiscache.h"
+
+#include "common/concurrent.h"
+
+#include "database.h"
+
+#include <QRandomGenerator>
+#include <QVector>
+#include <QtDebug>
+
+namespace PMP::Server
+{
+    namespace
+    {
+        FileAnalysis toFileAnalysis(DatabaseRecords::FileAnalysisCacheRecord const& record)
+        {
+            FileHashes hashes =
+                    record.legacyHash.isNull()
+                        ? FileHashes(record.hash)
+                        : FileHashes(record.hash, record.legacyHash);
+
+            FileInfo fileInfo(record.path, record.fileSize, record.lastModified);
+
+            AudioData audioData(AudioData::FileFormat(record.audioFormat),
+                                record.trackLengthMilliseconds);
+
+            TagData tagData(record.artist, record.title, record.album,
+                            record.albumArtist, record.comment);
+
+            return FileAnalysis(hashes, fileInfo, audioData, tagData);
+        }
+
+        DatabaseRecords::FileAnalysisCacheRecord toRecord(FileAnalysis const& analysis)
+        {
+            auto const& hashes = analysis.hashes().allHashes();
+            auto const& fileInfo = analysis.fileInfo();
+            auto const& audioData = analysis.audioData();
+            auto const& tagData = analysis.tagData();
+
+            DatabaseRecords::FileAnalysisCacheRecord record;
+            record.path = fileInfo.path();
+            record.fileSize = fileInfo.size();
+            record.lastModified = fileInfo.lastModifiedUtc();
+            record.hash = hashes[0];
+            if (hashes.size() > 1)
+                record.legacyHash = hashes[1];
+            record.audioFormat = int(audioData.format());
+            record.trackLengthMilliseconds = audioData.trackLengthMilliseconds();
+            record.title = tagData.title();
+            record.artist = tagData.artist();
+            record.album = tagData.album();
+            record.albumArtist = tagData.albumArtist();
+            record.comment = tagData.comment();
+
+            return record;
+        }
+    }
+
+    AnalysisCache::~AnalysisCache()
+    {
+        QMutexLocker lock(&_mutex);
+
+        while (_writerActive)
+            _writerFinished.wait(&_mutex);
+    }
+
+    Future<SuccessType, FailureType> AnalysisCache::loadAllFromDatabase()
+    {
+        {
+            QMutexLocker lock(&_mutex);
+            _loadingState = LoadingState::Loading;
+        }
+
+        auto work =
+            [this]() -> ResultOrError<SuccessType, FailureType>
+            {
+                auto db = Database::getDatabaseForCurrentThread();
+                if (!db) /* database not available */
+                {
+                    markLoadingFinished();
+                    return failure;
+                }
+
+                auto recordsOrFailure = db->getFileAnalysisCache();
+                if (recordsOrFailure.failed())
+                {
+                    markLoadingFinished();
+                    return failure;
+                }
+
+                const auto records = recordsOrFailure.result();
+
+                {
+                    QMutexLocker lock(&_mutex);
+                    _entries.reserve(records.size());
+
+                    for (auto const& record : records)
+                    {
+                        _entries.insert(record.path, toFileAnalysis(record));
+                    }
+                }
+
+                qDebug() << "AnalysisCache: loaded" << records.size()
+                         << "entries from the database";
+
+                markLoadingFinished();
+                return success;
+            };
+
+        return Concurrent::runOnThreadPool<SuccessType, FailureType>(globalThreadPool,
+                                                                        work);
+    }
+
+    void AnalysisCache::setVerificationPercentage(int percentage)
+    {
+        QMutexLocker lock(&_mutex);
+        _verificationPercentage = qBound(0, percentage, 100);
+    }
+
+    Nullable<FileAnalysis> AnalysisCache::lookup(FileInfo const& fileInfo)
+    {
+        waitUntilLoaded();
+
+        QMutexLocker lock(&_mutex);
+
+        auto it = _entries.constFind(fileInfo.path());
+        if (it == _entries.constEnd())
+            return null;
+
+        if (it.value().fileInfo() != fileInfo)
+            return null; /* file was modified */
+
+        if (_pruningActive)
+            _pathsSeenWhilePruning.insert(fileInfo.path());
+
+        /* pretend we don't have it, once in a while, so that silent corruption of a file
+           gets noticed when the new hash is stored */
+        if (_verificationPercentage > 0
+                && int(QRandomGenerator::global()->bounded(100)) < _verificationPercentage)
+        {
+            qDebug() << "AnalysisCache: will verify cached analysis of"
+                     << fileInfo.path();
+            return null;
+        }
+
+        return it.value();
+    }
+
+    void AnalysisCache::store(FileAnalysis const& analysis)
+    {
+        auto const& fileInfo = analysis.fileInfo();
+
+        {
+            QMutexLocker lock(&_mutex);
+
+            if (_pruningActive)
+                _pathsSeenWhilePruning.insert(fileInfo.path());
+
+            auto it = _entries.find(fileInfo.path());
+            if (it != _entries.end())
+            {
+                auto const& previous = it.value();
+
+                if (previous.fileInfo() == fileInfo
+                        && previous.hashes().main() == analysis.hashes().main())
+                {
+                    return; /* verified, nothing changed */
+                }
+
+                if (previous.fileInfo() == fileInfo)
+                {
+                    qWarning() << "AnalysisCache: file contents changed without a change"
+                               << "in size or modification time:" << fileInfo.path();
+                }
+
+                it.value() = analysis;
+            }
+            else
+            {
+                _entries.insert(fileInfo.path(), analysis);
+            }
+        }
+
+        auto record = toRecord(analysis);
+
+        QMutexLocker lock(&_mutex);
+        _pendingChanges.insert(record.path, record);
+        scheduleWriteOfPendingChanges();
+    }
+
+    void AnalysisCache::remove(QString const& path)
+    {
+        QMutexLocker lock(&_mutex);
+        if (_entries.remove(path) == 0)
+            return;
+
+        _pendingChanges.insert(path, null);
+        scheduleWriteOfPendingChanges();
+    }
+
+    void AnalysisCache::startPruning()
+    {
+        QMutexLocker lock(&_mutex);
+        _pruningActive = true;
+        _pathsSeenWhilePruning.clear();
+    }
+
+    void AnalysisCache::finishPruning()
+    {
+        waitUntilLoaded();
+
+        QMutexLocker lock(&_mutex);
+        if (!_pruningActive)
+            return;
+
+        _pruningActive = false;
+
+        int removedCount = 0;
+        for (auto it = _entries.begin(); it != _entries.end(); )
+        {
+            if (_pathsSeenWhilePruning.contains(it.key()))
+            {
+                ++it;
+                continue;
+            }
+
+            _pendingChanges.insert(it.key(), null);
+            it = _entries.erase(it);
+            ++removedCount;
+        }
+
+        _pathsSeenWhilePruning.clear();
+
+        qDebug() << "AnalysisCache: pruned" << removedCount << "stale entries";
+
+        if (removedCount > 0)
+            scheduleWriteOfPendingChanges();
+    }
+
+    void AnalysisCache::waitUntilLoaded()
+    {
+        QMutexLocker lock(&_mutex);
+
+        while (_loadingState == LoadingState::Loading)
+            _loadingFinished.wait(&_mutex);
+    }
+
+    void AnalysisCache::markLoadingFinished()
+    {
+        QMutexLocker lock(&_mutex);
+        _loadingState = LoadingState::Finished;
+        _loadingFinished.wakeAll();
+    }
+
+    /* must be called with the mutex locked */
+    void AnalysisCache::scheduleWriteOfPendingChanges()
+    {
+        if (_writerActive)
+            return; /* the active writer will pick up the new changes */
+
+        _writerActive = true;
+
+        Concurrent::runOnThreadPool<SuccessType, FailureType>(
+            globalThreadPool,
+            [this]() -> SuccessOrFailure
+            {
+                writePendingChanges();
+                return success;
+            }
+        );
+    }
+
+    void AnalysisCache::writePendingChanges()
+    {
+        auto db = Database::getDatabaseForCurrentThread();
+
+        while (true)
+        {
+            PendingChanges changes;
+
+            {
+                QMutexLocker lock(&_mutex);
+                changes.swap(_pendingChanges);
+
+                if (changes.isEmpty())
+                {
+                    _writerActive = false;
+                    _writerFinished.wakeAll();
+                    return;
+                }
+            }
+
+            if (!db) /* database not available */
+                continue; /* discard the changes */
+
+            auto& database = *db;
+            auto result =
+                database.executeInTransaction(
+                    [&database, &changes]() -> SuccessOrFailure
+                    {
+                        return writeChanges(database, changes);
+                    }
+                );
+
+            if (result.failed())
+            {
+                qWarning() << "AnalysisCache: failed to write" << changes.size()
+                           << "changes to the database";
+            }
+        }
+    }
+
+    SuccessOrFailure AnalysisCache::writeChanges(Database& database,
+                                                 PendingChanges const& changes)
+    {
+        QVector<DatabaseRecords::FileAnalysisCacheRecord> recordsToWrite;
+        QVector<QString> pathsToRemove;
+
+        for (auto it = changes.constBegin(); it != changes.constEnd(); ++it)
+        {
+            if (it.value().hasValue())
+                recordsToWrite.append(it.value().value());
+            else
+                pathsToRemove.append(it.key());
+        }
+
+        if (database.removeFileAnalysisCacheRecords(pathsToRemove).failed())
+            return failure;
+
+        return database.insertOrUpdateFileAnalysisCacheRecords(recordsToWrite);
+    }
+}
@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PMP_SERVER_ANALYSISCACHE_H
+#define PMP_SERVER_ANALYSISCACHE_H
+
+#include "common/future.h"
+#include "common/nullable.h"
+
+#include "databaserecords.h"
+#include "fileanalysis.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include <QWaitCondition>
+
+namespace PMP::Server
+{
+    class Database;
+
+    /* Remembers the analysis results of files, indexed by path.  A result is only
+       reused if the size and the modification time of the file are still the same.
+       The cache is persisted in the database, so a server restart does not require
+       re-hashing of the entire music collection.  Changes are written to the database
+       in the background; changes that arrive while a write is in progress are
+       collected and written together in a single transaction afterwards.
+       Entries for files that were deleted, moved or modified are pruned at the end
+       of a full indexation: every entry that was not confirmed by a lookup or a store
+       since the start of the pruning round is removed. */
+    class AnalysisCache
+    {
+    public:
+        ~AnalysisCache();
+
+        Future<SuccessType, FailureType> loadAllFromDatabase();
+
+        void setVerificationPercentage(int percentage);
+
+        Nullable<FileAnalysis> lookup(FileInfo const& fileInfo);
+        void store(FileAnalysis const& analysis);
+        void remove(QString const& path);
+
+        void startPruning();
+        void finishPruning();
+
+    private:
+        enum class LoadingState { NotStarted, Loading, Finished };
+
+        /* a null record means the entry was removed */
+        using PendingChanges =
+                QHash<QString, Nullable<DatabaseRecords::FileAnalysisCacheRecord>>;
+
+        void waitUntilLoaded();
+        void markLoadingFinished();
+
+        void scheduleWriteOfPendingChanges();
+        void writePendingChanges();
+        static SuccessOrFailure writeChanges(Database& database,
+                                             PendingChanges const& changes);
+
+        QMutex _mutex;
+        QWaitCondition _loadingFinished;
+        QWaitCondition _writerFinished;
+        LoadingState _loadingState { LoadingState::NotStarted };
+        int _verificationPercentage { 0 };
+        QHash<QString, FileAnalysis> _entries;
+        PendingChanges _pendingChanges;
+        QSet<QString> _pathsSeenWhilePruning;
+        bool _pruningActive { false };
+        bool _writerActive { false };
+    };
+}
+#endif
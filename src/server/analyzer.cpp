@@ -22,30 +22,135 @@
 #include "common/concurrent.h"
 #include "common/fileanalyzer.h"
 
+#include <QFile>
 #include <QtDebug>
+#include <QThread>
 #include <QThreadPool>
 
+#include <algorithm>
+
 namespace PMP::Server
 {
+    namespace
+    {
+        /* 256 MiB; enough to keep all analysis threads busy, while still making the
+           reading stage wait before it gets too far ahead of the analysis stage */
+        const qint64 defaultMaxBytesInFlight = 256 * 1024 * 1024;
+    }
+
+    class Analyzer::FileContents
+    {
+    public:
+        FileContents() {}
+
+        FileContents(FileInfo const& fileInfo, QString extension,
+                     TagLib::ByteVector contents)
+         : _fileInfo(fileInfo), _extension(extension), _contents(contents)
+        {
+            //
+        }
+
+        /* for a file that the analysis stage will read by itself */
+        FileContents(FileInfo const& fileInfo, QString extension)
+         : _fileInfo(fileInfo), _extension(extension), _mustReadFromDisk(true)
+        {
+            //
+        }
+
+        explicit FileContents(FileAnalysis const& cachedAnalysis)
+         : _fileInfo(cachedAnalysis.fileInfo()), _cachedAnalysis(cachedAnalysis)
+        {
+            //
+        }
+
+        FileInfo const& fileInfo() const { return _fileInfo; }
+        QString extension() const { return _extension; }
+        TagLib::ByteVector const& contents() const { return _contents; }
+
+        bool isFromCache() const { return _cachedAnalysis.hasValue(); }
+        bool mustReadFromDisk() const { return _mustReadFromDisk; }
+        FileAnalysis const& cachedAnalysis() const { return _cachedAnalysis.value(); }
+
+    private:
+        FileInfo _fileInfo;
+        QString _extension;
+        TagLib::ByteVector _contents;
+        Nullable<FileAnalysis> _cachedAnalysis;
+        bool _mustReadFromDisk { false };
+    };
+
     Analyzer::Analyzer(QObject* parent)
      : QObject(parent),
        _queueThreadPool(new QThreadPool(this)),
-       _onDemandThreadPool(new QThreadPool(this))
+       _analysisThreadPool(new QThreadPool(this)),
+       _onDemandThreadPool(new QThreadPool(this)),
+       _maxBytesInFlight(defaultMaxBytesInFlight)
     {
-        /* single thread only, because it's mostly I/O */
+        /* reading files is done by a single thread only, so that the disk gets
+           sequential reads; the CPU-bound work (parsing and hashing) is done by as many
+           threads as there are cores */
         _queueThreadPool->setMaxThreadCount(1);
+        _analysisThreadPool->setMaxThreadCount(QThread::idealThreadCount());
         _onDemandThreadPool->setMaxThreadCount(1);
+
+        /* lookups in the cache will wait until loading has finished */
+        _analysisCache.loadAllFromDatabase();
     }
 
     Analyzer::~Analyzer()
     {
+        {
+            QMutexLocker lock(&_readBudgetLock);
+            _shuttingDown = true;
+            _readBudgetReleased.wakeAll();
+        }
+
         _queueThreadPool->clear();
+        _analysisThreadPool->clear();
         _onDemandThreadPool->clear();
 
         _queueThreadPool->waitForDone();
+        _analysisThreadPool->waitForDone();
         _onDemandThreadPool->waitForDone();
     }
 
+    void Analyzer::setAnalysisThreadCount(int threadCount)
+    {
+        if (threadCount <= 0)
+            threadCount = QThread::idealThreadCount();
+
+        qDebug() << "Analyzer: using" << threadCount << "thread(s) for file analysis";
+        _analysisThreadPool->setMaxThreadCount(threadCount);
+    }
+
+    void Analyzer::setMaxBytesInFlight(qint64 byteCount)
+    {
+        if (byteCount <= 0)
+            byteCount = defaultMaxBytesInFlight;
+
+        qDebug() << "Analyzer: read-ahead limit set to" << byteCount << "bytes";
+
+        QMutexLocker lock(&_readBudgetLock);
+        _maxBytesInFlight = byteCount;
+        _readBudgetReleased.wakeAll();
+    }
+
+    void Analyzer::setCacheVerificationPercentage(int percentage)
+    {
+        qDebug() << "Analyzer: cache verification percentage set to" << percentage;
+        _analysisCache.setVerificationPercentage(percentage);
+    }
+
+    void Analyzer::startCachePruning()
+    {
+        _analysisCache.startPruning();
+    }
+
+    void Analyzer::finishCachePruning()
+    {
+        _analysisCache.finishPruning();
+    }
+
     void Analyzer::enqueueFile(QString path)
     {
         QMutexLocker lock(&_lock);
@@ -55,12 +160,26 @@ namespace PMP::Server
 
         _pathsInProgress << path;
 
-        auto future =
-            Concurrent::runOnThreadPool<FileAnalysis, FailureType>(
+        auto readFuture =
+            Concurrent::runOnThreadPool<FileContents, FailureType>(
                 _queueThreadPool,
                 [this, path]()
                 {
-                    return analyzeFileInternal(this, path, true);
+                    return readFileInternal(this, path, true);
+                }
+            );
+
+        auto future =
+            readFuture.thenOnThreadPool<FileAnalysis, FailureType>(
+                _analysisThreadPool,
+                [this](ResultOrError<FileContents, FailureType> readOutcome)
+                    -> ResultOrError<FileAnalysis, FailureType>
+                {
+                    if (readOutcome.failed())
+                        return failure;
+
+                    return analyzeFileContentsAndUpdateCache(readOutcome.result(),
+                                                             true);
                 }
             );
 
@@ -126,40 +245,147 @@ namespace PMP::Server
                                                                     Analyzer* analyzer,
                                                                     QString path,
                                                                     bool fromQueue)
+    {
+        auto contentsOrFailure = readFileInternal(analyzer, path, fromQueue);
+        if (contentsOrFailure.failed())
+            return failure;
+
+        return analyzer->analyzeFileContentsAndUpdateCache(contentsOrFailure.result(),
+                                                           fromQueue);
+    }
+
+    ResultOrError<Analyzer::FileContents, FailureType> Analyzer::readFileInternal(
+                                                                    Analyzer* analyzer,
+                                                                    QString path,
+                                                                    bool fromQueue)
     {
         QFileInfo firstQFileInfo(path);
         FileInfo firstFileInfo = extractFileInfo(firstQFileInfo);
 
-        FileAnalyzer fileAnalyzer(firstQFileInfo);
-        fileAnalyzer.analyze();
+        if (!firstQFileInfo.exists())
+        {
+            qDebug() << "Analyzer: file does not exist (anymore):" << path;
+            analyzer->_analysisCache.remove(firstFileInfo.path());
+            return failure;
+        }
+
+        auto cachedAnalysis = analyzer->_analysisCache.lookup(firstFileInfo);
+        if (cachedAnalysis.hasValue())
+            return FileContents(cachedAnalysis.value());
+
+        /* Files that don't fit in the read-ahead budget are not loaded into memory;
+           the analysis stage hashes them in chunks straight from the disk instead.
+           This is also done for on-demand analysis, which does not use the budget. */
+        if (!fromQueue || !analyzer->fitsInReadBudget(firstFileInfo.size()))
+            return FileContents(firstFileInfo, firstQFileInfo.suffix());
+
+        if (!analyzer->waitForReadBudget(firstFileInfo.size()))
+            return failure; /* shutting down */
+
+        /* read straight into a TagLib buffer, so the analysis won't need a copy */
+        TagLib::ByteVector contents;
+        {
+            QFile file(path);
+            if (file.open(QIODevice::ReadOnly))
+            {
+                auto size = file.size();
+                contents.resize(uint(size));
+                auto bytesRead = file.read(contents.data(), size);
+                contents.resize(uint(std::max(bytesRead, qint64(0))));
+            }
+        }
 
         QFileInfo secondQFileInfo(path);
         FileInfo secondFileInfo = extractFileInfo(secondQFileInfo);
 
         if (firstFileInfo != secondFileInfo) /* file was changed? */
         {
-            if (secondQFileInfo.exists())
-            {
-                qDebug() << "Analyzer: file seems to have changed, will retry later:"
-                         << path;
-                if (fromQueue)
-                {
-                    QMutexLocker lock(&analyzer->_lock);
-                    analyzer->_pathsInProgress.remove(path);
-                }
-                analyzer->enqueueFile(path); /* try again later */
-            }
-            else
-            {
-                qDebug() << "Analyzer: file seems to have been deleted:" << path;
-            }
+            analyzer->releaseReadBudget(firstFileInfo.size());
+            analyzer->onFileChangedWhileReading(path, secondQFileInfo.exists(),
+                                                fromQueue);
+            return failure;
+        }
 
+        if (contents.isEmpty())
+        {
+            analyzer->releaseReadBudget(firstFileInfo.size());
+
+            qDebug() << "Analyzer: could not read file:" << path;
             return failure;
         }
 
+        return FileContents(secondFileInfo, secondQFileInfo.suffix(), contents);
+    }
+
+    ResultOrError<FileAnalysis, FailureType> Analyzer::analyzeFileContentsAndUpdateCache(
+                                                             FileContents const& contents,
+                                                             bool fromQueue)
+    {
+        if (contents.isFromCache())
+            return contents.cachedAnalysis();
+
+        if (contents.mustReadFromDisk())
+        {
+            auto outcome = analyzeFileFromDisk(contents, fromQueue);
+
+            if (outcome.succeeded())
+                _analysisCache.store(outcome.result());
+
+            return outcome;
+        }
+
+        auto outcome = analyzeFileContents(contents);
+
+        if (fromQueue)
+            releaseReadBudget(contents.fileInfo().size());
+
+        if (outcome.succeeded())
+            _analysisCache.store(outcome.result());
+
+        return outcome;
+    }
+
+    ResultOrError<FileAnalysis, FailureType> Analyzer::analyzeFileContents(
+                                                             FileContents const& contents)
+    {
+        auto const& fileInfo = contents.fileInfo();
+
+        FileAnalyzer fileAnalyzer(contents.contents(), contents.extension());
+        fileAnalyzer.analyze();
+
+        return extractAnalysis(fileAnalyzer, fileInfo);
+    }
+
+    ResultOrError<FileAnalysis, FailureType> Analyzer::analyzeFileFromDisk(
+                                                             FileContents const& contents,
+                                                             bool fromQueue)
+    {
+        auto const& fileInfo = contents.fileInfo();
+        auto const& path = fileInfo.path();
+
+        /* the streaming mode reads the tags and hashes the audio in chunks */
+        FileAnalyzer fileAnalyzer(QFileInfo(path));
+        fileAnalyzer.analyze(FileAnalyzer::AnalysisMode::Streaming);
+
+        QFileInfo secondQFileInfo(path);
+        FileInfo secondFileInfo = extractFileInfo(secondQFileInfo);
+
+        if (fileInfo != secondFileInfo) /* file was changed? */
+        {
+            onFileChangedWhileReading(path, secondQFileInfo.exists(), fromQueue);
+            return failure;
+        }
+
+        return extractAnalysis(fileAnalyzer, fileInfo);
+    }
+
+    ResultOrError<FileAnalysis, FailureType> Analyzer::extractAnalysis(
+                                                        FileAnalyzer const& fileAnalyzer,
+                                                        FileInfo const& fileInfo)
+    {
         if (!fileAnalyzer.analysisDone()) /* something went wrong */
         {
-            qDebug() << "Analyzer: file analysis failed:" << path;
+            qDebug() << "Analyzer: file analysis failed:" << fileInfo.path();
             return failure;
         }
 
@@ -167,14 +393,14 @@ namespace PMP::Server
         if (audioData.trackLengthMilliseconds() > std::numeric_limits<qint32>::max())
         {
             /* file too long, probably not music anyway */
-            qDebug() << "Analyzer: file audio too long:" << path;
+            qDebug() << "Analyzer: file audio too long:" << fileInfo.path();
             return failure;
         }
 
         auto hashes = extractHashes(fileAnalyzer);
         auto tagData = fileAnalyzer.tagData();
 
-        FileAnalysis analysis(hashes, secondFileInfo, audioData, tagData);
+        FileAnalysis analysis(hashes, fileInfo, audioData, tagData);
         return analysis;
     }
 
@@ -196,6 +422,27 @@ namespace PMP::Server
                         fileInfo.lastModified().toUTC());
     }
 
+    void Analyzer::onFileChangedWhileReading(QString path, bool stillExists,
+                                             bool fromQueue)
+    {
+        if (stillExists)
+        {
+            qDebug() << "Analyzer: file seems to have changed, will retry later:"
+                     << path;
+            if (fromQueue)
+            {
+                QMutexLocker lock(&_lock);
+                _pathsInProgress.remove(path);
+            }
+            enqueueFile(path); /* try again later */
+        }
+        else
+        {
+            qDebug() << "Analyzer: file seems to have been deleted:" << path;
+            _analysisCache.remove(path);
+        }
+    }
+
     void Analyzer::onFileAnalysisFailed(QString path)
     {
         qDebug() << "Analyzer: failed to analyze" << path;
@@ -237,4 +484,36 @@ namespace PMP::Server
         _pathsInProgress.remove(path);
         allFinished = _pathsInProgress.empty();
     }
+
+    bool Analyzer::fitsInReadBudget(qint64 byteCount)
+    {
+        QMutexLocker lock(&_readBudgetLock);
+        return byteCount <= _maxBytesInFlight;
+    }
+
+    bool Analyzer::waitForReadBudget(qint64 byteCount)
+    {
+        QMutexLocker lock(&_readBudgetLock);
+
+        while (!_shuttingDown
+               && _bytesInFlight > 0
+               && _bytesInFlight + byteCount > _maxBytesInFlight)
+        {
+            _readBudgetReleased.wait(&_readBudgetLock);
+        }
+
+        if (_shuttingDown)
+            return false;
+
+        _bytesInFlight += byteCount;
+        return true;
+    }
+
+    void Analyzer::releaseReadBudget(qint64 byteCount)
+    {
+        QMutexLocker lock(&_readBudgetLock);
+
+        _bytesInFlight -= byteCount;
+        _readBudgetReleased.wakeAll();
+    }
 }
@@ -23,6 +23,7 @@
 #include "common/audiodata.h"
 #include "common/future.h"
 
+#include "analysiscache.h"
 #include "fileanalysis.h"
 
 #include <QDateTime>
@@ -31,6 +32,7 @@
 #include <QObject>
 #include <QSet>
 #include <QVector>
+#include <QWaitCondition>
 
 QT_FORWARD_DECLARE_CLASS(QFileInfo)
 QT_FORWARD_DECLARE_CLASS(QThreadPool)
@@ -49,6 +51,12 @@ namespace PMP::Server
         Analyzer(QObject* parent);
         ~Analyzer();
 
+        void setAnalysisThreadCount(int threadCount);
+        void setMaxBytesInFlight(qint64 byteCount);
+        void setCacheVerificationPercentage(int percentage);
+        void startCachePruning();
+        void finishCachePruning();
+
         void enqueueFile(QString path);
         bool isFinished();
 
@@ -61,19 +69,47 @@ namespace PMP::Server
         void finished();
 
     private:
+        class FileContents;
+
         static ResultOrError<FileAnalysis, FailureType> analyzeFileInternal(
                                                                     Analyzer* analyzer,
                                                                     QString path,
                                                                     bool fromQueue);
+        static ResultOrError<FileContents, FailureType> readFileInternal(
+                                                                    Analyzer* analyzer,
+                                                                    QString path,
+                                                                    bool fromQueue);
+        static ResultOrError<FileAnalysis, FailureType> analyzeFileContents(
+                                                            FileContents const& contents);
+        ResultOrError<FileAnalysis, FailureType> analyzeFileFromDisk(
+                                                            FileContents const& contents,
+                                                            bool fromQueue);
+        static ResultOrError<FileAnalysis, FailureType> extractAnalysis(
+                                                        FileAnalyzer const& fileAnalyzer,
+                                                        FileInfo const& fileInfo);
+        ResultOrError<FileAnalysis, FailureType> analyzeFileContentsAndUpdateCache(
+                                                            FileContents const& contents,
+                                                            bool fromQueue);
         static FileHashes extractHashes(FileAnalyzer const& fileAnalyzer);
         static FileInfo extractFileInfo(QFileInfo& fileInfo);
+        void onFileChangedWhileReading(QString path, bool stillExists, bool fromQueue);
         void onFileAnalysisFailed(QString path);
         void onFileAnalysisCompleted(QString path, FileAnalysis analysis);
         void markAsNoLongerInProgress(QString path, bool& allFinished);
+        bool fitsInReadBudget(qint64 byteCount);
+        bool waitForReadBudget(qint64 byteCount);
+        void releaseReadBudget(qint64 byteCount);
 
         QThreadPool* _queueThreadPool;
+        QThreadPool* _analysisThreadPool;
         QThreadPool* _onDemandThreadPool;
+        AnalysisCache _analysisCache;
         QMutex _lock;
+        QMutex _readBudgetLock;
+        QWaitCondition _readBudgetReleased;
+        qint64 _maxBytesInFlight;
+        qint64 _bytesInFlight { 0 };
+        bool _shuttingDown { false };
         QSet<QString> _pathsInProgress;
         QHash<QString, Future<FileAnalysis, FailureType>> _onDemandInProgress;
     };
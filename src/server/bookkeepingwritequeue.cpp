@@ -0,0 +1,181 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bookkeepingwritequeue.h"
+
+#include "common/concurrent.h"
+
+#include "database.h"
+
+#include <QDateTime>
+#include <QtDebug>
+#include <QTimer>
+
+namespace
+{
+    const int batchSizeThreshold = 1000;
+    const int flushDelayMilliseconds = 2000;
+}
+
+namespace PMP::Server
+{
+    int BookkeepingWriteQueue::Batch::size() const
+    {
+        return filenames.size() + fileSizes.size() + equivalences.size();
+    }
+
+    BookkeepingWriteQueue::BookkeepingWriteQueue(QObject* parent)
+     : QObject(parent)
+    {
+        //
+    }
+
+    BookkeepingWriteQueue::~BookkeepingWriteQueue()
+    {
+        /* write what is left synchronously, we will not get another chance */
+        auto batch = takeBatch();
+        if (batch.size() == 0)
+            return;
+
+        auto db = Database::getDatabaseForCurrentThread();
+        if (!db)
+            return;
+
+        writeBatch(*db, batch);
+    }
+
+    void BookkeepingWriteQueue::registerFilenameSeen(uint hashId,
+                                                     QString const& filenameWithoutPath)
+    {
+        int batchSize;
+        {
+            QMutexLocker lock(&_mutex);
+            _batch.filenames.append({ hashId, filenameWithoutPath });
+            batchSize = _batch.size();
+        }
+
+        onEntryAdded(batchSize);
+    }
+
+    void BookkeepingWriteQueue::registerFileSizeSeen(uint hashId, qint64 size)
+    {
+        int batchSize;
+        {
+            QMutexLocker lock(&_mutex);
+            _batch.fileSizes.append({ hashId, size });
+            batchSize = _batch.size();
+        }
+
+        onEntryAdded(batchSize);
+    }
+
+    void BookkeepingWriteQueue::registerEquivalence(quint32 hashId1, quint32 hashId2)
+    {
+        int batchSize;
+        {
+            QMutexLocker lock(&_mutex);
+            _batch.equivalences.append({ hashId1, hashId2 });
+            batchSize = _batch.size();
+        }
+
+        onEntryAdded(batchSize);
+    }
+
+    void BookkeepingWriteQueue::flush()
+    {
+        auto batch = takeBatch();
+        if (batch.size() == 0)
+            return;
+
+        Concurrent::runOnThreadPool<SuccessType, FailureType>(
+            globalThreadPool,
+            [batch]() -> SuccessOrFailure
+            {
+                auto db = Database::getDatabaseForCurrentThread();
+                if (!db) return failure; /* database not available */
+
+                return writeBatch(*db, batch);
+            }
+        );
+    }
+
+    void BookkeepingWriteQueue::onEntryAdded(int batchSize)
+    {
+        if (batchSize >= batchSizeThreshold)
+        {
+            flush();
+            return;
+        }
+
+        {
+            QMutexLocker lock(&_mutex);
+            if (_flushScheduled)
+                return;
+
+            _flushScheduled = true;
+        }
+
+        QTimer::singleShot(flushDelayMilliseconds, this, [this]() { flush(); });
+    }
+
+    BookkeepingWriteQueue::Batch BookkeepingWriteQueue::takeBatch()
+    {
+        QMutexLocker lock(&_mutex);
+
+        Batch batch;
+        std::swap(batch, _batch);
+        _flushScheduled = false;
+
+        return batch;
+    }
+
+    SuccessOrFailure BookkeepingWriteQueue::writeBatch(Database& database,
+                                                       Batch const& batch)
+    {
+        int currentYear = QDateTime::currentDateTimeUtc().date().year();
+
+        auto result =
+            database.executeInTransaction(
+                [&database, &batch, currentYear]() -> SuccessOrFailure
+                {
+                    auto result =
+                        database.registerFilenamesSeen(batch.filenames, currentYear);
+                    if (result.failed())
+                        return failure;
+
+                    result = database.registerFileSizesSeen(batch.fileSizes, currentYear);
+                    if (result.failed())
+                        return failure;
+
+                    return database.registerEquivalences(batch.equivalences,
+                                                         currentYear);
+                }
+            );
+
+        if (result.failed())
+        {
+            qWarning() << "BookkeepingWriteQueue: failed to write batch of size"
+                       << batch.size();
+            return failure;
+        }
+
+        qDebug() << "BookkeepingWriteQueue: wrote batch of size" << batch.size();
+        return success;
+    }
+}
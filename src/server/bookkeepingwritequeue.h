@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_SERVER_BOOKKEEPINGWRITEQUEUE_H
+#define PMP_SERVER_BOOKKEEPINGWRITEQUEUE_H
+
+#include "common/resultorerror.h"
+
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+namespace PMP::Server
+{
+    class Database;
+
+    /* Collects the file names, file sizes and hash equivalences that were seen during
+       indexation, and writes them to the database in batches.  Each batch is written
+       inside a single transaction using multi-row inserts.  A batch is written when
+       enough entries have been collected, or a short time after the first entry of
+       the batch was added. */
+    class BookkeepingWriteQueue : public QObject
+    {
+        Q_OBJECT
+    public:
+        explicit BookkeepingWriteQueue(QObject* parent);
+        ~BookkeepingWriteQueue();
+
+        void registerFilenameSeen(uint hashId, QString const& filenameWithoutPath);
+        void registerFileSizeSeen(uint hashId, qint64 size);
+        void registerEquivalence(quint32 hashId1, quint32 hashId2);
+
+        void flush();
+
+    private:
+        struct Batch
+        {
+            QVector<QPair<uint, QString>> filenames;
+            QVector<QPair<uint, qint64>> fileSizes;
+            QVector<QPair<quint32, quint32>> equivalences;
+
+            int size() const;
+        };
+
+        void onEntryAdded(int batchSize);
+        Batch takeBatch();
+        static SuccessOrFailure writeBatch(Database& database, Batch const& batch);
+
+        QMutex _mutex;
+        Batch _batch;
+        bool _flushScheduled { false };
+    };
+}
+#endif
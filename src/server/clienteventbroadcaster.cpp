@@ -0,0 +1,109 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "clienteventbroadcaster.h"
+
+#include "collectionmonitor.h"
+#include "player.h"
+#include "playerqueue.h"
+
+namespace PMP::Server
+{
+    /* ====================== BroadcastMessage ====================== */
+
+    QVector<QByteArray> BroadcastMessage::encodedFor(ClientKind const& clientKind,
+                                                     Encoder const& encoder)
+    {
+        auto it = _encodedByClientKind.constFind(clientKind);
+        if (it != _encodedByClientKind.constEnd())
+            return it.value();
+
+        auto encoded = encoder();
+        _encodedByClientKind.insert(clientKind, encoded);
+        return encoded;
+    }
+
+    /* ====================== ClientEventBroadcaster ====================== */
+
+    ClientEventBroadcaster::ClientEventBroadcaster(QObject* parent, Player* player,
+                                                   CollectionMonitor* collectionMonitor)
+     : QObject(parent)
+    {
+        auto* queue = &player->queue();
+
+        connect(
+            queue, &PlayerQueue::entryRemoved,
+            this,
+            [this](qint32 offset, quint32 queueId)
+            {
+                auto message = BroadcastMessagePtr::create();
+                Q_EMIT queueEntryRemoved(offset, queueId, message);
+            }
+        );
+        connect(
+            queue, &PlayerQueue::entryMoved,
+            this,
+            [this](qint32 fromOffset, qint32 toOffset, quint32 queueId)
+            {
+                auto message = BroadcastMessagePtr::create();
+                Q_EMIT queueEntryMoved(fromOffset, toOffset, queueId, message);
+            }
+        );
+        connect(
+            player, &Player::newHistoryEntry,
+            this,
+            [this](QSharedPointer<RecentHistoryEntry> entry)
+            {
+                auto message = BroadcastMessagePtr::create();
+                Q_EMIT newHistoryEntry(entry, message);
+            }
+        );
+        connect(
+            collectionMonitor, &CollectionMonitor::hashAvailabilityChanged,
+            this,
+            [this](QVector<FileHash> available, QVector<FileHash> unavailable)
+            {
+                auto message = BroadcastMessagePtr::create();
+                Q_EMIT hashAvailabilityChanged(available, unavailable, message);
+            }
+        );
+        connect(
+            collectionMonitor, &CollectionMonitor::hashInfoChanged,
+            this,
+            [this](QVector<CollectionTrackInfo> changes)
+            {
+                auto message = BroadcastMessagePtr::create();
+                Q_EMIT hashInfoChanged(changes, message);
+            }
+        );
+    }
+
+    BroadcastMessagePtr ClientEventBroadcaster::playerStateMessage(
+                                                     PlayerStateOverview const& overview)
+    {
+        /* the player state is requested by every client for every position change, so
+           we keep using the same message as long as the state stays the same */
+        if (_playerStateMessage && _lastPlayerStateOverview == overview)
+            return _playerStateMessage;
+
+        _lastPlayerStateOverview = overview;
+        _playerStateMessage = BroadcastMessagePtr::create();
+        return _playerStateMessage;
+    }
+}
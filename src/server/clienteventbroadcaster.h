@@ -0,0 +1,114 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_SERVER_CLIENTEVENTBROADCASTER_H
+#define PMP_SERVER_CLIENTEVENTBROADCASTER_H
+
+#include "common/filehash.h"
+#include "common/nullable.h"
+
+#include "collectiontrackinfo.h"
+#include "recenthistoryentry.h"
+#include "serverinterface.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+
+#include <functional>
+
+namespace PMP::Server
+{
+    class CollectionMonitor;
+    class Player;
+
+    /* A message that is to be sent to many clients.  Each client asks for the message
+       in the encoding for its own protocol version and the protocol extensions that
+       make a difference for the encoding; the first client of each such kind encodes
+       the message, all other clients of the same kind get the same (implicitly shared)
+       buffers. */
+    class BroadcastMessage
+    {
+    public:
+        struct ClientKind
+        {
+            int protocolNo;
+            bool supportsCompression;
+            bool supportsHashIds;
+
+            bool operator==(ClientKind const& other) const
+            {
+                return protocolNo == other.protocolNo
+                    && supportsCompression == other.supportsCompression
+                    && supportsHashIds == other.supportsHashIds;
+            }
+        };
+
+        using Encoder = std::function<QVector<QByteArray> ()>;
+
+        QVector<QByteArray> encodedFor(ClientKind const& clientKind,
+                                       Encoder const& encoder);
+
+    private:
+        QHash<ClientKind, QVector<QByteArray>> _encodedByClientKind;
+    };
+
+    inline uint qHash(BroadcastMessage::ClientKind const& clientKind, uint seed = 0)
+    {
+        uint flags = (clientKind.supportsCompression ? 1u : 0u)
+                   | (clientKind.supportsHashIds ? 2u : 0u);
+
+        return ::qHash(clientKind.protocolNo, seed) ^ flags;
+    }
+
+    using BroadcastMessagePtr = QSharedPointer<BroadcastMessage>;
+
+    /* Subscribes once to the server events that are sent to every connected client,
+       and passes them on together with a shared BroadcastMessage, so that each event
+       is serialized only once per protocol version instead of once per client. */
+    class ClientEventBroadcaster : public QObject
+    {
+        Q_OBJECT
+    public:
+        ClientEventBroadcaster(QObject* parent, Player* player,
+                               CollectionMonitor* collectionMonitor);
+
+        BroadcastMessagePtr playerStateMessage(PlayerStateOverview const& overview);
+
+    Q_SIGNALS:
+        void queueEntryRemoved(qint32 offset, quint32 queueId,
+                               PMP::Server::BroadcastMessagePtr message);
+        void queueEntryMoved(qint32 fromOffset, qint32 toOffset, quint32 queueId,
+                             PMP::Server::BroadcastMessagePtr message);
+        void newHistoryEntry(QSharedPointer<PMP::Server::RecentHistoryEntry> entry,
+                             PMP::Server::BroadcastMessagePtr message);
+        void hashAvailabilityChanged(QVector<PMP::FileHash> available,
+                                     QVector<PMP::FileHash> unavailable,
+                                     PMP::Server::BroadcastMessagePtr message);
+        void hashInfoChanged(QVector<PMP::Server::CollectionTrackInfo> changes,
+                             PMP::Server::BroadcastMessagePtr message);
+
+    private:
+        Nullable<PlayerStateOverview> _lastPlayerStateOverview;
+        BroadcastMessagePtr _playerStateMessage;
+    };
+}
+#endif
@@ -20,6 +20,7 @@
 #include "collectionmonitor.h"
 
 #include "common/containerutil.h"
+#include "common/stringpool.h"
 
 #include <QtDebug>
 #include <QTimer>
@@ -28,17 +29,32 @@ namespace PMP::Server
 {
     CollectionMonitor::CollectionMonitor(QObject* parent)
      : QObject(parent),
-       _pendingTagNotificationCount(0)
+       _pendingTagNotificationCount(0),
+       _journalId(QUuid::createUuid()),
+       _journalVersion(0)
     {
         //
     }
 
+    QVector<FileHash> CollectionMonitor::getHashesChangedSince(quint64 version) const
+    {
+        QVector<FileHash> hashes;
+
+        for (auto it = _journal.upperBound(version); it != _journal.end(); ++it)
+        {
+            hashes.append(it.value());
+        }
+
+        return hashes;
+    }
+
     void CollectionMonitor::hashBecameAvailable(FileHash hash)
     {
         HashInfo& info = _collection[hash];
         if (info.isAvailable) return; /* no change */
 
         info.isAvailable = true;
+        addToJournal(hash);
         _pendingNotifications[hash].availability = true; /* availability changed */
         checkNeedToSendNotifications();
     }
@@ -53,6 +69,7 @@ namespace PMP::Server
         if (!info.isAvailable) return; /* no change */
 
         info.isAvailable = false;
+        addToJournal(hash);
         _pendingNotifications[hash].availability = true; /* availability changed */
         checkNeedToSendNotifications();
     }
@@ -73,11 +90,13 @@ namespace PMP::Server
 
         if (infoStillTheSame) return;
 
-        info.title = title;
-        info.artist = artist;
-        info.album = album;
-        info.albumArtist = albumArtist;
+        auto& pool = StringPool::tagStrings();
+        info.title = pool.intern(title);
+        info.artist = pool.intern(artist);
+        info.album = pool.intern(album);
+        info.albumArtist = pool.intern(albumArtist);
         info.lengthInMilliseconds = lengthInMilliseconds;
+        addToJournal(hash);
 
         Changed& notification = _pendingNotifications[hash];
         if (!notification.tags)
@@ -88,6 +107,18 @@ namespace PMP::Server
         }
     }
 
+    void CollectionMonitor::addToJournal(FileHash const& hash)
+    {
+        /* only the most recent change of each hash needs to be remembered */
+        auto it = _journalVersionOfHash.find(hash);
+        if (it != _journalVersionOfHash.end())
+            _journal.remove(it.value());
+
+        auto version = ++_journalVersion;
+        _journal.insert(version, hash);
+        _journalVersionOfHash.insert(hash, version);
+    }
+
     void CollectionMonitor::checkNeedToSendNotifications()
     {
         bool first = _pendingNotifications.size() == 1;
@@ -23,9 +23,11 @@
 #include "collectiontrackinfo.h"
 
 #include <QHash>
+#include <QMap>
 #include <QMetaType>
 #include <QObject>
 #include <QPair>
+#include <QUuid>
 #include <QVector>
 
 namespace PMP::Server
@@ -37,6 +39,16 @@ namespace PMP::Server
     public:
         CollectionMonitor(QObject* parent = nullptr);
 
+        /* The journal keeps track of which hashes changed since a certain version.  The
+           journal ID changes every time the server is started, so a version number is
+           only meaningful in combination with the journal ID.  The journal is only kept
+           in memory, so a journal ID that survives a restart would make clients ask for
+           changes that the server no longer knows about; the full collection fetch that
+           clients need to do after a server restart is an accepted limitation. */
+        QUuid journalId() const { return _journalId; }
+        quint64 journalVersion() const { return _journalVersion; }
+        QVector<FileHash> getHashesChangedSince(quint64 version) const;
+
     public Q_SLOTS:
         void hashBecameAvailable(PMP::FileHash hash);
         void hashBecameUnavailable(PMP::FileHash hash);
@@ -53,6 +65,7 @@ namespace PMP::Server
         void emitNotifications();
 
     private:
+        void addToJournal(FileHash const& hash);
         void checkNeedToSendNotifications();
         void emitFullNotifications(QVector<FileHash> hashes);
         void emitAvailabilityNotifications(QVector<FileHash> hashes);
@@ -85,6 +98,10 @@ namespace PMP::Server
         QHash<FileHash, HashInfo> _collection;
         QHash<FileHash, Changed> _pendingNotifications;
         int _pendingTagNotificationCount;
+        QUuid _journalId;
+        quint64 _journalVersion;
+        QMap<quint64, FileHash> _journal;
+        QHash<FileHash, quint64> _journalVersionOfHash;
     };
 }
 #endif
@@ -19,6 +19,7 @@
 
 #include "connectedclient.h"
 
+#include "common/binarycursor.h"
 #include "common/filehash.h"
 #include "common/networkprotocol.h"
 #include "common/networkutil.h"
@@ -35,6 +36,7 @@
 #include "users.h"
 
 #include <QMap>
+#include <QSet>
 #include <QThreadPool>
 #include <QTimer>
 
@@ -42,16 +44,110 @@
 
 namespace PMP::Server
 {
+    namespace
+    {
+        /* when the socket has more than this amount of data waiting to be sent, we hold
+           back further output until it has drained; while waiting, a newer state
+           message replaces an older one of the same kind instead of being queued */
+        const qint64 outputHighWaterMark = 1024 * 1024;
+
+        /* a client that lets this much output pile up is not reading from its socket
+           anymore, so we give up on it instead of letting the buffer grow forever */
+        const qint64 outputHardLimit = 64 * 1024 * 1024;
+
+        QVector<FileHash> getHashes(QVector<CollectionTrackInfo> const& tracks)
+        {
+            QVector<FileHash> hashes;
+            hashes.reserve(tracks.size());
+
+            for (auto const& track : tracks)
+                hashes.append(track.hash());
+
+            return hashes;
+        }
+
+        QVector<FileHash> getHashesWithoutId(QVector<FileHash> const& hashes,
+                                             QVector<QPair<uint, FileHash>> const& ids)
+        {
+            if (ids.size() == hashes.size())
+                return {};
+
+            QSet<FileHash> hashesWithId;
+            hashesWithId.reserve(ids.size());
+            for (auto const& idAndHash : ids)
+                hashesWithId.insert(idAndHash.second);
+
+            QVector<FileHash> result;
+            for (auto const& hash : hashes)
+            {
+                if (!hashesWithId.contains(hash))
+                    result.append(hash);
+            }
+
+            return result;
+        }
+
+        /* appends everything that follows the hash (or hash ID) of a track */
+        void appendTrackInfoWithoutHash(QByteArray& message,
+                                        CollectionTrackInfo const& track,
+                                        bool withAlbumAndTrackLength,
+                                        bool withAlbumArtist)
+        {
+            const int maxSize = (1 << 16) - 1;
+
+            QString title = track.title();
+            QString artist = track.artist();
+            QString album = track.album();
+            QString albumArtist = track.albumArtist();
+
+            /* worst case: 4 bytes in UTF-8 for each char */
+            title.truncate(maxSize / 4);
+            artist.truncate(maxSize / 4);
+            album.truncate(maxSize / 4);
+            albumArtist.truncate(maxSize / 4);
+
+            QByteArray titleData = title.toUtf8();
+            QByteArray artistData = artist.toUtf8();
+            QByteArray albumData = album.toUtf8();
+            QByteArray albumArtistData = albumArtist.toUtf8();
+
+            NetworkUtil::appendByte(message, track.isAvailable() ? 1 : 0);
+            NetworkUtil::append2Bytes(message, (uint)titleData.size());
+            NetworkUtil::append2Bytes(message, (uint)artistData.size());
+            if (withAlbumAndTrackLength)
+            {
+                NetworkUtil::append2Bytes(message, (uint)albumData.size());
+                if (withAlbumArtist)
+                {
+                    NetworkUtil::append2Bytes(message, (uint)albumArtistData.size());
+                }
+                NetworkUtil::append4BytesSigned(message, track.lengthInMilliseconds());
+            }
+
+            message += titleData;
+            message += artistData;
+            if (withAlbumAndTrackLength)
+            {
+                message += albumData;
+                if (withAlbumArtist)
+                {
+                    message += albumArtistData;
+                }
+            }
+        }
+    }
+
     /* ====================== ConnectedClient ====================== */
 
-    const qint16 ConnectedClient::ServerProtocolNo = 27;
+    const qint16 ConnectedClient::ServerProtocolNo = 29;
 
     ConnectedClient::ConnectedClient(QTcpSocket* socket, ServerInterface* serverInterface,
                                      Player* player,
                                      Users* users,
                                      CollectionMonitor* collectionMonitor,
                                      ServerHealthMonitor* serverHealthMonitor,
-                                     Scrobbling* scrobbling)
+                                     Scrobbling* scrobbling,
+                                     ClientEventBroadcaster* eventBroadcaster)
      : _socket(socket),
        _serverInterface(serverInterface),
        _player(player),
@@ -59,6 +155,7 @@ namespace PMP::Server
        _collectionMonitor(collectionMonitor),
        _serverHealthMonitor(serverHealthMonitor),
        _scrobbling(scrobbling),
+       _eventBroadcaster(eventBroadcaster),
        _clientProtocolNo(-1),
        _lastSentNowPlayingID(0),
        _terminated(false),
@@ -71,6 +168,10 @@ namespace PMP::Server
 
         _extensionsThis.registerExtensionSupport({NetworkProtocolExtension::Scrobbling,
                                                   222, 2});
+        _extensionsThis.registerExtensionSupport({NetworkProtocolExtension::Compression,
+                                                  221, 1});
+        _extensionsThis.registerExtensionSupport({NetworkProtocolExtension::HashIds,
+                                                  220, 1});
 
         connect(
             _serverInterface, &ServerInterface::serverShuttingDown,
@@ -94,6 +195,8 @@ namespace PMP::Server
             }
         );
         connect(socket, &QTcpSocket::readyRead, this, &ConnectedClient::dataArrived);
+        connect(socket, &QTcpSocket::bytesWritten,
+                this, &ConnectedClient::onSocketBytesWritten);
         connect(socket, &QTcpSocket::errorOccurred, this, &ConnectedClient::socketError);
 
         /* Send greeting.
@@ -118,6 +221,14 @@ namespace PMP::Server
         if (_terminated) return;
         qDebug() << " will terminate and clean up connection now";
         _terminated = true;
+
+        /* whatever is still waiting to be sent should not be lost */
+        if (!_outputBuffer.isEmpty() && _socket->isValid())
+            _socket->write(_outputBuffer);
+
+        _outputBuffer.clear();
+        _stateMessagesPending.clear();
+
         _socket->close();
         _textReadBuffer.clear();
         this->deleteLater();
@@ -134,8 +245,6 @@ namespace PMP::Server
 
         _eventsEnabled = true;
 
-        auto queue = &_player->queue();
-
         connect(_player, &Player::volumeChanged, this, &ConnectedClient::volumeChanged);
         connect(
             _player, &Player::stateChanged,
@@ -146,7 +255,7 @@ namespace PMP::Server
             this, &ConnectedClient::currentTrackChanged
         );
         connect(
-            _player, &Player::newHistoryEntry,
+            _eventBroadcaster, &ClientEventBroadcaster::newHistoryEntry,
             this, &ConnectedClient::newHistoryEntry
         );
         connect(
@@ -182,7 +291,7 @@ namespace PMP::Server
         );
 
         connect(
-            queue, &PlayerQueue::entryRemoved,
+            _eventBroadcaster, &ClientEventBroadcaster::queueEntryRemoved,
             this, &ConnectedClient::queueEntryRemoved
         );
         connect(
@@ -194,16 +303,16 @@ namespace PMP::Server
             this, &ConnectedClient::queueEntryAddedWithReference
         );
         connect(
-            queue, &PlayerQueue::entryMoved,
+            _eventBroadcaster, &ClientEventBroadcaster::queueEntryMoved,
             this, &ConnectedClient::queueEntryMoved
         );
 
         connect(
-            _collectionMonitor, &CollectionMonitor::hashAvailabilityChanged,
+            _eventBroadcaster, &ClientEventBroadcaster::hashAvailabilityChanged,
             this, &ConnectedClient::onHashAvailabilityChanged
         );
         connect(
-            _collectionMonitor, &CollectionMonitor::hashInfoChanged,
+            _eventBroadcaster, &ClientEventBroadcaster::hashInfoChanged,
             this, &ConnectedClient::onHashInfoChanged
         );
 
@@ -571,41 +680,214 @@ namespace PMP::Server
             );
     }
 
-    void ConnectedClient::sendBinaryMessage(QByteArray const& message)
+    void ConnectedClient::appendHashIdsMessageStart(QByteArray& buffer,
+                                        HashIdsServerMessageType messageType) const
+    {
+        auto type = static_cast<quint8>(messageType);
+
+        buffer +=
+            NetworkProtocolExtensionMessages::generateExtensionMessageStart(
+                NetworkProtocolExtension::HashIds, _extensionsThis, type
+            );
+    }
+
+    qint64 ConnectedClient::bytesWaitingToBeSent() const
+    {
+        return _socket->bytesToWrite() + _outputBuffer.size();
+    }
+
+    void ConnectedClient::sendBinaryMessage(QByteArray const& message,
+                                            OutputMessageKind kind)
+    {
+        if (!canSendBinaryMessage(message))
+            return;
+
+        /* broadcast messages are compressed only once, in sendBroadcastMessage */
+        auto compressed = compressMessageIfWorthwhile(message);
+        auto const& messageToSend = compressed.isEmpty() ? message : compressed;
+
+        queueBinaryMessage(messageToSend, kind);
+    }
+
+    bool ConnectedClient::canSendBinaryMessage(QByteArray const& message) const
     {
         if (!_socket->isValid())
         {
             qWarning() << "cannot send binary message when socket not in valid state";
-            return;
+            return false;
         }
 
         if (_terminated)
         {
             qWarning() << "cannot send binary message because connection is terminated";
-            return;
+            return false;
         }
 
         if (!_binaryMode)
         {
             qWarning() << "cannot send binary message when not in binary mode";
-            return; /* only supported in binary mode */
+            return false; /* only supported in binary mode */
         }
 
         auto messageLength = message.length();
         if (messageLength > std::numeric_limits<qint32>::max() - 1)
         {
             qWarning() << "Message too long for sending; length:" << messageLength;
+            return false;
+        }
+
+        return true;
+    }
+
+    void ConnectedClient::queueBinaryMessage(QByteArray const& message,
+                                             OutputMessageKind kind)
+    {
+        if (kind != OutputMessageKind::Regular && isOutputCongested())
+        {
+            /* replaces the previous message of this kind if that one is still waiting */
+            _stateMessagesPending.insert(kind, message);
+            scheduleOutputFlush();
+            return;
+        }
+
+        if (kind != OutputMessageKind::Regular)
+            _stateMessagesPending.remove(kind); /* this one is newer */
+        else
+            appendPendingStateMessages(); /* they must not overtake newer messages */
+
+        appendToOutputBuffer(message);
+    }
+
+    QByteArray ConnectedClient::compressMessageIfWorthwhile(
+                                                        QByteArray const& message) const
+    {
+        if (message.length() < NetworkProtocolExtensionMessages::CompressionThreshold
+            || _extensionsOther.isNotSupported(NetworkProtocolExtension::Compression, 1))
+        {
+            return {};
+        }
+
+        return NetworkProtocolExtensionMessages::generateCompressedMessage(_extensionsThis,
+                                                                           message);
+    }
+
+    void ConnectedClient::sendBroadcastMessage(BroadcastMessage& message,
+                                               BroadcastMessage::Encoder const& encoder,
+                                               OutputMessageKind kind)
+    {
+        BroadcastMessage::ClientKind clientKind;
+        clientKind.protocolNo = _clientProtocolNo;
+        clientKind.supportsCompression =
+                _extensionsOther.isSupported(NetworkProtocolExtension::Compression, 1);
+        clientKind.supportsHashIds =
+                _extensionsOther.isSupported(NetworkProtocolExtension::HashIds, 1);
+
+        /* the compressed form is cached too, so that it is shared by all clients of the
+           same kind instead of being produced again for each of them */
+        auto encodeAndCompress =
+            [this, &encoder]() -> QVector<QByteArray>
+            {
+                auto messages = encoder();
+
+                for (auto& message : messages)
+                {
+                    auto compressed = compressMessageIfWorthwhile(message);
+                    if (!compressed.isEmpty())
+                        message = compressed;
+                }
+
+                return messages;
+            };
+
+        const auto encodedMessages = message.encodedFor(clientKind, encodeAndCompress);
+
+        for (auto const& encodedMessage : encodedMessages)
+        {
+            if (!canSendBinaryMessage(encodedMessage))
+                return;
+
+            queueBinaryMessage(encodedMessage, kind);
+        }
+    }
+
+    void ConnectedClient::appendToOutputBuffer(QByteArray const& message)
+    {
+        if (bytesWaitingToBeSent() + message.length() > outputHardLimit)
+        {
+            qWarning() << "client is not receiving its output; more than"
+                       << outputHardLimit << "bytes waiting; disconnecting";
+            _outputBuffer.clear(); /* no point in trying to send all of that */
+            terminateConnection();
             return;
         }
 
-        QByteArray lengthBytes;
-        NetworkUtil::append4BytesSigned(lengthBytes, messageLength);
+        NetworkUtil::append4BytesSigned(_outputBuffer, message.length());
+        _outputBuffer += message;
+
+        scheduleOutputFlush();
+    }
+
+    void ConnectedClient::appendPendingStateMessages()
+    {
+        /* Pending state messages are older than anything that is sent after them, so
+           they go into the output buffer before a newer regular message.  Only state
+           messages that follow each other without a regular message in between get
+           replaced by the newest one. */
+        for (auto const& stateMessage : qAsConst(_stateMessagesPending))
+        {
+            NetworkUtil::append4BytesSigned(_outputBuffer, stateMessage.length());
+            _outputBuffer += stateMessage;
+        }
+
+        _stateMessagesPending.clear();
+    }
+
+    void ConnectedClient::scheduleOutputFlush()
+    {
+        if (_outputFlushScheduled)
+            return;
+
+        /* everything that is sent during the current event loop iteration will be
+           written to the socket at once */
+        _outputFlushScheduled = true;
+        QTimer::singleShot(0, this, &ConnectedClient::flushOutput);
+    }
+
+    bool ConnectedClient::isOutputCongested() const
+    {
+        return _socket->bytesToWrite() >= outputHighWaterMark;
+    }
+
+    void ConnectedClient::flushOutput()
+    {
+        _outputFlushScheduled = false;
+
+        if (_terminated || !_socket->isValid())
+            return;
+
+        /* wait for the socket to drain; 'bytesWritten' will make us try again */
+        if (isOutputCongested())
+            return;
 
-        _socket->write(lengthBytes);
-        _socket->write(message);
+        appendPendingStateMessages();
+
+        if (_outputBuffer.isEmpty())
+            return;
+
+        _socket->write(_outputBuffer);
+        _outputBuffer.clear();
         _socket->flush();
     }
 
+    void ConnectedClient::onSocketBytesWritten()
+    {
+        if (_outputBuffer.isEmpty() && _stateMessagesPending.isEmpty())
+            return;
+
+        if (!isOutputCongested())
+            scheduleOutputFlush();
+    }
+
     void ConnectedClient::sendKeepAliveReply(quint8 blob)
     {
         QByteArray message;
@@ -640,6 +922,22 @@ namespace PMP::Server
 
         auto playerStateOverview = _serverInterface->getPlayerStateOverview();
 
+        auto message = _eventBroadcaster->playerStateMessage(playerStateOverview);
+        sendBroadcastMessage(
+            *message,
+            [this, playerStateOverview]() -> QVector<QByteArray>
+            {
+                return { createPlayerStateMessage(playerStateOverview) };
+            },
+            OutputMessageKind::PlayerState
+        );
+
+        _lastSentNowPlayingID = playerStateOverview.nowPlayingQueueId;
+    }
+
+    QByteArray ConnectedClient::createPlayerStateMessage(
+                                        PlayerStateOverview const& playerStateOverview) const
+    {
         quint8 stateNum = 0;
         switch (playerStateOverview.playerState)
         {
@@ -666,9 +964,7 @@ namespace PMP::Server
         NetworkUtil::append4Bytes(message, playerStateOverview.nowPlayingQueueId);
         NetworkUtil::append8Bytes(message, playerStateOverview.trackPosition);
 
-        sendBinaryMessage(message);
-
-        _lastSentNowPlayingID = playerStateOverview.nowPlayingQueueId;
+        return message;
     }
 
     void ConnectedClient::sendVolumeMessage()
@@ -686,7 +982,7 @@ namespace PMP::Server
         NetworkProtocol::append2Bytes(message, ServerMessageType::VolumeChangedMessage);
         NetworkUtil::appendByte(message, volume);
 
-        sendBinaryMessage(message);
+        sendBinaryMessage(message, OutputMessageKind::Volume);
     }
 
     void ConnectedClient::sendDynamicModeStatusMessage(StartStopEventStatus enabledStatus,
@@ -984,6 +1280,15 @@ namespace PMP::Server
             return;
         }
 
+        if (_extensionsOther.isSupported(NetworkProtocolExtension::HashIds, 1))
+        {
+            stats = sendHashUserDataMessageUsingHashIds(userId, stats);
+            if (stats.isEmpty())
+                return;
+
+            /* send the remaining ones, that have no ID, in the regular format */
+        }
+
         qint16 fields = 1 /* previously heard */ | 2 /* score */;
         fields &=
             NetworkProtocol::getHashUserDataFieldsMaskForProtocolVersion(
@@ -1027,6 +1332,136 @@ namespace PMP::Server
         sendBinaryMessage(message);
     }
 
+    QVector<HashStats> ConnectedClient::sendHashUserDataMessageUsingHashIds(
+                                                            quint32 userId,
+                                                            QVector<HashStats> const& stats)
+    {
+        QVector<FileHash> hashes;
+        hashes.reserve(stats.size());
+        for (auto const& stat : stats)
+            hashes.append(stat.hash());
+
+        auto ids = getHashIdsForClient(hashes);
+        if (ids.isEmpty())
+            return stats;
+
+        sendHashDefinitionsIfNeeded(ids);
+
+        const quint16 fields = 1 /* previously heard */ | 2 /* score */;
+
+        QByteArray message;
+        message.reserve(2 + 2 + 2 + 4 + ids.size() * (4 + 8 + 2));
+        appendHashIdsMessageStart(message, HashIdsServerMessageType::HashUserDataMessage);
+        NetworkUtil::append2Bytes(message, static_cast<quint16>(ids.size()));
+        NetworkUtil::append2Bytes(message, fields);
+        NetworkUtil::append4Bytes(message, userId);
+
+        QVector<HashStats> statsWithoutId;
+        int statIndex = 0;
+        for (auto const& idAndHash : qAsConst(ids))
+        {
+            while (statIndex < stats.size() && stats[statIndex].hash() != idAndHash.second)
+                statsWithoutId.append(stats[statIndex++]);
+
+            auto const& trackStats = stats[statIndex++].stats();
+
+            NetworkUtil::append4Bytes(message, idAndHash.first);
+            NetworkUtil::append8ByteMaybeEmptyQDateTimeMsSinceEpoch(
+                message, trackStats.lastHeard()
+            );
+            NetworkUtil::append2Bytes(message, static_cast<quint16>(trackStats.score()));
+        }
+
+        while (statIndex < stats.size())
+            statsWithoutId.append(stats[statIndex++]);
+
+        qDebug() << "sending user track data for" << ids.size()
+                 << "hashes using hash IDs; user:" << userId;
+
+        sendBinaryMessage(message);
+        return statsWithoutId;
+    }
+
+    QVector<QPair<uint, FileHash>> ConnectedClient::getHashIdsForClient(
+                                                    QVector<FileHash> const& hashes) const
+    {
+        if (_extensionsOther.isNotSupported(NetworkProtocolExtension::HashIds, 1))
+            return {};
+
+        /* the IDs come back in the same order, but hashes without ID are skipped */
+        auto ids = _player->resolver().getIDs(hashes);
+
+        /* a hash that has not been registered in the database yet has ID zero; we have
+           to send the full hash for those */
+        QVector<QPair<uint, FileHash>> result;
+        result.reserve(ids.size());
+        for (auto const& idAndHash : qAsConst(ids))
+        {
+            if (idAndHash.first != 0)
+                result.append(idAndHash);
+        }
+
+        return result;
+    }
+
+    void ConnectedClient::sendHashDefinitionsIfNeeded(
+                                               QVector<QPair<uint, FileHash>> const& ids)
+    {
+        QVector<QPair<uint, FileHash>> newDefinitions;
+
+        for (auto const& idAndHash : ids)
+        {
+            if (_hashIdsKnownByClient.contains(idAndHash.first))
+                continue;
+
+            _hashIdsKnownByClient.insert(idAndHash.first);
+            newDefinitions.append(idAndHash);
+        }
+
+        const int maxBatchSize = 5000;
+
+        for (int start = 0; start < newDefinitions.size(); start += maxBatchSize)
+        {
+            int count = qMin(maxBatchSize, newDefinitions.size() - start);
+
+            QByteArray message;
+            message.reserve(2 + 2 + 4 + count * (4 + NetworkProtocol::FILEHASH_BYTECOUNT));
+            appendHashIdsMessageStart(message,
+                                      HashIdsServerMessageType::HashDefinitionsMessage);
+            NetworkUtil::append2Bytes(message, 0); /* filler */
+            NetworkUtil::append4Bytes(message, static_cast<quint32>(count));
+
+            for (int i = start; i < start + count; ++i)
+            {
+                auto const& idAndHash = newDefinitions[i];
+                NetworkUtil::append4Bytes(message, idAndHash.first);
+                NetworkProtocol::appendHash(message, idAndHash.second);
+            }
+
+            sendBinaryMessage(message);
+        }
+    }
+
+    void ConnectedClient::sendCollectionFetchCompletionMessage(uint clientReference,
+                                                               bool isFullCollection,
+                                                               QUuid journalId,
+                                                               quint64 journalVersion)
+    {
+        quint8 flags = isFullCollection ? 1 : 0;
+
+        QByteArray message;
+        message.reserve(2 + 2 + 4 + 16 + 8);
+        NetworkProtocol::append2Bytes(message,
+                                      ServerMessageType::CollectionFetchCompletionMessage);
+        NetworkUtil::appendByte(message, 0); // filler
+        NetworkUtil::appendByte(message, flags);
+        NetworkUtil::append4Bytes(message, clientReference);
+        message.append(journalId.toRfc4122());
+        NetworkUtil::append8Bytes(message, journalVersion);
+
+        sendBinaryMessage(message);
+    }
+
     void ConnectedClient::sendHashInfoReply(uint clientReference,
                                             CollectionTrackInfo info)
     {
@@ -1068,7 +1503,8 @@ namespace PMP::Server
         sendBinaryMessage(message);
     }
 
-    void ConnectedClient::sendQueueEntryRemovedMessage(qint32 offset, quint32 queueID)
+    QByteArray ConnectedClient::createQueueEntryRemovedMessage(qint32 offset,
+                                                               quint32 queueID) const
     {
         QByteArray message;
         message.reserve(10);
@@ -1077,7 +1513,7 @@ namespace PMP::Server
         NetworkUtil::append4Bytes(message, offset);
         NetworkUtil::append4Bytes(message, queueID);
 
-        sendBinaryMessage(message);
+        return message;
     }
 
     void ConnectedClient::sendQueueEntryAddedMessage(qint32 offset, quint32 queueID)
@@ -1106,8 +1542,9 @@ namespace PMP::Server
         sendBinaryMessage(message);
     }
 
-    void ConnectedClient::sendQueueEntryMovedMessage(qint32 fromOffset, qint32 toOffset,
-                                                     quint32 queueID)
+    QByteArray ConnectedClient::createQueueEntryMovedMessage(qint32 fromOffset,
+                                                             qint32 toOffset,
+                                                             quint32 queueID) const
     {
         QByteArray message;
         message.reserve(14);
@@ -1116,7 +1553,7 @@ namespace PMP::Server
         NetworkUtil::append4Bytes(message, toOffset);
         NetworkUtil::append4Bytes(message, queueID);
 
-        sendBinaryMessage(message);
+        return message;
     }
 
     quint16 ConnectedClient::createTrackStatusFor(QSharedPointer<QueueEntry> entry)
@@ -1380,30 +1817,48 @@ namespace PMP::Server
         sendTrackInfoBatchMessage(clientReference, false, tracks);
     }
 
-    void ConnectedClient::sendTrackAvailabilityBatchMessage(QVector<FileHash> available,
-                                                            QVector<FileHash> unavailable)
+    QVector<QByteArray> ConnectedClient::createTrackAvailabilityBatchMessages(
+                                                     QVector<FileHash> available,
+                                                     QVector<FileHash> unavailable) const
     {
         if (_clientProtocolNo < 11) /* only send this if the client will understand */
-            return;
+            return {};
 
         const int maxSize = (1 << 16) - 1;
 
         /* not too big? */
         if (available.size() > maxSize)
         {
-            /* TODO: maybe delay the second part? */
-            sendTrackAvailabilityBatchMessage(available.mid(0, maxSize), unavailable);
-            sendTrackAvailabilityBatchMessage(available.mid(maxSize), unavailable);
-            return;
+            return
+                createTrackAvailabilityBatchMessages(available.mid(0, maxSize), {})
+                + createTrackAvailabilityBatchMessages(available.mid(maxSize),
+                                                       unavailable);
         }
         if (unavailable.size() > maxSize)
         {
-            /* TODO: maybe delay the second part? */
-            sendTrackAvailabilityBatchMessage(available, unavailable.mid(0, maxSize));
-            sendTrackAvailabilityBatchMessage(available, unavailable.mid(maxSize));
-            return;
+            return
+                createTrackAvailabilityBatchMessages(available,
+                                                     unavailable.mid(0, maxSize))
+                + createTrackAvailabilityBatchMessages({}, unavailable.mid(maxSize));
+        }
+
+        auto availableIds = getHashIdsForClient(available);
+        auto unavailableIds = getHashIdsForClient(unavailable);
+        if (!availableIds.isEmpty() || !unavailableIds.isEmpty())
+        {
+            /* the hashes without ID will be sent using the regular message */
+            return
+                QVector<QByteArray> {
+                    createHashIdsAvailabilityMessage(availableIds, unavailableIds)
+                }
+                + createTrackAvailabilityBatchMessages(
+                                        getHashesWithoutId(available, availableIds),
+                                        getHashesWithoutId(unavailable, unavailableIds));
         }
 
+        if (available.isEmpty() && unavailable.isEmpty())
+            return {};
+
         qDebug() << "sending track availability notification batch message;"
                  << "available count:" << available.size()
                  << "unavailable count:" << unavailable.size();
@@ -1429,24 +1884,107 @@ namespace PMP::Server
             NetworkProtocol::appendHash(message, unavailable[i]);
         }
 
-        sendBinaryMessage(message);
+        return { message };
+    }
+
+    QByteArray ConnectedClient::createHashIdsAvailabilityMessage(
+                                  QVector<QPair<uint, FileHash>> const& available,
+                                  QVector<QPair<uint, FileHash>> const& unavailable) const
+    {
+        qDebug() << "sending track availability notification batch message using hash"
+                 << "IDs; available count:" << available.size()
+                 << "unavailable count:" << unavailable.size();
+
+        QByteArray message;
+        message.reserve(2 + 2 + 4 + 4 * (available.size() + unavailable.size()));
+
+        appendHashIdsMessageStart(
+                  message, HashIdsServerMessageType::TrackAvailabilityChangeBatchMessage);
+        NetworkUtil::append2Bytes(message, 0) /* filler */;
+        NetworkUtil::append2Bytes(message, available.size());
+        NetworkUtil::append2Bytes(message, unavailable.size());
+
+        for (auto const& idAndHash : available)
+            NetworkUtil::append4Bytes(message, idAndHash.first);
+
+        for (auto const& idAndHash : unavailable)
+            NetworkUtil::append4Bytes(message, idAndHash.first);
+
+        return message;
     }
 
     void ConnectedClient::sendTrackInfoBatchMessage(uint clientReference,
                                                     bool isNotification,
                                                     QVector<CollectionTrackInfo> tracks)
+    {
+        sendHashDefinitionsIfNeeded(getHashIdsForClient(getHashes(tracks)));
+
+        const auto messages =
+            createTrackInfoBatchMessages(clientReference, isNotification, tracks);
+
+        for (auto const& message : messages)
+            sendBinaryMessage(message);
+    }
+
+    QVector<QByteArray> ConnectedClient::createTrackInfoBatchMessages(
+                                            uint clientReference, bool isNotification,
+                                            QVector<CollectionTrackInfo> tracks) const
     {
         const int maxSize = (1 << 16) - 1;
 
         /* not too big? */
         if (tracks.size() > maxSize)
         {
-            /* TODO: maybe delay the second part? */
-            sendTrackInfoBatchMessage(clientReference, isNotification,
-                                      tracks.mid(0, maxSize));
-            sendTrackInfoBatchMessage(clientReference, isNotification,
-                                      tracks.mid(maxSize));
-            return;
+            return
+                createTrackInfoBatchMessages(clientReference, isNotification,
+                                             tracks.mid(0, maxSize))
+                + createTrackInfoBatchMessages(clientReference, isNotification,
+                                               tracks.mid(maxSize));
+        }
+
+        auto ids = getHashIdsForClient(getHashes(tracks));
+        if (!ids.isEmpty())
+        {
+            QHash<FileHash, uint> idsByHash;
+            idsByHash.reserve(ids.size());
+            for (auto const& idAndHash : qAsConst(ids))
+                idsByHash.insert(idAndHash.second, idAndHash.first);
+
+            QVector<uint> idsOfTracksWithId;
+            idsOfTracksWithId.reserve(ids.size());
+            QVector<CollectionTrackInfo> tracksWithId;
+            tracksWithId.reserve(ids.size());
+            QVector<CollectionTrackInfo> tracksWithoutId;
+
+            for (auto const& track : qAsConst(tracks))
+            {
+                auto id = idsByHash.value(track.hash(), 0);
+                if (id != 0)
+                {
+                    idsOfTracksWithId.append(id);
+                    tracksWithId.append(track);
+                }
+                else
+                {
+                    tracksWithoutId.append(track);
+                }
+            }
+
+            auto messages =
+                QVector<QByteArray> {
+                    createHashIdsTrackInfoMessage(clientReference, isNotification,
+                                                  idsOfTracksWithId, tracksWithId)
+                };
+
+            /* the tracks without ID will be sent using the regular message */
+            if (!tracksWithoutId.isEmpty())
+            {
+                messages +=
+                    createTrackInfoBatchMessages(clientReference, isNotification,
+                                                 tracksWithoutId);
+            }
+
+            return messages;
         }
 
         bool withAlbumAndTrackLength = _clientProtocolNo >= 7;
@@ -1472,57 +2010,48 @@ namespace PMP::Server
             NetworkUtil::append4Bytes(message, clientReference);
         }
 
-        for (int i = 0; i < tracks.size(); ++i)
+        for (auto const& track : qAsConst(tracks))
         {
-            const CollectionTrackInfo& track = tracks[i];
+            NetworkProtocol::appendHash(message, track.hash());
+            appendTrackInfoWithoutHash(message, track, withAlbumAndTrackLength,
+                                       withAlbumArtist);
+        }
 
-            QString title = track.title();
-            QString artist = track.artist();
-            QString album = track.album();
-            QString albumArtist = track.albumArtist();
+        return { message };
+    }
 
-            /* worst case: 4 bytes in UTF-8 for each char */
-            title.truncate(maxSize / 4);
-            artist.truncate(maxSize / 4);
-            album.truncate(maxSize / 4);
-            albumArtist.truncate(maxSize / 4);
+    QByteArray ConnectedClient::createHashIdsTrackInfoMessage(uint clientReference,
+                                        bool isNotification,
+                                        QVector<uint> const& ids,
+                                        QVector<CollectionTrackInfo> const& tracks) const
+    {
+        qDebug() << "sending track info batch message using hash IDs; count:"
+                 << tracks.size() << "; notification:" << isNotification;
 
-            QByteArray titleData = title.toUtf8();
-            QByteArray artistData = artist.toUtf8();
-            QByteArray albumData = album.toUtf8();
-            QByteArray albumArtistData = albumArtist.toUtf8();
+        /* estimate how much bytes we will need and reserve that memory in the buffer */
+        const int bytesEstimatedPerTrack = 4 + 1 + 2 + 2 + 2 + 2 + 4 + 20 + 15 + 15 + 15;
 
-            NetworkProtocol::appendHash(message, track.hash());
-            NetworkUtil::appendByte(message, track.isAvailable() ? 1 : 0);
-            NetworkUtil::append2Bytes(message, (uint)titleData.size());
-            NetworkUtil::append2Bytes(message, (uint)artistData.size());
-            if (withAlbumAndTrackLength)
-            {
-                NetworkUtil::append2Bytes(message, (uint)albumData.size());
-                if (withAlbumArtist)
-                {
-                    NetworkUtil::append2Bytes(message, (uint)albumArtistData.size());
-                }
-                NetworkUtil::append4BytesSigned(message, track.lengthInMilliseconds());
-            }
+        QByteArray message;
+        message.reserve(2 + 1 + 1 + 2 + 4 + tracks.size() * bytesEstimatedPerTrack);
 
-            message += titleData;
-            message += artistData;
-            if (withAlbumAndTrackLength)
-            {
-                message += albumData;
-                if (withAlbumArtist)
-                {
-                    message += albumArtistData;
-                }
-            }
+        appendHashIdsMessageStart(message,
+                                  HashIdsServerMessageType::TrackInfoBatchMessage);
+        NetworkUtil::appendByte(message, isNotification ? 1 : 0); /* flags */
+        NetworkUtil::appendByte(message, 0); /* filler */
+        NetworkUtil::append2Bytes(message, tracks.size());
+        NetworkUtil::append4Bytes(message, isNotification ? 0 : clientReference);
+
+        for (int i = 0; i < tracks.size(); ++i)
+        {
+            NetworkUtil::append4Bytes(message, ids[i]);
+            appendTrackInfoWithoutHash(message, tracks[i], true, true);
         }
 
-        sendBinaryMessage(message);
+        return message;
     }
 
-    void ConnectedClient::sendNewHistoryEntryMessage(
-        QSharedPointer<RecentHistoryEntry> entry)
+    QByteArray ConnectedClient::createNewHistoryEntryMessage(
+        QSharedPointer<RecentHistoryEntry> entry) const
     {
         QByteArray message;
         message.reserve(2 + 2 + 4 + 4 + 8 + 8 + 2 + 2);
@@ -1538,7 +2067,7 @@ namespace PMP::Server
         NetworkUtil::append2BytesSigned(message, entry->permillage());
         NetworkUtil::append2Bytes(message, status);
 
-        sendBinaryMessage(message);
+        return message;
     }
 
     void ConnectedClient::onScrobblingProviderInfo(ScrobblingProvider provider,
@@ -1563,14 +2092,29 @@ namespace PMP::Server
     }
 
     void ConnectedClient::onHashAvailabilityChanged(QVector<FileHash> available,
-                                                    QVector<FileHash> unavailable)
+                                                    QVector<FileHash> unavailable,
+                                                    BroadcastMessagePtr message)
     {
-        sendTrackAvailabilityBatchMessage(available, unavailable);
+        sendHashDefinitionsIfNeeded(getHashIdsForClient(available + unavailable));
+
+        sendBroadcastMessage(
+            *message,
+            [this, available, unavailable]()
+            {
+                return createTrackAvailabilityBatchMessages(available, unavailable);
+            }
+        );
     }
 
-    void ConnectedClient::onHashInfoChanged(QVector<CollectionTrackInfo> changes)
+    void ConnectedClient::onHashInfoChanged(QVector<CollectionTrackInfo> changes,
+                                            BroadcastMessagePtr message)
     {
-        sendTrackInfoBatchMessage(0, true, changes);
+        sendHashDefinitionsIfNeeded(getHashIdsForClient(getHashes(changes)));
+
+        sendBroadcastMessage(
+            *message,
+            [this, changes]() { return createTrackInfoBatchMessages(0, true, changes); }
+        );
     }
 
     void ConnectedClient::onCollectionTrackInfoCompleted(uint clientReference)
@@ -2045,10 +2589,19 @@ namespace PMP::Server
         );
     }
 
-    void ConnectedClient::newHistoryEntry(QSharedPointer<RecentHistoryEntry> entry)
+    void ConnectedClient::newHistoryEntry(QSharedPointer<RecentHistoryEntry> entry,
+                                          BroadcastMessagePtr message)
     {
-        if (_binaryMode)
-            sendNewHistoryEntryMessage(entry);
+        if (!_binaryMode)
+            return;
+
+        sendBroadcastMessage(
+            *message,
+            [this, entry]() -> QVector<QByteArray>
+            {
+                return { createNewHistoryEntryMessage(entry) };
+            }
+        );
     }
 
     void ConnectedClient::trackPositionChanged(qint64 position)
@@ -2133,9 +2686,17 @@ namespace PMP::Server
         QTimer::singleShot(25, this, &ConnectedClient::sendStateInfoAfterTimeout);
     }
 
-    void ConnectedClient::queueEntryRemoved(qint32 offset, quint32 queueID)
+    void ConnectedClient::queueEntryRemoved(qint32 offset, quint32 queueID,
+                                            BroadcastMessagePtr message)
     {
-        sendQueueEntryRemovedMessage(offset, queueID);
+        sendBroadcastMessage(
+            *message,
+            [this, offset, queueID]() -> QVector<QByteArray>
+            {
+                return { createQueueEntryRemovedMessage(offset, queueID) };
+            }
+        );
+
         schedulePlayerStateNotification(); /* queue length changed, notify after delay */
     }
 
@@ -2161,41 +2722,41 @@ namespace PMP::Server
         schedulePlayerStateNotification(); /* queue length changed, notify after delay */
     }
 
-    void ConnectedClient::queueEntryMoved(quint32 fromOffset, quint32 toOffset,
-                                          quint32 queueID)
+    void ConnectedClient::queueEntryMoved(qint32 fromOffset, qint32 toOffset,
+                                          quint32 queueID, BroadcastMessagePtr message)
     {
-        sendQueueEntryMovedMessage(fromOffset, toOffset, queueID);
+        sendBroadcastMessage(
+            *message,
+            [this, fromOffset, toOffset, queueID]() -> QVector<QByteArray>
+            {
+                return { createQueueEntryMovedMessage(fromOffset, toOffset, queueID) };
+            }
+        );
     }
 
     void ConnectedClient::readBinaryCommands()
     {
-        char lengthBytes[4];
+        _frameReader.readFrom(*_socket);
 
-        while
-            (_socket->isOpen()
-            && _socket->peek(lengthBytes, sizeof(lengthBytes)) == sizeof(lengthBytes))
+        BinaryFrame frame;
+        while (_socket->isOpen() && _frameReader.nextFrame(frame))
         {
-            quint32 messageLength = NetworkUtil::get4Bytes(lengthBytes);
-
-            if (_socket->bytesAvailable() - sizeof(lengthBytes) < messageLength)
-            {
-                qDebug() << "ConnectedClient: waiting for incoming message with length"
-                         << messageLength << " --- only partially received";
-                break; /* message not complete yet */
-            }
+            auto const& message = frame.message();
 
-            if (messageLength > 100 * 1024)
+            if (message.size() > 100 * 1024)
             {
                 qDebug() << "ConnectedClient: received message larger than 100 kB";
             }
 
-            //qDebug() << "received complete binary message with length" << messageLength;
-
-            _socket->read(lengthBytes, sizeof(lengthBytes)); /* consume the length */
-            QByteArray message = _socket->read(messageLength);
-
             handleBinaryMessage(message);
         }
+
+        quint32 messageLength;
+        if (_frameReader.waitingForIncompleteFrame(messageLength))
+        {
+            qDebug() << "ConnectedClient: waiting for incoming message with length"
+                     << messageLength << " --- only partially received";
+        }
     }
 
     void ConnectedClient::handleBinaryMessage(QByteArray const& message)
@@ -2284,6 +2845,9 @@ namespace PMP::Server
         case ClientMessageType::CollectionFetchRequestMessage:
             parseCollectionFetchRequestMessage(message);
             return;
+        case ClientMessageType::CollectionChangesFetchRequestMessage:
+            parseCollectionChangesFetchRequestMessage(message);
+            return;
         case ClientMessageType::AddHashToEndOfQueueRequestMessage:
         case ClientMessageType::AddHashToFrontOfQueueRequestMessage:
             parseAddHashToQueueRequest(message, messageType);
@@ -2291,6 +2855,9 @@ namespace PMP::Server
         case ClientMessageType::HashUserDataRequestMessage:
             parseHashUserDataRequest(message);
             return;
+        case ClientMessageType::UserDataForAllHashesRequestMessage:
+            parseUserDataForAllHashesRequest(message);
+            return;
         case ClientMessageType::HashInfoRequest:
             parseHashInfoRequest(message);
             return;
@@ -2337,6 +2904,16 @@ namespace PMP::Server
         //    }
         //}
 
+        if (extension == NetworkProtocolExtension::Compression)
+        {
+            switch (static_cast<CompressionMessageType>(messageType))
+            {
+            case CompressionMessageType::CompressedMessage:
+                parseCompressedMessage(message);
+                return;
+            }
+        }
+
         if (extension == NetworkProtocolExtension::Scrobbling)
         {
             switch (static_cast<ScrobblingClientMessageType>(messageType))
@@ -2359,6 +2936,29 @@ namespace PMP::Server
                    << "; extension: " << toString(extension);
     }
 
+    void ConnectedClient::parseCompressedMessage(QByteArray const& message)
+    {
+        /* don't let an anonymous connection make us allocate a large buffer */
+        if (!isLoggedIn())
+        {
+            qWarning() << "received compressed message before login; length:"
+                       << message.length();
+            return;
+        }
+
+        auto decompressed =
+            NetworkProtocolExtensionMessages::decompressMessage(message,
+                                                                quint32(outputHardLimit));
+        if (decompressed == null)
+        {
+            qWarning() << "received invalid compressed message; length:"
+                       << message.length();
+            return; /* invalid message */
+        }
+
+        handleBinaryMessage(decompressed.value());
+    }
+
     void ConnectedClient::parseKeepAliveMessage(const QByteArray& message)
     {
         if (message.length() != 4)
@@ -2924,12 +3524,12 @@ namespace PMP::Server
 
         if (!isLoggedIn()) { return; /* client needs to be authenticated for this */ }
 
-        quint16 fields = NetworkUtil::get2Bytes(message, 2);
-        quint32 userId = NetworkUtil::get4Bytes(message, 4);
+        BinaryCursor cursor(message, 2);
+        quint16 fields = cursor.read2Bytes();
+        quint32 userId = cursor.read4Bytes();
 
-        int offset = 2 + 2 + 4;
-        int hashCount = (message.length() - offset) / NetworkProtocol::FILEHASH_BYTECOUNT;
-        if ((message.length() - offset) % NetworkProtocol::FILEHASH_BYTECOUNT != 0)
+        int hashCount = cursor.remaining() / NetworkProtocol::FILEHASH_BYTECOUNT;
+        if (cursor.remaining() % NetworkProtocol::FILEHASH_BYTECOUNT != 0)
             return; /* invalid message */
 
         qDebug() << "received request for user track data; user:" << userId
@@ -2945,16 +3545,59 @@ namespace PMP::Server
         for (int i = 0; i < hashCount; ++i)
         {
             bool ok;
-            auto hash = NetworkProtocol::getHash(message, offset, &ok);
+            auto hash = NetworkProtocol::getHash(message, cursor.position(), &ok);
+            cursor.skip(NetworkProtocol::FILEHASH_BYTECOUNT);
             if (!ok || hash.isNull()) continue;
 
             hashes.append(hash);
-            offset += NetworkProtocol::FILEHASH_BYTECOUNT;
         }
 
         _serverInterface->requestHashUserData(userId, hashes);
     }
 
+    void ConnectedClient::parseUserDataForAllHashesRequest(const QByteArray& message)
+    {
+        if (message.length() != 2 + 2 + 4 + 4)
+            return; /* invalid message */
+
+        BinaryCursor cursor(message, 2);
+        quint16 fields = cursor.read2Bytes();
+        quint32 clientReference = cursor.read4Bytes();
+        quint32 userId = cursor.read4Bytes();
+
+        qDebug() << "received request for user data of all tracks; user:" << userId
+                 << " fields:" << fields << " ref:" << clientReference;
+
+        fields = fields & 3; /* filter non-supported fields */
+
+        if (fields == 0)
+        {
+            sendSuccessMessage(clientReference, 0); /* no data that we can return */
+            return;
+        }
+
+        auto future = _serverInterface->getHashUserDataForAllHashes(userId);
+        future.handleOnEventLoop(
+            this,
+            [this, clientReference, userId](
+                                        ResultOrError<QVector<HashStats>, Result> outcome)
+            {
+                if (outcome.failed())
+                {
+                    sendResultMessage(outcome.error(), clientReference);
+                    return;
+                }
+
+                /* only this client gets the data; changes that come later are sent to
+                   all clients as usual */
+                auto const stats = outcome.result();
+                sendHashUserDataMessage(userId, stats);
+
+                sendSuccessMessage(clientReference, static_cast<quint32>(stats.size()));
+            }
+        );
+    }
+
     void ConnectedClient::parseHashInfoRequest(const QByteArray& message)
     {
         if (message.length() != 8 + NetworkProtocol::FILEHASH_BYTECOUNT)
@@ -3149,6 +3792,30 @@ namespace PMP::Server
         handleCollectionFetchRequest(clientReference);
     }
 
+    void ConnectedClient::parseCollectionChangesFetchRequestMessage(
+                                                                QByteArray const& message)
+    {
+        if (message.length() != 2 + 2 + 4 + 16 + 8)
+            return; /* invalid message */
+
+        quint32 clientReference = NetworkUtil::get4Bytes(message, 4);
+        QUuid journalId = QUuid::fromRfc4122(message.mid(8, 16));
+        quint64 journalVersion = NetworkUtil::get8Bytes(message, 24);
+
+        qDebug() << "received collection changes fetch request; client ref:"
+                 << clientReference << "; journal:" << journalId
+                 << "; version:" << journalVersion;
+
+        if (!isLoggedIn())
+        {
+            /* client needs to be authenticated for this */
+            sendResultMessage(ResultMessageErrorCode::NotLoggedIn, clientReference);
+            return;
+        }
+
+        handleCollectionChangesFetchRequest(clientReference, journalId, journalVersion);
+    }
+
     void ConnectedClient::handleSingleByteAction(quint8 action)
     {
         /* actions 100-200 represent a SET VOLUME command */
@@ -3331,39 +3998,107 @@ namespace PMP::Server
     void ConnectedClient::handleCollectionFetchRequest(uint clientReference)
     {
         auto sender =
-            new CollectionSender(this, clientReference, &_player->resolver());
+            startCollectionSender(clientReference, _player->resolver().getAllHashes());
+
+        connect(sender, &CollectionSender::allSent,
+                this, &ConnectedClient::onCollectionTrackInfoCompleted);
+    }
+
+    void ConnectedClient::handleCollectionChangesFetchRequest(uint clientReference,
+                                                              QUuid journalId,
+                                                              quint64 journalVersion)
+    {
+        auto currentJournalId = _collectionMonitor->journalId();
+        auto currentVersion = _collectionMonitor->journalVersion();
+
+        /* if the client's version is from an older journal, we send everything */
+        bool incremental =
+                !journalId.isNull()
+                    && journalId == currentJournalId
+                    && journalVersion <= currentVersion;
+
+        auto hashes =
+                incremental
+                    ? _collectionMonitor->getHashesChangedSince(journalVersion)
+                    : _player->resolver().getAllHashes();
+
+        qDebug() << "sending" << (incremental ? "changes in" : "full") << "collection;"
+                 << "track count:" << hashes.size();
+
+        auto sender = startCollectionSender(clientReference, hashes);
+
+        connect(
+            sender, &CollectionSender::allSent,
+            this,
+            [this, incremental, currentJournalId, currentVersion](uint reference)
+            {
+                sendCollectionFetchCompletionMessage(reference, !incremental,
+                                                     currentJournalId, currentVersion);
+                onCollectionTrackInfoCompleted(reference);
+            }
+        );
+    }
+
+    CollectionSender* ConnectedClient::startCollectionSender(uint clientReference,
+                                                             QVector<FileHash> hashes)
+    {
+        auto sender =
+            new CollectionSender(this, _socket, clientReference, &_player->resolver(),
+                                 hashes);
 
         connect(sender, &CollectionSender::sendCollectionList,
                 this, &ConnectedClient::onCollectionTrackInfoBatchToSend);
 
-        connect(sender, &CollectionSender::allSent,
-                this, &ConnectedClient::onCollectionTrackInfoCompleted);
+        return sender;
     }
 
     /* =============================== CollectionSender =============================== */
 
-    CollectionSender::CollectionSender(ConnectedClient* connection, uint clientReference,
-                                       Resolver *resolver)
-     : QObject(connection), _clientRef(clientReference), _resolver(resolver),
-       _currentIndex(0)
+    namespace
+    {
+        /* big enough to keep the per-message overhead low, small enough to stay well
+           below the maximum number of tracks in a single message */
+        const int collectionBatchSize = 2000;
+
+        /* we only produce the next batch when the socket has less than this amount of
+           data waiting to be sent; this keeps the latency low for other messages that
+           need to be sent to the client while the collection is being transferred */
+        const qint64 collectionSendBufferLimit = 256 * 1024;
+    }
+
+    CollectionSender::CollectionSender(ConnectedClient* connection, QTcpSocket* socket,
+                                       uint clientReference, Resolver *resolver,
+                                       QVector<FileHash> hashes)
+     : QObject(connection), _connection(connection), _socket(socket),
+       _clientRef(clientReference),
+       _resolver(resolver), _hashes(hashes), _currentIndex(0), _batchScheduled(false)
     {
-        _hashes = _resolver->getAllHashes();
         qDebug() << "CollectionSender: starting.  Hash count:" << _hashes.size();
 
-        QTimer::singleShot(0, this, &CollectionSender::sendNextBatch);
+        connect(_socket, &QTcpSocket::bytesWritten,
+                this, &CollectionSender::onBytesWritten);
+
+        scheduleNextBatch();
     }
 
     void CollectionSender::sendNextBatch()
     {
+        _batchScheduled = false;
+
         if (_currentIndex >= _hashes.size())
         {
             qDebug() << "CollectionSender: all completed.  ref=" << _clientRef;
             Q_EMIT allSent(_clientRef);
+            disconnect(_socket, nullptr, this, nullptr);
+            deleteLater();
             return;
         }
 
-        int batchSize = qMin(30, _hashes.size());
-        batchSize = qMin(batchSize, _hashes.size() - _currentIndex);
+        /* wait for the socket to drain; 'bytesWritten' will wake us up again */
+        if (_connection->bytesWaitingToBeSent() >= collectionSendBufferLimit)
+            return;
+
+        int batchSize = qMin(collectionBatchSize, _hashes.size() - _currentIndex);
 
         auto batch = _hashes.mid(_currentIndex, batchSize);
         _currentIndex += batchSize;
@@ -3372,14 +4107,29 @@ namespace PMP::Server
         qDebug() << "CollectionSender: have batch of" << infoToSend.size()
                  << "to send.  ref=" << _clientRef;
 
-        /* schedule next batch already */
-        QTimer::singleShot(100, this, &CollectionSender::sendNextBatch);
-
         /* send this batch if it is not empty */
         if (!infoToSend.isEmpty())
         {
             Q_EMIT sendCollectionList(_clientRef, infoToSend);
         }
+
+        /* return to the event loop between batches, so that other messages can be
+           sent in between */
+        scheduleNextBatch();
+    }
+
+    void CollectionSender::onBytesWritten()
+    {
+        if (_connection->bytesWaitingToBeSent() < collectionSendBufferLimit)
+            scheduleNextBatch();
     }
 
+    void CollectionSender::scheduleNextBatch()
+    {
+        if (_batchScheduled)
+            return;
+
+        _batchScheduled = true;
+        QTimer::singleShot(0, this, &CollectionSender::sendNextBatch);
+    }
 }
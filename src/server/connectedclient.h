@@ -20,6 +20,7 @@
 #ifndef PMP_SERVER_CONNECTEDCLIENT_H
 #define PMP_SERVER_CONNECTEDCLIENT_H
 
+#include "common/binaryframereader.h"
 #include "common/filehash.h"
 #include "common/networkprotocol.h"
 #include "common/networkprotocolextensions.h"
@@ -27,6 +28,7 @@
 #include "common/scrobblingprovider.h"
 #include "common/startstopeventstatus.h"
 
+#include "clienteventbroadcaster.h"
 #include "collectiontrackinfo.h"
 #include "hashstats.h"
 #include "historyentry.h"
@@ -38,8 +40,12 @@
 #include <QDateTime>
 #include <QHash>
 #include <QList>
+#include <QMap>
+#include <QPair>
+#include <QSet>
 #include <QSharedPointer>
 #include <QTcpSocket>
+#include <QUuid>
 #include <QVector>
 
 namespace PMP::Server
@@ -61,13 +67,18 @@ namespace PMP::Server
         ConnectedClient(QTcpSocket* socket, ServerInterface* serverInterface,
                         Player* player, Users* users,
                         CollectionMonitor* collectionMonitor,
-                        ServerHealthMonitor* serverHealthMonitor, Scrobbling* scrobbling);
+                        ServerHealthMonitor* serverHealthMonitor, Scrobbling* scrobbling,
+                        ClientEventBroadcaster* eventBroadcaster);
 
         ~ConnectedClient();
 
+        qint64 bytesWaitingToBeSent() const;
+
     private Q_SLOTS:
         void terminateConnection();
         void dataArrived();
+        void flushOutput();
+        void onSocketBytesWritten();
         void socketError(QAbstractSocket::SocketError error);
 
         void serverHealthChanged(bool databaseUnavailable, bool sslLibrariesMissing);
@@ -87,7 +98,8 @@ namespace PMP::Server
                                           int waveTotalCount);
         void playerStateChanged(ServerPlayerState state);
         void currentTrackChanged(QSharedPointer<QueueEntry const> entry);
-        void newHistoryEntry(QSharedPointer<RecentHistoryEntry> entry);
+        void newHistoryEntry(QSharedPointer<RecentHistoryEntry> entry,
+                             BroadcastMessagePtr message);
         void trackPositionChanged(qint64 position);
         void onDelayedStartActiveChanged();
         void sendPlayerStateMessage();
@@ -97,18 +109,22 @@ namespace PMP::Server
                                           int noRepetitionSpanSeconds);
         void sendUserPlayingForModeMessage();
         void sendTextualQueueInfo();
-        void queueEntryRemoved(qint32 offset, quint32 queueID);
+        void queueEntryRemoved(qint32 offset, quint32 queueID,
+                               BroadcastMessagePtr message);
         void queueEntryAddedWithoutReference(qint32 index, quint32 queueId);
         void queueEntryAddedWithReference(qint32 index, quint32 queueId,
                                           quint32 clientReference);
-        void queueEntryMoved(quint32 fromOffset, quint32 toOffset, quint32 queueID);
+        void queueEntryMoved(qint32 fromOffset, qint32 toOffset, quint32 queueID,
+                             BroadcastMessagePtr message);
         void onUserPlayingForChanged(quint32 user);
         void onCollectionTrackInfoBatchToSend(uint clientReference,
                                               QVector<CollectionTrackInfo> tracks);
         void onCollectionTrackInfoCompleted(uint clientReference);
         void onHashAvailabilityChanged(QVector<PMP::FileHash> available,
-                                       QVector<PMP::FileHash> unavailable);
-        void onHashInfoChanged(QVector<CollectionTrackInfo> changes);
+                                       QVector<PMP::FileHash> unavailable,
+                                       BroadcastMessagePtr message);
+        void onHashInfoChanged(QVector<CollectionTrackInfo> changes,
+                               BroadcastMessagePtr message);
 
         void onScrobblingProviderInfo(ScrobblingProvider provider, ScrobblerStatus status,
                                       bool enabled);
@@ -120,6 +136,10 @@ namespace PMP::Server
     private:
         enum class GeneralOrSpecific { General, Specific };
 
+        /* messages that only contain the latest state of something; a newer message
+           of the same kind makes an older one obsolete */
+        enum class OutputMessageKind { Regular, PlayerState, Volume };
+
         void enableEvents();
         void enableHealthEvents(GeneralOrSpecific howEnabled);
 
@@ -137,7 +157,20 @@ namespace PMP::Server
         void handleBinaryModeSwitchRequest();
         void appendScrobblingMessageStart(QByteArray& buffer,
                                           ScrobblingServerMessageType messageType);
-        void sendBinaryMessage(QByteArray const& message);
+        void appendHashIdsMessageStart(QByteArray& buffer,
+                                       HashIdsServerMessageType messageType) const;
+        void sendBinaryMessage(QByteArray const& message,
+                               OutputMessageKind kind = OutputMessageKind::Regular);
+        bool canSendBinaryMessage(QByteArray const& message) const;
+        void queueBinaryMessage(QByteArray const& message, OutputMessageKind kind);
+        QByteArray compressMessageIfWorthwhile(QByteArray const& message) const;
+        void sendBroadcastMessage(BroadcastMessage& message,
+                                  BroadcastMessage::Encoder const& encoder,
+                                  OutputMessageKind kind = OutputMessageKind::Regular);
+        void appendToOutputBuffer(QByteArray const& message);
+        void appendPendingStateMessages();
+        void scheduleOutputFlush();
+        bool isOutputCongested() const;
         void sendKeepAliveReply(quint8 blob);
         void sendProtocolExtensionsMessage();
         void sendEventNotificationMessage(ServerEventCode eventCode);
@@ -150,12 +183,13 @@ namespace PMP::Server
                                             int waveDeliveredCount,
                                             int waveTotalCount);
         void sendQueueContentMessage(qint32 startOffset, quint8 length);
-        void sendQueueEntryRemovedMessage(qint32 offset, quint32 queueID);
+        QByteArray createPlayerStateMessage(PlayerStateOverview const& overview) const;
+        QByteArray createQueueEntryRemovedMessage(qint32 offset, quint32 queueID) const;
         void sendQueueEntryAddedMessage(qint32 offset, quint32 queueID);
         void sendQueueEntryAdditionConfirmationMessage(quint32 clientReference,
                                                        qint32 index, quint32 queueID);
-        void sendQueueEntryMovedMessage(qint32 fromOffset, qint32 toOffset,
-                                        quint32 queueID);
+        QByteArray createQueueEntryMovedMessage(qint32 fromOffset, qint32 toOffset,
+                                                quint32 queueID) const;
         void sendQueueEntryInfoMessage(quint32 queueID);
         void sendQueueEntryInfoMessage(QList<quint32> const& queueIDs);
         void sendQueueEntryHashMessage(QList<quint32> const& queueIDs);
@@ -181,14 +215,35 @@ namespace PMP::Server
         void sendNonFatalInternalErrorResultMessage(quint32 clientReference);
         void sendUserLoginSaltMessage(QString login, QByteArray const& userSalt,
                                       QByteArray const& sessionSalt);
-        void sendTrackAvailabilityBatchMessage(QVector<FileHash> available,
-                                               QVector<FileHash> unavailable);
+        QVector<QByteArray> createTrackAvailabilityBatchMessages(
+                                                    QVector<FileHash> available,
+                                                    QVector<FileHash> unavailable) const;
+        QByteArray createHashIdsAvailabilityMessage(
+                                 QVector<QPair<uint, FileHash>> const& available,
+                                 QVector<QPair<uint, FileHash>> const& unavailable) const;
         void sendTrackInfoBatchMessage(uint clientReference, bool isNotification,
                                        QVector<CollectionTrackInfo> tracks);
-        void sendNewHistoryEntryMessage(QSharedPointer<RecentHistoryEntry> entry);
+        QVector<QByteArray> createTrackInfoBatchMessages(uint clientReference,
+                                                 bool isNotification,
+                                                 QVector<CollectionTrackInfo> tracks) const;
+        QByteArray createHashIdsTrackInfoMessage(uint clientReference,
+                                        bool isNotification,
+                                        QVector<uint> const& ids,
+                                        QVector<CollectionTrackInfo> const& tracks) const;
+        void sendCollectionFetchCompletionMessage(uint clientReference,
+                                                  bool isFullCollection,
+                                                  QUuid journalId,
+                                                  quint64 journalVersion);
+        QByteArray createNewHistoryEntryMessage(
+                                   QSharedPointer<RecentHistoryEntry> entry) const;
         void sendQueueHistoryMessage(int limit);
         void sendHistoryFragmentMessage(uint clientReference, HistoryFragment fragment);
         void sendHashUserDataMessage(quint32 userId, QVector<HashStats> stats);
+        QVector<HashStats> sendHashUserDataMessageUsingHashIds(quint32 userId,
+                                                      QVector<HashStats> const& stats);
+        QVector<QPair<uint, FileHash>> getHashIdsForClient(
+                                                 QVector<FileHash> const& hashes) const;
+        void sendHashDefinitionsIfNeeded(QVector<QPair<uint, FileHash>> const& ids);
         void sendHashInfoReply(uint clientReference, CollectionTrackInfo info);
         void sendServerNameMessage();
         void sendServerHealthMessageIfNotEverythingOkay();
@@ -218,7 +273,12 @@ namespace PMP::Server
         void handleParameterlessAction(ParameterlessActionCode code,
                                        quint32 clientReference);
         void handleCollectionFetchRequest(uint clientReference);
+        void handleCollectionChangesFetchRequest(uint clientReference, QUuid journalId,
+                                                 quint64 journalVersion);
+        CollectionSender* startCollectionSender(uint clientReference,
+                                                QVector<FileHash> hashes);
 
+        void parseCompressedMessage(QByteArray const& message);
         void parseKeepAliveMessage(QByteArray const& message);
         void parseClientProtocolExtensionsMessage(QByteArray const& message);
         void parseSingleByteActionMessage(QByteArray const& message);
@@ -242,6 +302,7 @@ namespace PMP::Server
         void parseQueueEntryDuplicationRequest(QByteArray const& message);
         void parseQueueEntryMoveRequestMessage(QByteArray const& message);
         void parseHashUserDataRequest(QByteArray const& message);
+        void parseUserDataForAllHashesRequest(QByteArray const& message);
         void parseHashInfoRequest(QByteArray const& message);
         void parsePersonalHistoryRequest(QByteArray const& message);
         void parsePlayerHistoryRequest(QByteArray const& message);
@@ -251,6 +312,7 @@ namespace PMP::Server
         void parseScrobblingAuthenticationRequestMessage(QByteArray const& message);
         void parseGeneratorNonRepetitionChangeMessage(QByteArray const& message);
         void parseCollectionFetchRequestMessage(QByteArray const& message);
+        void parseCollectionChangesFetchRequestMessage(QByteArray const& message);
 
         void schedulePlayerStateNotification();
 
@@ -263,10 +325,15 @@ namespace PMP::Server
         CollectionMonitor* _collectionMonitor;
         ServerHealthMonitor* _serverHealthMonitor;
         Scrobbling* _scrobbling;
+        ClientEventBroadcaster* _eventBroadcaster;
         QByteArray _textReadBuffer;
+        BinaryFrameReader _frameReader;
+        QByteArray _outputBuffer;
+        QMap<OutputMessageKind, QByteArray> _stateMessagesPending;
         int _clientProtocolNo;
         NetworkProtocolExtensionSupportMap _extensionsThis;
         NetworkProtocolExtensionSupportMap _extensionsOther;
+        QSet<uint> _hashIdsKnownByClient;
         quint32 _lastSentNowPlayingID;
         QString _userAccountRegistering;
         QByteArray _saltForUserAccountRegistering;
@@ -277,14 +344,16 @@ namespace PMP::Server
         bool _eventsEnabled;
         bool _healthEventsEnabled;
         bool _pendingPlayerStatus;
+        bool _outputFlushScheduled { false };
     };
 
     class CollectionSender : public QObject
     {
         Q_OBJECT
     public:
-        CollectionSender(ConnectedClient* connection, uint clientReference,
-                         Resolver* resolver);
+        CollectionSender(ConnectedClient* connection, QTcpSocket* socket,
+                         uint clientReference, Resolver* resolver,
+                         QVector<FileHash> hashes);
 
     Q_SIGNALS:
         void sendCollectionList(uint clientReference,
@@ -293,12 +362,18 @@ namespace PMP::Server
 
     private Q_SLOTS:
         void sendNextBatch();
+        void onBytesWritten();
 
     private:
+        void scheduleNextBatch();
+
+        ConnectedClient* _connection;
+        QTcpSocket* _socket;
         uint _clientRef;
         Resolver* _resolver;
         QVector<FileHash> _hashes;
         int _currentIndex;
+        bool _batchScheduled;
     };
 }
 #endif
@@ -23,7 +23,9 @@
 
 #include "serversettings.h"
 
+#include <QCryptographicHash>
 #include <QElapsedTimer>
+#include <QSet>
 #include <QSqlDatabase>
 #include <QSqlError>
 #include <QSqlQuery>
@@ -32,8 +34,34 @@
 
 using namespace PMP::Server::DatabaseRecords;
 
+namespace
+{
+    /* maximum number of rows in a single multi-row INSERT statement */
+    const int multiRowInsertLimit = 500;
+}
+
 namespace PMP::Server
 {
+    /* ===== QueryPreparer ===== */
+
+    bool Database::QueryPreparer::prepareAndBind(QSqlQuery& query) const
+    {
+        if (!isCached())
+        {
+            _preparerOrBinder(query);
+            return true;
+        }
+
+        /* a cached query only needs to be prepared the first time it is used */
+        if (query.lastQuery() != _sql && !query.prepare(_sql))
+            return false;
+
+        if (_preparerOrBinder)
+            _preparerOrBinder(query);
+
+        return true;
+    }
+
     /* ===== DatabaseConnection ===== */
 
     Database::DatabaseConnection::DatabaseConnection(QSqlDatabase database)
@@ -47,14 +75,57 @@ namespace PMP::Server
         return _db.isOpen();
     }
 
-    bool Database::DatabaseConnection::executeVoid(
-                                                std::function<void (QSqlQuery&)> preparer)
+    bool Database::DatabaseConnection::beginTransaction()
+    {
+        if (_db.transaction())
+        {
+            _inTransaction = true;
+            return true;
+        }
+
+        auto error = _db.lastError();
+        logSqlError(error, "START TRANSACTION");
+
+        if (!shouldReconnectAndRetryQueryAfter(error, 0) || !closeAndReopenConnection())
+            return false;
+
+        if (!_db.transaction())
+        {
+            logSqlError(_db.lastError(), "START TRANSACTION");
+            return false;
+        }
+
+        _inTransaction = true;
+        return true;
+    }
+
+    bool Database::DatabaseConnection::commitTransaction()
+    {
+        _inTransaction = false;
+
+        if (_db.commit())
+            return true;
+
+        logSqlError(_db.lastError(), "COMMIT");
+        _db.rollback();
+        return false;
+    }
+
+    void Database::DatabaseConnection::rollbackTransaction()
+    {
+        _inTransaction = false;
+
+        if (!_db.rollback())
+            logSqlError(_db.lastError(), "ROLLBACK");
+    }
+
+    bool Database::DatabaseConnection::executeVoid(QueryPreparer const& preparer)
     {
         return executeQuery(preparer, false, std::function<void (QSqlQuery&)>());
     }
 
     bool Database::DatabaseConnection::executeNullableScalar(
-                                                std::function<void (QSqlQuery&)> preparer,
+                                                QueryPreparer const& preparer,
                                                 Nullable<QString>& s)
     {
         auto resultGetter =
@@ -82,7 +153,7 @@ namespace PMP::Server
     }
 
     bool Database::DatabaseConnection::executeScalar(
-        std::function<void (QSqlQuery&)> preparer, bool& b, bool defaultValue)
+        QueryPreparer const& preparer, bool& b, bool defaultValue)
     {
         auto resultGetter =
             [&b, defaultValue] (QSqlQuery& q)
@@ -106,7 +177,7 @@ namespace PMP::Server
     }
 
     bool Database::DatabaseConnection::executeScalar(
-        std::function<void (QSqlQuery&)> preparer, int& i, int defaultValue)
+        QueryPreparer const& preparer, int& i, int defaultValue)
     {
         auto resultGetter =
             [&i, defaultValue] (QSqlQuery& q)
@@ -130,7 +201,7 @@ namespace PMP::Server
     }
 
     bool Database::DatabaseConnection::executeScalar(
-        std::function<void (QSqlQuery&)> preparer, uint& i, uint defaultValue)
+        QueryPreparer const& preparer, uint& i, uint defaultValue)
     {
         auto resultGetter =
             [&i, defaultValue] (QSqlQuery& q)
@@ -154,7 +225,7 @@ namespace PMP::Server
     }
 
     bool Database::DatabaseConnection::executeScalar(
-        std::function<void (QSqlQuery&)> preparer, QDateTime& d)
+        QueryPreparer const& preparer, QDateTime& d)
     {
         auto resultGetter =
             [&d] (QSqlQuery& q)
@@ -179,7 +250,7 @@ namespace PMP::Server
 
     template<class T>
     ResultOrError<QVector<T>, FailureType> Database::DatabaseConnection::executeRecords(
-                                            std::function<void (QSqlQuery&)> preparer,
+                                            QueryPreparer const& preparer,
                                             std::function<T (QSqlQuery&)> extractRecord,
                                             int recordsToReserveCount)
     {
@@ -204,7 +275,7 @@ namespace PMP::Server
     }
 
     bool Database::DatabaseConnection::executeQuery(
-                                        std::function<void (QSqlQuery&)> preparer,
+                                        QueryPreparer const& preparer,
                                         bool processResult,
                                         std::function<void (QSqlQuery&)> resultFetcher)
     {
@@ -220,19 +291,28 @@ namespace PMP::Server
             return false;
         }
 
-        QSqlQuery q(_db);
+        auto query = obtainQuery(preparer);
 
         QElapsedTimer timer;
         timer.start();
 
-        if (executeQueryInternal(q, preparer, processResult, resultFetcher))
+        if (executeQueryInternal(*query, preparer, processResult, resultFetcher))
             return true;
 
         /* something went wrong */
 
         auto elapsedTimeMs = timer.elapsed();
-        logLastSqlError(q);
-        auto error = q.lastError();
+        logLastSqlError(*query);
+        auto error = query->lastError();
+        discardCachedQuery(preparer);
+
+        /* a transaction does not survive a reconnect, so the whole transaction will
+           have to fail */
+        if (_inTransaction)
+        {
+            qWarning() << "SQL query inside transaction failed:" << error.text();
+            return false;
+        }
 
         if (!shouldReconnectAndRetryQueryAfter(error, elapsedTimeMs))
         {
@@ -248,24 +328,53 @@ namespace PMP::Server
             return false;
         }
 
-        if (executeQueryInternal(q, preparer, processResult, resultFetcher))
+        query = obtainQuery(preparer);
+
+        if (executeQueryInternal(*query, preparer, processResult, resultFetcher))
         {
             qDebug() << "DatabaseConnection: reconnect and re-execute succeeded!";
             return true;
         }
 
-        logLastSqlError(q);
-        qWarning() << "SQL query failed a second time:" << q.lastError().text();
+        logLastSqlError(*query);
+        discardCachedQuery(preparer);
+        qWarning() << "SQL query failed a second time:" << query->lastError().text();
         return false;
     }
 
+    QSharedPointer<QSqlQuery> Database::DatabaseConnection::obtainQuery(
+                                                            QueryPreparer const& preparer)
+    {
+        if (!preparer.isCached())
+            return QSharedPointer<QSqlQuery>::create(_db);
+
+        /* The cache only holds queries whose SQL text is fixed at compile time (or
+           bucketed), so it cannot grow without bounds. */
+        auto& query = _statementCache[preparer.sql()];
+        if (!query)
+        {
+            query = QSharedPointer<QSqlQuery>::create(_db);
+            query->setForwardOnly(true);
+        }
+
+        return query;
+    }
+
+    void Database::DatabaseConnection::discardCachedQuery(QueryPreparer const& preparer)
+    {
+        /* a statement that failed might be in an unusable state, so don't reuse it */
+        if (preparer.isCached())
+            _statementCache.remove(preparer.sql());
+    }
+
     bool Database::DatabaseConnection::executeQueryInternal(
         QSqlQuery& query,
-        std::function<void (QSqlQuery&)> preparer,
+        QueryPreparer const& preparer,
         bool processResult,
         std::function<void (QSqlQuery&)> resultFetcher)
     {
-        preparer(query);
+        if (!preparer.prepareAndBind(query))
+            return false;
 
         if (!query.exec())
             return false;
@@ -273,6 +382,10 @@ namespace PMP::Server
         if (processResult)
             resultFetcher(query);
 
+        /* release the result set but keep the prepared statement for reuse */
+        if (preparer.isCached())
+            query.finish();
+
         return true;
     }
 
@@ -321,6 +434,10 @@ namespace PMP::Server
     bool Database::DatabaseConnection::closeAndReopenConnection()
     {
         qDebug() << "DatabaseConnection: closing and reopening connection";
+
+        /* prepared statements do not survive the connection they were prepared on */
+        _statementCache.clear();
+
         _db.close();
         _db.setDatabaseName("pmp");
 
@@ -478,7 +595,8 @@ namespace PMP::Server
             && initUsersTable(db)                /* pmp_user */
             && initHistoryTable(db)              /* pmp_history */
             && initEquivalenceTable(db)          /* pmp_equivalence */
-            && initUserHashStatsCacheTable(db);  /* pmp_userhashstatscache */
+            && initUserHashStatsCacheTable(db)   /* pmp_userhashstatscache */
+            && initFileAnalysisCacheTable(db);   /* pmp_fileanalysiscache */
 
         if (!tablesInitialized)
             return false;
@@ -722,6 +840,36 @@ namespace PMP::Server
         return insertResult.succeeded();
     }
 
+    bool Database::initFileAnalysisCacheTable(Database& database)
+    {
+        /* paths can be too long for an index, so the key is a hash of the path */
+        auto sql =
+            "CREATE TABLE IF NOT EXISTS pmp_fileanalysiscache("
+            " `PathHash` VARCHAR(40) NOT NULL,"
+            " `Path` TEXT NOT NULL,"
+            " `FileSize` BIGINT NOT NULL,"
+            " `LastModifiedMs` BIGINT NOT NULL,"
+            " `InputLength` INT UNSIGNED NOT NULL,"
+            " `SHA1` VARCHAR(40) NOT NULL,"
+            " `MD5` VARCHAR(32) NOT NULL,"
+            " `LegacyInputLength` INT UNSIGNED,"
+            " `LegacySHA1` VARCHAR(40),"
+            " `LegacyMD5` VARCHAR(32),"
+            " `AudioFormat` INT NOT NULL,"
+            " `TrackLengthMs` BIGINT NOT NULL,"
+            " `Title` TEXT,"
+            " `Artist` TEXT,"
+            " `Album` TEXT,"
+            " `AlbumArtist` TEXT,"
+            " `Comment` TEXT,"
+            " PRIMARY KEY (`PathHash`) "
+            ") "
+            "ENGINE = InnoDB "
+            "DEFAULT CHARACTER SET = utf8mb4 COLLATE = utf8mb4_general_ci";
+
+        return database.connection().executeVoid(prepareSimple(sql));
+    }
+
     Database::Database(DatabaseConnection&& databaseConnection)
         : _dbConnection(std::move(databaseConnection))
     {
@@ -782,6 +930,29 @@ namespace PMP::Server
         return _dbConnection.isOpen();
     }
 
+    SuccessOrFailure Database::executeInTransaction(
+                                            std::function<SuccessOrFailure ()> work)
+    {
+        /* nested use joins the transaction that is already active */
+        if (_dbConnection.isInTransaction())
+            return work();
+
+        if (!_dbConnection.beginTransaction())
+            return failure;
+
+        auto result = work();
+        if (result.failed())
+        {
+            _dbConnection.rollbackTransaction();
+            return failure;
+        }
+
+        if (!_dbConnection.commitTransaction())
+            return failure;
+
+        return success;
+    }
+
     ResultOrError<Nullable<QString>, FailureType> Database::getMiscDataValue(
         const QString& key)
     {
@@ -913,16 +1084,16 @@ namespace PMP::Server
         QString md5 = hash.MD5().toHex();
 
         auto preparer =
-            [=] (QSqlQuery& q)
-            {
-                q.prepare(
-                    "SELECT HashID FROM pmp_hash"
-                    " WHERE InputLength=? AND `SHA1`=? AND `MD5`=?"
-                );
-                q.addBindValue(hash.length());
-                q.addBindValue(sha1);
-                q.addBindValue(md5);
-            };
+            prepareCached(
+                "SELECT HashID FROM pmp_hash"
+                " WHERE InputLength=? AND `SHA1`=? AND `MD5`=?",
+                [=] (QSqlQuery& q)
+                {
+                    q.addBindValue(hash.length());
+                    q.addBindValue(sha1);
+                    q.addBindValue(md5);
+                }
+            );
 
         uint id;
         if (!_dbConnection.executeScalar(preparer, id, 0))
@@ -963,6 +1134,90 @@ namespace PMP::Server
                                                                    extractRecord);
     }
 
+    SuccessOrFailure Database::registerHashes(QVector<FileHash> const& hashes)
+    {
+        if (hashes.isEmpty())
+            return success;
+
+        auto bindRow =
+            [](QSqlQuery& q, FileHash const& hash)
+            {
+                q.addBindValue(hash.length());
+                q.addBindValue(QString(hash.SHA1().toHex()));
+                q.addBindValue(QString(hash.MD5().toHex()));
+            };
+
+        auto work =
+            [this, &hashes, bindRow]() -> SuccessOrFailure
+            {
+                return executeMultiRowInsert<FileHash>(
+                            "INSERT INTO pmp_hash(InputLength, `SHA1`, `MD5`) VALUES ",
+                            3,
+                            " ON DUPLICATE KEY UPDATE InputLength=InputLength",
+                            hashes, bindRow);
+            };
+
+        if (executeInTransaction(work).failed())
+        {
+            qWarning() << "Database::registerHashes : insert failed!" << Qt::endl;
+            return failure;
+        }
+
+        return success;
+    }
+
+    ResultOrError<QVector<QPair<uint, FileHash>>, FailureType> Database::getHashIds(
+                                                        QVector<FileHash> const& hashes)
+    {
+        auto extractRecord =
+            [](QSqlQuery& q) -> QPair<uint,FileHash>
+            {
+                uint hashID = q.value(0).toUInt();
+                uint length = q.value(1).toUInt();
+                QByteArray sha1 = QByteArray::fromHex(q.value(2).toByteArray());
+                QByteArray md5 = QByteArray::fromHex(q.value(3).toByteArray());
+
+                return { hashID, FileHash(length, sha1, md5) };
+            };
+
+        QVector<QPair<uint, FileHash>> result;
+        result.reserve(hashes.size());
+
+        for (int start = 0; start < hashes.size(); start += multiRowInsertLimit)
+        {
+            auto rowCount = qMin(multiRowInsertLimit, hashes.size() - start);
+
+            auto preparer =
+                [&hashes, start, rowCount](QSqlQuery& q)
+                {
+                    q.prepare(
+                        "SELECT HashID,InputLength,`SHA1`,`MD5` FROM pmp_hash "
+                        "WHERE (InputLength,`SHA1`,`MD5`) IN ("
+                            + buildMultiRowParamsList(rowCount, 3) + ")"
+                    );
+
+                    for (int i = start; i < start + rowCount; ++i)
+                    {
+                        auto const& hash = hashes[i];
+                        q.addBindValue(hash.length());
+                        q.addBindValue(QString(hash.SHA1().toHex()));
+                        q.addBindValue(QString(hash.MD5().toHex()));
+                    }
+                };
+
+            auto records =
+                _dbConnection.executeRecords<QPair<uint, FileHash>>(preparer,
+                                                                    extractRecord,
+                                                                    rowCount);
+            if (records.failed())
+                return failure;
+
+            result += records.result();
+        }
+
+        return result;
+    }
+
     ResultOrError<SuccessType, FailureType> Database::registerFilenameSeen(uint hashId,
                                                     const QString& filenameWithoutPath,
                                                     int currentYear)
@@ -972,65 +1227,243 @@ namespace PMP::Server
         if (filenameWithoutPath.length() > 255)
             return failure;
 
+        auto insertNeeded =
+            removeOutdatedFilenameEntries(hashId, filenameWithoutPath, currentYear);
+
+        if (insertNeeded.failed())
+            return failure;
+
+        if (!insertNeeded.result())
+            return success; /* nothing to update */
+
+        /* step 3 - insert the filename with the current year */
+
+        auto preparer3 =
+            prepareCached(
+                "INSERT INTO pmp_filename(`HashID`,`FilenameWithoutDir`,"
+                "                         `YearLastSeen`) "
+                "VALUES(?,?,?)",
+                [=](QSqlQuery& query)
+                {
+                    query.addBindValue(hashId);
+                    query.addBindValue(filenameWithoutPath);
+                    query.addBindValue(currentYear);
+                }
+            );
+
+        if (!_dbConnection.executeVoid(preparer3))
+            return failure;
+
+        return success;
+    }
+
+    ResultOrError<bool, FailureType> Database::removeOutdatedFilenameEntries(uint hashId,
+                                                    const QString& filenameWithoutPath,
+                                                    int currentYear)
+    {
         /* A race condition could cause duplicate records to be registered; that is
            tolerable however. */
 
         /* step 1 - find the oldest year that has been registered (or 0 for NULL) */
 
         auto preparer1 =
-            [=](QSqlQuery& query)
-            {
-                query.prepare(
-                    "SELECT `YearLastSeen` FROM pmp_filename "
-                    "WHERE `HashID`=? AND `FilenameWithoutDir`=? "
-                    "ORDER BY COALESCE(`YearLastSeen`, 0) "
-                    "LIMIT 1"
-                );
-                query.addBindValue(hashId);
-                query.addBindValue(filenameWithoutPath);
-            };
+            prepareCached(
+                "SELECT `YearLastSeen` FROM pmp_filename "
+                "WHERE `HashID`=? AND `FilenameWithoutDir`=? "
+                "ORDER BY COALESCE(`YearLastSeen`, 0) "
+                "LIMIT 1",
+                [=](QSqlQuery& query)
+                {
+                    query.addBindValue(hashId);
+                    query.addBindValue(filenameWithoutPath);
+                }
+            );
 
         int oldYear;
         if (!_dbConnection.executeScalar(preparer1, oldYear, -1))
             return failure;
 
         if (oldYear == currentYear)
-            return success; /* nothing to update */
+            return false; /* nothing to update */
 
         /* step 2 - delete existing entries with an older year or without a year. This
                     also causes duplicate entries to be cleaned up eventually. */
 
         auto preparer2 =
-            [=](QSqlQuery& query)
-            {
-                query.prepare(
-                    "DELETE FROM pmp_filename "
-                    "WHERE `HashID`=? AND `FilenameWithoutDir`=?"
-                );
-                query.addBindValue(hashId);
-                query.addBindValue(filenameWithoutPath);
-            };
+            prepareCached(
+                "DELETE FROM pmp_filename "
+                "WHERE `HashID`=? AND `FilenameWithoutDir`=?",
+                [=](QSqlQuery& query)
+                {
+                    query.addBindValue(hashId);
+                    query.addBindValue(filenameWithoutPath);
+                }
+            );
 
         if (!_dbConnection.executeVoid(preparer2))
             return failure;
 
-        /* step 3 - insert the filename with the current year */
+        return true;
+    }
 
-        auto preparer3 =
-            [=](QSqlQuery& query)
+    SuccessOrFailure Database::registerFilenamesSeen(
+                                        QVector<QPair<uint, QString>> const& filenames,
+                                        int currentYear)
+    {
+        auto work =
+            [this, &filenames, currentYear]() -> SuccessOrFailure
             {
-                query.prepare(
-                    "INSERT INTO pmp_filename(`HashID`,`FilenameWithoutDir`,"
-                    "                         `YearLastSeen`) "
-                    "VALUES(?,?,?)"
-                );
-                query.addBindValue(hashId);
-                query.addBindValue(filenameWithoutPath);
-                query.addBindValue(currentYear);
+                QSet<QPair<uint, QString>> uniqueFilenames;
+                uniqueFilenames.reserve(filenames.size());
+                QSet<uint> hashIdSet;
+
+                for (auto const& pair : filenames)
+                {
+                    /* We do not support extremely long file names */
+                    if (pair.second.length() > 255)
+                        continue;
+
+                    uniqueFilenames.insert(pair);
+                    hashIdSet.insert(pair.first);
+                }
+
+                if (uniqueFilenames.isEmpty())
+                    return success;
+
+                auto oldestYearsOrFailure =
+                        getOldestYearsOfFilenames(hashIdSet.values().toVector());
+                if (oldestYearsOrFailure.failed())
+                    return failure;
+
+                auto const oldestYears = oldestYearsOrFailure.result();
+
+                QVector<QPair<uint, QString>> toDelete;
+                QVector<QPair<uint, QString>> toInsert;
+                toInsert.reserve(uniqueFilenames.size());
+
+                for (auto const& pair : qAsConst(uniqueFilenames))
+                {
+                    auto it = oldestYears.constFind(pair);
+                    if (it != oldestYears.constEnd())
+                    {
+                        if (it.value() == currentYear)
+                            continue; /* nothing to update */
+
+                        /* delete entries with an older year or without a year; this
+                           also causes duplicate entries to be cleaned up eventually */
+                        toDelete.append(pair);
+                    }
+
+                    toInsert.append(pair);
+                }
+
+                if (removeFilenameEntries(toDelete).failed())
+                    return failure;
+
+                auto bindRow =
+                    [currentYear](QSqlQuery& q, QPair<uint, QString> const& pair)
+                    {
+                        q.addBindValue(pair.first);
+                        q.addBindValue(pair.second);
+                        q.addBindValue(currentYear);
+                    };
+
+                return executeMultiRowInsert<QPair<uint, QString>>(
+                            "INSERT INTO pmp_filename(`HashID`,`FilenameWithoutDir`,"
+                            "                         `YearLastSeen`) VALUES ",
+                            3, "", toInsert, bindRow);
             };
 
-        if (!_dbConnection.executeVoid(preparer3))
+        if (executeInTransaction(work).failed())
+        {
+            qWarning() << "Database::registerFilenamesSeen : failed!" << Qt::endl;
             return failure;
+        }
+
+        return success;
+    }
+
+    ResultOrError<QHash<QPair<uint, QString>, int>, FailureType>
+        Database::getOldestYearsOfFilenames(QVector<uint> const& hashIds)
+    {
+        using FilenameYear = QPair<QPair<uint, QString>, int>;
+
+        auto extractRecord =
+            [](QSqlQuery& q) -> FilenameYear
+            {
+                uint hashId = q.value(0).toUInt();
+                QString filename = q.value(1).toString();
+                int year = q.value(2).toInt(); /* 0 for NULL */
+
+                return { { hashId, filename }, year };
+            };
+
+        QHash<QPair<uint, QString>, int> result;
+
+        for (int start = 0; start < hashIds.size(); start += multiRowInsertLimit)
+        {
+            auto count = qMin(multiRowInsertLimit, hashIds.size() - start);
+
+            auto preparer =
+                [&hashIds, start, count](QSqlQuery& q)
+                {
+                    q.prepare(
+                        "SELECT `HashID`,`FilenameWithoutDir`,"
+                        " COALESCE(`YearLastSeen`, 0) "
+                        "FROM pmp_filename "
+                        "WHERE `HashID` IN " + buildParamsList(count)
+                    );
+
+                    for (int i = start; i < start + count; ++i)
+                    {
+                        q.addBindValue(hashIds[i]);
+                    }
+                };
+
+            auto records =
+                _dbConnection.executeRecords<FilenameYear>(preparer, extractRecord);
+            if (records.failed())
+                return failure;
+
+            for (auto const& record : records.result())
+            {
+                auto it = result.find(record.first);
+                if (it == result.end())
+                    result.insert(record.first, record.second);
+                else if (record.second < it.value())
+                    it.value() = record.second;
+            }
+        }
+
+        return result;
+    }
+
+    SuccessOrFailure Database::removeFilenameEntries(
+                                        QVector<QPair<uint, QString>> const& filenames)
+    {
+        for (int start = 0; start < filenames.size(); start += multiRowInsertLimit)
+        {
+            auto rowCount = qMin(multiRowInsertLimit, filenames.size() - start);
+
+            auto preparer =
+                [&filenames, start, rowCount](QSqlQuery& q)
+                {
+                    q.prepare(
+                        "DELETE FROM pmp_filename "
+                        "WHERE (`HashID`,`FilenameWithoutDir`) IN ("
+                            + buildMultiRowParamsList(rowCount, 2) + ")"
+                    );
+
+                    for (int i = start; i < start + rowCount; ++i)
+                    {
+                        q.addBindValue(filenames[i].first);
+                        q.addBindValue(filenames[i].second);
+                    }
+                };
+
+            if (!_dbConnection.executeVoid(preparer))
+                return failure;
+        }
 
         return success;
     }
@@ -1061,22 +1494,61 @@ namespace PMP::Server
                                                                         int currentYear)
     {
         auto preparer =
-            [=] (QSqlQuery& q)
+            prepareCached(
+                "INSERT INTO pmp_filesize(`HashID`,`FileSize`,`YearLastSeen`)"
+                " VALUES(?,?,?)"
+                " ON DUPLICATE KEY UPDATE `YearLastSeen`=?",
+                [=] (QSqlQuery& q)
+                {
+                    q.addBindValue(hashId);
+                    q.addBindValue(size);
+                    q.addBindValue(currentYear);
+                    q.addBindValue(currentYear);
+                }
+            );
+
+        if (!_dbConnection.executeVoid(preparer))
+        {
+            qDebug() << "Database::registerFileSize : insert/update failed!" << Qt::endl;
+            return failure;
+        }
+
+        return success;
+    }
+
+    SuccessOrFailure Database::registerFileSizesSeen(
+                                            QVector<QPair<uint, qint64>> const& fileSizes,
+                                            int currentYear)
+    {
+        auto bindRow =
+            [currentYear](QSqlQuery& q, QPair<uint, qint64> const& pair)
             {
-                q.prepare(
-                    "INSERT INTO pmp_filesize(`HashID`,`FileSize`,`YearLastSeen`)"
-                    " VALUES(?,?,?)"
-                    " ON DUPLICATE KEY UPDATE `YearLastSeen`=?"
-                );
-                q.addBindValue(hashId);
-                q.addBindValue(size);
+                q.addBindValue(pair.first);
+                q.addBindValue(pair.second);
                 q.addBindValue(currentYear);
+            };
+
+        auto bindSuffix =
+            [currentYear](QSqlQuery& q)
+            {
                 q.addBindValue(currentYear);
             };
 
-        if (!_dbConnection.executeVoid(preparer))
+        auto work =
+            [this, &fileSizes, bindRow, bindSuffix]() -> SuccessOrFailure
+            {
+                return executeMultiRowInsert<QPair<uint, qint64>>(
+                            "INSERT INTO pmp_filesize(`HashID`,`FileSize`,`YearLastSeen`)"
+                            " VALUES ",
+                            3,
+                            " ON DUPLICATE KEY UPDATE `YearLastSeen`=?",
+                            fileSizes, bindRow, bindSuffix);
+            };
+
+        if (executeInTransaction(work).failed())
         {
-            qDebug() << "Database::registerFileSize : insert/update failed!" << Qt::endl;
+            qWarning() << "Database::registerFileSizesSeen : insert/update failed!"
+                       << Qt::endl;
             return failure;
         }
 
@@ -1324,31 +1796,44 @@ namespace PMP::Server
                                                             bool validForScoring)
     {
         auto preparer =
-            [=] (QSqlQuery& q)
+            prepareCached(
+                "INSERT INTO pmp_history"
+                " (`HashID`,`UserID`,`Start`,`End`,`Permillage`,`ValidForScoring`) "
+                "VALUES(?,?,?,?,?,?)",
+                [=] (QSqlQuery& q)
+                {
+                    q.addBindValue(hashId);
+                    q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt)
+                                               : userId);
+                    q.addBindValue(start.toUTC());
+                    q.addBindValue(end.toUTC());
+                    q.addBindValue(permillage);
+                    q.addBindValue(validForScoring);
+                }
+            );
+
+        uint historyId = 0;
+
+        /* the statistics in the cache table are kept up-to-date in the same
+           transaction, so they can never be out of sync with the history table */
+        auto work =
+            [this, &preparer, &historyId, hashId, userId]() -> SuccessOrFailure
             {
-                q.prepare(
-                    "INSERT INTO pmp_history"
-                    " (`HashID`,`UserID`,`Start`,`End`,`Permillage`,`ValidForScoring`) "
-                    "VALUES(?,?,?,?,?,?)"
-                );
-                q.addBindValue(hashId);
-                q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt) : userId);
-                q.addBindValue(start.toUTC());
-                q.addBindValue(end.toUTC());
-                q.addBindValue(permillage);
-                q.addBindValue(validForScoring);
-            };
+                if (!_dbConnection.executeVoid(preparer)) /* error */
+                {
+                    qWarning() << "Database::addToHistory : insert failed!" << Qt::endl;
+                    return failure;
+                }
 
-        if (!_dbConnection.executeVoid(preparer)) /* error */
-        {
-            qWarning() << "Database::addToHistory : insert failed!" << Qt::endl;
-            return failure;
-        }
+                auto preparer2 = prepareCached("SELECT LAST_INSERT_ID()");
 
-        auto preparer2 = prepareSimple("SELECT LAST_INSERT_ID()");
+                if (!_dbConnection.executeScalar(preparer2, historyId, 0))
+                    return failure;
 
-        uint historyId = 0;
-        if (!_dbConnection.executeScalar(preparer2, historyId, 0))
+                return refreshUserHashStatsCacheEntry(userId, hashId);
+            };
+
+        if (executeInTransaction(work).failed())
             return failure;
 
         qDebug() << "inserted new history entry with ID" << historyId
@@ -1432,35 +1917,34 @@ namespace PMP::Server
         if (hashIds.isEmpty())
             return QVector<HashHistoryStats> {};
 
-        auto preparer =
-            [=](QSqlQuery& q)
-            {
-                q.prepare(
-                    "SELECT ha.HashID, hi.LastHistoryId, hi.PrevHeard,"
-                    "       hi2.ScoreHeardCount, hi2.ScorePermillage "
-                    "FROM pmp_hash AS ha"
-                    " LEFT JOIN"
-                    "  (SELECT HashID, MAX(HistoryID) AS LastHistoryId,"
-                    "          MAX(End) AS PrevHeard"
-                    "   FROM pmp_history"
-                    "   WHERE COALESCE(UserID, 0)=? GROUP BY HashID) AS hi"
-                    "  ON ha.HashID=hi.HashID"
-                    " LEFT JOIN"
-                    "  (SELECT HashID, COUNT(*) AS ScoreHeardCount,"
-                    "   AVG(Permillage) AS ScorePermillage FROM pmp_history"
-                    "   WHERE COALESCE(UserID, 0)=? AND ValidForScoring != 0"
-                    "   GROUP BY HashID) AS hi2"
-                    "  ON ha.HashID=hi2.HashID "
-                    "WHERE ha.HashID IN " + buildParamsList(hashIds.size())
-                );
+        auto bucketSize = getParamsBucketSize(hashIds.size());
 
-                q.addBindValue(userId);
-                q.addBindValue(userId); /* twice */
-                for (auto hashId : qAsConst(hashIds))
+        /* The null-safe comparison for the user ID allows the use of the
+           (UserID, HashID) index; COALESCE(UserID, 0) would not. */
+        auto preparer =
+            prepareCached(
+                "SELECT ha.HashID, hi.LastHistoryId, hi.PrevHeard,"
+                "       hi.ScoreHeardCount, hi.ScorePermillage "
+                "FROM pmp_hash AS ha"
+                " LEFT JOIN"
+                "  (SELECT HashID, MAX(HistoryID) AS LastHistoryId,"
+                "          MAX(End) AS PrevHeard,"
+                "          SUM(ValidForScoring != 0) AS ScoreHeardCount,"
+                "          AVG(CASE WHEN ValidForScoring != 0 THEN Permillage END)"
+                "           AS ScorePermillage"
+                "   FROM pmp_history"
+                "   WHERE UserID <=> ? AND HashID IN " + buildParamsList(bucketSize) +
+                "   GROUP BY HashID) AS hi"
+                "  ON ha.HashID=hi.HashID "
+                "WHERE ha.HashID IN " + buildParamsList(bucketSize),
+                [=](QSqlQuery& q)
                 {
-                    q.addBindValue(hashId);
+                    q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt)
+                                               : userId);
+                    addBucketedBindValues(q, hashIds, bucketSize);
+                    addBucketedBindValues(q, hashIds, bucketSize); /* twice */
                 }
-            };
+            );
 
         auto extractRecord =
             [](QSqlQuery& q)
@@ -1534,6 +2018,43 @@ namespace PMP::Server
         return success;
     }
 
+    SuccessOrFailure Database::registerEquivalences(
+                                    QVector<QPair<quint32, quint32>> const& equivalences,
+                                    int currentYear)
+    {
+        auto bindRow =
+            [currentYear](QSqlQuery& q, QPair<quint32, quint32> const& pair)
+            {
+                Q_ASSERT_X(pair.first != pair.second,
+                           "Database::registerEquivalences",
+                           "hashes must be different");
+
+                q.addBindValue(pair.first);
+                q.addBindValue(pair.second);
+                q.addBindValue(currentYear);
+            };
+
+        auto work =
+            [this, &equivalences, bindRow]() -> SuccessOrFailure
+            {
+                return executeMultiRowInsert<QPair<quint32, quint32>>(
+                            "INSERT INTO pmp_equivalence(`Hash1`,`Hash2`,`YearAdded`)"
+                            " VALUES ",
+                            3,
+                            " ON DUPLICATE KEY UPDATE `YearAdded`=`YearAdded`",
+                            equivalences, bindRow);
+            };
+
+        if (executeInTransaction(work).failed())
+        {
+            qDebug() << "Database::registerEquivalences : insert/update failed!"
+                     << Qt::endl;
+            return failure;
+        }
+
+        return success;
+    }
+
     ResultOrError<QVector<HistoryRecord>, FailureType>
         Database::getUserHistoryForScrobbling(quint32 userId, quint32 startId,
                                               QDateTime earliestDateTime, int limit)
@@ -1635,80 +2156,105 @@ namespace PMP::Server
                                                                 quint32 userId,
                                                                 QVector<quint32> hashIds)
     {
+        if (hashIds.isEmpty())
+            return QVector<HashHistoryStats> {};
+
+        auto bucketSize = getParamsBucketSize(hashIds.size());
+
         auto preparer =
-            [=] (QSqlQuery& q)
-        {
-            auto sql =
+            prepareCached(
                 "SELECT HashID, LastHistoryId, LastHeard, ScoreHeardCount,"
                 " AveragePermillage "
                 "FROM pmp_userhashstatscache "
-                "WHERE COALESCE(UserID, 0)=?"
-                "  AND HashID IN " + buildParamsList(hashIds.size());
+                "WHERE UserID <=> ?"
+                "  AND HashID IN " + buildParamsList(bucketSize),
+                [=] (QSqlQuery& q)
+                {
+                    q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt)
+                                               : userId);
+                    addBucketedBindValues(q, hashIds, bucketSize);
+                }
+            );
 
-            q.prepare(sql);
+        return _dbConnection.executeRecords<HashHistoryStats>(preparer,
+                                                              extractCachedHashStats,
+                                                              hashIds.size());
+    }
 
-            q.addBindValue(userId);
-            for (auto hashId : qAsConst(hashIds))
-            {
-                q.addBindValue(hashId);
-            }
-        };
+    ResultOrError<QVector<HashHistoryStats>, FailureType>
+        Database::getAllCachedHashStatsForUser(quint32 userId)
+    {
+        auto preparer =
+            prepareCached(
+                "SELECT HashID, LastHistoryId, LastHeard, ScoreHeardCount,"
+                " AveragePermillage "
+                "FROM pmp_userhashstatscache "
+                "WHERE UserID <=> ?",
+                [=] (QSqlQuery& q)
+                {
+                    q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt)
+                                               : userId);
+                }
+            );
 
-        auto extractRecord =
-            [](QSqlQuery& q)
-            {
-                quint32 hashID = q.value(0).toUInt();
-                uint lastHistoryId = getUInt(q.value(1), 0);
-                QDateTime lastHeard = getUtcDateTime(q.value(2));
-                quint32 scoreHeardCount = (quint32)getUInt(q.value(3), 0);
-                qint32 averagePermillage = (qint32)getInt(q.value(4), -1);
+        return _dbConnection.executeRecords<HashHistoryStats>(preparer,
+                                                              extractCachedHashStats);
+    }
 
-                HashHistoryStats stats;
-                stats.lastHistoryId = lastHistoryId;
-                stats.hashId = hashID;
-                stats.lastHeard = lastHeard;
-                stats.scoreHeardCount = scoreHeardCount;
-                stats.averagePermillage = averagePermillage;
+    HashHistoryStats Database::extractCachedHashStats(QSqlQuery& q)
+    {
+        quint32 hashID = q.value(0).toUInt();
+        uint lastHistoryId = getUInt(q.value(1), 0);
+        QDateTime lastHeard = getUtcDateTime(q.value(2));
+        quint32 scoreHeardCount = (quint32)getUInt(q.value(3), 0);
+        qint32 averagePermillage = (qint32)getInt(q.value(4), -1);
 
-                return stats;
-            };
+        HashHistoryStats stats;
+        stats.lastHistoryId = lastHistoryId;
+        stats.hashId = hashID;
+        stats.lastHeard = lastHeard;
+        stats.scoreHeardCount = scoreHeardCount;
+        stats.averagePermillage = averagePermillage;
 
-        return _dbConnection.executeRecords<HashHistoryStats>(preparer, extractRecord);
+        return stats;
     }
 
     SuccessOrFailure Database::updateUserHashStatsCacheEntry(quint32 userId,
                                                             const HashHistoryStats& stats)
     {
         auto preparer =
-            [=] (QSqlQuery& q)
-        {
-            auto sql =
+            prepareCached(
                 "INSERT INTO pmp_userhashstatscache("
                 " `HashID`,`UserID`,`Timestamp`,`LastHistoryID`,`LastHeard`,"
                 " `ScoreHeardCount`,`AveragePermillage`) "
-                "VALUES(?,?,UTC_TIMESTAMP(),?,?,?,?) "
-                "ON DUPLICATE KEY UPDATE"
-                " HashID=?, UserID=?, `Timestamp`=UTC_TIMESTAMP(),"
-                " LastHistoryID=?,LastHeard=?,ScoreHeardCount=?,AveragePermillage=?";
-
-            q.prepare(sql);
-
-            q.addBindValue(stats.hashId);
-            q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt) : userId);
-            q.addBindValue(stats.lastHistoryId);
-            q.addBindValue(stats.lastHeard.toUTC());
-            q.addBindValue(stats.scoreHeardCount);
-            q.addBindValue(stats.averagePermillage);
-
-            q.addBindValue(stats.hashId);
-            q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt) : userId);
-            q.addBindValue(stats.lastHistoryId);
-            q.addBindValue(stats.lastHeard.toUTC());
-            q.addBindValue(stats.scoreHeardCount);
-            q.addBindValue(stats.averagePermillage);
-        };
+                "VALUES(?,?,UTC_TIMESTAMP(),?,?,?,?)",
+                [=] (QSqlQuery& q)
+                {
+                    q.addBindValue(stats.hashId);
+                    q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt)
+                                               : userId);
+                    q.addBindValue(stats.lastHistoryId);
+                    q.addBindValue(stats.lastHeard.toUTC());
+                    q.addBindValue(stats.scoreHeardCount);
+                    q.addBindValue(stats.averagePermillage);
+                }
+            );
 
-        if (!_dbConnection.executeVoid(preparer))
+        /* The unique index does not consider NULL user IDs to be duplicates, so we
+           cannot rely on ON DUPLICATE KEY UPDATE here */
+        auto work =
+            [this, &preparer, userId, &stats]() -> SuccessOrFailure
+            {
+                if (removeUserHashStatsCacheEntry(userId, stats.hashId).failed())
+                    return failure;
+
+                if (!_dbConnection.executeVoid(preparer))
+                    return failure;
+
+                return success;
+            };
+
+        if (executeInTransaction(work).failed())
         {
             qDebug() << "Database::updateUserHashStatsCache : insert/update failed!"
                      << Qt::endl;
@@ -1718,26 +2264,250 @@ namespace PMP::Server
         return success;
     }
 
-    SuccessOrFailure Database::removeUserHashStatsCacheEntry(quint32 userId,
+    SuccessOrFailure Database::refreshUserHashStatsCacheEntry(quint32 userId,
                                                              quint32 hashId)
     {
         auto preparer =
-            [=] (QSqlQuery& q)
+            prepareCached(
+                "INSERT INTO pmp_userhashstatscache("
+                " `HashID`,`UserID`,`Timestamp`,`LastHistoryID`,`LastHeard`,"
+                " `ScoreHeardCount`,`AveragePermillage`) "
+                + userHashStatsAggregationSql() +
+                "WHERE UserID <=> ? AND HashID=? "
+                "GROUP BY UserID, HashID",
+                [=] (QSqlQuery& q)
+                {
+                    q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt)
+                                               : userId);
+                    q.addBindValue(hashId);
+                }
+            );
+
+        /* this only reads the history of a single track for a single user, which is
+           an index lookup */
+        auto work =
+            [this, &preparer, userId, hashId]() -> SuccessOrFailure
             {
-                q.prepare(
-                    "DELETE FROM pmp_userhashstatscache "
-                    "WHERE UserId=? AND HashID=?"
-                    );
-                q.addBindValue(userId);
-                q.addBindValue(hashId);
+                if (removeUserHashStatsCacheEntry(userId, hashId).failed())
+                    return failure;
+
+                if (!_dbConnection.executeVoid(preparer))
+                    return failure;
+
+                return success;
             };
 
+        if (executeInTransaction(work).failed())
+        {
+            qWarning() << "Database::refreshUserHashStatsCacheEntry : failed for user"
+                       << userId << "and hash" << hashId;
+            return failure;
+        }
+
+        return success;
+    }
+
+    SuccessOrFailure Database::rebuildUserHashStatsCache()
+    {
+        auto deletion = prepareSimple("DELETE FROM pmp_userhashstatscache");
+
+        auto insertion =
+            prepareSimple(
+                "INSERT INTO pmp_userhashstatscache("
+                " `HashID`,`UserID`,`Timestamp`,`LastHistoryID`,`LastHeard`,"
+                " `ScoreHeardCount`,`AveragePermillage`) "
+                + userHashStatsAggregationSql() +
+                "GROUP BY UserID, HashID"
+            );
+
+        /* a single pass over the history table, which happens entirely inside the
+           database server */
+        auto work =
+            [this, &deletion, &insertion]() -> SuccessOrFailure
+            {
+                if (!_dbConnection.executeVoid(deletion))
+                    return failure;
+
+                if (!_dbConnection.executeVoid(insertion))
+                    return failure;
+
+                auto lastHistoryIdOrFailure = getLastHistoryId();
+                if (lastHistoryIdOrFailure.failed())
+                    return failure;
+
+                return insertOrUpdateMiscData(
+                                "UserHashStatsCacheHistoryId",
+                                QString::number(lastHistoryIdOrFailure.result()));
+            };
+
+        if (executeInTransaction(work).failed())
+        {
+            qWarning() << "Database::rebuildUserHashStatsCache : failed!";
+            return failure;
+        }
+
+        return success;
+    }
+
+    SuccessOrFailure Database::removeUserHashStatsCacheEntry(quint32 userId,
+                                                             quint32 hashId)
+    {
+        auto preparer =
+            prepareCached(
+                "DELETE FROM pmp_userhashstatscache "
+                "WHERE UserID <=> ? AND HashID=?",
+                [=] (QSqlQuery& q)
+                {
+                    q.addBindValue(userId == 0 ? /*NULL*/QVariant(QVariant::UInt)
+                                               : userId);
+                    q.addBindValue(hashId);
+                }
+            );
+
         if (!_dbConnection.executeVoid(preparer))
             return failure;
 
         return success;
     }
 
+    ResultOrError<QVector<FileAnalysisCacheRecord>, FailureType>
+                                                            Database::getFileAnalysisCache()
+    {
+        auto preparer =
+            prepareSimple(
+                "SELECT `Path`,FileSize,LastModifiedMs,"
+                " InputLength,`SHA1`,`MD5`,LegacyInputLength,LegacySHA1,LegacyMD5,"
+                " AudioFormat,TrackLengthMs,Title,Artist,Album,AlbumArtist,`Comment` "
+                "FROM pmp_fileanalysiscache"
+            );
+
+        auto extractRecord =
+            [](QSqlQuery& q)
+            {
+                FileAnalysisCacheRecord record;
+                record.path = q.value(0).toString();
+                record.fileSize = q.value(1).toLongLong();
+                record.lastModified =
+                        QDateTime::fromMSecsSinceEpoch(q.value(2).toLongLong(), Qt::UTC);
+
+                record.hash =
+                        FileHash(q.value(3).toUInt(),
+                                 QByteArray::fromHex(q.value(4).toByteArray()),
+                                 QByteArray::fromHex(q.value(5).toByteArray()));
+
+                if (!q.value(6).isNull())
+                {
+                    record.legacyHash =
+                            FileHash(q.value(6).toUInt(),
+                                     QByteArray::fromHex(q.value(7).toByteArray()),
+                                     QByteArray::fromHex(q.value(8).toByteArray()));
+                }
+
+                record.audioFormat = q.value(9).toInt();
+                record.trackLengthMilliseconds = q.value(10).toLongLong();
+                record.title = getString(q.value(11), "");
+                record.artist = getString(q.value(12), "");
+                record.album = getString(q.value(13), "");
+                record.albumArtist = getString(q.value(14), "");
+                record.comment = getString(q.value(15), "");
+
+                return record;
+            };
+
+        return _dbConnection.executeRecords<FileAnalysisCacheRecord>(preparer,
+                                                                     extractRecord);
+    }
+
+    SuccessOrFailure Database::insertOrUpdateFileAnalysisCacheRecords(
+                                    QVector<FileAnalysisCacheRecord> const& records)
+    {
+        if (records.isEmpty())
+            return success;
+
+        auto bindRow =
+            [](QSqlQuery& q, FileAnalysisCacheRecord const& record)
+            {
+                auto const& hash = record.hash;
+                auto const& legacyHash = record.legacyHash;
+
+                q.addBindValue(getPathHash(record.path));
+                q.addBindValue(record.path);
+                q.addBindValue(record.fileSize);
+                q.addBindValue(record.lastModified.toMSecsSinceEpoch());
+                q.addBindValue(hash.length());
+                q.addBindValue(QString(hash.SHA1().toHex()));
+                q.addBindValue(QString(hash.MD5().toHex()));
+
+                if (!legacyHash.isNull())
+                {
+                    q.addBindValue(legacyHash.length());
+                    q.addBindValue(QString(legacyHash.SHA1().toHex()));
+                    q.addBindValue(QString(legacyHash.MD5().toHex()));
+                }
+                else
+                {
+                    q.addBindValue(/*NULL*/QVariant(QVariant::UInt));
+                    q.addBindValue(/*NULL*/QVariant(QVariant::String));
+                    q.addBindValue(/*NULL*/QVariant(QVariant::String));
+                }
+
+                q.addBindValue(record.audioFormat);
+                q.addBindValue(record.trackLengthMilliseconds);
+                q.addBindValue(record.title);
+                q.addBindValue(record.artist);
+                q.addBindValue(record.album);
+                q.addBindValue(record.albumArtist);
+                q.addBindValue(record.comment);
+            };
+
+        auto result =
+            executeMultiRowInsert<FileAnalysisCacheRecord>(
+                "REPLACE INTO pmp_fileanalysiscache("
+                " `PathHash`,`Path`,FileSize,LastModifiedMs,"
+                " InputLength,`SHA1`,`MD5`,LegacyInputLength,LegacySHA1,LegacyMD5,"
+                " AudioFormat,TrackLengthMs,Title,Artist,Album,AlbumArtist,`Comment`) "
+                "VALUES ",
+                17,
+                "",
+                records, bindRow);
+
+        if (result.failed())
+        {
+            qDebug() << "Database::insertOrUpdateFileAnalysisCacheRecords : failed!";
+            return failure;
+        }
+
+        return success;
+    }
+
+    SuccessOrFailure Database::removeFileAnalysisCacheRecords(
+                                                        QVector<QString> const& paths)
+    {
+        for (int start = 0; start < paths.size(); start += multiRowInsertLimit)
+        {
+            auto count = qMin(multiRowInsertLimit, paths.size() - start);
+
+            auto preparer =
+                [&paths, start, count](QSqlQuery& q)
+                {
+                    q.prepare(
+                        "DELETE FROM pmp_fileanalysiscache "
+                        "WHERE `PathHash` IN " + buildParamsList(count)
+                    );
+
+                    for (int i = start; i < start + count; ++i)
+                    {
+                        q.addBindValue(getPathHash(paths[i]));
+                    }
+                };
+
+            if (!_dbConnection.executeVoid(preparer))
+                return failure;
+        }
+
+        return success;
+    }
+
     bool Database::setLastFmScrobblingEnabled(quint32 userId, bool enabled)
     {
         auto preparer =
@@ -1855,11 +2625,115 @@ namespace PMP::Server
         return s;
     }
 
+    QString Database::userHashStatsAggregationSql()
+    {
+        return
+            "SELECT HashID, UserID, UTC_TIMESTAMP(), MAX(HistoryID), MAX(End),"
+            " SUM(ValidForScoring != 0),"
+            " FLOOR(AVG(CASE WHEN ValidForScoring != 0 THEN Permillage END)) "
+            "FROM pmp_history ";
+    }
+
+    QString Database::buildMultiRowParamsList(int rowCount, unsigned columnCount)
+    {
+        auto row = buildParamsList(columnCount);
+
+        QString s;
+        s.reserve(rowCount * (row.size() + 1));
+
+        for (int i = 0; i < rowCount; ++i)
+        {
+            if (i > 0)
+                s += ",";
+
+            s += row;
+        }
+
+        return s;
+    }
+
+    template<class T>
+    SuccessOrFailure Database::executeMultiRowInsert(QString const& sqlBeforeValues,
+                                        unsigned columnCount,
+                                        QString const& sqlAfterValues,
+                                        QVector<T> const& rows,
+                                        std::function<void (QSqlQuery&, T const&)> bindRow,
+                                        std::function<void (QSqlQuery&)> bindSuffix)
+    {
+        for (int start = 0; start < rows.size(); start += multiRowInsertLimit)
+        {
+            auto rowCount = qMin(multiRowInsertLimit, rows.size() - start);
+
+            auto preparer =
+                [&](QSqlQuery& q)
+                {
+                    q.prepare(sqlBeforeValues
+                              + buildMultiRowParamsList(rowCount, columnCount)
+                              + sqlAfterValues);
+
+                    for (int i = start; i < start + rowCount; ++i)
+                    {
+                        bindRow(q, rows[i]);
+                    }
+
+                    if (bindSuffix)
+                        bindSuffix(q);
+                };
+
+            if (!_dbConnection.executeVoid(preparer))
+                return failure;
+        }
+
+        return success;
+    }
+
+    int Database::getParamsBucketSize(int paramsCount)
+    {
+        /* Rounding the number of parameters up to a power of two limits the number of
+           distinct SQL texts, so that queries with an IN list can be cached too. */
+        int bucketSize = 8;
+        while (bucketSize < paramsCount)
+            bucketSize *= 2;
+
+        return bucketSize;
+    }
+
+    void Database::addBucketedBindValues(QSqlQuery& q, QVector<quint32> const& values,
+                                         int bucketSize)
+    {
+        Q_ASSERT_X(!values.isEmpty(), "Database::addBucketedBindValues",
+                   "values must not be empty");
+
+        for (auto value : values)
+        {
+            q.addBindValue(value);
+        }
+
+        /* pad with a repeated value; this does not change the outcome of an IN test */
+        auto padding = values.last();
+        for (int i = values.size(); i < bucketSize; ++i)
+        {
+            q.addBindValue(padding);
+        }
+    }
+
+    QString Database::getPathHash(QString const& path)
+    {
+        auto hash = QCryptographicHash::hash(path.toUtf8(), QCryptographicHash::Sha1);
+        return QString::fromLatin1(hash.toHex());
+    }
+
     std::function<void (QSqlQuery&)> Database::prepareSimple(QString sql)
     {
         return [=] (QSqlQuery& q) { q.prepare(sql); };
     }
 
+    Database::QueryPreparer Database::prepareCached(QString sql,
+                                                 std::function<void (QSqlQuery&)> binder)
+    {
+        return QueryPreparer(std::move(sql), std::move(binder));
+    }
+
     bool Database::getBool(QVariant v, bool nullValue)
     {
         if (v.isNull())
@@ -28,6 +28,7 @@
 #include <QAtomicInt>
 #include <QByteArray>
 #include <QDateTime>
+#include <QHash>
 #include <QPair>
 #include <QSharedPointer>
 #include <QString>
@@ -38,6 +39,7 @@
 #include <QVector>
 
 #include <functional>
+#include <type_traits>
 
 QT_FORWARD_DECLARE_CLASS(QSqlQuery)
 QT_FORWARD_DECLARE_CLASS(QTextStream)
@@ -56,6 +58,8 @@ namespace PMP::Server
 
         bool isConnectionOpen() const;
 
+        SuccessOrFailure executeInTransaction(std::function<SuccessOrFailure ()> work);
+
         ResultOrError<Nullable<QString>, FailureType> getMiscDataValue(
                                                                     QString const& key);
         ResultOrError<SuccessType, FailureType> insertMiscData(QString const& key,
@@ -74,15 +78,24 @@ namespace PMP::Server
         ResultOrError<uint, FailureType> getHashId(const FileHash& hash);
         ResultOrError<QVector<QPair<uint,FileHash>>, FailureType> getHashes(
                                                                    uint largerThanID = 0);
+        SuccessOrFailure registerHashes(QVector<FileHash> const& hashes);
+        ResultOrError<QVector<QPair<uint, FileHash>>, FailureType> getHashIds(
+                                                        QVector<FileHash> const& hashes);
 
         ResultOrError<SuccessType, FailureType> registerFilenameSeen(uint hashId,
                                                     const QString& filenameWithoutPath,
                                                     int currentYear);
+        SuccessOrFailure registerFilenamesSeen(
+                                    QVector<QPair<uint, QString>> const& filenames,
+                                    int currentYear);
         ResultOrError<QVector<QString>, FailureType> getFilenames(uint hashID);
 
         ResultOrError<SuccessType, FailureType> registerFileSizeSeen(uint hashId,
                                                                      qint64 size,
                                                                      int currentYear);
+        SuccessOrFailure registerFileSizesSeen(
+                                    QVector<QPair<uint, qint64>> const& fileSizes,
+                                    int currentYear);
         ResultOrError<QVector<qint64>, FailureType> getFileSizes(uint hashID);
 
         ResultOrError<QVector<DatabaseRecords::User>, FailureType> getUsers();
@@ -137,19 +150,62 @@ namespace PMP::Server
                                                                     getCachedHashStats(
                                                                 quint32 userId,
                                                                 QVector<quint32> hashIds);
+        ResultOrError<QVector<DatabaseRecords::HashHistoryStats>, FailureType>
+                                            getAllCachedHashStatsForUser(quint32 userId);
         SuccessOrFailure updateUserHashStatsCacheEntry(quint32 userId,
                                         DatabaseRecords::HashHistoryStats const& stats);
         SuccessOrFailure removeUserHashStatsCacheEntry(quint32 userId, quint32 hashId);
+        SuccessOrFailure refreshUserHashStatsCacheEntry(quint32 userId, quint32 hashId);
+        SuccessOrFailure rebuildUserHashStatsCache();
 
         ResultOrError<QVector<QPair<quint32, quint32>>, FailureType> getEquivalences();
         ResultOrError<SuccessType, FailureType> registerEquivalence(quint32 hashId1,
                                                                     quint32 hashId2,
                                                                     int currentYear);
+        SuccessOrFailure registerEquivalences(
+                                QVector<QPair<quint32, quint32>> const& equivalences,
+                                int currentYear);
+
+        ResultOrError<QVector<DatabaseRecords::FileAnalysisCacheRecord>, FailureType>
+                                                                getFileAnalysisCache();
+        SuccessOrFailure insertOrUpdateFileAnalysisCacheRecords(
+                    QVector<DatabaseRecords::FileAnalysisCacheRecord> const& records);
+        SuccessOrFailure removeFileAnalysisCacheRecords(QVector<QString> const& paths);
 
         static QSharedPointer<Database> getDatabaseForCurrentThread();
         static QUuid getDatabaseUuid();
 
     private:
+        /* Prepares a query and binds its parameters.  A cached preparer only binds the
+           parameters; its SQL text is prepared once per connection and the prepared
+           statement is then reused for each subsequent execution. */
+        class QueryPreparer
+        {
+        public:
+            template<class F,
+                     std::enable_if_t<std::is_invocable_v<F, QSqlQuery&>, int> = 0>
+            QueryPreparer(F preparer)
+             : _preparerOrBinder(std::move(preparer))
+            {
+                //
+            }
+
+            QueryPreparer(QString sql, std::function<void (QSqlQuery&)> binder)
+             : _sql(std::move(sql)), _preparerOrBinder(std::move(binder))
+            {
+                //
+            }
+
+            bool isCached() const { return !_sql.isEmpty(); }
+            QString const& sql() const { return _sql; }
+
+            bool prepareAndBind(QSqlQuery& query) const;
+
+        private:
+            QString _sql;
+            std::function<void (QSqlQuery&)> _preparerOrBinder;
+        };
+
         class DatabaseConnection
         {
         public:
@@ -158,36 +214,43 @@ namespace PMP::Server
             DatabaseConnection(DatabaseConnection&&) = default;
 
             bool isOpen() const;
+            bool isInTransaction() const { return _inTransaction; }
 
-            bool executeVoid(std::function<void (QSqlQuery&)> preparer);
+            bool beginTransaction();
+            bool commitTransaction();
+            void rollbackTransaction();
 
-            bool executeNullableScalar(std::function<void (QSqlQuery&)> preparer,
+            bool executeVoid(QueryPreparer const& preparer);
+
+            bool executeNullableScalar(QueryPreparer const& preparer,
                                        Nullable<QString>& s);
 
-            bool executeScalar(std::function<void (QSqlQuery&)> preparer,
+            bool executeScalar(QueryPreparer const& preparer,
                                bool& b, bool defaultValue);
-            bool executeScalar(std::function<void (QSqlQuery&)> preparer,
+            bool executeScalar(QueryPreparer const& preparer,
                                int& i, int defaultValue);
-            bool executeScalar(std::function<void (QSqlQuery&)> preparer,
+            bool executeScalar(QueryPreparer const& preparer,
                                uint& i, uint defaultValue);
-            bool executeScalar(std::function<void (QSqlQuery&)> preparer,
+            bool executeScalar(QueryPreparer const& preparer,
                                QDateTime& d);
 
             template<class T>
             ResultOrError<QVector<T>, FailureType> executeRecords(
-                std::function<void (QSqlQuery&)> preparer,
+                QueryPreparer const& preparer,
                 std::function<T (QSqlQuery&)> extractRecord,
                 int recordsToReserveCount = -1);
 
-            bool executeQuery(std::function<void (QSqlQuery&)> preparer,
+            bool executeQuery(QueryPreparer const& preparer,
                               bool processResult,
                               std::function<void (QSqlQuery&)> resultFetcher);
 
             QSqlDatabase& qSqlDatabase() { return _db; }
 
         private:
+            QSharedPointer<QSqlQuery> obtainQuery(QueryPreparer const& preparer);
+            void discardCachedQuery(QueryPreparer const& preparer);
             bool executeQueryInternal(QSqlQuery& query,
-                                      std::function<void (QSqlQuery&)> preparer,
+                                      QueryPreparer const& preparer,
                                       bool processResult,
                                       std::function<void (QSqlQuery&)> resultFetcher);
             void logLastSqlError(QSqlQuery const& query);
@@ -197,6 +260,8 @@ namespace PMP::Server
             bool closeAndReopenConnection();
 
             QSqlDatabase _db;
+            QHash<QString, QSharedPointer<QSqlQuery>> _statementCache;
+            bool _inTransaction { false };
         };
 
         class TableEditor
@@ -216,8 +281,30 @@ namespace PMP::Server
         DatabaseConnection& connection() { return _dbConnection; }
 
         static QString buildParamsList(unsigned paramsCount);
+        static QString buildMultiRowParamsList(int rowCount, unsigned columnCount);
+        static QString userHashStatsAggregationSql();
+        static DatabaseRecords::HashHistoryStats extractCachedHashStats(QSqlQuery& q);
+        template<class T>
+        SuccessOrFailure executeMultiRowInsert(QString const& sqlBeforeValues,
+                                        unsigned columnCount,
+                                        QString const& sqlAfterValues,
+                                        QVector<T> const& rows,
+                                        std::function<void (QSqlQuery&, T const&)> bindRow,
+                                        std::function<void (QSqlQuery&)> bindSuffix = {});
+        ResultOrError<bool, FailureType> removeOutdatedFilenameEntries(uint hashId,
+                                                    const QString& filenameWithoutPath,
+                                                    int currentYear);
+        ResultOrError<QHash<QPair<uint, QString>, int>, FailureType>
+            getOldestYearsOfFilenames(QVector<uint> const& hashIds);
+        SuccessOrFailure removeFilenameEntries(
+                                    QVector<QPair<uint, QString>> const& filenames);
+        static int getParamsBucketSize(int paramsCount);
+        static void addBucketedBindValues(QSqlQuery& q, QVector<quint32> const& values,
+                                          int bucketSize);
 
         static std::function<void (QSqlQuery&)> prepareSimple(QString sql);
+        static QueryPreparer prepareCached(QString sql,
+                                           std::function<void (QSqlQuery&)> binder = {});
 
         static bool addColumnIfNotExists(QSqlQuery& q, QString tableName,
                                          QString columnName, QString type);
@@ -243,6 +330,9 @@ namespace PMP::Server
         static bool initEquivalenceTable(Database& database);
         static bool initUserHashStatsCacheTable(Database& database);
         static bool initUserHashStatsCacheBookkeeping(Database& database);
+        static bool initFileAnalysisCacheTable(Database& database);
+
+        static QString getPathHash(QString const& path);
 
         static QString _hostname;
         static int _port;
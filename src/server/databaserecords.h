@@ -20,6 +20,8 @@
 #ifndef PMP_DATABASERECORDS_H
 #define PMP_DATABASERECORDS_H
 
+#include "common/filehash.h"
+
 #include <QByteArray>
 #include <QDateTime>
 #include <QString>
@@ -122,6 +124,22 @@ namespace PMP::Server
             qint16 permillage {-1};
             bool validForScoring {false};
         };
+
+        struct FileAnalysisCacheRecord
+        {
+            QString path;
+            qint64 fileSize {0};
+            QDateTime lastModified;
+            FileHash hash;
+            FileHash legacyHash;
+            int audioFormat {0};
+            qint64 trackLengthMilliseconds {-1};
+            QString title;
+            QString artist;
+            QString album;
+            QString albumArtist;
+            QString comment;
+        };
     }
 }
 #endif
@@ -0,0 +1,173 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "directorytraversal.h"
+
+#include "common/concurrent.h"
+#include "common/fileanalyzer.h"
+
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QtDebug>
+#include <QThreadPool>
+
+namespace PMP::Server
+{
+    namespace
+    {
+        /* file systems with coarse timestamps could have a directory modified twice
+           without its modification time changing; don't trust recent timestamps */
+        const int minimumListingAgeSeconds = 2;
+    }
+
+    /* ========================== DirectoryListingCache ========================== */
+
+    void DirectoryListingCache::clear()
+    {
+        QMutexLocker lock(&_mutex);
+        _listings.clear();
+    }
+
+    bool DirectoryListingCache::findUnchanged(QString const& directory,
+                                              QDateTime const& lastModified,
+                                              QStringList& subdirectories)
+    {
+        QMutexLocker lock(&_mutex);
+
+        auto it = _listings.constFind(directory);
+        if (it == _listings.constEnd() || it.value().lastModified != lastModified)
+            return false;
+
+        subdirectories = it.value().subdirectories;
+        return true;
+    }
+
+    void DirectoryListingCache::store(QString const& directory,
+                                      QDateTime const& lastModified,
+                                      QStringList const& subdirectories)
+    {
+        QMutexLocker lock(&_mutex);
+        _listings.insert(directory, Listing { lastModified, subdirectories });
+    }
+
+    /* ========================== DirectoryTraversal ========================== */
+
+    DirectoryTraversal::DirectoryTraversal(QThreadPool* threadPool,
+                                           FileHandler fileHandler)
+     : _threadPool(threadPool), _fileHandler(fileHandler)
+    {
+        //
+    }
+
+    void DirectoryTraversal::setListingCache(DirectoryListingCache* cache,
+                                             bool skipUnchangedDirectories)
+    {
+        _listingCache = cache;
+        _skipUnchangedDirectories = skipUnchangedDirectories;
+    }
+
+    void DirectoryTraversal::run(QStringList const& rootPaths)
+    {
+        _startTime = QDateTime::currentDateTimeUtc();
+
+        for (auto const& rootPath : rootPaths)
+        {
+            enqueueDirectory(QFileInfo(rootPath).absoluteFilePath());
+        }
+
+        QMutexLocker lock(&_mutex);
+        while (_pendingCount > 0)
+            _allFinished.wait(&_mutex);
+    }
+
+    void DirectoryTraversal::enqueueDirectory(QString const& path)
+    {
+        {
+            QMutexLocker lock(&_mutex);
+            _pendingCount++;
+        }
+
+        Concurrent::runOnThreadPool<SuccessType, FailureType>(
+            _threadPool,
+            [this, path]() -> SuccessOrFailure
+            {
+                processDirectory(path);
+                markDirectoryFinished();
+                return success;
+            }
+        );
+    }
+
+    void DirectoryTraversal::processDirectory(QString const& path)
+    {
+        _directoryCount.fetchAndAddRelaxed(1);
+
+        auto lastModified = QFileInfo(path).lastModified().toUTC();
+
+        QStringList subdirectories;
+
+        if (_listingCache && _skipUnchangedDirectories
+                && _listingCache->findUnchanged(path, lastModified, subdirectories))
+        {
+            _skippedCount.fetchAndAddRelaxed(1);
+
+            for (auto const& subdirectory : qAsConst(subdirectories))
+                enqueueDirectory(subdirectory);
+
+            return;
+        }
+
+        QDirIterator it(path, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+
+        while (it.hasNext())
+        {
+            it.next();
+            QFileInfo entry = it.fileInfo();
+
+            if (entry.isDir())
+            {
+                if (entry.isSymLink()) continue; /* no symlinks */
+
+                auto subdirectory = entry.absoluteFilePath();
+                subdirectories.append(subdirectory);
+                enqueueDirectory(subdirectory);
+                continue;
+            }
+
+            if (!FileAnalyzer::isFileSupported(entry)) continue;
+
+            _fileHandler(entry);
+        }
+
+        if (_listingCache
+                && lastModified.secsTo(_startTime) >= minimumListingAgeSeconds)
+        {
+            _listingCache->store(path, lastModified, subdirectories);
+        }
+    }
+
+    void DirectoryTraversal::markDirectoryFinished()
+    {
+        QMutexLocker lock(&_mutex);
+
+        _pendingCount--;
+        if (_pendingCount == 0)
+            _allFinished.wakeAll();
+    }
+}
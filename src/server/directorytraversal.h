@@ -0,0 +1,107 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_SERVER_DIRECTORYTRAVERSAL_H
+#define PMP_SERVER_DIRECTORYTRAVERSAL_H
+
+#include <QAtomicInt>
+#include <QDateTime>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QWaitCondition>
+
+#include <functional>
+
+QT_FORWARD_DECLARE_CLASS(QFileInfo)
+QT_FORWARD_DECLARE_CLASS(QThreadPool)
+
+namespace PMP::Server
+{
+    /** Remembers the last modification time and the subdirectories of directories
+        that have been traversed before.
+
+        The modification time of a directory only changes when entries are added to
+        it, removed from it or renamed. So if the modification time is still the
+        same, the directory contains no new files and the subdirectories it had last
+        time are still the same.
+    */
+    class DirectoryListingCache
+    {
+    public:
+        void clear();
+
+        bool findUnchanged(QString const& directory, QDateTime const& lastModified,
+                           QStringList& subdirectories);
+        void store(QString const& directory, QDateTime const& lastModified,
+                   QStringList const& subdirectories);
+
+    private:
+        struct Listing
+        {
+            QDateTime lastModified;
+            QStringList subdirectories;
+        };
+
+        QMutex _mutex;
+        QHash<QString, Listing> _listings;
+    };
+
+    /** Walks directory trees using multiple threads, one task per directory.
+
+        Supported files are passed to the file handler as soon as they are found;
+        the handler is called from multiple threads at the same time. When a listing
+        cache is set and skipping is enabled, directories that have not changed since
+        the previous traversal are not listed again; only their subdirectories are
+        visited.
+    */
+    class DirectoryTraversal
+    {
+    public:
+        using FileHandler = std::function<void (QFileInfo&)>;
+
+        DirectoryTraversal(QThreadPool* threadPool, FileHandler fileHandler);
+
+        void setListingCache(DirectoryListingCache* cache,
+                             bool skipUnchangedDirectories);
+
+        void run(QStringList const& rootPaths);
+
+        int directoryCount() const { return _directoryCount.loadRelaxed(); }
+        int skippedDirectoryCount() const { return _skippedCount.loadRelaxed(); }
+
+    private:
+        void enqueueDirectory(QString const& path);
+        void processDirectory(QString const& path);
+        void markDirectoryFinished();
+
+        QThreadPool* _threadPool;
+        FileHandler _fileHandler;
+        DirectoryListingCache* _listingCache { nullptr };
+        bool _skipUnchangedDirectories { false };
+        QDateTime _startTime;
+        QMutex _mutex;
+        QWaitCondition _allFinished;
+        int _pendingCount { 0 };
+        QAtomicInt _directoryCount { 0 };
+        QAtomicInt _skippedCount { 0 };
+    };
+}
+#endif
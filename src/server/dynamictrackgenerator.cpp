@@ -28,6 +28,8 @@
 #include <QDateTime>
 #include <QTimer>
 
+#include <algorithm>
+
 namespace PMP::Server
 {
     namespace
@@ -280,4 +282,23 @@ namespace PMP::Server
         return true;
     }
 
+    quint32 DynamicTrackGenerator::samplingWeight(TrackStats const& stats,
+                                                  qint64 lengthMilliseconds)
+    {
+        /* same checks as the basic filter */
+        if (lengthMilliseconds >= 0 && lengthMilliseconds < 15 * 1000)
+            return 0;
+
+        if (stats.scoreIsLessThanXPercent(30))
+            return 0;
+
+        /* an unknown score always passes the score tolerance check */
+        if (!stats.haveScore())
+            return 1000;
+
+        /* the score tolerance check passes if the random permillage number is not
+           higher than the score plus 100 */
+        return quint32(std::min(1000, stats.score() + 101));
+    }
+
 }
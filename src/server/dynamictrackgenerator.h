@@ -54,6 +54,8 @@ namespace PMP::Server
         bool satisfiesFilters(Candidate& candidate);
 
         bool satisfiesBasicFilter(Candidate const& candidate) override;
+        quint32 samplingWeight(TrackStats const& stats,
+                               qint64 lengthMilliseconds) override;
 
         QQueue<QSharedPointer<Candidate>> _upcoming;
         bool _enabled;
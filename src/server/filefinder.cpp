@@ -26,6 +26,7 @@
 #include "analyzer.h"
 #include "database.h"
 #include "filelocations.h"
+#include "filesystemindex.h"
 #include "hashidregistrar.h"
 
 #include <QDirIterator>
@@ -38,10 +39,12 @@
 namespace PMP::Server
 {
     FileFinder::FileFinder(QObject* parent, HashIdRegistrar* hashIdRegistrar,
-                           FileLocations* fileLocations, Analyzer* analyzer)
+                           FileLocations* fileLocations,
+                           FileSystemIndex* fileSystemIndex, Analyzer* analyzer)
         : QObject(parent),
         _hashIdRegistrar(hashIdRegistrar),
         _fileLocations(fileLocations),
+        _fileSystemIndex(fileSystemIndex),
         _analyzer(analyzer),
         _threadPool(new QThreadPool(this))
     {
@@ -158,6 +161,26 @@ namespace PMP::Server
 
         auto const filenames = filenamesResult.result();
 
+        if (_fileSystemIndex->isComplete())
+        {
+            for (QString const& fileShort : filenames)
+            {
+                const auto candidatePaths =
+                                        _fileSystemIndex->getPathsByFileName(fileShort);
+
+                for (QString const& candidatePath : candidatePaths)
+                {
+                    if (candidateHasHash(candidatePath, hash))
+                        return candidatePath;
+                }
+            }
+
+            qDebug() << "FileFinder: filename based heuristic found no results for ID"
+                     << id << "in the file system index";
+            return {};
+        }
+
+        /* the index is not ready yet, so we have to walk the directory tree */
         const auto musicPaths = _musicPaths;
         for (QString const& musicPath : musicPaths)
         {
@@ -177,12 +200,7 @@ namespace PMP::Server
 
                     QString candidatePath = dir.filePath(fileShort);
 
-                    auto maybeHash = _analyzer->analyzeFile(candidatePath);
-                    if (maybeHash.failed())
-                        continue; /* failed to analyze */
-
-                    auto candidateHashes = maybeHash.result().hashes();
-                    if (candidateHashes.contains(hash))
+                    if (candidateHasHash(candidatePath, hash))
                         return candidatePath;
                 }
             }
@@ -203,6 +221,33 @@ namespace PMP::Server
 
         QVector<QString> newFilesToScan;
 
+        if (_fileSystemIndex->isComplete())
+        {
+            for (auto fileSize : qAsConst(previousFileSizes))
+            {
+                const auto candidatePaths = _fileSystemIndex->getPathsBySize(fileSize);
+
+                for (QString const& candidatePath : candidatePaths)
+                {
+                    qDebug() << "FileFinder: checking out" << candidatePath
+                             << "because its file size seems to match";
+
+                    if (candidateHasHash(candidatePath, hash))
+                        return candidatePath;
+                }
+            }
+
+            const auto allPaths = _fileSystemIndex->getAllPaths();
+            for (QString const& candidatePath : allPaths)
+            {
+                if (!_fileLocations->pathHasAtLeastOneId(candidatePath))
+                    newFilesToScan.append(candidatePath); /* it's a new file */
+            }
+
+            return findPathByQuickScanOfNewFiles(newFilesToScan, hash);
+        }
+
+        /* the index is not ready yet, so we have to walk the directory tree */
         const auto musicPaths = _musicPaths;
         for (QString const& musicPath : musicPaths)
         {
@@ -226,12 +271,8 @@ namespace PMP::Server
 
                 qDebug() << "FileFinder: checking out" << candidatePath
                          << "because its file size seems to match";
-                auto maybeHash = _analyzer->analyzeFile(candidatePath);
-                if (maybeHash.failed())
-                    continue; /* failed to analyze */
 
-                auto candidateHashes = maybeHash.result().hashes();
-                if (candidateHashes.contains(hash))
+                if (candidateHasHash(candidatePath, hash))
                     return candidatePath;
             }
         }
@@ -258,12 +299,7 @@ namespace PMP::Server
 
             qDebug() << "FileFinder: checking out new file:" << candidatePath;
 
-            auto maybeHash = _analyzer->analyzeFile(candidatePath);
-            if (maybeHash.failed())
-                continue; /* failed to analyze */
-
-            auto candidateHashes = maybeHash.result().hashes();
-            if (candidateHashes.contains(hash))
+            if (candidateHasHash(candidatePath, hash))
                 return candidatePath;
         }
 
@@ -281,4 +317,20 @@ namespace PMP::Server
 
         return {};
     }
+
+    bool FileFinder::candidateHasHash(QString const& candidatePath, FileHash const& hash)
+    {
+        auto maybeHash = _analyzer->analyzeFile(candidatePath);
+        if (maybeHash.failed())
+        {
+            /* the index can be out of date if we are not notified of all changes */
+            if (!QFileInfo::exists(candidatePath))
+                _fileSystemIndex->removePathOrTree(candidatePath);
+
+            return false; /* failed to analyze */
+        }
+
+        auto candidateHashes = maybeHash.result().hashes();
+        return candidateHashes.contains(hash);
+    }
 }
@@ -35,6 +35,7 @@ namespace PMP::Server
     class Analyzer;
     class Database;
     class FileLocations;
+    class FileSystemIndex;
     class HashIdRegistrar;
 
     class FileFinder : public QObject
@@ -42,7 +43,8 @@ namespace PMP::Server
         Q_OBJECT
     public:
         FileFinder(QObject* parent, HashIdRegistrar* hashIdRegistrar,
-                   FileLocations* fileLocations, Analyzer* analyzer);
+                   FileLocations* fileLocations, FileSystemIndex* fileSystemIndex,
+                   Analyzer* analyzer);
 
         void setMusicPaths(QStringList paths);
 
@@ -65,9 +67,12 @@ namespace PMP::Server
         QString findPathByQuickScanOfNewFiles(QVector<QString> newFiles,
                                               const FileHash& hash);
 
+        bool candidateHasHash(QString const& candidatePath, FileHash const& hash);
+
         QMutex _mutex;
         HashIdRegistrar* _hashIdRegistrar;
         FileLocations* _fileLocations;
+        FileSystemIndex* _fileSystemIndex;
         Analyzer* _analyzer;
         QThreadPool* _threadPool;
         QStringList _musicPaths;
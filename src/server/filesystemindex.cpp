@@ -0,0 +1,189 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "filesystemindex.h"
+
+#include <QtDebug>
+#include <QVector>
+
+namespace PMP::Server
+{
+    void FileSystemIndex::clear()
+    {
+        QMutexLocker lock(&_mutex);
+
+        _pathToEntry.clear();
+        _fileNameToPaths.clear();
+        _sizeToPaths.clear();
+        _refreshNumber++; /* a refresh that is still running will not complete */
+        _complete = false;
+    }
+
+    uint FileSystemIndex::startRefresh()
+    {
+        QMutexLocker lock(&_mutex);
+
+        _refreshNumber++;
+        return _refreshNumber;
+    }
+
+    void FileSystemIndex::finishRefresh(uint refreshNumber)
+    {
+        QMutexLocker lock(&_mutex);
+
+        if (refreshNumber != _refreshNumber)
+        {
+            qDebug() << "FileSystemIndex: refresh" << refreshNumber
+                     << "was superseded, not marking the index as complete";
+            return;
+        }
+
+        /* files that were not encountered during the refresh are gone */
+        QVector<QString> pathsToRemove;
+        for (auto it = _pathToEntry.constBegin(); it != _pathToEntry.constEnd(); ++it)
+        {
+            if (it.value().refreshNumber != refreshNumber)
+                pathsToRemove.append(it.key());
+        }
+
+        for (auto const& path : qAsConst(pathsToRemove))
+        {
+            removeInternal(path, _pathToEntry.value(path));
+        }
+
+        _complete = true;
+
+        qDebug() << "FileSystemIndex: refresh completed;" << _pathToEntry.size()
+                 << "files indexed," << pathsToRemove.size() << "removed";
+    }
+
+    bool FileSystemIndex::isComplete()
+    {
+        QMutexLocker lock(&_mutex);
+        return _complete;
+    }
+
+    void FileSystemIndex::insert(QString const& path, qint64 size)
+    {
+        if (path.isEmpty())
+        {
+            qWarning() << "FileSystemIndex: insert() called with empty path";
+            return;
+        }
+
+        QMutexLocker lock(&_mutex);
+
+        auto it = _pathToEntry.find(path);
+        if (it != _pathToEntry.end())
+        {
+            it.value().refreshNumber = _refreshNumber;
+
+            if (it.value().size == size)
+                return;
+
+            auto& sizePaths = _sizeToPaths[it.value().size];
+            sizePaths.removeOne(path);
+            if (sizePaths.isEmpty())
+                _sizeToPaths.remove(it.value().size);
+
+            it.value().size = size;
+            _sizeToPaths[size].append(path);
+            return;
+        }
+
+        _pathToEntry.insert(path, Entry { size, _refreshNumber });
+        _fileNameToPaths[fileNameOf(path)].append(path);
+        _sizeToPaths[size].append(path);
+    }
+
+    void FileSystemIndex::removePathOrTree(QString const& path)
+    {
+        QMutexLocker lock(&_mutex);
+
+        auto exactMatch = _pathToEntry.constFind(path);
+        if (exactMatch != _pathToEntry.constEnd())
+        {
+            removeInternal(path, exactMatch.value());
+            return;
+        }
+
+        /* it might have been a directory; its files are next to each other */
+        auto prefix = path + "/";
+        QVector<QString> pathsToRemove;
+        for (auto it = qAsConst(_pathToEntry).lowerBound(prefix);
+             it != _pathToEntry.constEnd() && it.key().startsWith(prefix);
+             ++it)
+        {
+            pathsToRemove.append(it.key());
+        }
+
+        for (auto const& pathToRemove : qAsConst(pathsToRemove))
+        {
+            removeInternal(pathToRemove, _pathToEntry.value(pathToRemove));
+        }
+    }
+
+    QStringList FileSystemIndex::getPathsByFileName(QString const& fileName)
+    {
+        QMutexLocker lock(&_mutex);
+
+        return _fileNameToPaths.value(fileName);
+    }
+
+    QStringList FileSystemIndex::getPathsBySize(qint64 size)
+    {
+        QMutexLocker lock(&_mutex);
+
+        return _sizeToPaths.value(size);
+    }
+
+    QStringList FileSystemIndex::getAllPaths()
+    {
+        QMutexLocker lock(&_mutex);
+        return _pathToEntry.keys();
+    }
+
+    int FileSystemIndex::fileCount()
+    {
+        QMutexLocker lock(&_mutex);
+        return _pathToEntry.size();
+    }
+
+    QString FileSystemIndex::fileNameOf(QString const& path)
+    {
+        return path.mid(path.lastIndexOf('/') + 1);
+    }
+
+    void FileSystemIndex::removeInternal(QString const& path, Entry const& entry)
+    {
+        auto const size = entry.size; /* 'entry' might not survive the removal */
+        _pathToEntry.remove(path);
+
+        auto fileName = fileNameOf(path);
+        auto& fileNamePaths = _fileNameToPaths[fileName];
+        fileNamePaths.removeOne(path);
+        if (fileNamePaths.isEmpty())
+            _fileNameToPaths.remove(fileName);
+
+        auto& sizePaths = _sizeToPaths[size];
+        sizePaths.removeOne(path);
+        if (sizePaths.isEmpty())
+            _sizeToPaths.remove(size);
+    }
+}
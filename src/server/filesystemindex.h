@@ -0,0 +1,75 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_SERVER_FILESYSTEMINDEX_H
+#define PMP_SERVER_FILESYSTEMINDEX_H
+
+#include <QHash>
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+namespace PMP::Server
+{
+    /** Index of the supported files found in the music folders, by file name and by
+        file size.
+
+        The index is filled by the Resolver while it traverses the music folders and
+        is kept up-to-date with the changes that are reported for those folders. It
+        lets the FileFinder look up candidate files without walking the directory
+        tree. The index is only complete after a full traversal has finished; before
+        that, users should not rely on it.
+    */
+    class FileSystemIndex
+    {
+    public:
+        void clear();
+
+        uint startRefresh();
+        void finishRefresh(uint refreshNumber);
+        bool isComplete();
+
+        void insert(QString const& path, qint64 size);
+        void removePathOrTree(QString const& path);
+
+        QStringList getPathsByFileName(QString const& fileName);
+        QStringList getPathsBySize(qint64 size);
+        QStringList getAllPaths();
+        int fileCount();
+
+    private:
+        struct Entry
+        {
+            qint64 size;
+            uint refreshNumber;
+        };
+
+        static QString fileNameOf(QString const& path);
+        void removeInternal(QString const& path, Entry const& entry);
+
+        QMutex _mutex;
+        QMap<QString, Entry> _pathToEntry; /* ordered for prefix lookup */
+        QHash<QString, QStringList> _fileNameToPaths;
+        QHash<qint64, QStringList> _sizeToPaths;
+        uint _refreshNumber { 0 };
+        bool _complete { false };
+    };
+}
+#endif
@@ -106,18 +106,27 @@ namespace PMP::Server
                 auto db = Database::getDatabaseForCurrentThread();
                 if (!db) return failure; /* database not available */
 
+                QVector<FileHash> missing;
+                for (int i = 0; i < hashes.size(); ++i)
+                {
+                    if (ids[i] <= 0)
+                        missing.append(hashes[i]);
+                }
+
+                auto registrationResult = registerHashes(*db, missing);
+                if (registrationResult.failed())
+                    return failure;
+
                 auto result = ids;
+                QMutexLocker lock(&_mutex);
                 for (int i = 0; i < hashes.size(); ++i)
                 {
                     if (result[i] > 0)
                         continue;
 
-                    auto& hash = hashes[i];
-                    auto registrationResult = registerHash(*db, hash);
-                    if (registrationResult.failed())
+                    result[i] = _hashes.value(hashes[i], 0);
+                    if (result[i] <= 0)
                         return failure;
-
-                    result[i] = registrationResult.result();
                 }
 
                 return result;
@@ -199,6 +208,39 @@ namespace PMP::Server
         return null;
     }
 
+    SuccessOrFailure HashIdRegistrar::registerHashes(Database& db,
+                                                     QVector<FileHash> const& hashes)
+    {
+        if (hashes.size() == 1)
+            return registerHash(db, hashes[0]).toSuccessOrFailure();
+
+        /* register all hashes in a single transaction */
+        if (db.registerHashes(hashes).failed())
+        {
+            qWarning() << "HashIdRegistrar: failed to register" << hashes.size()
+                       << "hashes";
+            return failure;
+        }
+
+        auto idsOrError = db.getHashIds(hashes);
+        if (idsOrError.failed())
+        {
+            qWarning() << "HashIdRegistrar: failed to get IDs for" << hashes.size()
+                       << "hashes";
+            return failure;
+        }
+
+        QMutexLocker lock(&_mutex);
+        for (auto const& pair : idsOrError.result())
+        {
+            _hashes.insert(pair.second, pair.first);
+            _ids.insert(pair.first, pair.second);
+        }
+
+        qDebug() << "HashIdRegistrar: got IDs for" << hashes.size() << "hashes";
+        return success;
+    }
+
     ResultOrError<uint, FailureType> HashIdRegistrar::registerHash(Database& db,
                                                                    FileHash hash)
     {
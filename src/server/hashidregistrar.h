@@ -47,6 +47,7 @@ namespace PMP::Server
         Nullable<FileHash> getHashForId(uint id);
 
     private:
+        SuccessOrFailure registerHashes(Database& db, QVector<FileHash> const& hashes);
         ResultOrError<uint, FailureType> registerHash(Database& db, FileHash hash);
 
         QMutex _mutex;
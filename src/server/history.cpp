@@ -45,6 +45,10 @@ namespace PMP::Server
             player, &Player::newHistoryEntry,
             this, &History::newHistoryEntry
         );
+        connect(
+            player, &Player::userPlayingForChanged,
+            this, &History::preloadUserStats
+        );
         connect(
             _statistics, &HistoryStatistics::hashStatisticsChanged,
             this, &History::hashStatisticsChanged
@@ -86,6 +90,17 @@ namespace PMP::Server
         return _statistics->getStatsIfAvailable(userId, hashId);
     }
 
+    QHash<uint, TrackStats> History::getUserStats(QVector<uint> const& hashIds,
+                                                  quint32 userId)
+    {
+        return _statistics->getStatsIfAvailable(userId, hashIds);
+    }
+
+    Future<SuccessType, FailureType> History::preloadUserStats(quint32 userId)
+    {
+        return _statistics->preloadForUser(userId);
+    }
+
     void History::currentTrackChanged(QSharedPointer<QueueEntry const> newTrack)
     {
         if (_nowPlaying != nullptr && newTrack != _nowPlaying)
@@ -31,6 +31,7 @@
 #include <QHash>
 #include <QObject>
 #include <QSharedPointer>
+#include <QVector>
 
 QT_FORWARD_DECLARE_CLASS(QThreadPool)
 
@@ -57,6 +58,9 @@ namespace PMP::Server
                                                                         uint hashId,
                                                                         quint32 userId);
         Nullable<TrackStats> getUserStats(uint hashId, quint32 userId);
+        QHash<uint, TrackStats> getUserStats(QVector<uint> const& hashIds,
+                                             quint32 userId);
+        Future<SuccessType, FailureType> preloadUserStats(quint32 userId);
 
     Q_SIGNALS:
         void hashStatisticsChanged(quint32 userId, QVector<uint> hashIds);
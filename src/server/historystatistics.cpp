@@ -106,11 +106,18 @@ namespace PMP::Server
 
                     uint historyId = historyIdOrFailure.result();
 
+                    /* the database has updated the statistics cache table already, so
+                       we only need to forget what we had in memory for this hash */
+                    {
+                        QMutexLocker lock(&_mutex);
+                        _userHashStatsCache->remove(userId, hashId);
+                    }
+
                     const auto hashesInGroup =
                             _hashRelations->getEquivalencyGroup(hashId);
 
                     auto tryFetch =
-                        fetchInternal(this, userId, hashesInGroup, UseCachedValues::No);
+                        fetchInternal(this, userId, hashesInGroup, UseCachedValues::Yes);
 
                     if (tryFetch.failed())
                         return failure;
@@ -156,6 +163,60 @@ namespace PMP::Server
         return null;
     }
 
+    QHash<uint, TrackStats> HistoryStatistics::getStatsIfAvailable(quint32 userId,
+                                                         QVector<uint> const& hashIds)
+    {
+        QHash<uint, TrackStats> result;
+        result.reserve(hashIds.size());
+
+        QVector<QVector<uint>> groupsToFetch;
+
+        QMutexLocker lock(&_mutex);
+        auto& userData = _userData[userId];
+
+        for (auto hashId : hashIds)
+        {
+            auto it = userData.hashData.constFind(hashId);
+            if (it != userData.hashData.constEnd())
+            {
+                auto const& groupStats = it.value().groupStats;
+                if (groupStats.hasValue())
+                    result.insert(hashId, groupStats.value());
+
+                continue;
+            }
+
+            if (userData.hashesInProgress.contains(hashId))
+                continue;
+
+            const auto hashesInGroup = _hashRelations->getEquivalencyGroup(hashId);
+
+            for (auto hashIdInGroup : hashesInGroup)
+                userData.hashesInProgress << hashIdInGroup;
+
+            groupsToFetch.append(hashesInGroup);
+        }
+
+        lock.unlock();
+
+        if (!groupsToFetch.isEmpty())
+        {
+            qDebug() << "HistoryStatistics: scheduling bulk fetch of" << groupsToFetch.size()
+                     << "hash groups for user" << userId;
+
+            /* one task for all groups, instead of one task per group */
+            Concurrent::runOnThreadPool<SuccessType, FailureType>(
+                _threadPool,
+                [this, userId, groupsToFetch]()
+                {
+                    return fetchGroupsInternal(this, userId, groupsToFetch);
+                }
+            );
+        }
+
+        return result;
+    }
+
     Future<SuccessType, FailureType> HistoryStatistics::scheduleFetchIfMissing(
                                                                            quint32 userId,
                                                                            uint hashId)
@@ -163,6 +224,17 @@ namespace PMP::Server
         return scheduleFetch(userId, hashId, true);
     }
 
+    Future<SuccessType, FailureType> HistoryStatistics::preloadForUser(quint32 userId)
+    {
+        if (_userHashStatsCache->hasBeenLoadedForUser(userId))
+            return FutureResult(success);
+
+        return Concurrent::runOnThreadPool<SuccessType, FailureType>(
+            _threadPool,
+            [this, userId]() { return preloadInternal(this, userId); }
+        );
+    }
+
     void HistoryStatistics::invalidateAllGroupStatisticsForHash(uint hashId)
     {
         QMutexLocker lock(&_mutex);
@@ -225,10 +297,10 @@ namespace PMP::Server
                 if (!database)
                     return failure;
 
-                auto tryToRemoveFromCacheInDatabase =
-                    database->removeUserHashStatsCacheEntry(userId, hashId);
+                auto tryToRefreshCacheInDatabase =
+                    database->refreshUserHashStatsCacheEntry(userId, hashId);
 
-                if (tryToRemoveFromCacheInDatabase.failed())
+                if (tryToRefreshCacheInDatabase.failed())
                     return failure;
 
                 QMutexLocker lock(&_mutex);
@@ -336,6 +408,83 @@ namespace PMP::Server
         return future;
     }
 
+    SuccessOrFailure HistoryStatistics::preloadInternal(HistoryStatistics* calculator,
+                                                        quint32 userId)
+    {
+        auto* cache = calculator->_userHashStatsCache;
+
+        if (cache->hasBeenLoadedForUser(userId))
+            return success; /* preloaded already */
+
+        auto database = Database::getDatabaseForCurrentThread();
+        if (!database)
+            return failure;
+
+        auto statsOrFailure = database->getAllCachedHashStatsForUser(userId);
+        if (statsOrFailure.failed())
+            return failure;
+
+        const auto allStats = statsOrFailure.result();
+        cache->loadForUser(userId, allStats);
+
+        qDebug() << "HistoryStatistics: preloaded" << allStats.size()
+                 << "cached hash statistics for user" << userId;
+
+        /* calculate the group statistics for every group whose individual statistics
+           are all available now, without going back to the database */
+
+        QMutexLocker lock(&calculator->_mutex);
+        auto& userData = calculator->_userData[userId];
+
+        QSet<uint> hashesHandled;
+        hashesHandled.reserve(allStats.size());
+        QVector<uint> hashesChanged;
+
+        for (auto const& stats : allStats)
+        {
+            auto hashId = stats.hashId;
+            if (hashesHandled.contains(hashId))
+                continue;
+
+            const auto hashesInGroup =
+                    calculator->_hashRelations->getEquivalencyGroup(hashId);
+
+            for (auto hashIdInGroup : hashesInGroup)
+                hashesHandled << hashIdInGroup;
+
+            bool busyOrKnown = false;
+            for (auto hashIdInGroup : hashesInGroup)
+            {
+                if (userData.hashesInProgress.contains(hashIdInGroup)
+                        || userData.hashData.contains(hashIdInGroup))
+                {
+                    busyOrKnown = true;
+                    break;
+                }
+            }
+
+            if (busyOrKnown)
+                continue;
+
+            auto individualStats = cache->getForUser(userId, hashesInGroup);
+            if (individualStats.size() != hashesInGroup.size())
+                continue; /* incomplete; will be fetched when needed */
+
+            bool changed =
+                calculator->recalculateGroupStats(userId, toTrackStats(individualStats));
+
+            if (changed)
+                hashesChanged += hashesInGroup;
+        }
+
+        lock.unlock();
+
+        if (!hashesChanged.isEmpty())
+            calculator->scheduleStatisticsChangedSignal(userId, hashesChanged);
+
+        return success;
+    }
+
     SuccessOrFailure HistoryStatistics::fetchInternal(HistoryStatistics* calculator,
                                                       quint32 userId,
                                                       QVector<uint> hashIdsInGroup,
@@ -371,6 +520,98 @@ namespace PMP::Server
         return success;
     }
 
+    SuccessOrFailure HistoryStatistics::fetchGroupsInternal(
+                                                           HistoryStatistics* calculator,
+                                                           quint32 userId,
+                                                           QVector<QVector<uint>> groups)
+    {
+        /* groups are fetched in rounds, so that a round needs only a few queries */
+        const int maxHashesPerRound = 256;
+
+        auto* cache = calculator->_userHashStatsCache;
+
+        auto database = Database::getDatabaseForCurrentThread();
+
+        int groupIndex = 0;
+        while (groupIndex < groups.size())
+        {
+            int roundEnd = groupIndex;
+            QVector<uint> hashIds;
+            while (roundEnd < groups.size()
+                    && (hashIds.isEmpty()
+                        || hashIds.size() + groups[roundEnd].size() <= maxHashesPerRound))
+            {
+                hashIds += groups[roundEnd];
+                roundEnd++;
+            }
+
+            ResultOrError<QHash<uint, TrackStats>, FailureType> individualStatsOrFailure =
+                failure;
+
+            if (database)
+            {
+                /* the cache table updates of a round are committed together */
+                database->executeInTransaction(
+                    [&]() -> SuccessOrFailure
+                    {
+                        individualStatsOrFailure =
+                            fetchIndividualStats(cache, userId, hashIds,
+                                                 UseCachedValues::Yes);
+
+                        return individualStatsOrFailure.toSuccessOrFailure();
+                    }
+                );
+            }
+
+            QMutexLocker lock(&calculator->_mutex);
+            auto& userData = calculator->_userData[userId];
+
+            if (individualStatsOrFailure.failed())
+            {
+                /* the remaining groups will be fetched again when requested */
+                for (int i = groupIndex; i < groups.size(); ++i)
+                    ContainerUtil::removeFromSet(groups[i], userData.hashesInProgress);
+
+                return failure;
+            }
+
+            auto const& individualStats = individualStatsOrFailure.result();
+            QVector<uint> hashesChanged;
+
+            for (int i = groupIndex; i < roundEnd; ++i)
+            {
+                auto const& group = groups[i];
+
+                QHash<uint, TrackStats> statsForGroup;
+                statsForGroup.reserve(group.size());
+
+                for (auto hashId : group)
+                {
+                    auto it = individualStats.constFind(hashId);
+                    if (it != individualStats.constEnd())
+                        statsForGroup.insert(hashId, it.value());
+                }
+
+                if (!statsForGroup.isEmpty()
+                        && calculator->recalculateGroupStats(userId, statsForGroup))
+                {
+                    hashesChanged += group;
+                }
+
+                ContainerUtil::removeFromSet(group, userData.hashesInProgress);
+            }
+
+            lock.unlock();
+
+            if (!hashesChanged.isEmpty())
+                calculator->scheduleStatisticsChangedSignal(userId, hashesChanged);
+
+            groupIndex = roundEnd;
+        }
+
+        return success;
+    }
+
     ResultOrError<QHash<uint, TrackStats>, FailureType>
         HistoryStatistics::fetchIndividualStats(UserHashStatsCache* cache, quint32 userId,
                                                 QVector<uint> hashIdsInGroup,
@@ -380,7 +621,6 @@ namespace PMP::Server
 
         if (cacheUseForIndividualHashes == UseCachedValues::Yes)
         {
-            //ensureCacheHasBeenLoadedForUser(cache, userId);
             auto const statsFromCache = cache->getForUser(userId, hashIdsInGroup);
             result = toTrackStats(statsFromCache, hashIdsInGroup.size());
 
@@ -57,8 +57,11 @@ namespace PMP::Server
                                                       bool validForScoring);
 
         Nullable<TrackStats> getStatsIfAvailable(quint32 userId, uint hashId);
+        QHash<uint, TrackStats> getStatsIfAvailable(quint32 userId,
+                                                    QVector<uint> const& hashIds);
         Future<SuccessType, FailureType> scheduleFetchIfMissing(quint32 userId,
                                                                 uint hashId);
+        Future<SuccessType, FailureType> preloadForUser(quint32 userId);
         void invalidateAllGroupStatisticsForHash(uint hashId);
         void invalidateIndividualHashStatistics(quint32 userId, uint hashId);
 
@@ -86,11 +89,18 @@ namespace PMP::Server
             QSet<uint> hashesInProgress;
         };
 
+        static SuccessOrFailure preloadInternal(HistoryStatistics* calculator,
+                                                quint32 userId);
+
         static SuccessOrFailure fetchInternal(HistoryStatistics* calculator,
                                               quint32 userId,
                                               QVector<uint> hashIdsInGroup,
                                             UseCachedValues cacheUseForIndividualHashes);
 
+        static SuccessOrFailure fetchGroupsInternal(HistoryStatistics* calculator,
+                                                    quint32 userId,
+                                                    QVector<QVector<uint>> groups);
+
         static ResultOrError<QHash<uint, TrackStats>, FailureType> fetchIndividualStats(
                                                 UserHashStatsCache* cache,
                                                 quint32 userId,
@@ -0,0 +1,421 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "musicfolderwatcher.h"
+
+#include "common/concurrent.h"
+#include "common/fileanalyzer.h"
+
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSocketNotifier>
+#include <QtDebug>
+#include <QTimer>
+#include <QVector>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace PMP::Server
+{
+    namespace
+    {
+        /* how long to collect changes before reporting them */
+        const int reportDelayMilliseconds = 2000;
+
+        /* interval between scans when watching everything is not possible */
+        const int fallbackScanIntervalMilliseconds = 15 * 60 * 1000;
+
+        /* Selects the 'activated' signal of QSocketNotifier.  That signal is overloaded
+           in Qt 5.15, and its last parameter has a private type that cannot be named,
+           so the overload is picked by deducing the remaining parameters. */
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        template<class... Rest>
+        auto socketActivatedSignal(void (QSocketNotifier::*signal)(QSocketDescriptor,
+                                                                    Rest...))
+        {
+            return signal;
+        }
+#else
+        template<class... Rest>
+        auto socketActivatedSignal(void (QSocketNotifier::*signal)(int, Rest...))
+        {
+            return signal;
+        }
+#endif
+    }
+
+    MusicFolderWatcher::MusicFolderWatcher(QObject* parent)
+     : QObject(parent),
+       _reportTimer(new QTimer(this)),
+       _fallbackScanTimer(new QTimer(this))
+    {
+        _reportTimer->setSingleShot(true);
+        _reportTimer->setInterval(reportDelayMilliseconds);
+        connect(_reportTimer, &QTimer::timeout,
+                this, &MusicFolderWatcher::reportPendingChanges);
+
+        _fallbackScanTimer->setInterval(fallbackScanIntervalMilliseconds);
+        connect(_fallbackScanTimer, &QTimer::timeout,
+                this, &MusicFolderWatcher::scanForNewFilesNeeded);
+
+#ifdef Q_OS_LINUX
+        _inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotifyFd >= 0)
+        {
+            _notifier = new QSocketNotifier(_inotifyFd, QSocketNotifier::Read, this);
+            connect(_notifier, socketActivatedSignal(&QSocketNotifier::activated),
+                    this, &MusicFolderWatcher::readEvents);
+            return;
+        }
+
+        enableFallbackScanning("inotify could not be initialized");
+#else
+        enableFallbackScanning("watching folders is not supported on this platform");
+#endif
+    }
+
+    MusicFolderWatcher::~MusicFolderWatcher()
+    {
+        removeAllWatches();
+
+#ifdef Q_OS_LINUX
+        if (_inotifyFd >= 0)
+        {
+            delete _notifier;
+            _notifier = nullptr;
+            ::close(_inotifyFd);
+            _inotifyFd = -1;
+        }
+#endif
+    }
+
+    void MusicFolderWatcher::setMusicPaths(QStringList paths)
+    {
+        if (paths == _musicPaths)
+            return;
+
+        _musicPaths = paths;
+        _generation++; /* invalidates tree listings that are still running */
+
+        removeAllWatches();
+        _pendingChanged.clear();
+        _pendingRemoved.clear();
+
+        if (_inotifyFd < 0)
+            return; /* keep using the fallback */
+
+        _watchLimitReached = false;
+        _fallbackScanTimer->stop();
+
+        for (auto const& path : qAsConst(paths))
+        {
+            startWatchingTreeAsync(QFileInfo(path).absoluteFilePath(), false);
+        }
+    }
+
+    bool MusicFolderWatcher::isWatchingEverything() const
+    {
+        return _inotifyFd >= 0 && !_watchLimitReached;
+    }
+
+    void MusicFolderWatcher::readEvents()
+    {
+#ifdef Q_OS_LINUX
+        alignas(struct inotify_event) char buffer[16 * 1024];
+        bool eventsWereLost = false;
+
+        while (true)
+        {
+            auto length = ::read(_inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0)
+                break; /* nothing left to read (EAGAIN) */
+
+            for (char* ptr = buffer; ptr < buffer + length; )
+            {
+                auto const* event = reinterpret_cast<struct inotify_event const*>(ptr);
+                ptr += sizeof(struct inotify_event) + event->len;
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    eventsWereLost = true;
+                    continue;
+                }
+
+                if (event->mask & IN_IGNORED) /* watch was removed */
+                {
+                    auto directory = _watchToDirectory.take(event->wd);
+                    if (_directoryToWatch.value(directory, -1) == event->wd)
+                        _directoryToWatch.remove(directory);
+
+                    continue;
+                }
+
+                auto directory = _watchToDirectory.value(event->wd);
+                if (directory.isEmpty())
+                    continue;
+
+                if (event->mask & IN_DELETE_SELF)
+                {
+                    markRemoved(directory);
+                    continue;
+                }
+
+                if (event->len == 0)
+                    continue;
+
+                auto path = directory + "/" + QFile::decodeName(event->name);
+
+                if (event->mask & IN_ISDIR)
+                {
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    {
+                        startWatchingTreeAsync(path, true);
+                    }
+                    else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                    {
+                        removeWatchesForTree(path);
+                        markRemoved(path);
+                    }
+
+                    continue;
+                }
+
+                if (!FileAnalyzer::isExtensionSupported(QFileInfo(path).suffix()))
+                    continue;
+
+                /* a newly created file is reported once it has been closed */
+                if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                    markChanged(path);
+                else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                    markRemoved(path);
+            }
+        }
+
+        if (eventsWereLost)
+        {
+            qWarning() << "MusicFolderWatcher: inotify event queue overflowed;"
+                       << "requesting a scan for new files";
+            Q_EMIT scanForNewFilesNeeded();
+        }
+#endif
+    }
+
+    void MusicFolderWatcher::reportPendingChanges()
+    {
+        if (!_pendingRemoved.isEmpty())
+        {
+            auto removed = _pendingRemoved.values();
+            _pendingRemoved.clear();
+
+            qDebug() << "MusicFolderWatcher:" << removed.size() << "paths removed";
+            Q_EMIT pathsRemoved(removed);
+        }
+
+        if (!_pendingChanged.isEmpty())
+        {
+            auto changed = _pendingChanged.values();
+            _pendingChanged.clear();
+
+            qDebug() << "MusicFolderWatcher:" << changed.size() << "files changed";
+            Q_EMIT filesChanged(changed);
+        }
+    }
+
+    MusicFolderWatcher::DirectoryTreeContents MusicFolderWatcher::listDirectoryTree(
+                                                                    QString const& path)
+    {
+        DirectoryTreeContents contents;
+        contents.directories.append(path);
+
+        QDirIterator it(path, QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot,
+                        QDirIterator::Subdirectories); /* no symlinks */
+
+        while (it.hasNext())
+        {
+            QFileInfo entry(it.next());
+
+            if (entry.isDir())
+            {
+                if (!entry.isSymLink())
+                    contents.directories.append(entry.absoluteFilePath());
+            }
+            else if (FileAnalyzer::isFileSupported(entry))
+            {
+                contents.files.append(entry.absoluteFilePath());
+            }
+        }
+
+        return contents;
+    }
+
+    void MusicFolderWatcher::startWatchingTreeAsync(QString const& path, bool reportFiles)
+    {
+        if (_inotifyFd < 0 || _watchLimitReached)
+            return;
+
+        auto generation = _generation;
+
+        auto future =
+            Concurrent::runOnThreadPool<DirectoryTreeContents, FailureType>(
+                globalThreadPool,
+                [path]() -> ResultOrError<DirectoryTreeContents, FailureType>
+                {
+                    return listDirectoryTree(path);
+                }
+            );
+
+        future.handleOnEventLoop(
+            this,
+            [this, generation, reportFiles](
+                                ResultOrError<DirectoryTreeContents, FailureType> outcome)
+            {
+                if (generation != _generation || outcome.failed())
+                    return; /* music paths changed in the meantime */
+
+                auto contents = outcome.result();
+                addWatches(contents.directories);
+
+                if (!reportFiles)
+                    return;
+
+                for (auto const& file : qAsConst(contents.files))
+                    markChanged(file);
+            }
+        );
+    }
+
+    void MusicFolderWatcher::addWatches(QStringList const& directories)
+    {
+#ifdef Q_OS_LINUX
+        const uint32_t mask =
+                IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_DELETE_SELF
+                    | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+        for (auto const& directory : directories)
+        {
+            if (_watchLimitReached)
+                return;
+
+            if (_directoryToWatch.contains(directory))
+                continue;
+
+            int watch = inotify_add_watch(_inotifyFd,
+                                          QFile::encodeName(directory).constData(),
+                                          mask);
+            if (watch < 0)
+            {
+                if (errno == ENOSPC)
+                {
+                    _watchLimitReached = true;
+                    enableFallbackScanning("inotify watch limit reached after "
+                                           + QString::number(_directoryToWatch.size())
+                                           + " directories");
+                    return;
+                }
+
+                qDebug() << "MusicFolderWatcher: could not watch directory"
+                         << directory << "; errno:" << errno;
+                continue;
+            }
+
+            _watchToDirectory.insert(watch, directory);
+            _directoryToWatch.insert(directory, watch);
+        }
+#else
+        Q_UNUSED(directories)
+#endif
+    }
+
+    void MusicFolderWatcher::removeWatchesForTree(QString const& path)
+    {
+#ifdef Q_OS_LINUX
+        QVector<QString> directories;
+        if (_directoryToWatch.contains(path))
+            directories.append(path);
+
+        /* the subdirectories are next to each other in the map */
+        auto prefix = path + "/";
+        for (auto it = qAsConst(_directoryToWatch).lowerBound(prefix);
+             it != _directoryToWatch.constEnd() && it.key().startsWith(prefix);
+             ++it)
+        {
+            directories.append(it.key());
+        }
+
+        for (auto const& directory : qAsConst(directories))
+        {
+            int watch = _directoryToWatch.take(directory);
+            _watchToDirectory.remove(watch);
+            inotify_rm_watch(_inotifyFd, watch);
+        }
+#else
+        Q_UNUSED(path)
+#endif
+    }
+
+    void MusicFolderWatcher::removeAllWatches()
+    {
+#ifdef Q_OS_LINUX
+        for (auto it = _watchToDirectory.constBegin();
+             it != _watchToDirectory.constEnd();
+             ++it)
+        {
+            inotify_rm_watch(_inotifyFd, it.key());
+        }
+#endif
+
+        _watchToDirectory.clear();
+        _directoryToWatch.clear();
+    }
+
+    void MusicFolderWatcher::enableFallbackScanning(QString const& reason)
+    {
+        if (_fallbackScanTimer->isActive())
+            return;
+
+        qWarning() << "MusicFolderWatcher:" << reason
+                   << "; falling back to a periodic scan for new files every"
+                   << (fallbackScanIntervalMilliseconds / 60000) << "minutes";
+
+        _fallbackScanTimer->start();
+    }
+
+    void MusicFolderWatcher::markChanged(QString const& path)
+    {
+        _pendingRemoved.remove(path);
+        _pendingChanged.insert(path);
+
+        if (!_reportTimer->isActive())
+            _reportTimer->start();
+    }
+
+    void MusicFolderWatcher::markRemoved(QString const& path)
+    {
+        _pendingChanged.remove(path);
+        _pendingRemoved.insert(path);
+
+        if (!_reportTimer->isActive())
+            _reportTimer->start();
+    }
+}
@@ -0,0 +1,93 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_SERVER_MUSICFOLDERWATCHER_H
+#define PMP_SERVER_MUSICFOLDERWATCHER_H
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+QT_FORWARD_DECLARE_CLASS(QSocketNotifier)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+namespace PMP::Server
+{
+    /** Watches the music folders for files that appear, change or disappear.
+
+        On Linux this uses inotify, with one watch per directory.  When the system
+        limit for the number of watches is reached, or when inotify is not available,
+        the watcher falls back to requesting a periodic scan for new files instead.
+        Changes are collected for a short while before they are reported, so that a
+        burst of changes (e.g. a folder being copied) results in a single batch.
+    */
+    class MusicFolderWatcher : public QObject
+    {
+        Q_OBJECT
+    public:
+        MusicFolderWatcher(QObject* parent);
+        ~MusicFolderWatcher();
+
+        void setMusicPaths(QStringList paths);
+
+        bool isWatchingEverything() const;
+
+    Q_SIGNALS:
+        void filesChanged(QStringList paths);
+        void pathsRemoved(QStringList paths);
+        void scanForNewFilesNeeded();
+
+    private Q_SLOTS:
+        void readEvents();
+        void reportPendingChanges();
+
+    private:
+        struct DirectoryTreeContents
+        {
+            QStringList directories;
+            QStringList files;
+        };
+
+        static DirectoryTreeContents listDirectoryTree(QString const& path);
+
+        void startWatchingTreeAsync(QString const& path, bool reportFiles);
+        void addWatches(QStringList const& directories);
+        void removeWatchesForTree(QString const& path);
+        void removeAllWatches();
+        void enableFallbackScanning(QString const& reason);
+        void markChanged(QString const& path);
+        void markRemoved(QString const& path);
+
+        QStringList _musicPaths;
+        uint _generation { 0 };
+        int _inotifyFd { -1 };
+        QSocketNotifier* _notifier { nullptr };
+        QTimer* _reportTimer { nullptr };
+        QTimer* _fallbackScanTimer { nullptr };
+        QHash<int, QString> _watchToDirectory;
+        QMap<QString, int> _directoryToWatch; /* ordered for prefix lookup */
+        QSet<QString> _pendingChanged;
+        QSet<QString> _pendingRemoved;
+        bool _watchLimitReached { false };
+    };
+}
+#endif
@@ -0,0 +1,268 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "preloadcache.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPair>
+#include <QSaveFile>
+#include <QSet>
+#include <QTextStream>
+#include <QtDebug>
+#include <QVector>
+
+#include <algorithm>
+
+namespace PMP::Server
+{
+    namespace
+    {
+        const QString indexFileName = "index.txt";
+        const QString indexHeader = "PMP-preload-cache-index 3";
+    }
+
+    PreloadCache::PreloadCache(QString directory, qint64 byteBudget)
+     : _directory(directory), _byteBudget(byteBudget)
+    {
+        //
+    }
+
+    QString PreloadCache::fileNameFor(uint hashId, QString extension)
+    {
+        return "H" + QString::number(hashId) + "." + extension;
+    }
+
+    void PreloadCache::load()
+    {
+        _entries.clear();
+        _totalSize = 0;
+
+        QFile file(indexFilePath());
+        if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            QTextStream stream(&file);
+            stream.setCodec("UTF-8");
+
+            if (stream.readLine() != indexHeader)
+            {
+                qWarning() << "PreloadCache: index file has unknown format; ignoring it";
+            }
+            else
+            {
+                while (!stream.atEnd())
+                {
+                    auto parts = stream.readLine().split('\t');
+                    if (parts.size() != 6) continue;
+
+                    bool ok1, ok2, ok3, ok4;
+                    uint hashId = parts[0].toUInt(&ok1);
+                    auto hash = FileHash::tryParse(parts[1]);
+                    qint64 size = parts[3].toLongLong(&ok2);
+                    qint64 lastModifiedMs = parts[4].toLongLong(&ok3);
+                    qint64 lastUsedMs = parts[5].toLongLong(&ok4);
+                    if (!ok1 || !ok2 || !ok3 || !ok4 || hashId == 0 || hash.isNull())
+                        continue;
+
+                    Entry entry;
+                    entry.hash = hash;
+                    entry.fileName = parts[2];
+                    entry.size = size;
+                    entry.lastModified =
+                            QDateTime::fromMSecsSinceEpoch(lastModifiedMs, Qt::UTC);
+                    entry.lastUsed = QDateTime::fromMSecsSinceEpoch(lastUsedMs, Qt::UTC);
+
+                    /* the file must still be there and be unchanged */
+                    if (!fileIsUnchanged(entry)) continue;
+
+                    _entries.insert(hashId, entry);
+                    _totalSize += size;
+                }
+            }
+
+            file.close();
+        }
+
+        removeUnknownFiles();
+
+        qDebug() << "PreloadCache: loaded" << _entries.size() << "entries with a total of"
+                 << _totalSize << "bytes from" << _directory;
+    }
+
+    void PreloadCache::saveIndexIfChanged()
+    {
+        if (!_indexChanged) return;
+
+        QSaveFile file(indexFilePath());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            qWarning() << "PreloadCache: could not open index file for writing";
+            return;
+        }
+
+        QTextStream stream(&file);
+        stream.setCodec("UTF-8");
+        stream << indexHeader << "\n";
+
+        for (auto it = _entries.constBegin(); it != _entries.constEnd(); ++it)
+        {
+            auto const& entry = it.value();
+            stream << it.key() << "\t" << entry.hash.toString() << "\t"
+                   << entry.fileName << "\t" << entry.size << "\t"
+                   << entry.lastModified.toMSecsSinceEpoch() << "\t"
+                   << entry.lastUsed.toMSecsSinceEpoch() << "\n";
+        }
+
+        stream.flush();
+        if (!file.commit())
+        {
+            qWarning() << "PreloadCache: failed to save index file";
+            return;
+        }
+
+        _indexChanged = false;
+    }
+
+    QString PreloadCache::lookup(uint hashId, FileHash const& hash)
+    {
+        auto it = _entries.find(hashId);
+        if (it == _entries.end())
+            return {};
+
+        if (it.value().hash != hash)
+        {
+            qWarning() << "PreloadCache: file for hash ID" << hashId
+                       << "belongs to a different hash; removing it";
+            remove(hashId);
+            return {};
+        }
+
+        if (!fileIsUnchanged(it.value()))
+        {
+            qDebug() << "PreloadCache: file for hash ID" << hashId
+                     << "has disappeared or has been modified";
+            remove(hashId);
+            return {};
+        }
+
+        it.value().lastUsed = QDateTime::currentDateTimeUtc();
+        _indexChanged = true;
+        return _directory + "/" + it.value().fileName;
+    }
+
+    void PreloadCache::add(uint hashId, FileHash const& hash, QString filePath)
+    {
+        QFileInfo fileInfo(filePath);
+
+        Entry entry;
+        entry.hash = hash;
+        entry.fileName = fileInfo.fileName();
+        entry.size = fileInfo.size();
+        entry.lastModified = fileInfo.lastModified().toUTC();
+        entry.lastUsed = QDateTime::currentDateTimeUtc();
+
+        auto it = _entries.find(hashId);
+        if (it != _entries.end())
+        {
+            _totalSize -= it.value().size;
+
+            if (it.value().fileName != entry.fileName)
+                QFile::remove(_directory + "/" + it.value().fileName);
+        }
+
+        _entries.insert(hashId, entry);
+        _totalSize += entry.size;
+        _indexChanged = true;
+    }
+
+    void PreloadCache::remove(uint hashId)
+    {
+        auto it = _entries.find(hashId);
+        if (it == _entries.end())
+            return;
+
+        QFile::remove(_directory + "/" + it.value().fileName);
+        _totalSize -= it.value().size;
+        _entries.erase(it);
+        _indexChanged = true;
+    }
+
+    void PreloadCache::evictIfOverBudget(std::function<bool (uint)> const& isInUse)
+    {
+        if (_totalSize <= _byteBudget)
+            return;
+
+        QVector<QPair<QDateTime, uint>> candidates;
+        candidates.reserve(_entries.size());
+        for (auto it = _entries.constBegin(); it != _entries.constEnd(); ++it)
+        {
+            if (!isInUse(it.key()))
+                candidates.append({ it.value().lastUsed, it.key() });
+        }
+
+        /* least recently used first */
+        std::sort(candidates.begin(), candidates.end());
+
+        for (auto const& candidate : qAsConst(candidates))
+        {
+            if (_totalSize <= _byteBudget)
+                break;
+
+            qDebug() << "PreloadCache: evicting file for hash ID" << candidate.second;
+            remove(candidate.second);
+        }
+    }
+
+    QString PreloadCache::indexFilePath() const
+    {
+        return _directory + "/" + indexFileName;
+    }
+
+    bool PreloadCache::fileIsUnchanged(Entry const& entry) const
+    {
+        QFileInfo fileInfo(_directory + "/" + entry.fileName);
+
+        return fileInfo.isFile()
+            && fileInfo.size() == entry.size
+            && fileInfo.lastModified().toUTC() == entry.lastModified;
+    }
+
+    void PreloadCache::removeUnknownFiles()
+    {
+        QDir dir(_directory);
+        if (!dir.exists()) return;
+
+        QSet<QString> knownFiles;
+        knownFiles.reserve(_entries.size() + 1);
+        knownFiles << indexFileName;
+        for (auto const& entry : qAsConst(_entries))
+            knownFiles << entry.fileName;
+
+        const auto files = dir.entryInfoList(QDir::Files | QDir::NoSymLinks);
+        for (auto const& file : files)
+        {
+            if (knownFiles.contains(file.fileName())) continue;
+
+            qDebug() << "PreloadCache: deleting unknown file" << file.fileName();
+            QFile::remove(file.absoluteFilePath());
+        }
+    }
+}
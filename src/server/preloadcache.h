@@ -0,0 +1,93 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PMP_SERVER_PRELOADCACHE_H
+#define PMP_SERVER_PRELOADCACHE_H
+
+#include "common/filehash.h"
+
+#include <QDateTime>
+#include <QHash>
+#include <QString>
+
+#include <functional>
+
+namespace PMP::Server
+{
+    /** Keeps preloaded files across restarts of the server.
+
+        Files are identified by the hash ID of the track, so a track that is queued
+        more than once only needs to be preloaded once.  Hash IDs are specific to a
+        database, so each database gets its own cache directory, and the hash of each
+        file is kept as well; an entry whose hash does not match is not used.
+
+        A cache file can be a hard link to the original music file.  Editing the tags
+        of the original in place then changes the cache file as well, so the size and
+        the modification time of each file are recorded and checked again before the
+        file is used.  Hard links count towards the byte budget like copies do: once
+        the original file is replaced or deleted, the link is what keeps its data on
+        disk.
+
+        The cache has a byte budget; when the total size of the files exceeds that
+        budget, the files that have not been used for the longest time are removed
+        first.  An index file in the cache directory keeps track of the files and when
+        they were last used.
+    */
+    class PreloadCache
+    {
+    public:
+        PreloadCache(QString directory, qint64 byteBudget);
+
+        QString directory() const { return _directory; }
+        static QString fileNameFor(uint hashId, QString extension);
+
+        void load();
+        void saveIndexIfChanged();
+
+        QString lookup(uint hashId, FileHash const& hash);
+        void add(uint hashId, FileHash const& hash, QString filePath);
+        void remove(uint hashId);
+
+        qint64 totalSize() const { return _totalSize; }
+
+        void evictIfOverBudget(std::function<bool (uint)> const& isInUse);
+
+    private:
+        struct Entry
+        {
+            FileHash hash;
+            QString fileName;
+            qint64 size { 0 };
+            QDateTime lastModified;
+            QDateTime lastUsed;
+        };
+
+        QString indexFilePath() const;
+        bool fileIsUnchanged(Entry const& entry) const;
+        void removeUnknownFiles();
+
+        QString _directory;
+        qint64 _byteBudget;
+        qint64 _totalSize { 0 };
+        QHash<uint, Entry> _entries;
+        bool _indexChanged { false };
+    };
+}
+#endif
@@ -22,11 +22,11 @@
 #include "common/concurrent.h"
 #include "common/fileanalyzer.h"
 
+#include "database.h"
 #include "playerqueue.h"
 #include "queueentry.h"
 #include "resolver.h"
 
-#include <QCoreApplication>
 #include <QDir>
 #include <QFile>
 #include <QFileInfo>
@@ -37,6 +37,13 @@
 #include <QTemporaryFile>
 #include <QThreadPool>
 #include <QTimer>
+#include <QVector>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace PMP::Server
 {
@@ -63,33 +70,29 @@ namespace PMP::Server
     class Preloader::PreloadTrack
     {
     public:
-        PreloadTrack(FileHash hash, QString filename)
-         : _status(Initial), _hash(hash), _filename(filename)
+        PreloadTrack(FileHash hash, uint hashId, QString filename)
+         : _status(Initial), _hash(hash), _hashId(hashId), _filename(filename)
         {
             //
         }
 
-        ~PreloadTrack()
-        {
-            cleanup();
-        }
-
-        enum Status { Initial = 0, Processing, Preloaded, Failed, CleanedUp };
+        enum Status { Initial = 0, Processing, Preloaded, Failed };
 
         Status status() const;
         FileHash const& hash() const;
+        uint hashId() const;
         QString originalFilename() const;
 
         void setToLoading();
         void setToFailed();
         void setToLoaded(QString cacheFile);
-        bool cleanup();
 
         QString getCachedFile() const;
 
     private:
         Status _status;
         FileHash _hash;
+        uint _hashId;
         QString _filename;
         QString _cacheFile;
     };
@@ -104,6 +107,11 @@ namespace PMP::Server
         return _hash;
     }
 
+    uint Preloader::PreloadTrack::hashId() const
+    {
+        return _hashId;
+    }
+
     QString Preloader::PreloadTrack::originalFilename() const
     {
         return _filename;
@@ -125,17 +133,6 @@ namespace PMP::Server
         _status = Status::Preloaded;
     }
 
-    bool Preloader::PreloadTrack::cleanup()
-    {
-        if (_status == Status::Processing) return false; /* a file will appear */
-        if (_status != Status::Preloaded || _cacheFile.isEmpty()) return true;
-        if (!QFile::remove(_cacheFile)) return false;
-
-        _cacheFile.clear();
-        _status = Status::CleanedUp;
-        return true;
-    }
-
     QString Preloader::PreloadTrack::getCachedFile() const
     {
         return _cacheFile;
@@ -146,6 +143,7 @@ namespace PMP::Server
     Preloader::Preloader(QObject* parent, PlayerQueue* queue, Resolver* resolver)
      : QObject(parent),
        _queue(queue), _resolver(resolver),
+       _cache(cacheDirectory(), PRELOAD_CACHE_BYTE_BUDGET),
        _jobsRunning(0),
        _firstTrackCheckTimerRunning(false),
        _preloadCheckTimerRunning(false),
@@ -159,18 +157,17 @@ namespace PMP::Server
             this, &Preloader::firstTrackInQueueChanged
         );
 
+        _cache.load();
+
         scheduleCheckForTracksToPreload();
     }
 
     Preloader::~Preloader()
     {
-        /* delete cache files */
-        for (auto* track : _tracksByQueueID.values())
-        {
-            if (track->status() != PreloadTrack::Status::Preloaded) continue;
+        /* the cache files are kept for the next time the server is started */
+        _cache.saveIndexIfChanged();
 
-            QFile::remove(track->getCachedFile());
-        }
+        qDeleteAll(_tracksByQueueID);
     }
 
     bool Preloader::havePreloadedFileQuickCheck(uint queueId)
@@ -189,21 +186,27 @@ namespace PMP::Server
         auto filename = track->getCachedFile();
         if (filename.isEmpty()) return PreloadedFile();
 
-        if (!QFileInfo::exists(filename))
+        auto hashId = track->hashId();
+
+        /* this also marks the file as recently used */
+        if (_cache.lookup(hashId, track->hash()).isEmpty())
         {
             /* the file that was preloaded has disappeared */
             _tracksByQueueID.remove(queueID);
             delete track;
+            scheduleCacheIndexSave();
             return PreloadedFile();
         }
 
-        doLock(queueID);
+        scheduleCacheIndexSave();
+
+        doLock(hashId);
 
         return PreloadedFile(
             this,
-            [queueID](Preloader* preloader)
+            [hashId](Preloader* preloader)
             {
-                if (preloader) preloader->doUnlock(queueID);
+                if (preloader) preloader->doUnlock(hashId);
             },
             filename
         );
@@ -211,9 +214,9 @@ namespace PMP::Server
 
     void Preloader::cleanupOldFiles()
     {
-        QString tempDir = QDir::temp().absolutePath() + "/PMP-preload-cache";
-
-        QDir dir(tempDir);
+        /* the persistent cache cleans up after itself; this only removes the files that
+           older versions left behind in the TEMP directory */
+        QDir dir(legacyCacheDirectory());
         if (!dir.exists()) { return; }
 
         auto threshhold = QDate::currentDate().addDays(-10).startOfDay();
@@ -237,14 +240,14 @@ namespace PMP::Server
     {
         Q_UNUSED(queueID);
 
-        if (offset >= PRELOAD_RANGE) return;
+        if (offset >= PRELOAD_MAX_RANGE) return;
 
         scheduleCheckForTracksToPreload();
     }
 
     void Preloader::queueEntryRemoved(qint32 offset, quint32 queueID)
     {
-        if (offset < PRELOAD_RANGE)
+        if (offset < PRELOAD_MAX_RANGE)
         {
             scheduleCheckForTracksToPreload();
         }
@@ -257,7 +260,7 @@ namespace PMP::Server
     {
         Q_UNUSED(queueID);
 
-        if (toOffset >= PRELOAD_RANGE && fromOffset >= PRELOAD_RANGE)
+        if (toOffset >= PRELOAD_MAX_RANGE && fromOffset >= PRELOAD_MAX_RANGE)
             return;
 
         scheduleCheckForTracksToPreload();
@@ -306,9 +309,21 @@ namespace PMP::Server
         _preloadCheckTimerRunning = false;
         qDebug() << "running preload check";
 
-        auto queueEntries = _queue->entries(0, PRELOAD_RANGE);
+        /* the first track is always preloaded, the others only if they fit in the
+           byte budget */
+        qint64 bytesNeeded = 0;
+        bool isFirstTrack = true;
+        auto queueEntries = _queue->entries(0, PRELOAD_MAX_RANGE);
         for (auto& entry : queueEntries)
         {
+            if (!entry->isTrack())
+                continue;
+
+            bytesNeeded += entry->hash().value().length();
+            if (bytesNeeded > PRELOAD_BYTE_BUDGET && !isFirstTrack)
+                break;
+
+            isFirstTrack = false;
             checkToPreloadTrack(entry);
         }
 
@@ -331,8 +346,9 @@ namespace PMP::Server
             if (QFileInfo::exists(track->getCachedFile()))
                 return; /* preloaded file is present */
 
-            /* file has gone missing (it was in a TEMP folder after all) */
+            /* file has gone missing */
             qDebug() << "cached file has gone missing for queue ID" << id;
+            _cache.remove(track->hashId());
             _tracksByQueueID.remove(id);
             delete track;
             track = nullptr;
@@ -340,37 +356,57 @@ namespace PMP::Server
 
         if (track) return;
 
-        qDebug() << "putting queue ID" << id << "on the list for preloading";
-
-        track = new PreloadTrack(hash, filename.valueOr({}));
+        auto hashId = _resolver->getID(hash);
+        if (hashId == 0)
+        {
+            qWarning() << "Preloader: no hash ID for queue ID" << id << "with hash" << hash;
+            return;
+        }
 
+        track = new PreloadTrack(hash, hashId, filename.valueOr({}));
         _tracksByQueueID.insert(id, track);
+
+        /* maybe we have it already, from an earlier time this track was queued */
+        auto cachedFile = _cache.lookup(hashId, hash);
+        if (!cachedFile.isEmpty())
+        {
+            qDebug() << "found queue ID" << id << "in the preload cache";
+            track->setToLoaded(cachedFile);
+            scheduleCacheIndexSave();
+            Q_EMIT trackPreloaded(id);
+            return;
+        }
+
+        qDebug() << "putting queue ID" << id << "on the list for preloading";
         _tracksToPreload.append(id);
     }
 
-    Future<QString, FailureType> Preloader::preloadAsync(uint queueId, FileHash hash,
+    Future<QString, FailureType> Preloader::preloadAsync(uint hashId, FileHash hash,
                                                          QString originalFilename)
     {
+        auto directory = _cache.directory();
+
         if (!originalFilename.isEmpty()
                 && _resolver->pathStillValid(hash, originalFilename))
         {
             return Concurrent::runOnThreadPool<QString, FailureType>(
                 globalThreadPool,
-                [queueId, originalFilename]()
+                [hashId, originalFilename, directory]()
                 {
-                    return runPreload(queueId, originalFilename);
+                    return runPreload(hashId, originalFilename, directory);
                 }
             );
         }
 
-        qDebug() << "Preloader: don't have a filename yet for queue ID" << queueId
-                 << "which has hash" << hash;
+        qDebug() << "Preloader: don't have a filename yet for hash ID" << hashId
+                 << "which is hash" << hash;
 
         return
             _resolver->findPathForHashAsync(hash)
                 .thenOnThreadPool<QString, FailureType>(
                     globalThreadPool,
-                    [queueId](FailureOr<QString> outcome) -> FailureOr<QString>
+                    [hashId, directory](FailureOr<QString> outcome)
+                        -> FailureOr<QString>
                     {
                         if (outcome.failed())
                             return failure;
@@ -378,18 +414,19 @@ namespace PMP::Server
                         auto path = outcome.result();
 
                         qDebug() << "Preloader: found path" << path
-                                 << "for queue ID" << queueId;
+                                 << "for hash ID" << hashId;
 
-                        return runPreload(queueId, path);
+                        return runPreload(hashId, path, directory);
                     }
                 );
     }
 
-    ResultOrError<QString, FailureType> Preloader::runPreload(uint queueId,
-                                                              QString originalFilename)
+    ResultOrError<QString, FailureType> Preloader::runPreload(uint hashId,
+                                                              QString originalFilename,
+                                                              QString cacheDirectory)
     {
         qDebug() << "Preloader: will process" << originalFilename
-                 << "for queue ID" << queueId;
+                 << "for hash ID" << hashId;
 
         QFileInfo fileInfo(originalFilename);
         if (!fileInfo.isFile() || !fileInfo.isReadable())
@@ -400,6 +437,50 @@ namespace PMP::Server
 
         QString extension = fileInfo.suffix();
 
+        QString saveName =
+            cacheDirectory + "/" + PreloadCache::fileNameFor(hashId, extension);
+
+        /* a file that is not in the cache index is a leftover; replace it */
+        if (QFileInfo::exists(saveName) && !QFile::remove(saveName))
+        {
+            qWarning() << "Preloader: cannot replace existing file" << saveName;
+            return failure;
+        }
+
+        qint64 dataOffset = 0;
+        if (!FileAnalyzer::getPlaybackDataOffset(originalFilename, extension, dataOffset))
+        {
+            qDebug() << "Preloader: cannot determine the playback data range of"
+                     << originalFilename << "; processing the whole file";
+
+            auto result = preloadByRewriting(originalFilename, extension, saveName);
+            if (result.failed())
+                return failure;
+        }
+        else if (dataOffset == 0 && createHardLink(originalFilename, saveName))
+        {
+            /* the link shares its contents with the original file; the cache detects
+               modifications of the original by checking size and modification time */
+            qDebug() << "Preloader: file needs no changes; created hard link"
+                     << saveName << "for hash ID" << hashId;
+            return saveName;
+        }
+        else
+        {
+            auto result = copyFileData(originalFilename, dataOffset, saveName);
+            if (result.failed())
+                return failure;
+        }
+
+        /* success */
+        qDebug() << "Preloader: successfully preloaded file for hash ID" << hashId
+                 << "into cache file:" << saveName;
+        return saveName;
+    }
+
+    SuccessOrFailure Preloader::preloadByRewriting(QString originalFilename,
+                                                   QString extension, QString saveName)
+    {
         QFile file(originalFilename);
         if (!file.open(QIODevice::ReadOnly))
         {
@@ -410,26 +491,39 @@ namespace PMP::Server
         QByteArray contents = file.readAll();
         file.close();
 
-        qDebug() << "Preloader: read" << contents.size() << "bytes from"
-                 << originalFilename << "for queue ID" << queueId;
-
         if (!FileAnalyzer::preprocessFileForPlayback(contents, extension))
         {
             qWarning() << "Preloader: failed to preprocess file" << originalFilename;
             return failure;
         }
 
-        QString tempDir;
-        if (QDir::temp().mkpath("PMP-preload-cache"))
-            tempDir = QDir::temp().absolutePath() + "/PMP-preload-cache";
-        else
-            tempDir = QDir::temp().absolutePath();
+        QSaveFile saveFile(saveName);
+        if (!saveFile.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "Preloader: failed to open temp file for writing:" << saveName;
+            return failure;
+        }
+
+        saveFile.write(contents);
+        if (!saveFile.commit())
+        {
+            QFile::remove(saveName);
+            qWarning() << "Preloader: failed to commit changes to temp file" << saveName;
+            return failure;
+        }
+
+        return success;
+    }
+
+    SuccessOrFailure Preloader::copyFileData(QString originalFilename, qint64 offset,
+                                             QString saveName)
+    {
+        const qint64 chunkSize = 1024 * 1024;
 
-        QString saveName = tempDir + "/" + tempFilename(queueId, extension);
-        QFileInfo saveFileInfo(saveName);
-        if (saveFileInfo.exists())
+        QFile file(originalFilename);
+        if (!file.open(QIODevice::ReadOnly) || !file.seek(offset))
         {
-            qWarning() << "Preloader: name collision for temp file" << saveName;
+            qWarning() << "Preloader: failed to open file:" << originalFilename;
             return failure;
         }
 
@@ -440,7 +534,23 @@ namespace PMP::Server
             return failure;
         }
 
-        saveFile.write(contents);
+        /* stream the data instead of reading the whole file into memory */
+        QByteArray buffer(int(chunkSize), Qt::Uninitialized);
+        while (true)
+        {
+            auto bytesRead = file.read(buffer.data(), chunkSize);
+            if (bytesRead == 0)
+                break;
+
+            if (bytesRead < 0 || saveFile.write(buffer.constData(), bytesRead) != bytesRead)
+            {
+                qWarning() << "Preloader: failed to copy" << originalFilename
+                           << "to temp file" << saveName;
+                saveFile.cancelWriting();
+                return failure;
+            }
+        }
+
         if (!saveFile.commit())
         {
             QFile::remove(saveName);
@@ -448,16 +558,52 @@ namespace PMP::Server
             return failure;
         }
 
-        /* success */
-        qDebug() << "Preloader: successfully preloaded file for queue ID" << queueId
-                 << "into temp file:" << saveName;
-        return saveName;
+        return success;
     }
 
-    QString Preloader::tempFilename(uint queueId, QString extension)
+    bool Preloader::createHardLink(QString existingFilename, QString linkName)
     {
-        return "P" + QString::number(QCoreApplication::applicationPid())
-                + "-Q" + QString::number(queueId) + "." + extension;
+#ifdef Q_OS_WIN
+        auto nativeExisting = QDir::toNativeSeparators(existingFilename);
+        auto nativeLink = QDir::toNativeSeparators(linkName);
+
+        return CreateHardLinkW(reinterpret_cast<LPCWSTR>(nativeLink.utf16()),
+                               reinterpret_cast<LPCWSTR>(nativeExisting.utf16()),
+                               nullptr) != 0;
+#else
+        /* fails when the file is on a different file system; we will copy it then */
+        auto encodedExisting = QFile::encodeName(existingFilename);
+        auto encodedLink = QFile::encodeName(linkName);
+
+        return ::link(encodedExisting.constData(), encodedLink.constData()) == 0;
+#endif
+    }
+
+    QString Preloader::cacheDirectory()
+    {
+        /* hash IDs are specific to a database, so each database needs its own cache */
+        auto databaseUuid = Database::getDatabaseUuid();
+        auto subdirectory =
+            databaseUuid.isNull() ? QString("no-database")
+                                  : databaseUuid.toString(QUuid::WithoutBraces);
+
+        auto directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        if (!directory.isEmpty())
+        {
+            directory += "/preload-cache/" + subdirectory;
+            if (QDir().mkpath(directory))
+                return directory;
+        }
+
+        /* fall back to a subdirectory of the old location */
+        auto fallback = legacyCacheDirectory() + "/persistent/" + subdirectory;
+        QDir().mkpath(fallback);
+        return fallback;
+    }
+
+    QString Preloader::legacyCacheDirectory()
+    {
+        return QDir::temp().absolutePath() + "/PMP-preload-cache";
     }
 
     void Preloader::checkForJobsToStart()
@@ -476,26 +622,46 @@ namespace PMP::Server
             if (!track) continue; /* already removed */
             if (track->status() != PreloadTrack::Status::Initial) continue;
 
-            qDebug() << "starting track preload task for QID" << queueId;
-
             track->setToLoading();
 
-            auto future = preloadAsync(queueId, track->hash(), track->originalFilename());
+            auto hashId = track->hashId();
+            if (_hashIdsInProgress.contains(hashId))
+                continue; /* same track queued twice; will be updated when job finishes */
+
+            qDebug() << "starting track preload task for QID" << queueId
+                     << "with hash ID" << hashId;
+
+            _hashIdsInProgress.insert(hashId);
+            auto future = preloadAsync(hashId, track->hash(), track->originalFilename());
             _jobsRunning++;
 
             future.handleOnEventLoop(
                 this,
-                [this, queueId](FailureOr<QString> outcome)
+                [this, hashId, hash = track->hash()](FailureOr<QString> outcome)
                 {
                     if (outcome.succeeded())
-                        preloadFinished(queueId, outcome.result());
+                        preloadFinished(hashId, hash, outcome.result());
                     else
-                        preloadFailed(queueId);
+                        preloadFailed(hashId);
                 }
             );
         }
     }
 
+    void Preloader::scheduleCacheIndexSave()
+    {
+        if (_cacheIndexSaveTimerRunning) return;
+
+        _cacheIndexSaveTimerRunning = true;
+        QTimer::singleShot(2000, this, &Preloader::saveCacheIndex);
+    }
+
+    void Preloader::saveCacheIndex()
+    {
+        _cacheIndexSaveTimerRunning = false;
+        _cache.saveIndexIfChanged();
+    }
+
     void Preloader::scheduleCheckForCacheEntriesToDelete()
     {
         if (_cacheExpirationCheckTimerRunning) return;
@@ -510,63 +676,66 @@ namespace PMP::Server
     {
         _cacheExpirationCheckTimerRunning = false;
 
-        int max = 3;
-        for (int i = 0; i < max && i < _tracksRemoved.size(); ++i)
+        /* forget about the queue entries that were removed; their files stay in the
+           cache, they might be needed again later */
+        for (auto id : qAsConst(_tracksRemoved))
         {
-            auto id = _tracksRemoved[i];
+            auto track = _tracksByQueueID.take(id);
+            delete track;
+        }
+        _tracksRemoved.clear();
 
-            if (_lockedQueueIds.contains(id)) continue;
+        _cache.evictIfOverBudget(
+            [this](uint hashId) { return isHashIdInUse(hashId); }
+        );
 
-            auto track = _tracksByQueueID.value(id, nullptr);
-            if (track && track->status() == PreloadTrack::Status::Processing)
-                continue; /* we'll have to wait */
+        scheduleCacheIndexSave();
+    }
 
-            qDebug() << "deleting preload-cache info (if any) for QID" << id;
+    void Preloader::preloadFailed(uint hashId)
+    {
+        qDebug() << "Preloader: preload job FAILED for hash ID" << hashId;
 
-            max--;
-            _tracksRemoved.removeAt(i);
-            i--;
+        _jobsRunning--;
+        _hashIdsInProgress.remove(hashId);
 
-            if (!track)
-            {
-                /* no object to delete */
-            }
-            else if (track->cleanup())
-            {
-                _tracksByQueueID.remove(id);
-                delete track;
-            }
-            else
+        for (auto* track : qAsConst(_tracksByQueueID))
+        {
+            if (track->hashId() == hashId
+                    && track->status() == PreloadTrack::Status::Processing)
             {
-                /* we will try again later */
-                _tracksRemoved.append(id);
+                track->setToFailed();
             }
         }
+
+        checkForJobsToStart();
     }
 
-    void Preloader::preloadFailed(uint queueID)
+    bool Preloader::isHashIdInUse(uint hashId) const
     {
-        qDebug() << "Preloader: preload job FAILED for QID" << queueID;
-
-        _jobsRunning--;
+        if (_lockedHashIds.contains(hashId) || _hashIdsInProgress.contains(hashId))
+            return true;
 
-        auto track = _tracksByQueueID.value(queueID, nullptr);
-        if (track) track->setToFailed();
+        for (auto* track : qAsConst(_tracksByQueueID))
+        {
+            if (track->hashId() == hashId)
+                return true;
+        }
 
-        checkForJobsToStart();
+        return false;
     }
 
-    void Preloader::doLock(uint queueId)
+    void Preloader::doLock(uint hashId)
     {
-        _lockedQueueIds[queueId]++;
+        _lockedHashIds[hashId]++;
     }
 
-    void Preloader::doUnlock(uint queueId)
+    void Preloader::doUnlock(uint hashId)
     {
-        auto lockIterator = _lockedQueueIds.find(queueId);
-        if (lockIterator == _lockedQueueIds.end())
+        auto lockIterator = _lockedHashIds.find(hashId);
+        if (lockIterator == _lockedHashIds.end())
         {
-            qWarning() << "Preloader::doUnlock: no lock found for QID" << queueId << "!";
+            qWarning() << "Preloader::doUnlock: no lock found for hash ID" << hashId << "!";
             return;
         }
 
@@ -577,39 +746,43 @@ namespace PMP::Server
         }
         else
         {
-            qWarning() << "Preloader::doUnlock: lock count for QID" << queueId
+            qWarning() << "Preloader::doUnlock: lock count for hash ID" << hashId
                        << "already zero!";
         }
 
         if (lockCount > 0) return; /* not completely unlocked yet */
 
-        _lockedQueueIds.erase(lockIterator);
+        _lockedHashIds.erase(lockIterator);
         scheduleCheckForCacheEntriesToDelete();
     }
 
-    void Preloader::preloadFinished(uint queueID, QString cacheFile)
+    void Preloader::preloadFinished(uint hashId, FileHash hash, QString cacheFile)
     {
-        qDebug() << "Preloader: preload job finished for QID" << queueID
+        qDebug() << "Preloader: preload job finished for hash ID" << hashId
                  << ": saved as" << cacheFile;
 
         _jobsRunning--;
+        _hashIdsInProgress.remove(hashId);
 
-        auto track = _tracksByQueueID.value(queueID, nullptr);
-        if (track)
-        {
-            track->setToLoaded(cacheFile);
-        }
-        else
+        _cache.add(hashId, hash, cacheFile);
+
+        QVector<uint> queueIds;
+        for (auto it = _tracksByQueueID.constBegin(); it != _tracksByQueueID.constEnd();
+             ++it)
         {
-            qDebug() << "QID" << queueID
-                     << "seems to be no longer needed, discarding cache file";
-            QFile::remove(cacheFile);
+            auto* track = it.value();
+            if (track->hashId() == hashId
+                    && track->status() == PreloadTrack::Status::Processing)
+            {
+                track->setToLoaded(cacheFile);
+                queueIds.append(it.key());
+            }
         }
 
         checkForJobsToStart();
         scheduleCheckForCacheEntriesToDelete();
 
-        Q_EMIT trackPreloaded(queueID);
+        for (auto queueId : qAsConst(queueIds))
+            Q_EMIT trackPreloaded(queueId);
     }
-
 }
@@ -25,10 +25,13 @@
 #include "common/future.h"
 #include "common/qobjectresourcekeeper.h"
 
+#include "preloadcache.h"
+
 #include <QHash>
 #include <QMutex>
 #include <QList>
 #include <QObject>
+#include <QSet>
 
 namespace PMP::Server
 {
@@ -87,35 +90,50 @@ namespace PMP::Server
         void checkForCacheExpiration();
 
         void checkForJobsToStart();
+        void scheduleCacheIndexSave();
+        void saveCacheIndex();
 
-        void preloadFinished(uint queueID, QString cacheFile);
-        void preloadFailed(uint queueID);
+        void preloadFinished(uint hashId, PMP::FileHash hash, QString cacheFile);
+        void preloadFailed(uint hashId);
 
     private:
-        static const int PRELOAD_RANGE = 5;
+        static const int PRELOAD_MAX_RANGE = 10;
+        static const qint64 PRELOAD_BYTE_BUDGET = 300 * 1024 * 1024;
+        static const qint64 PRELOAD_CACHE_BYTE_BUDGET = 1024 * 1024 * 1024;
 
         void checkToPreloadTrack(QSharedPointer<QueueEntry> entry);
 
-        Future<QString, FailureType> preloadAsync(uint queueId, FileHash hash,
+        Future<QString, FailureType> preloadAsync(uint hashId, FileHash hash,
                                                   QString originalFilename);
-        static ResultOrError<QString, FailureType> runPreload(uint queueId,
-                                                              QString originalFilename);
-
-        static QString tempFilename(uint queueId, QString extension);
-
-        void doLock(uint queueId);
-        void doUnlock(uint queueId);
-
-        QHash<uint, uint> _lockedQueueIds;
+        static ResultOrError<QString, FailureType> runPreload(uint hashId,
+                                                              QString originalFilename,
+                                                              QString cacheDirectory);
+        static SuccessOrFailure preloadByRewriting(QString originalFilename,
+                                                   QString extension, QString saveName);
+        static SuccessOrFailure copyFileData(QString originalFilename, qint64 offset,
+                                             QString saveName);
+        static bool createHardLink(QString existingFilename, QString linkName);
+        static QString cacheDirectory();
+        static QString legacyCacheDirectory();
+
+        bool isHashIdInUse(uint hashId) const;
+
+        void doLock(uint hashId);
+        void doUnlock(uint hashId);
+
+        QHash<uint, uint> _lockedHashIds;
         PlayerQueue* _queue;
         Resolver* _resolver;
+        PreloadCache _cache;
         QHash<uint, PreloadTrack*> _tracksByQueueID;
         QList<uint> _tracksToPreload;
         QList<uint> _tracksRemoved;
+        QSet<uint> _hashIdsInProgress;
         uint _jobsRunning;
         bool _firstTrackCheckTimerRunning;
         bool _preloadCheckTimerRunning;
         bool _cacheExpirationCheckTimerRunning;
+        bool _cacheIndexSaveTimerRunning { false };
     };
 }
 #endif
@@ -97,6 +97,32 @@ namespace PMP::Server
         return hash;
     }
 
+    bool RandomTracksSource::takeSpecificTrack(const FileHash& hash)
+    {
+        auto status = getTrackStatus(hash);
+        if (status != TrackStatus::Unused && status != TrackStatus::Used)
+            return false; /* unknown, or taken already */
+
+        if (status == TrackStatus::Unused)
+        {
+            /* the list is in random order, so the last element can take its place */
+            auto index = _unusedHashes.lastIndexOf(hash);
+            std::swap(_unusedHashes[index], _unusedHashes.last());
+            _unusedHashes.removeLast();
+
+            /* one less track in the list, just like in takeTrack */
+            if (_notifiedCount > 0)
+            {
+                _notifiedCount--;
+            }
+        }
+
+        _hashesStatus.insert(hash, TrackStatus::Taken);
+        _hashesTaken.insert(hash);
+
+        return true;
+    }
+
     void RandomTracksSource::putBackUsedTrack(const FileHash& hash)
     {
         auto status = getTrackStatus(hash);
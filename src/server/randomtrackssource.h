@@ -40,8 +40,11 @@ namespace PMP::Server
         RandomTracksSource(QObject* parent, Resolver* resolver);
 
         int totalTrackCount() const { return _hashesStatus.size(); }
+        int unusedTrackCount() const { return _unusedHashes.size(); }
+        int takenTrackCount() const { return _hashesTaken.size(); }
 
         FileHash takeTrack();
+        bool takeSpecificTrack(const FileHash& hash);
 
         void putBackUsedTrack(const FileHash& hash);
         void putBackUnusedTrack(const FileHash& hash);
@@ -22,29 +22,83 @@
 #include "common/async.h"
 #include "common/concurrent.h"
 #include "common/fileanalyzer.h"
+#include "common/stringpool.h"
 
 #include "analyzer.h"
+#include "bookkeepingwritequeue.h"
 #include "database.h"
+#include "directorytraversal.h"
 #include "filefinder.h"
 #include "hashidregistrar.h"
 #include "hashrelations.h"
 #include "historystatistics.h"
+#include "musicfolderwatcher.h"
+#include "resolversnapshot.h"
 
-#include <QDirIterator>
 #include <QFileInfo>
 #include <QSet>
 #include <QtConcurrent/QtConcurrent>
 #include <QtDebug>
 #include <QThreadPool>
+#include <QTimer>
 
 #include <algorithm>
 #include <limits>
 
 namespace PMP::Server
 {
+    namespace
+    {
+        const int traversalThreadCount = 4;
+        const int snapshotSaveIntervalMilliseconds = 30 * 60 * 1000;
+
+        TagData internTagStrings(TagData const& tag)
+        {
+            auto& pool = StringPool::tagStrings();
+
+            return TagData(pool.intern(tag.artist()), pool.intern(tag.title()),
+                           pool.intern(tag.album()), pool.intern(tag.albumArtist()),
+                           tag.comment());
+        }
+    }
 
     /* ========================== private class declarations ========================== */
 
+    /** Holds the write lock of the Resolver, like QWriteLocker.
+
+        Signals about changes that were made while holding the write lock are only
+        emitted after it has been released by the outermost WriteLocker.  Receivers
+        often call back into the Resolver, and a thread that holds the write lock
+        cannot also obtain the read lock.
+    */
+    class Resolver::WriteLocker
+    {
+    public:
+        explicit WriteLocker(Resolver* resolver)
+         : _resolver(resolver)
+        {
+            _resolver->_lock.lockForWrite();
+            _resolver->_writeLockDepth++;
+        }
+
+        ~WriteLocker()
+        {
+            QVector<std::function<void ()>> signalsToEmit;
+            if (--_resolver->_writeLockDepth == 0)
+                signalsToEmit.swap(_resolver->_signalsToEmit);
+
+            _resolver->_lock.unlock();
+
+            for (auto const& emitSignal : qAsConst(signalsToEmit))
+                emitSignal();
+        }
+
+    private:
+        Q_DISABLE_COPY(WriteLocker)
+
+        Resolver* _resolver;
+    };
+
     struct Resolver::VerifiedFile
     {
         Resolver::HashKnowledge* _parent;
@@ -83,7 +137,7 @@ namespace PMP::Server
             return _indexationNumber == indexationNumber;
         }
 
-        bool stillValid();
+        bool stillValid() const;
     };
 
     class Resolver::HashKnowledge
@@ -135,19 +189,26 @@ namespace PMP::Server
 
         void addInfo(AudioData const& audio, TagData const& t);
 
-        TagData const* findBestTag();
-        QString quickTitle() { return _quickTitle; }
-        QString quickArtist() { return _quickArtist; }
-        QString quickAlbum() { return _quickAlbum; }
-        QString quickAlbumArtist() { return _quickAlbumArtist; }
+        QList<const TagData*> const& tags() const { return _tags; }
+        TagData const* findBestTag() const;
+        QString quickTitle() const { return _quickTitle; }
+        QString quickArtist() const { return _quickArtist; }
+        QString quickAlbum() const { return _quickAlbum; }
+        QString quickAlbumArtist() const { return _quickAlbumArtist; }
 
         void addPath(const QString& filename,
                      qint64 fileSize, QDateTime fileLastModified, uint indexationNumber);
+        bool restorePath(const QString& filename,
+                         qint64 fileSize, QDateTime fileLastModified);
         void removeInvalidPath(Resolver::VerifiedFile* file);
+        QList<Resolver::VerifiedFile*> const& files() const { return _files; }
 
-        bool isAvailable();
         bool isStillValid(Resolver::VerifiedFile* file);
-        QString getFile();
+
+        /* these do not modify anything, so they can be used with just a read lock;
+           invalid paths they encounter are added to 'invalidPaths' instead */
+        bool isAvailable(QVector<QString>& invalidPaths) const;
+        QString getFile(QVector<QString>& invalidPaths) const;
     };
 
     /* ========================== VerifiedFile ========================== */
@@ -159,7 +220,7 @@ namespace PMP::Server
             && _parent->hash() == hash;
     }
 
-    bool Resolver::VerifiedFile::stillValid()
+    bool Resolver::VerifiedFile::stillValid() const
     {
         QFileInfo info(_path);
 
@@ -191,14 +252,16 @@ namespace PMP::Server
             lengthChanged = true;
         }
 
-        /* check for duplicate tags */
+        /* check for duplicate tags; interned strings can be compared by pointer */
+        auto const tag = internTagStrings(t);
         bool tagIsNew = true;
         for (auto* existing : qAsConst(_tags))
         {
-            if (existing->title() == t.title()
-                    && existing->artist() == t.artist()
-                    && existing->album() == t.album()
-                    && existing->albumArtist() == t.albumArtist())
+            if (StringPool::isSameInternedString(existing->title(), tag.title())
+                && StringPool::isSameInternedString(existing->artist(), tag.artist())
+                && StringPool::isSameInternedString(existing->album(), tag.album())
+                && StringPool::isSameInternedString(existing->albumArtist(),
+                                                    tag.albumArtist()))
             {
                 tagIsNew = false;
                 break;
@@ -208,7 +271,7 @@ namespace PMP::Server
         bool quickTagsChanged = false;
         if (tagIsNew)
         {
-            _tags.append(new TagData(t));
+            _tags.append(new TagData(tag));
 
             auto tags = findBestTag();
             if (tags)
@@ -240,15 +303,25 @@ namespace PMP::Server
             }
         }
 
+        if (tagIsNew || lengthChanged)
+            _parent->_snapshotOutdated.storeRelaxed(1);
+
         if (lengthChanged || quickTagsChanged)
         {
-            Q_EMIT _parent->hashTagInfoChanged(_hash, _quickTitle, _quickArtist,
-                                               _quickAlbum, _quickAlbumArtist,
-                                               _audio.trackLengthMilliseconds());
+            auto parent = _parent;
+            _parent->emitAfterUnlocking(
+                [parent, hash = _hash, title = _quickTitle, artist = _quickArtist,
+                 album = _quickAlbum, albumArtist = _quickAlbumArtist,
+                 length = lengthInMilliseconds()]()
+                {
+                    Q_EMIT parent->hashTagInfoChanged(hash, title, artist, album,
+                                                      albumArtist, length);
+                }
+            );
         }
     }
 
-    TagData const* Resolver::HashKnowledge::findBestTag()
+    TagData const* Resolver::HashKnowledge::findBestTag() const
     {
         /* try to return a match with complete tags */
         const TagData* bestTag = nullptr;
@@ -328,29 +401,60 @@ namespace PMP::Server
                                 indexationNumber);
         _files.append(file);
         _parent->_pathToVerifiedFile[filename] = file;
+        _parent->_snapshotOutdated.storeRelaxed(1);
 
-        // TODO: move this to another thread
-        auto db = Database::getDatabaseForCurrentThread();
-        if (_hashId > 0 && db)
+        if (_hashId > 0)
         {
-            int currentYear = QDateTime::currentDateTimeUtc().date().year();
+            auto writeQueue = _parent->_bookkeepingWriteQueue;
 
             /* save filename without path in the database */
-            db->registerFilenameSeen(_hashId, info.fileName(), currentYear);
+            writeQueue->registerFilenameSeen(_hashId, info.fileName());
 
-            db->registerFileSizeSeen(_hashId, fileSize, currentYear);
+            writeQueue->registerFileSizeSeen(_hashId, fileSize);
         }
 
         if (_files.length() == 1) /* count went from 0 to 1 */
         {
-            Q_EMIT _parent->hashBecameAvailable(_hash);
+            auto parent = _parent;
+            _parent->emitAfterUnlocking(
+                [parent, hash = _hash]() { Q_EMIT parent->hashBecameAvailable(hash); }
+            );
+        }
+    }
+
+    bool Resolver::HashKnowledge::restorePath(const QString& filename,
+                                              qint64 fileSize,
+                                              QDateTime fileLastModified)
+    {
+        /* a path that was analyzed already is more up-to-date than the snapshot */
+        if (_parent->_pathToVerifiedFile.contains(filename))
+            return false;
+
+        /* indexation number zero, so it will be verified by the next full indexation */
+        auto file = new VerifiedFile(this, filename, fileSize, fileLastModified, 0);
+        _files.append(file);
+        _parent->_pathToVerifiedFile[filename] = file;
+
+        if (_hashId > 0)
+            _parent->_fileLocations.insert(_hashId, filename);
+
+        if (_files.length() == 1) /* count went from 0 to 1 */
+        {
+            auto parent = _parent;
+            _parent->emitAfterUnlocking(
+                [parent, hash = _hash]() { Q_EMIT parent->hashBecameAvailable(hash); }
+            );
         }
+
+        return true;
     }
 
     void Resolver::HashKnowledge::removeInvalidPath(Resolver::VerifiedFile* file)
     {
         qDebug() << "Resolver: removing path:" << file->_path;
 
+        _parent->_snapshotOutdated.storeRelaxed(1);
+
         _parent->_fileLocations.remove(_hashId, file->_path);
 
         if (_parent->_pathToVerifiedFile.value(file->_path, nullptr) == file)
@@ -363,7 +467,10 @@ namespace PMP::Server
 
         if (_files.length() == 0) /* count went from 1 to 0 */
         {
-            Q_EMIT _parent->hashBecameUnavailable(_hash);
+            auto parent = _parent;
+            _parent->emitAfterUnlocking(
+                [parent, hash = _hash]() { Q_EMIT parent->hashBecameUnavailable(hash); }
+            );
         }
     }
 
@@ -377,25 +484,18 @@ namespace PMP::Server
         return false;
     }
 
-    bool Resolver::HashKnowledge::isAvailable()
+    bool Resolver::HashKnowledge::isAvailable(QVector<QString>& invalidPaths) const
     {
-        for (auto file : qAsConst(_files))
-        {
-            if (file->stillValid()) return true;
-
-            removeInvalidPath(file);
-        }
-
-        return false;
+        return !getFile(invalidPaths).isEmpty();
     }
 
-    QString Resolver::HashKnowledge::getFile()
+    QString Resolver::HashKnowledge::getFile(QVector<QString>& invalidPaths) const
     {
-        for (auto file : qAsConst(_files))
+        for (auto file : _files)
         {
             if (file->stillValid()) return file->_path;
 
-            removeInvalidPath(file);
+            invalidPaths << file->_path;
         }
 
         return {}; /* no file available */
@@ -408,11 +508,18 @@ namespace PMP::Server
      : _hashIdRegistrar(hashIdRegistrar),
        _hashRelations(hashRelations),
        _historyStatistics(historyStatistics),
-       _lock(QMutex::Recursive),
+       _lock(QReadWriteLock::Recursive),
        _fullIndexationNumber(1)
     {
         _analyzer = new Analyzer(this);
-        _fileFinder = new FileFinder(this, _hashIdRegistrar, &_fileLocations, _analyzer);
+        _bookkeepingWriteQueue = new BookkeepingWriteQueue(this);
+        _fileFinder = new FileFinder(this, _hashIdRegistrar, &_fileLocations,
+                                     &_fileSystemIndex, _analyzer);
+        _folderWatcher = new MusicFolderWatcher(this);
+
+        /* several threads, so that the latency of network shares can overlap */
+        _traversalThreadPool = new QThreadPool(this);
+        _traversalThreadPool->setMaxThreadCount(traversalThreadCount);
 
         connect(_analyzer, &Analyzer::fileAnalysisFailed,
                 this, &Resolver::onFileAnalysisFailed);
@@ -421,6 +528,20 @@ namespace PMP::Server
         connect(_analyzer, &Analyzer::finished,
                 this, &Resolver::onAnalyzerFinished);
 
+        connect(_folderWatcher, &MusicFolderWatcher::filesChanged,
+                this, &Resolver::onWatchedFilesChanged);
+        connect(_folderWatcher, &MusicFolderWatcher::pathsRemoved,
+                this, &Resolver::onWatchedPathsRemoved);
+        connect(_folderWatcher, &MusicFolderWatcher::scanForNewFilesNeeded,
+                this, &Resolver::onFolderWatcherScanNeeded);
+
+        _snapshotTimer = new QTimer(this);
+        _snapshotTimer->setInterval(snapshotSaveIntervalMilliseconds);
+        connect(_snapshotTimer, &QTimer::timeout, this, &Resolver::saveSnapshotAsync);
+        _snapshotTimer->start();
+
+        loadSnapshotAsync();
+
         auto dbLoadingFuture = _hashIdRegistrar->loadAllFromDatabase();
         dbLoadingFuture.handleOnEventLoop(
             this,
@@ -437,7 +558,7 @@ namespace PMP::Server
                 auto allHashes = _hashIdRegistrar->getAllLoaded();
 
                 uint newHashesCount = 0;
-                QMutexLocker lock(&_lock);
+                WriteLocker lock(this);
                 for (auto& pair : allHashes)
                 {
                     if (_idToKnowledge.contains(pair.first))
@@ -456,11 +577,30 @@ namespace PMP::Server
         );
     }
 
+    Resolver::~Resolver()
+    {
+        if (Database::getDatabaseUuid().isNull())
+            return;
+
+        if (_snapshotOutdated.loadRelaxed() == 0)
+            return;
+
+        qDebug() << "Resolver: saving snapshot before exiting";
+        (void)createSnapshot().saveToFile(ResolverSnapshot::defaultFilePath());
+    }
+
     void Resolver::setMusicPaths(QStringList paths)
     {
         _fileFinder->setMusicPaths(paths);
+        _folderWatcher->setMusicPaths(paths);
+
+        WriteLocker lock(this);
+        if (paths != _musicPaths)
+        {
+            _fileSystemIndex.clear(); /* needs a new traversal to become complete */
+            _directoryListingCache.clear();
+        }
 
-        QMutexLocker lock(&_lock);
         _musicPaths = paths;
 
         qDebug() << "music paths set to:" << paths.join("; ");
@@ -468,12 +608,23 @@ namespace PMP::Server
 
     QStringList Resolver::musicPaths()
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
         QStringList paths = _musicPaths;
         paths.detach();
         return paths;
     }
 
+    void Resolver::setAnalysisParallelism(int threadCount, qint64 maxBytesInFlight)
+    {
+        _analyzer->setAnalysisThreadCount(threadCount);
+        _analyzer->setMaxBytesInFlight(maxBytesInFlight);
+    }
+
+    void Resolver::setAnalysisCacheVerificationPercentage(int percentage)
+    {
+        _analyzer->setCacheVerificationPercentage(percentage);
+    }
+
     bool Resolver::isFullIndexationRunning()
     {
         return _fullIndexationStatus != FullIndexationStatus::NotRunning;
@@ -519,6 +670,8 @@ namespace PMP::Server
     {
         qDebug() << "quick scan for new files finished";
 
+        _bookkeepingWriteQueue->flush();
+
         Q_EMIT quickScanForNewFilesRunStatusChanged();
     }
 
@@ -526,6 +679,8 @@ namespace PMP::Server
     {
         qDebug() << "full indexation finished";
 
+        _bookkeepingWriteQueue->flush();
+
         Q_EMIT fullIndexationRunStatusChanged();
     }
 
@@ -558,7 +713,7 @@ namespace PMP::Server
                     if (hashIds.size() > 1)
                         markHashesAsEquivalent(hashIds);
 
-                    QMutexLocker lock(&_lock);
+                    WriteLocker lock(this);
 
                     HashKnowledge* knowledge;
                     if (!hashes.multipleHashes())
@@ -632,6 +787,69 @@ namespace PMP::Server
         }
     }
 
+    void Resolver::onWatchedFilesChanged(QStringList paths)
+    {
+        uint fileCount = 0;
+        for (auto const& path : qAsConst(paths))
+        {
+            /* forget the old contents of the file if it was modified */
+            checkFileStillExistsAndIsValid(path);
+
+            QFileInfo info(path);
+            if (!FileAnalyzer::isFileSupported(info)) continue;
+
+            _fileSystemIndex.insert(info.absoluteFilePath(), info.size());
+
+            fileCount++;
+            _analyzer->enqueueFile(info.absoluteFilePath());
+        }
+
+        qDebug() << "Resolver:" << fileCount
+                 << "new or modified files added to analysis queue";
+    }
+
+    void Resolver::onWatchedPathsRemoved(QStringList paths)
+    {
+        QVector<QString> pathsToCheck;
+
+        {
+            QReadLocker lock(&_lock);
+
+            for (auto const& path : qAsConst(paths))
+            {
+                _fileSystemIndex.removePathOrTree(path);
+
+                if (_pathToVerifiedFile.contains(path))
+                {
+                    pathsToCheck << path;
+                    continue;
+                }
+
+                /* it might have been a directory; its files are next to each other */
+                auto prefix = path + "/";
+                for (auto it = qAsConst(_pathToVerifiedFile).lowerBound(prefix);
+                     it != _pathToVerifiedFile.constEnd() && it.key().startsWith(prefix);
+                     ++it)
+                {
+                    pathsToCheck << it.key();
+                }
+            }
+        }
+
+        for (auto const& path : qAsConst(pathsToCheck))
+        {
+            checkFileStillExistsAndIsValid(path);
+        }
+    }
+
+    void Resolver::onFolderWatcherScanNeeded()
+    {
+        if (isFullIndexationRunning() || isQuickScanForNewFilesRunning())
+            return; /* the running scan will do */
+
+        (void)startQuickScanForNewFiles();
+    }
+
     Future<QString, FailureType> Resolver::findPathForHashAsync(FileHash hash)
     {
         if (hash.isNull())
@@ -641,12 +859,15 @@ namespace PMP::Server
         }
 
         {
-            QMutexLocker lock(&_lock);
+            QReadLocker lock(&_lock);
 
-            auto it = _hashToKnowledge.find(hash);
-            if (it != _hashToKnowledge.end())
+            auto it = _hashToKnowledge.constFind(hash);
+            if (it != _hashToKnowledge.constEnd())
             {
-                auto path = it.value()->getFile();
+                QVector<QString> invalidPaths;
+                auto path = it.value()->getFile(invalidPaths);
+                scheduleRemovalOfInvalidPaths(invalidPaths);
+
                 if (!path.isEmpty())
                 {
                     return FutureResult(path);
@@ -678,10 +899,10 @@ namespace PMP::Server
         FileHash hash;
 
         {
-            QMutexLocker lock(&_lock);
+            QReadLocker lock(&_lock);
 
-            auto it = _idToKnowledge.find(hashId);
-            if (it == _idToKnowledge.end())
+            auto it = _idToKnowledge.constFind(hashId);
+            if (it == _idToKnowledge.constEnd())
             {
                 qWarning() << "Resolver: hash ID" << hashId << "is unknown";
                 return FutureError(failure);
@@ -689,7 +910,10 @@ namespace PMP::Server
 
             hash = it.value()->hash();
 
-            auto path = it.value()->getFile();
+            QVector<QString> invalidPaths;
+            auto path = it.value()->getFile(invalidPaths);
+            scheduleRemovalOfInvalidPaths(invalidPaths);
+
             if (!path.isEmpty())
             {
                 return FutureResult(path);
@@ -703,7 +927,7 @@ namespace PMP::Server
 
     Future<SuccessType, FailureType> Resolver::waitUntilAnyFileAnalyzed(uint hashId)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         auto it = _idToKnowledge.constFind(hashId);
         if (it == _idToKnowledge.constEnd())
@@ -722,28 +946,36 @@ namespace PMP::Server
 
         auto musicPaths = this->musicPaths();
 
-        uint fileCount = 0;
-        for (QString const& musicPath : qAsConst(musicPaths))
-        {
-            QDirIterator it(musicPath, QDirIterator::Subdirectories); /* no symlinks */
+        /* unchanged directories can only be skipped if the index is complete already,
+           because the index would lose the files in the directories we skip */
+        bool refreshIndex = !_fileSystemIndex.isComplete();
+        uint indexRefreshNumber = refreshIndex ? _fileSystemIndex.startRefresh() : 0;
 
-            while (it.hasNext())
+        QAtomicInt fileCount { 0 };
+        DirectoryTraversal traversal(
+            _traversalThreadPool,
+            [this, &fileCount](QFileInfo& entry)
             {
-                QFileInfo entry(it.next());
-                if (!FileAnalyzer::isFileSupported(entry)) continue;
-
                 auto absoluteFilePath = entry.absoluteFilePath();
+                _fileSystemIndex.insert(absoluteFilePath, entry.size());
 
                 if (_fileLocations.pathHasAtLeastOneId(absoluteFilePath))
-                    continue; /* not a new file */
+                    return; /* not a new file */
 
-                fileCount++;
+                fileCount.fetchAndAddRelaxed(1);
                 _analyzer->enqueueFile(absoluteFilePath);
             }
-        }
+        );
+        traversal.setListingCache(&_directoryListingCache, !refreshIndex);
+        traversal.run(musicPaths);
+
+        if (refreshIndex)
+            _fileSystemIndex.finishRefresh(indexRefreshNumber);
 
-        qDebug() << "quick scan for new files:"
-                 << fileCount << "files added to analysis queue";
+        qDebug() << "quick scan for new files: traversed"
+                 << traversal.directoryCount() << "directories, of which"
+                 << traversal.skippedDirectoryCount() << "were unchanged;"
+                 << fileCount.loadRelaxed() << "files added to analysis queue";
 
         if (_analyzer->isFinished())
         {
@@ -762,23 +994,31 @@ namespace PMP::Server
         qDebug() << "full indexation: running file system traversal (music paths)";
 
         auto musicPaths = this->musicPaths();
+        auto indexRefreshNumber = _fileSystemIndex.startRefresh();
 
-        uint fileCount = 0;
-        for (QString const& musicPath : qAsConst(musicPaths))
-        {
-            QDirIterator it(musicPath, QDirIterator::Subdirectories); /* no symlinks */
+        /* every file that is found gets looked up in the analysis cache */
+        _analyzer->startCachePruning();
 
-            while (it.hasNext())
+        QAtomicInt fileCount { 0 };
+        DirectoryTraversal traversal(
+            _traversalThreadPool,
+            [this, &fileCount](QFileInfo& entry)
             {
-                QFileInfo entry(it.next());
-                if (!FileAnalyzer::isFileSupported(entry)) continue;
+                auto absoluteFilePath = entry.absoluteFilePath();
+                _fileSystemIndex.insert(absoluteFilePath, entry.size());
 
-                fileCount++;
-                _analyzer->enqueueFile(entry.absoluteFilePath());
+                fileCount.fetchAndAddRelaxed(1);
+                _analyzer->enqueueFile(absoluteFilePath);
             }
-        }
+        );
+        traversal.setListingCache(&_directoryListingCache, false);
+        traversal.run(musicPaths);
 
-        qDebug() << "full indexation:" << fileCount << "files added to analysis queue";
+        _fileSystemIndex.finishRefresh(indexRefreshNumber);
+
+        qDebug() << "full indexation: traversed" << traversal.directoryCount()
+                 << "directories;" << fileCount.loadRelaxed()
+                 << "files added to analysis queue";
 
         if (_analyzer->isFinished())
         {
@@ -805,16 +1045,193 @@ namespace PMP::Server
             checkFileStillExistsAndIsValid(path);
         }
 
+        _analyzer->finishCachePruning();
+
         _fullIndexationStatus = FullIndexationStatus::NotRunning;
         QTimer::singleShot(0, this, [this]() { onFullIndexationFinished(); });
     }
 
+    void Resolver::loadSnapshotAsync()
+    {
+        auto databaseUuid = Database::getDatabaseUuid();
+        if (databaseUuid.isNull())
+            return; /* the hash IDs in a snapshot cannot be trusted without database */
+
+        auto future =
+            Concurrent::runOnThreadPool<ResolverSnapshot, FailureType>(
+                globalThreadPool,
+                []() -> FailureOr<ResolverSnapshot>
+                {
+                    auto filePath = ResolverSnapshot::defaultFilePath();
+                    return ResolverSnapshot::loadFromFile(filePath);
+                }
+            );
+
+        future.handleOnEventLoop(
+            this,
+            [this, databaseUuid](FailureOr<ResolverSnapshot> outcome)
+            {
+                if (outcome.failed())
+                    return;
+
+                auto snapshot = outcome.result();
+                if (snapshot.databaseUuid() != databaseUuid)
+                {
+                    qWarning() << "Resolver: ignoring snapshot because it was created"
+                               << "for another database";
+                    return;
+                }
+
+                restoreFromSnapshot(snapshot);
+            }
+        );
+    }
+
+    void Resolver::restoreFromSnapshot(ResolverSnapshot const& snapshot)
+    {
+        QVector<QString> restoredPaths;
+        uint restoredTrackCount = 0;
+
+        {
+            WriteLocker lock(this);
+
+            for (auto const& track : snapshot.tracks())
+            {
+                if (track.hashId == 0 || track.hash.isNull())
+                    continue;
+
+                auto knowledge = _hashToKnowledge.value(track.hash, nullptr);
+                if (!knowledge)
+                {
+                    if (_idToKnowledge.contains(track.hashId))
+                        continue; /* ID is in use for another hash */
+
+                    knowledge = new HashKnowledge(this, track.hash, track.hashId);
+                    _hashToKnowledge.insert(track.hash, knowledge);
+                    _idToKnowledge.insert(track.hashId, knowledge);
+                    _hashesList.append(track.hash);
+                }
+                else if (knowledge->id() == 0)
+                {
+                    if (_idToKnowledge.contains(track.hashId))
+                        continue; /* ID is in use for another hash */
+
+                    knowledge->setId(track.hashId);
+                    _idToKnowledge.insert(track.hashId, knowledge);
+                }
+                else if (knowledge->id() != track.hashId)
+                {
+                    qWarning() << "Resolver: snapshot has ID" << track.hashId
+                               << "for hash" << track.hash << "instead of"
+                               << knowledge->id();
+                    continue;
+                }
+
+                /* tags obtained by analysis are more up-to-date than the snapshot */
+                if (knowledge->tags().isEmpty() && !track.tags.isEmpty())
+                {
+                    for (auto const& tag : track.tags)
+                        knowledge->addInfo(track.audio, tag);
+
+                    knowledge->markFileAnalyzed();
+                }
+
+                for (auto const& file : track.files)
+                {
+                    if (knowledge->restorePath(file.path, file.size,
+                                               file.lastModifiedUtc))
+                    {
+                        restoredPaths.append(file.path);
+                    }
+                }
+
+                restoredTrackCount++;
+            }
+        }
+
+        qDebug() << "Resolver: restored" << restoredTrackCount << "tracks and"
+                 << restoredPaths.size() << "files from snapshot";
+
+        if (!restoredPaths.isEmpty())
+            QtConcurrent::run(this, &Resolver::verifyRestoredPaths, restoredPaths);
+    }
+
+    void Resolver::verifyRestoredPaths(QVector<QString> paths)
+    {
+        qDebug() << "Resolver: verifying" << paths.size()
+                 << "paths that were restored from snapshot";
+
+        /* takes the lock for each path separately, so others don't have to wait */
+        for (auto const& path : qAsConst(paths))
+        {
+            checkFileStillExistsAndIsValid(path);
+        }
+
+        qDebug() << "Resolver: finished verifying paths restored from snapshot";
+    }
+
+    ResolverSnapshot Resolver::createSnapshot()
+    {
+        QReadLocker lock(&_lock);
+
+        ResolverSnapshot snapshot(Database::getDatabaseUuid());
+
+        for (auto const* knowledge : qAsConst(_idToKnowledge))
+        {
+            if (knowledge->tags().isEmpty() && knowledge->files().isEmpty())
+                continue; /* nothing worth saving */
+
+            ResolverSnapshot::Track track;
+            track.hashId = knowledge->id();
+            track.hash = knowledge->hash();
+            track.audio = knowledge->audio();
+
+            for (auto const* tag : knowledge->tags())
+                track.tags.append(*tag);
+
+            for (auto const* file : knowledge->files())
+            {
+                track.files.append(
+                    ResolverSnapshot::File
+                    {
+                        file->_path, file->_size, file->_lastModifiedUtc
+                    }
+                );
+            }
+
+            snapshot.addTrack(track);
+        }
+
+        /* cleared while holding the lock, so no change can be missed */
+        _snapshotOutdated.storeRelaxed(0);
+        return snapshot;
+    }
+
+    void Resolver::saveSnapshotAsync()
+    {
+        if (Database::getDatabaseUuid().isNull())
+            return;
+
+        if (_snapshotOutdated.loadRelaxed() == 0)
+            return;
+
+        auto snapshot = createSnapshot();
+
+        Concurrent::runOnThreadPool<SuccessType, FailureType>(
+            globalThreadPool,
+            [snapshot]() -> SuccessOrFailure
+            {
+                return snapshot.saveToFile(ResolverSnapshot::defaultFilePath());
+            }
+        );
+    }
+
     Resolver::HashKnowledge* Resolver::registerHash(const FileHash& hash)
     {
         if (hash.isNull())
             return nullptr; /* invalid hash */
 
-        QMutexLocker lock(&_lock);
+        WriteLocker lock(this);
 
         auto knowledge = _hashToKnowledge.value(hash, nullptr);
         if (!knowledge)
@@ -828,15 +1245,22 @@ namespace PMP::Server
             return knowledge; /* registered already */
         }
 
-        auto db = Database::getDatabaseForCurrentThread();
-        if (!db) return knowledge; /* database not available */
+        /* the registrar usually knows the ID already, which saves a round trip to
+           the database */
+        auto id = _hashIdRegistrar->getIdForHash(hash).valueOr(0);
+        if (id <= 0)
+        {
+            auto db = Database::getDatabaseForCurrentThread();
+            if (!db) return knowledge; /* database not available */
+
+            db->registerHash(hash);
+            auto idOrError = db->getHashId(hash);
+            if (idOrError.failed() || idOrError.result() <= 0)
+                return knowledge; /* something went wrong */
 
-        db->registerHash(hash);
-        auto idOrError = db->getHashId(hash);
-        if (idOrError.failed() || idOrError.result() <= 0)
-            return knowledge; /* something went wrong */
+            id = idOrError.result();
+        }
 
-        auto id = idOrError.result();
         knowledge->setId(id);
         _idToKnowledge[id] = knowledge;
 
@@ -853,32 +1277,15 @@ namespace PMP::Server
         _hashRelations->markAsEquivalent(hashes);
         _historyStatistics->invalidateAllGroupStatisticsForHash(hashes[0]);
 
-        Concurrent::runOnThreadPool<SuccessType, FailureType>(
-            globalThreadPool,
-            [hashes]() -> ResultOrError<SuccessType, FailureType>
-            {
-                auto db = Database::getDatabaseForCurrentThread();
-                if (!db) return failure;
-
-                int currentYear = QDateTime::currentDateTimeUtc().date().year();
-
-                for (int i = 1; i < hashes.size(); ++i)
-                {
-                    auto result =
-                            db->registerEquivalence(hashes[0], hashes[i], currentYear);
-
-                    if (result.failed())
-                        return failure;
-                }
-
-                return success;
-            }
-        );
+        for (int i = 1; i < hashes.size(); ++i)
+        {
+            _bookkeepingWriteQueue->registerEquivalence(hashes[0], hashes[i]);
+        }
     }
 
     QVector<QString> Resolver::getPathsThatDontMatchCurrentFullIndexationNumber()
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         QVector<QString> result;
 
@@ -895,28 +1302,36 @@ namespace PMP::Server
 
     bool Resolver::haveFileForHash(const FileHash& hash)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         auto knowledge = _hashToKnowledge.value(hash, nullptr);
-        return knowledge && knowledge->isAvailable();
+        if (!knowledge) return false;
+
+        QVector<QString> invalidPaths;
+        bool available = knowledge->isAvailable(invalidPaths);
+        scheduleRemovalOfInvalidPaths(invalidPaths);
+
+        return available;
     }
 
     bool Resolver::pathStillValid(const FileHash& hash, QString path)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         VerifiedFile* file = _pathToVerifiedFile.value(path, nullptr);
         if (!file) return false;
 
-        auto knowledge = file->_parent;
-        if (knowledge->hash() != hash) return false;
+        if (file->_parent->hash() != hash) return false;
 
-        return knowledge->isStillValid(file);
+        if (file->stillValid()) return true;
+
+        scheduleRemovalOfInvalidPaths({ path });
+        return false;
     }
 
     Nullable<FileHash> Resolver::getHashForFilePath(QString path)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         VerifiedFile* file = _pathToVerifiedFile.value(path, nullptr);
         if (file)
@@ -933,7 +1348,7 @@ namespace PMP::Server
 
     void Resolver::checkFileStillExistsAndIsValid(QString path)
     {
-        QMutexLocker lock(&_lock);
+        WriteLocker lock(this);
 
         VerifiedFile* file = _pathToVerifiedFile.value(path, nullptr);
         if (!file) return;
@@ -942,9 +1357,51 @@ namespace PMP::Server
         (void)knowledge->isStillValid(file);
     }
 
+    void Resolver::scheduleRemovalOfInvalidPaths(QVector<QString> const& paths)
+    {
+        if (paths.isEmpty())
+            return;
+
+        QMutexLocker lock(&_invalidPathsMutex);
+
+        bool removalAlreadyScheduled = !_invalidPathsToRemove.isEmpty();
+
+        for (auto const& path : paths)
+            _invalidPathsToRemove.insert(path);
+
+        if (removalAlreadyScheduled)
+            return;
+
+        /* readers only hold the read lock, so the removal is left to the event loop */
+        QTimer::singleShot(0, this, [this]() { removeInvalidPaths(); });
+    }
+
+    void Resolver::emitAfterUnlocking(std::function<void ()> emitSignal)
+    {
+        Q_ASSERT_X(_writeLockDepth > 0, "Resolver::emitAfterUnlocking",
+                   "write lock not held");
+
+        _signalsToEmit.append(emitSignal);
+    }
+
+    void Resolver::removeInvalidPaths()
+    {
+        QSet<QString> paths;
+        {
+            QMutexLocker lock(&_invalidPathsMutex);
+            paths.swap(_invalidPathsToRemove);
+        }
+
+        /* the paths are checked again, because a file could have come back */
+        for (auto const& path : qAsConst(paths))
+        {
+            checkFileStillExistsAndIsValid(path);
+        }
+    }
+
     Nullable<AudioData> Resolver::findAudioData(const FileHash& hash)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         auto knowledge = _hashToKnowledge.value(hash, nullptr);
         if (knowledge) return knowledge->audio();
@@ -954,7 +1411,7 @@ namespace PMP::Server
 
     Nullable<TagData> Resolver::findTagData(const FileHash& hash)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         auto knowledge = _hashToKnowledge.value(hash, nullptr);
 
@@ -971,17 +1428,18 @@ namespace PMP::Server
 
     QVector<FileHash> Resolver::getAllHashes()
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
         auto copy = _hashesList.toVector();
         return copy;
     }
 
     QVector<CollectionTrackInfo> Resolver::getHashesTrackInfo(QVector<FileHash> hashes)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         QVector<CollectionTrackInfo> result;
         result.reserve(hashes.size());
+        QVector<QString> invalidPaths;
 
         for (auto& hash : qAsConst(hashes))
         {
@@ -994,7 +1452,7 @@ namespace PMP::Server
                 lengthInMilliseconds = 0;
             }
 
-            CollectionTrackInfo info(hash, knowledge->isAvailable(),
+            CollectionTrackInfo info(hash, knowledge->isAvailable(invalidPaths),
                                      knowledge->quickTitle(), knowledge->quickArtist(),
                                      knowledge->quickAlbum(),
                                      knowledge->quickAlbumArtist(),
@@ -1003,12 +1461,13 @@ namespace PMP::Server
             result.append(info);
         }
 
+        scheduleRemovalOfInvalidPaths(invalidPaths);
         return result;
     }
 
     CollectionTrackInfo Resolver::getHashTrackInfo(uint hashId)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         auto knowledge = _idToKnowledge.value(hashId, nullptr);
         if (!knowledge) return {};
@@ -1019,17 +1478,39 @@ namespace PMP::Server
             lengthInMilliseconds = 0;
         }
 
-        CollectionTrackInfo info(knowledge->hash(), knowledge->isAvailable(),
+        QVector<QString> invalidPaths;
+        CollectionTrackInfo info(knowledge->hash(), knowledge->isAvailable(invalidPaths),
                                  knowledge->quickTitle(), knowledge->quickArtist(),
                                  knowledge->quickAlbum(), knowledge->quickAlbumArtist(),
                                  qint32(lengthInMilliseconds));
+        scheduleRemovalOfInvalidPaths(invalidPaths);
 
         return info;
     }
 
+    QHash<uint, qint64> Resolver::getLengthsOfTracksWithFiles()
+    {
+        QReadLocker lock(&_lock);
+
+        QHash<uint, qint64> result;
+        result.reserve(_idToKnowledge.size());
+
+        /* the files are not verified here; that would take too long for the entire
+           collection */
+        for (auto const* knowledge : qAsConst(_idToKnowledge))
+        {
+            if (knowledge->files().isEmpty())
+                continue;
+
+            result.insert(knowledge->id(), knowledge->audio().trackLengthMilliseconds());
+        }
+
+        return result;
+    }
+
     FileHash Resolver::getHashByID(uint id)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         auto knowledge = _idToKnowledge.value(id, nullptr);
         if (knowledge) return knowledge->hash();
@@ -1041,7 +1522,7 @@ namespace PMP::Server
 
     uint Resolver::getID(const FileHash& hash)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         auto knowledge = _hashToKnowledge.value(hash, nullptr);
         if (knowledge) return knowledge->id();
@@ -1051,7 +1532,7 @@ namespace PMP::Server
 
     QList<QPair<uint, FileHash>> Resolver::getIDs(QList<FileHash> hashes)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         QList<QPair<uint, FileHash>> result;
         result.reserve(hashes.size());
@@ -1069,7 +1550,7 @@ namespace PMP::Server
 
     QVector<QPair<uint, FileHash>> Resolver::getIDs(QVector<FileHash> hashes)
     {
-        QMutexLocker lock(&_lock);
+        QReadLocker lock(&_lock);
 
         QVector<QPair<uint, FileHash>> result;
         result.reserve(hashes.size());
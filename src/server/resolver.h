@@ -27,27 +27,41 @@
 #include "common/tagdata.h"
 
 #include "collectiontrackinfo.h"
+#include "directorytraversal.h"
 #include "fileanalysis.h"
 #include "filelocations.h"
+#include "filesystemindex.h"
 #include "result.h"
 
 #include <QDateTime>
 #include <QHash>
+#include <QAtomicInt>
+#include <QMap>
 #include <QMutex>
 #include <QObject>
 #include <QPair>
+#include <QReadWriteLock>
+#include <QSet>
 #include <QString>
 #include <QStringList>
 #include <QVector>
 
+#include <functional>
+
+QT_FORWARD_DECLARE_CLASS(QThreadPool)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
 namespace PMP::Server
 {
     class Analyzer;
+    class BookkeepingWriteQueue;
     class FileFinder;
     class FileLocations;
     class HashIdRegistrar;
     class HashRelations;
     class HistoryStatistics;
+    class MusicFolderWatcher;
+    class ResolverSnapshot;
 
     class Resolver : public QObject
     {
@@ -55,10 +69,14 @@ namespace PMP::Server
     public:
         Resolver(HashIdRegistrar* hashIdRegistrar, HashRelations* hashRelations,
                  HistoryStatistics* historyStatistics);
+        ~Resolver();
 
         void setMusicPaths(QStringList paths);
         QStringList musicPaths();
 
+        void setAnalysisParallelism(int threadCount, qint64 maxBytesInFlight);
+        void setAnalysisCacheVerificationPercentage(int percentage);
+
         Result startFullIndexation();
         Result startQuickScanForNewFiles();
         bool isFullIndexationRunning();
@@ -78,18 +96,26 @@ namespace PMP::Server
         QVector<FileHash> getAllHashes();
         QVector<CollectionTrackInfo> getHashesTrackInfo(QVector<FileHash> hashes);
         CollectionTrackInfo getHashTrackInfo(uint hashId);
+        QHash<uint, qint64> getLengthsOfTracksWithFiles();
 
         FileHash getHashByID(uint id);
         uint getID(const FileHash& hash);
         QList<QPair<uint, FileHash>> getIDs(QList<FileHash> hashes);
         QVector<QPair<uint, FileHash>> getIDs(QVector<FileHash> hashes);
 
+        /* adds the tracks of a snapshot; what is known already takes precedence */
+        void restoreFromSnapshot(ResolverSnapshot const& snapshot);
+
     private Q_SLOTS:
         void onQuickScanForNewFilesFinished();
         void onFullIndexationFinished();
         void onFileAnalysisFailed(QString path);
         void onFileAnalysisCompleted(QString path, FileAnalysis analysis);
         void onAnalyzerFinished();
+        void onWatchedFilesChanged(QStringList paths);
+        void onWatchedPathsRemoved(QStringList paths);
+        void onFolderWatcherScanNeeded();
+        void saveSnapshotAsync();
 
     Q_SIGNALS:
         void fullIndexationRunStatusChanged();
@@ -119,31 +145,52 @@ namespace PMP::Server
 
         struct VerifiedFile;
         class HashKnowledge;
+        class WriteLocker;
 
         HashKnowledge* registerHash(const FileHash& hash);
         void markHashesAsEquivalent(QVector<uint> hashes);
         QVector<QString> getPathsThatDontMatchCurrentFullIndexationNumber();
         void checkFileStillExistsAndIsValid(QString path);
+        void scheduleRemovalOfInvalidPaths(QVector<QString> const& paths);
+        void removeInvalidPaths();
+        void emitAfterUnlocking(std::function<void ()> emitSignal);
 
         void doQuickScanForNewFilesFileSystemTraversal();
         void doFullIndexationFileSystemTraversal();
         void doFullIndexationCheckForFileRemovals();
 
+        void loadSnapshotAsync();
+        void verifyRestoredPaths(QVector<QString> paths);
+        ResolverSnapshot createSnapshot();
+
         FileLocations _fileLocations;
+        FileSystemIndex _fileSystemIndex;
         Analyzer* _analyzer { nullptr };
+        BookkeepingWriteQueue* _bookkeepingWriteQueue { nullptr };
         FileFinder* _fileFinder { nullptr };
+        MusicFolderWatcher* _folderWatcher { nullptr };
+        QThreadPool* _traversalThreadPool { nullptr };
+        DirectoryListingCache _directoryListingCache;
+        QTimer* _snapshotTimer { nullptr };
+        QAtomicInt _snapshotOutdated { 0 };
         HashIdRegistrar* _hashIdRegistrar { nullptr };
         HashRelations* _hashRelations { nullptr };
         HistoryStatistics* _historyStatistics { nullptr };
 
-        QMutex _lock;
+        /* queries only need the read lock, so they don't block each other; only the
+           processing of analysis results and file removals needs the write lock */
+        QReadWriteLock _lock;
+        int _writeLockDepth { 0 }; /* protected by the write lock */
+        QVector<std::function<void ()>> _signalsToEmit; /* protected by the write lock */
+        QMutex _invalidPathsMutex;
+        QSet<QString> _invalidPathsToRemove;
 
         QStringList _musicPaths;
 
         QList<FileHash> _hashesList;
         QHash<FileHash, HashKnowledge*> _hashToKnowledge;
         QHash<uint, HashKnowledge*> _idToKnowledge;
-        QHash<QString, VerifiedFile*> _pathToVerifiedFile;
+        QMap<QString, VerifiedFile*> _pathToVerifiedFile; /* ordered for prefix lookup */
 
         uint _fullIndexationNumber;
         FullIndexationStatus _fullIndexationStatus { FullIndexationStatus::NotRunning };
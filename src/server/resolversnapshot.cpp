@@ -0,0 +1,241 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resolversnapshot.h"
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtDebug>
+
+namespace PMP::Server
+{
+    namespace
+    {
+        const quint32 snapshotMagic = 0x504D5253; /* "PMRS" */
+        const quint32 snapshotFormatVersion = 1;
+
+        /* limits to protect against reading garbage */
+        const quint32 maxTrackCount = 20 * 1000 * 1000;
+        const quint32 maxTagsPerTrack = 1000;
+        const quint32 maxFilesPerTrack = 1000;
+    }
+
+    QByteArray ResolverSnapshot::serialize() const
+    {
+        QByteArray body;
+        {
+            QDataStream stream(&body, QIODevice::WriteOnly);
+            stream.setVersion(QDataStream::Qt_5_12);
+
+            stream << _databaseUuid;
+            stream << quint32(_tracks.size());
+
+            for (auto const& track : _tracks)
+            {
+                stream << quint32(track.hashId)
+                       << quint32(track.hash.length())
+                       << track.hash.SHA1()
+                       << track.hash.MD5()
+                       << qint32(track.audio.format())
+                       << qint64(track.audio.trackLengthMilliseconds());
+
+                stream << quint32(track.tags.size());
+                for (auto const& tag : track.tags)
+                {
+                    stream << tag.artist() << tag.title() << tag.album()
+                           << tag.albumArtist() << tag.comment();
+                }
+
+                stream << quint32(track.files.size());
+                for (auto const& file : track.files)
+                {
+                    stream << file.path << qint64(file.size)
+                           << qint64(file.lastModifiedUtc.toMSecsSinceEpoch());
+                }
+            }
+        }
+
+        QByteArray result;
+        {
+            QDataStream stream(&result, QIODevice::WriteOnly);
+            stream << snapshotMagic << snapshotFormatVersion;
+        }
+
+        result += qCompress(body);
+        return result;
+    }
+
+    FailureOr<ResolverSnapshot> ResolverSnapshot::deserialize(QByteArray const& data)
+    {
+        QByteArray body;
+        {
+            QDataStream stream(data);
+
+            quint32 magic = 0;
+            quint32 formatVersion = 0;
+            stream >> magic >> formatVersion;
+
+            if (stream.status() != QDataStream::Ok || magic != snapshotMagic)
+            {
+                qWarning() << "ResolverSnapshot: data is not a snapshot";
+                return failure;
+            }
+
+            if (formatVersion != snapshotFormatVersion)
+            {
+                qWarning() << "ResolverSnapshot: unsupported format version"
+                           << formatVersion;
+                return failure;
+            }
+
+            const int headerSize = 2 * sizeof(quint32);
+            body = qUncompress(data.mid(headerSize));
+            if (body.isEmpty())
+            {
+                qWarning() << "ResolverSnapshot: decompression failed";
+                return failure;
+            }
+        }
+
+        QDataStream stream(body);
+        stream.setVersion(QDataStream::Qt_5_12);
+
+        ResolverSnapshot snapshot;
+
+        quint32 trackCount = 0;
+        stream >> snapshot._databaseUuid >> trackCount;
+        if (stream.status() != QDataStream::Ok || trackCount > maxTrackCount)
+            return failure;
+
+        snapshot._tracks.reserve(int(trackCount));
+
+        for (quint32 trackIndex = 0; trackIndex < trackCount; ++trackIndex)
+        {
+            quint32 hashId, hashLength;
+            QByteArray sha1, md5;
+            qint32 format;
+            qint64 lengthMilliseconds;
+            stream >> hashId >> hashLength >> sha1 >> md5 >> format
+                   >> lengthMilliseconds;
+
+            Track track;
+            track.hashId = hashId;
+            track.hash = FileHash(hashLength, sha1, md5);
+            track.audio = AudioData(AudioData::FileFormat(format), lengthMilliseconds);
+
+            quint32 tagCount = 0;
+            stream >> tagCount;
+            if (stream.status() != QDataStream::Ok || tagCount > maxTagsPerTrack)
+                return failure;
+
+            for (quint32 tagIndex = 0; tagIndex < tagCount; ++tagIndex)
+            {
+                QString artist, title, album, albumArtist, comment;
+                stream >> artist >> title >> album >> albumArtist >> comment;
+
+                track.tags.append(TagData(artist, title, album, albumArtist, comment));
+            }
+
+            quint32 fileCount = 0;
+            stream >> fileCount;
+            if (stream.status() != QDataStream::Ok || fileCount > maxFilesPerTrack)
+                return failure;
+
+            for (quint32 fileIndex = 0; fileIndex < fileCount; ++fileIndex)
+            {
+                File file;
+                qint64 size, lastModifiedMs;
+                stream >> file.path >> size >> lastModifiedMs;
+
+                file.size = size;
+                file.lastModifiedUtc =
+                                QDateTime::fromMSecsSinceEpoch(lastModifiedMs, Qt::UTC);
+
+                track.files.append(file);
+            }
+
+            if (stream.status() != QDataStream::Ok)
+                return failure;
+
+            snapshot._tracks.append(track);
+        }
+
+        return snapshot;
+    }
+
+    SuccessOrFailure ResolverSnapshot::saveToFile(QString const& filePath) const
+    {
+        auto data = serialize();
+
+        QSaveFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly))
+        {
+            qWarning() << "ResolverSnapshot: could not open file for writing:"
+                       << filePath;
+            return failure;
+        }
+
+        if (file.write(data) != data.size() || !file.commit())
+        {
+            qWarning() << "ResolverSnapshot: could not write file:" << filePath;
+            return failure;
+        }
+
+        qDebug() << "ResolverSnapshot: saved" << _tracks.size() << "tracks in"
+                 << data.size() << "bytes to" << filePath;
+        return success;
+    }
+
+    FailureOr<ResolverSnapshot> ResolverSnapshot::loadFromFile(QString const& filePath)
+    {
+        QFile file(filePath);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qDebug() << "ResolverSnapshot: no snapshot file found at" << filePath;
+            return failure;
+        }
+
+        auto data = file.readAll();
+        file.close();
+
+        auto snapshot = deserialize(data);
+        if (snapshot.failed())
+        {
+            qWarning() << "ResolverSnapshot: snapshot file is not valid:" << filePath;
+            return failure;
+        }
+
+        qDebug() << "ResolverSnapshot: loaded" << snapshot.result().tracks().size()
+                 << "tracks from" << filePath;
+        return snapshot;
+    }
+
+    QString ResolverSnapshot::defaultFilePath()
+    {
+        auto directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        if (directory.isEmpty())
+            directory = QDir::temp().absolutePath() + "/PMP-server";
+
+        QDir().mkpath(directory);
+        return directory + "/resolver-snapshot.bin";
+    }
+}
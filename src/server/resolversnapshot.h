@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_SERVER_RESOLVERSNAPSHOT_H
+#define PMP_SERVER_RESOLVERSNAPSHOT_H
+
+#include "common/audiodata.h"
+#include "common/filehash.h"
+#include "common/resultorerror.h"
+#include "common/tagdata.h"
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+#include <QUuid>
+#include <QVector>
+
+namespace PMP::Server
+{
+    /** What the Resolver knew about the music collection at a certain time.
+
+        A snapshot is saved to disk regularly and at shutdown, so that at startup the
+        collection can be made available right away, without waiting for all files
+        to be analyzed again. The snapshot is only valid for the database it was
+        created with, because it contains hash IDs.
+    */
+    class ResolverSnapshot
+    {
+    public:
+        struct File
+        {
+            QString path;
+            qint64 size;
+            QDateTime lastModifiedUtc;
+        };
+
+        struct Track
+        {
+            uint hashId;
+            FileHash hash;
+            AudioData audio;
+            QVector<TagData> tags;
+            QVector<File> files;
+        };
+
+        ResolverSnapshot() {}
+        ResolverSnapshot(QUuid databaseUuid) : _databaseUuid(databaseUuid) {}
+
+        QUuid databaseUuid() const { return _databaseUuid; }
+
+        QVector<Track> const& tracks() const { return _tracks; }
+        void addTrack(Track const& track) { _tracks.append(track); }
+
+        QByteArray serialize() const;
+        static FailureOr<ResolverSnapshot> deserialize(QByteArray const& data);
+
+        SuccessOrFailure saveToFile(QString const& filePath) const;
+        static FailureOr<ResolverSnapshot> loadFromFile(QString const& filePath);
+
+        static QString defaultFilePath();
+
+    private:
+        QUuid _databaseUuid;
+        QVector<Track> _tracks;
+    };
+}
+#endif
@@ -120,6 +120,21 @@ static void setUpAndRunInitialIndexation(Resolver* resolver)
     resolver->startFullIndexation();
 }
 
+static void rebuildUserHashStatsCache()
+{
+    QTextStream out(stdout);
+    out << "Rebuilding the statistics cache..." << Qt::endl;
+
+    auto db = Database::getDatabaseForCurrentThread();
+    if (!db || db->rebuildUserHashStatsCache().failed())
+    {
+        out << "Rebuilding the statistics cache failed!" << Qt::endl;
+        return;
+    }
+
+    out << "Statistics cache rebuilt successfully" << Qt::endl;
+}
+
 static void loadEquivalencesAndStartHashStatsCacheFixerAsync(
                                             HashRelations* hashRelations,
                                             UserHashStatsCacheFixer* hashStatsCacheFixer)
@@ -162,7 +177,8 @@ static void startBackgroundTasks(HashRelations* hashRelations,
     loadEquivalencesAndStartHashStatsCacheFixerAsync(hashRelations, hashStatsCacheFixer);
 }
 
-static int runServer(QCoreApplication& app, bool doIndexation);
+static int runServer(QCoreApplication& app, bool doIndexation,
+                     bool rebuildHashStatsCache);
 
 int main(int argc, char* argv[])
 {
@@ -174,21 +190,25 @@ int main(int argc, char* argv[])
     QCoreApplication::setOrganizationDomain(PMP_ORGANIZATION_DOMAIN);
 
     bool doIndexation = true;
+    bool rebuildHashStatsCache = false;
     const QStringList args = QCoreApplication::arguments();
     for (auto& arg : args)
     {
         if (arg == "-no-index" || arg == "-no-indexation")
             doIndexation = false;
+        else if (arg == "-rebuild-stats-cache")
+            rebuildHashStatsCache = true;
     }
 
-    auto exitCode = runServer(app, doIndexation);
+    auto exitCode = runServer(app, doIndexation, rebuildHashStatsCache);
 
     qDebug() << "Exiting with code" << exitCode;
 
     return exitCode;
 }
 
-static int runServer(QCoreApplication& app, bool doIndexation)
+static int runServer(QCoreApplication& app, bool doIndexation,
+                     bool rebuildHashStatsCache)
 {
     QTextStream out(stdout);
 
@@ -235,6 +255,10 @@ static int runServer(QCoreApplication& app, bool doIndexation)
     {
         serverHealthMonitor.setDatabaseUnavailable();
     }
+    else if (rebuildHashStatsCache)
+    {
+        rebuildUserHashStatsCache();
+    }
 
     SelfTest::runSelfTest(serverHealthMonitor);
 
@@ -312,6 +336,22 @@ static int runServer(QCoreApplication& app, bool doIndexation)
         }
     );
 
+    resolver.setAnalysisParallelism(serverSettings.analysisThreadCount(),
+                                    serverSettings.analysisReadAheadBytes());
+    resolver.setAnalysisCacheVerificationPercentage(
+                                serverSettings.analysisCacheVerificationPercentage());
+    QObject::connect(
+        &serverSettings, &ServerSettings::indexationSettingsChanged,
+        &resolver,
+        [&serverSettings, &resolver]()
+        {
+            resolver.setAnalysisParallelism(serverSettings.analysisThreadCount(),
+                                            serverSettings.analysisReadAheadBytes());
+            resolver.setAnalysisCacheVerificationPercentage(
+                                serverSettings.analysisCacheVerificationPercentage());
+        }
+    );
+
     /* unique server instance ID (not to be confused with the unique ID of the database)*/
     QUuid serverInstanceIdentifier = QUuid::createUuid();
 
@@ -156,6 +156,8 @@ namespace PMP::Server
     {
         _userLoggedIn = userId;
         _userLoggedInName = userLogin;
+
+        _history->preloadUserStats(userId);
     }
 
     SimpleFuture<ResultMessageErrorCode> ServerInterface::reloadServerSettings()
@@ -671,6 +673,60 @@ namespace PMP::Server
             Q_EMIT hashUserDataChangedOrAvailable(userId, hashStatsAlreadyAvailable);
     }
 
+    Future<QVector<HashStats>, Result> ServerInterface::getHashUserDataForAllHashes(
+                                                                           quint32 userId)
+    {
+        if (!isLoggedIn())
+            return FutureError(Error::notLoggedIn());
+
+        if (userId != 0 && !_users->checkUserIdExists(userId))
+            return FutureError(Error::userIdNotFound());
+
+        auto* history = _history;
+        auto* hashIdRegistrar = _hashIdRegistrar;
+        auto* resolver = &_player->resolver();
+
+        /* preloading first gives us most of the statistics in a single query */
+        auto future =
+            history->preloadUserStats(userId)
+                .thenOnThreadPool<QVector<HashStats>, Result>(
+                    globalThreadPool,
+                    [history, hashIdRegistrar, resolver, userId](SuccessOrFailure)
+                        -> ResultOrError<QVector<HashStats>, Result>
+                    {
+                        /* a failed preload is not fatal, it only makes things slower */
+
+                        const auto existingHashes =
+                            hashIdRegistrar->getExistingIdsOnly(resolver->getAllHashes());
+
+                        QVector<uint> hashIds;
+                        hashIds.reserve(existingHashes.size());
+                        for (auto const& idAndHash : existingHashes)
+                            hashIds.append(idAndHash.first);
+
+                        /* statistics that are missing will be fetched in the background
+                           and will be sent later as change notifications */
+                        const auto statsForHashes = history->getUserStats(hashIds, userId);
+
+                        QVector<HashStats> result;
+                        result.reserve(statsForHashes.size());
+
+                        for (auto const& idAndHash : existingHashes)
+                        {
+                            auto it = statsForHashes.constFind(idAndHash.first);
+                            if (it == statsForHashes.constEnd())
+                                continue;
+
+                            result.append(HashStats(idAndHash.second, it.value()));
+                        }
+
+                        return result;
+                    }
+                );
+
+        return future;
+    }
+
     Future<CollectionTrackInfo, Result> ServerInterface::getHashInfo(FileHash hash)
     {
         /* note: client does not need to be logged in for this */
@@ -68,6 +68,23 @@ namespace PMP::Server
         bool delayedStartActive;
     };
 
+    inline bool operator==(PlayerStateOverview const& first,
+                           PlayerStateOverview const& second)
+    {
+        return first.trackPosition == second.trackPosition
+            && first.nowPlayingQueueId == second.nowPlayingQueueId
+            && first.queueLength == second.queueLength
+            && first.playerState == second.playerState
+            && first.volume == second.volume
+            && first.delayedStartActive == second.delayedStartActive;
+    }
+
+    inline bool operator!=(PlayerStateOverview const& first,
+                           PlayerStateOverview const& second)
+    {
+        return !(first == second);
+    }
+
     class ServerInterface : public QObject
     {
         Q_OBJECT
@@ -148,6 +165,7 @@ namespace PMP::Server
         void setTrackRepetitionAvoidanceSeconds(int seconds);
 
         void requestHashUserData(quint32 userId, QVector<FileHash> hashes);
+        Future<QVector<HashStats>, Result> getHashUserDataForAllHashes(quint32 userId);
         Future<CollectionTrackInfo, Result> getHashInfo(FileHash hash);
 
         void shutDownServer();
@@ -45,6 +45,7 @@ namespace PMP::Server
         loadDefaultVolume(settings);
         loadMusicPaths(settings);
         loadFixedServerPassword(settings);
+        loadIndexationSettings(settings);
         loadDatabaseConnectionSettings(settings);
     }
 
@@ -149,6 +150,70 @@ namespace PMP::Server
         setFixedServerPassword(fixedServerPassword);
     }
 
+    void ServerSettings::loadIndexationSettings(QSettings& settings)
+    {
+        /* zero means: choose automatically */
+        int threadCount = 0;
+        QVariant threadCountSetting = settings.value("Indexation/analysis_threads");
+        if (threadCountSetting.isValid() && threadCountSetting.toString() != "")
+        {
+            bool ok;
+            threadCount = threadCountSetting.toString().toInt(&ok);
+            if (!ok || threadCount < 1 || threadCount > 256)
+            {
+                qWarning() << "server settings: ignoring invalid number of analysis threads; must be a number from 1 to 256";
+                threadCount = 0;
+            }
+        }
+        if (threadCount <= 0)
+        {
+            settings.setValue("Indexation/analysis_threads", "");
+        }
+
+        qint64 readAheadMegabytes = 0;
+        QVariant readAheadSetting = settings.value("Indexation/read_ahead_megabytes");
+        if (readAheadSetting.isValid() && readAheadSetting.toString() != "")
+        {
+            bool ok;
+            readAheadMegabytes = readAheadSetting.toString().toLongLong(&ok);
+            if (!ok || readAheadMegabytes < 1 || readAheadMegabytes > 65536)
+            {
+                qWarning() << "server settings: ignoring invalid read-ahead size; must be a number of megabytes from 1 to 65536";
+                readAheadMegabytes = 0;
+            }
+        }
+        if (readAheadMegabytes <= 0)
+        {
+            settings.setValue("Indexation/read_ahead_megabytes", "");
+        }
+
+        /* a small percentage of cache hits gets re-hashed to detect silent corruption */
+        int verificationPercentage = 1;
+        QVariant verificationSetting =
+                settings.value("Indexation/cache_verification_percentage");
+        if (verificationSetting.isValid() && verificationSetting.toString() != "")
+        {
+            bool ok;
+            int percentage = verificationSetting.toString().toInt(&ok);
+            if (!ok || percentage < 0 || percentage > 100)
+            {
+                qWarning() << "server settings: ignoring invalid cache verification percentage; must be a number from 0 to 100";
+                settings.setValue("Indexation/cache_verification_percentage", "");
+            }
+            else
+            {
+                verificationPercentage = percentage;
+            }
+        }
+        else
+        {
+            settings.setValue("Indexation/cache_verification_percentage", "");
+        }
+
+        setIndexationSettings(threadCount, readAheadMegabytes * 1024 * 1024,
+                              verificationPercentage);
+    }
+
     void ServerSettings::loadDatabaseConnectionSettings(QSettings& settings)
     {
         DatabaseConnectionSettings newConnectionSettings;
@@ -258,6 +323,23 @@ namespace PMP::Server
         Q_EMIT fixedServerPasswordChanged();
     }
 
+    void ServerSettings::setIndexationSettings(int analysisThreadCount,
+                                               qint64 readAheadBytes,
+                                               int cacheVerificationPercentage)
+    {
+        if (analysisThreadCount == _analysisThreadCount
+                && readAheadBytes == _analysisReadAheadBytes
+                && cacheVerificationPercentage == _analysisCacheVerificationPercentage)
+        {
+            return; /* no change */
+        }
+
+        _analysisThreadCount = analysisThreadCount;
+        _analysisReadAheadBytes = readAheadBytes;
+        _analysisCacheVerificationPercentage = cacheVerificationPercentage;
+        Q_EMIT indexationSettingsChanged();
+    }
+
     void ServerSettings::setDatabaseConnectionSettings(
                                                DatabaseConnectionSettings const& settings)
     {
@@ -69,6 +69,12 @@ namespace PMP::Server
         int defaultVolume() const { return _defaultVolume; }
         QStringList musicPaths() const { return _musicPaths; }
         QString fixedServerPassword() const { return _fixedServerPassword; }
+        int analysisThreadCount() const { return _analysisThreadCount; }
+        qint64 analysisReadAheadBytes() const { return _analysisReadAheadBytes; }
+        int analysisCacheVerificationPercentage() const
+        {
+            return _analysisCacheVerificationPercentage;
+        }
 
         DatabaseConnectionSettings databaseConnectionSettings() const
         {
@@ -83,6 +89,7 @@ namespace PMP::Server
         void defaultVolumeChanged();
         void musicPathsChanged();
         void fixedServerPasswordChanged();
+        void indexationSettingsChanged();
         void databaseConnectionSettingsChanged();
 
     private:
@@ -90,12 +97,15 @@ namespace PMP::Server
         void loadDefaultVolume(QSettings& settings);
         void loadMusicPaths(QSettings& settings);
         void loadFixedServerPassword(QSettings& settings);
+        void loadIndexationSettings(QSettings& settings);
         void loadDatabaseConnectionSettings(QSettings& settings);
 
         void setServerCaption(QString serverCaption);
         void setDefaultVolume(int volume);
         void setMusicPaths(QStringList const& paths);
         void setFixedServerPassword(QString password);
+        void setIndexationSettings(int analysisThreadCount, qint64 readAheadBytes,
+                                   int cacheVerificationPercentage);
         void setDatabaseConnectionSettings(DatabaseConnectionSettings const& settings);
 
         static QStringList generateDefaultScanPaths();
@@ -104,6 +114,9 @@ namespace PMP::Server
         int _defaultVolume;
         QStringList _musicPaths;
         QString _fixedServerPassword;
+        int _analysisThreadCount { 0 };
+        qint64 _analysisReadAheadBytes { 0 };
+        int _analysisCacheVerificationPercentage { 0 };
         DatabaseConnectionSettings _databaseConnectionSettings;
     };
 }
@@ -21,6 +21,7 @@
 
 #include "common/networkutil.h"
 
+#include "clienteventbroadcaster.h"
 #include "connectedclient.h"
 #include "serverinterface.h"
 #include "serversettings.h"
@@ -135,6 +136,8 @@ namespace PMP::Server
         _scrobbling = scrobbling;
         _delayedStart = delayedStart;
 
+        _eventBroadcaster = new ClientEventBroadcaster(this, player, collectionMonitor);
+
         if (!_server->listen(address, port))
             return false;
 
@@ -178,7 +181,8 @@ namespace PMP::Server
         auto connectedClient =
             new ConnectedClient(
                 connection, serverInterface, _player, _users,
-                _collectionMonitor, _serverHealthMonitor, _scrobbling
+                _collectionMonitor, _serverHealthMonitor, _scrobbling,
+                _eventBroadcaster
             );
 
         _connectionCount++;
@@ -29,6 +29,7 @@ QT_FORWARD_DECLARE_CLASS(QUdpSocket)
 
 namespace PMP::Server
 {
+    class ClientEventBroadcaster;
     class CollectionMonitor;
     class DelayedStart;
     class Generator;
@@ -101,6 +102,7 @@ namespace PMP::Server
         ServerHealthMonitor* _serverHealthMonitor { nullptr };
         Scrobbling* _scrobbling { nullptr };
         DelayedStart* _delayedStart { nullptr };
+        ClientEventBroadcaster* _eventBroadcaster { nullptr };
         QTcpServer* _server;
         QUdpSocket* _udpSocket;
         QTimer* _broadcastTimer;
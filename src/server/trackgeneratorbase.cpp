@@ -19,8 +19,10 @@
 
 #include "trackgeneratorbase.h"
 
+#include "common/containerutil.h"
 #include "common/util.h"
 
+#include "history.h"
 #include "randomtrackssource.h"
 #include "resolver.h"
 #include "trackrepetitionchecker.h"
@@ -72,6 +74,9 @@ namespace PMP::Server
 
         qDebug() << "criteria changing";
 
+        if (criteria.user() != _criteria.user())
+            _samplerIsForCurrentUser = false; /* weights will be recalculated */
+
         _criteria = criteria;
         criteriaChanged();
     }
@@ -96,9 +101,60 @@ namespace PMP::Server
        _history(history),
        _repetitionChecker(repetitionChecker),
        _randomEngine(Util::getRandomSeed()),
-       _desiredUpcomingTrackCount(0)
+       _desiredUpcomingTrackCount(0),
+       _samplerIsForCurrentUser(false)
     {
-        //
+        connect(
+            _history, &History::hashStatisticsChanged,
+            this, &TrackGeneratorBase::onHashStatisticsChanged
+        );
+
+        connect(
+            _resolver, &Resolver::hashBecameAvailable,
+            this, &TrackGeneratorBase::onHashBecameAvailable
+        );
+        connect(
+            _resolver, &Resolver::hashBecameUnavailable,
+            this, &TrackGeneratorBase::onHashBecameUnavailable
+        );
+    }
+
+    void TrackGeneratorBase::onHashStatisticsChanged(quint32 userId,
+                                                     QVector<uint> hashIds)
+    {
+        if (!_samplerIsForCurrentUser || userId != _criteria.user())
+            return;
+
+        for (auto hashId : qAsConst(hashIds))
+            updateSamplingWeight(hashId);
+    }
+
+    void TrackGeneratorBase::onHashBecameAvailable(FileHash hash)
+    {
+        if (!_samplerIsForCurrentUser)
+            return;
+
+        auto hashId = _resolver->getID(hash);
+        if (hashId == 0)
+            return;
+
+        auto audioData = _resolver->findAudioData(hash).valueOr({});
+        _trackLengths.insert(hashId, audioData.trackLengthMilliseconds());
+
+        updateSamplingWeight(hashId);
+    }
+
+    void TrackGeneratorBase::onHashBecameUnavailable(FileHash hash)
+    {
+        if (!_samplerIsForCurrentUser)
+            return;
+
+        auto hashId = _resolver->getID(hash);
+        if (hashId == 0)
+            return;
+
+        _trackLengths.remove(hashId);
+        _sampler.setWeight(hashId, 0);
     }
 
     int TrackGeneratorBase::totalTrackCountInSource() const
@@ -114,6 +170,12 @@ namespace PMP::Server
 
     QSharedPointer<TrackGeneratorBase::Candidate> TrackGeneratorBase::createCandidate()
     {
+        auto candidate = createCandidateFromSampler();
+        if (candidate)
+            return candidate;
+
+        /* no acceptable tracks known (yet); take whatever the source gives us */
+
         auto hash = _source->takeTrack();
 
         if (hash.isNull())
@@ -147,6 +209,101 @@ namespace PMP::Server
                                                  getRandomPermillage());
     }
 
+    QSharedPointer<TrackGeneratorBase::Candidate>
+        TrackGeneratorBase::createCandidateFromSampler()
+    {
+        if (!_samplerIsForCurrentUser)
+            prepareSamplerForCurrentUser();
+
+        /* the track picked could have been taken already, so allow a few attempts */
+        for (int attempt = 0; attempt < 3; ++attempt)
+        {
+            auto hashId = _sampler.pick(_randomEngine);
+            if (hashId == 0)
+                return nullptr; /* nothing to pick from */
+
+            auto hash = _resolver->getHashByID(hashId);
+            if (hash.isNull() || !_source->takeSpecificTrack(hash))
+                continue;
+
+            if (!_resolver->haveFileForHash(hash))
+            {
+                _source->putBackUsedTrack(hash);
+                _trackLengths.remove(hashId);
+                _sampler.setWeight(hashId, 0);
+                continue;
+            }
+
+            auto audioData = _resolver->findAudioData(hash).valueOr({});
+
+            std::uniform_int_distribution<int> range(0, int(_sampler.weight(hashId)) - 1);
+            auto randomPermillage = quint16(range(_randomEngine));
+
+            return QSharedPointer<Candidate>::create(_source, hashId, hash, audioData,
+                                                     randomPermillage);
+        }
+
+        return nullptr;
+    }
+
+    void TrackGeneratorBase::prepareSamplerForCurrentUser()
+    {
+        _samplerIsForCurrentUser = true;
+        rebuildSampler();
+
+        /* missing stats are added when they arrive, but loading all of them at once is
+           a lot faster */
+        auto user = _criteria.user();
+        _history->preloadUserStats(user).handleOnEventLoop(
+            this,
+            [this, user](SuccessOrFailure outcome)
+            {
+                if (outcome.succeeded() && _samplerIsForCurrentUser
+                        && user == _criteria.user())
+                {
+                    rebuildSampler();
+                }
+            }
+        );
+    }
+
+    void TrackGeneratorBase::rebuildSampler()
+    {
+        _sampler.clear();
+        _trackLengths = _resolver->getLengthsOfTracksWithFiles();
+
+        auto user = _criteria.user();
+        auto hashIds = ContainerUtil::keysToVector(_trackLengths);
+        auto allStats = _history->getUserStats(hashIds, user);
+
+        /* tracks without stats stay at weight zero until their stats arrive */
+        for (auto it = allStats.constBegin(); it != allStats.constEnd(); ++it)
+        {
+            auto length = _trackLengths.value(it.key());
+            _sampler.setWeight(it.key(), samplingWeight(it.value(), length));
+        }
+
+        qDebug() << "sampling weights calculated for user" << user << "; tracks:"
+                 << _trackLengths.size() << "; with stats:" << allStats.size()
+                 << "; total weight:" << _sampler.totalWeight();
+    }
+
+    void TrackGeneratorBase::updateSamplingWeight(uint hashId)
+    {
+        auto it = _trackLengths.constFind(hashId);
+        if (it == _trackLengths.constEnd())
+            return; /* no file available */
+
+        auto maybeStats = _history->getUserStats(hashId, _criteria.user());
+        if (maybeStats.isNull())
+        {
+            _sampler.setWeight(hashId, 0);
+            return;
+        }
+
+        _sampler.setWeight(hashId, samplingWeight(maybeStats.value(), it.value()));
+    }
+
     QVector<QSharedPointer<TrackGeneratorBase::Candidate>>
         TrackGeneratorBase::takeFromSourceAndApplyFilter(
                                             int trackCount,
@@ -24,7 +24,10 @@
 #include "common/filehash.h"
 
 #include "dynamicmodecriteria.h"
+#include "trackstats.h"
+#include "weightedsampler.h"
 
+#include <QHash>
 #include <QObject>
 #include <QPointer>
 #include <QQueue>
@@ -53,6 +56,11 @@ namespace PMP::Server
     public Q_SLOTS:
         void setDesiredUpcomingCount(int trackCount);
 
+    private Q_SLOTS:
+        void onHashStatisticsChanged(quint32 userId, QVector<uint> hashIds);
+        void onHashBecameAvailable(PMP::FileHash hash);
+        void onHashBecameUnavailable(PMP::FileHash hash);
+
     protected:
         TrackGeneratorBase(QObject* parent, RandomTracksSource* source,
                            Resolver* resolver, History* history,
@@ -129,6 +137,14 @@ namespace PMP::Server
                                      int reserveSpaceForAtLeastXElements = 0);
 
         virtual bool satisfiesBasicFilter(Candidate const& candidate) = 0;
+
+        /* The chance, in permille, that a candidate with these stats and this length
+           will be accepted.  Candidates are drawn from the collection according to this
+           weight, and a candidate drawn that way gets a random permillage number below
+           its weight; that is equivalent to drawing candidates uniformly and rejecting
+           those with a random permillage number that is too high, only faster. */
+        virtual quint32 samplingWeight(TrackStats const& stats,
+                                       qint64 lengthMilliseconds) = 0;
         bool satisfiesNonRepetition(Candidate const& candidate,
                                     qint64 extraMarginMilliseconds = 0);
 
@@ -140,6 +156,11 @@ namespace PMP::Server
              std::function<int (Candidate const&, Candidate const&)> candidateComparison);
 
     private:
+        QSharedPointer<Candidate> createCandidateFromSampler();
+        void prepareSamplerForCurrentUser();
+        void rebuildSampler();
+        void updateSamplingWeight(uint hashId);
+
         RandomTracksSource* _source;
         Resolver* _resolver;
         History* _history;
@@ -147,6 +168,9 @@ namespace PMP::Server
         std::mt19937 _randomEngine;
         DynamicModeCriteria _criteria;
         int _desiredUpcomingTrackCount;
+        WeightedSampler _sampler;
+        QHash<uint, qint64> _trackLengths; /* tracks that have a file */
+        bool _samplerIsForCurrentUser;
     };
 }
 #endif
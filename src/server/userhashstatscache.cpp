@@ -43,9 +43,11 @@ namespace PMP::Server
         if (stats.size() > userData.size())
             userData.reserve(stats.size());
 
+        /* entries that are present already could be more recent */
         for (auto const& record : qAsConst(stats))
         {
-            userData.insert(record.hashId, record);
+            if (!userData.contains(record.hashId))
+                userData.insert(record.hashId, record);
         }
 
         _usersLoaded << userId;
@@ -317,4 +317,18 @@ namespace PMP::Server
         return true;
     }
 
+    quint32 WaveTrackGenerator::samplingWeight(TrackStats const& stats,
+                                               qint64 lengthMilliseconds)
+    {
+        /* same checks as the basic filter; all tracks that pass are equally likely */
+
+        if (lengthMilliseconds >= 0 && lengthMilliseconds < 30 * 1000)
+            return 0;
+
+        if (!stats.haveScore() || stats.scoreIsLessThanXPercent(60))
+            return 0;
+
+        return 1000;
+    }
+
 }
@@ -59,6 +59,8 @@ namespace PMP::Server
         int selectionFilterCompare(Candidate const& t1, Candidate const& t2);
 
         bool satisfiesBasicFilter(Candidate const& candidate) override;
+        quint32 samplingWeight(TrackStats const& stats,
+                               qint64 lengthMilliseconds) override;
 
         QQueue<QSharedPointer<Candidate>> _upcoming;
         QVector<QSharedPointer<Candidate>> _buffer;
@@ -0,0 +1,137 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "weightedsampler.h"
+
+namespace PMP::Server
+{
+    WeightedSampler::WeightedSampler()
+    {
+        clear();
+    }
+
+    void WeightedSampler::clear()
+    {
+        _itemToSlot.clear();
+        _slotToItem.clear();
+        _weights.clear();
+        _tree.clear();
+        _tree.append(0);
+        _totalWeight = 0;
+    }
+
+    void WeightedSampler::setWeight(uint item, quint32 weight)
+    {
+        if (item == 0)
+            return;
+
+        auto it = _itemToSlot.constFind(item);
+        if (it == _itemToSlot.constEnd())
+        {
+            if (weight > 0)
+                appendSlot(item, weight);
+
+            return;
+        }
+
+        int slot = it.value();
+        qint64 difference = qint64(weight) - _weights[slot];
+        if (difference == 0)
+            return;
+
+        _weights[slot] = weight;
+        addToTree(slot + 1, difference);
+        _totalWeight += difference;
+    }
+
+    quint32 WeightedSampler::weight(uint item) const
+    {
+        auto it = _itemToSlot.constFind(item);
+        if (it == _itemToSlot.constEnd())
+            return 0;
+
+        return _weights[it.value()];
+    }
+
+    uint WeightedSampler::pick(std::mt19937& randomEngine) const
+    {
+        if (_totalWeight <= 0)
+            return 0;
+
+        std::uniform_int_distribution<qint64> range(0, _totalWeight - 1);
+        auto slot = findSlot(range(randomEngine));
+
+        return _slotToItem[slot];
+    }
+
+    void WeightedSampler::appendSlot(uint item, quint32 weight)
+    {
+        int slot = _weights.size();
+        _itemToSlot.insert(item, slot);
+        _slotToItem.append(item);
+        _weights.append(weight);
+
+        /* the new node covers a range of slots that ends with the new slot itself */
+        int index = slot + 1;
+        int lowestBit = index & -index;
+        _tree.append(weight + prefixSum(index - 1) - prefixSum(index - lowestBit));
+
+        _totalWeight += weight;
+    }
+
+    void WeightedSampler::addToTree(int index, qint64 difference)
+    {
+        for (int i = index; i < _tree.size(); i += i & -i)
+            _tree[i] += difference;
+    }
+
+    qint64 WeightedSampler::prefixSum(int slotCount) const
+    {
+        qint64 sum = 0;
+
+        for (int i = slotCount; i > 0; i -= i & -i)
+            sum += _tree[i];
+
+        return sum;
+    }
+
+    int WeightedSampler::findSlot(qint64 target) const
+    {
+        /* find the first slot for which the sum of the weights up to and including that
+           slot exceeds the target; slots with a weight of zero are skipped that way */
+
+        int nodeCount = _tree.size() - 1;
+        int step = 1;
+        while (step * 2 <= nodeCount)
+            step *= 2;
+
+        int position = 0;
+        for (; step > 0; step /= 2)
+        {
+            int next = position + step;
+            if (next <= nodeCount && _tree[next] <= target)
+            {
+                position = next;
+                target -= _tree[next];
+            }
+        }
+
+        return position; /* index 'position + 1', which is slot 'position' */
+    }
+}
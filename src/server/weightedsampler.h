@@ -0,0 +1,66 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_SERVER_WEIGHTEDSAMPLER_H
+#define PMP_SERVER_WEIGHTEDSAMPLER_H
+
+#include <QHash>
+#include <QVector>
+
+#include <random>
+
+namespace PMP::Server
+{
+    /** Picks random items with a chance that is proportional to their weight.
+
+        Items are identified by a non-zero number, like a hash ID.  The weights are kept
+        in a Fenwick tree (binary indexed tree), so changing the weight of an item and
+        picking an item both take O(log n) time.  An item whose weight is set to zero
+        keeps its slot in the tree; it just cannot be picked anymore.
+    */
+    class WeightedSampler
+    {
+    public:
+        WeightedSampler();
+
+        void clear();
+
+        void setWeight(uint item, quint32 weight);
+        quint32 weight(uint item) const;
+
+        qint64 totalWeight() const { return _totalWeight; }
+        bool isEmpty() const { return _totalWeight <= 0; }
+
+        /* returns zero if there is nothing to pick from */
+        uint pick(std::mt19937& randomEngine) const;
+
+    private:
+        void appendSlot(uint item, quint32 weight);
+        void addToTree(int index, qint64 difference);
+        qint64 prefixSum(int slotCount) const;
+        int findSlot(qint64 target) const;
+
+        QHash<uint, int> _itemToSlot;
+        QVector<uint> _slotToItem;
+        QVector<quint32> _weights;
+        QVector<qint64> _tree; /* indexes start at 1; _tree[0] is not used */
+        qint64 _totalWeight;
+    };
+}
+#endif
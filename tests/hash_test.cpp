@@ -344,6 +344,12 @@ public:
                 return false;
             }
 
+            if (!hasSameResultAsWholeFileAnalysis(analyzer, modifiedData))
+            {
+                writeDebugFile(_filename + "_MODIFIED.data", modifiedData);
+                return false;
+            }
+
             QString modifiedHash = getHashAsString(analyzer.hash());
             if (modifiedHash != _expectedResult)
             {
@@ -368,6 +374,36 @@ public:
 
 private:
 
+    bool hasSameResultAsWholeFileAnalysis(FileAnalyzer const& streamingAnalyzer,
+                                          TagLib::ByteVector const& data)
+    {
+        FileAnalyzer analyzer(data, extension());
+        analyzer.analyze(FileAnalyzer::AnalysisMode::WholeFile);
+        if (!analyzer.analysisDone())
+        {
+            _err << "Whole file analysis FAILED on modified data!" << Qt::endl;
+            return false;
+        }
+
+        auto streamingHash = getHashAsString(streamingAnalyzer.hash());
+        auto streamingLegacyHash = getHashAsString(streamingAnalyzer.legacyHash());
+        auto wholeFileHash = getHashAsString(analyzer.hash());
+        auto wholeFileLegacyHash = getHashAsString(analyzer.legacyHash());
+
+        if (streamingHash != wholeFileHash || streamingLegacyHash != wholeFileLegacyHash)
+        {
+            _err << "Streaming analysis does not match whole file analysis!" << Qt::endl
+                 << "Filename: " << _filename << Qt::endl
+                 << "Streaming:  " << streamingHash
+                 << " (legacy: " << streamingLegacyHash << ")" << Qt::endl
+                 << "Whole file: " << wholeFileHash
+                 << " (legacy: " << wholeFileLegacyHash << ")" << Qt::endl;
+            return false;
+        }
+
+        return true;
+    }
+
     QVector<TagLib::ByteVector> generateSingleModifiedData(
                                     QList<std::function<void (TagLib::File*)> > modifiers)
     {
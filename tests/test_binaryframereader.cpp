@@ -0,0 +1,282 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "test_binaryframereader.h"
+
+#include "common/binarycursor.h"
+#include "common/binaryframereader.h"
+#include "common/networkutil.h"
+
+#include <QRandomGenerator>
+#include <QtTest/QTest>
+#include <QVector>
+
+using namespace PMP;
+
+namespace
+{
+    QByteArray makeFrame(QByteArray const& message)
+    {
+        QByteArray frame;
+        NetworkUtil::append4Bytes(frame, static_cast<quint32>(message.size()));
+        frame += message;
+        return frame;
+    }
+
+    QVector<QByteArray> makeMessages(QRandomGenerator& random, int count)
+    {
+        QVector<QByteArray> messages;
+        messages.reserve(count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            /* mostly small messages, like a real session, with a few large ones */
+            int size = random.bounded(100) < 95 ? random.bounded(2, 64)
+                                                : random.bounded(1000, 200000);
+
+            QByteArray message(size, '\0');
+            for (int j = 0; j < size; ++j)
+                message[j] = static_cast<char>(random.bounded(256));
+
+            messages.append(message);
+        }
+
+        return messages;
+    }
+
+    QVector<QByteArray> splitRandomly(QRandomGenerator& random, QByteArray const& stream)
+    {
+        QVector<QByteArray> chunks;
+
+        int position = 0;
+        while (position < stream.size())
+        {
+            int chunkSize = qMin(random.bounded(1, 70000), stream.size() - position);
+            chunks.append(stream.mid(position, chunkSize));
+            position += chunkSize;
+        }
+
+        return chunks;
+    }
+
+    QVector<QByteArray> readAllFrames(QVector<QByteArray> const& chunks)
+    {
+        BinaryFrameReader reader;
+        QVector<QByteArray> messages;
+
+        BinaryFrame frame;
+        for (auto const& chunk : chunks)
+        {
+            reader.append(chunk);
+
+            while (reader.nextFrame(frame))
+                messages.append(QByteArray(frame.message().constData(),
+                                           frame.message().size()));
+        }
+
+        return messages;
+    }
+}
+
+void TestBinaryFrameReader::singleFrame()
+{
+    BinaryFrameReader reader;
+    reader.append(makeFrame("hello"));
+
+    BinaryFrame frame;
+    QVERIFY(reader.nextFrame(frame));
+    QCOMPARE(frame.message(), QByteArray("hello"));
+    QVERIFY(!reader.nextFrame(frame));
+    QCOMPARE(reader.bytesBuffered(), 0);
+}
+
+void TestBinaryFrameReader::multipleFramesInOneChunk()
+{
+    BinaryFrameReader reader;
+    reader.append(makeFrame("abc") + makeFrame("defgh") + makeFrame("ij"));
+
+    BinaryFrame frame;
+    QVERIFY(reader.nextFrame(frame));
+    QCOMPARE(frame.message(), QByteArray("abc"));
+    QVERIFY(reader.nextFrame(frame));
+    QCOMPARE(frame.message(), QByteArray("defgh"));
+    QVERIFY(reader.nextFrame(frame));
+    QCOMPARE(frame.message(), QByteArray("ij"));
+    QVERIFY(!reader.nextFrame(frame));
+}
+
+void TestBinaryFrameReader::frameSplitAcrossChunks()
+{
+    auto bytes = makeFrame("0123456789") + makeFrame("xyz");
+
+    BinaryFrameReader reader;
+    BinaryFrame frame;
+
+    reader.append(bytes.left(2)); /* not even the complete length */
+    QVERIFY(!reader.nextFrame(frame));
+
+    quint32 expectedLength = 0;
+    QVERIFY(!reader.waitingForIncompleteFrame(expectedLength));
+
+    reader.append(bytes.mid(2, 6));
+    QVERIFY(!reader.nextFrame(frame));
+    QVERIFY(reader.waitingForIncompleteFrame(expectedLength));
+    QCOMPARE(expectedLength, 10u);
+
+    reader.append(bytes.mid(8));
+    QVERIFY(reader.nextFrame(frame));
+    QCOMPARE(frame.message(), QByteArray("0123456789"));
+    QVERIFY(reader.nextFrame(frame));
+    QCOMPARE(frame.message(), QByteArray("xyz"));
+    QVERIFY(!reader.nextFrame(frame));
+    QVERIFY(!reader.waitingForIncompleteFrame(expectedLength));
+}
+
+void TestBinaryFrameReader::emptyFrame()
+{
+    BinaryFrameReader reader;
+    reader.append(makeFrame(QByteArray()) + makeFrame("a"));
+
+    BinaryFrame frame;
+    QVERIFY(reader.nextFrame(frame));
+    QCOMPARE(frame.message().size(), 0);
+    QVERIFY(reader.nextFrame(frame));
+    QCOMPARE(frame.message(), QByteArray("a"));
+}
+
+void TestBinaryFrameReader::frameOutlivesReader()
+{
+    BinaryFrame frame;
+
+    {
+        BinaryFrameReader reader;
+        reader.append(makeFrame("first") + makeFrame("sec"));
+        QVERIFY(reader.nextFrame(frame));
+
+        /* the reader compacts and grows its buffer while the frame is still in use */
+        reader.append(QByteArray(100000, 'z'));
+        reader.clear();
+    }
+
+    QCOMPARE(frame.message(), QByteArray("first"));
+}
+
+void TestBinaryFrameReader::randomlySplitSession()
+{
+    QRandomGenerator random(12345);
+
+    for (int round = 0; round < 20; ++round)
+    {
+        auto messages = makeMessages(random, 200);
+
+        QByteArray stream;
+        for (auto const& message : qAsConst(messages))
+            stream += makeFrame(message);
+
+        auto received = readAllFrames(splitRandomly(random, stream));
+
+        QCOMPARE(received.size(), messages.size());
+        QVERIFY(received == messages);
+    }
+}
+
+void TestBinaryFrameReader::cursorReadsFields()
+{
+    QByteArray message;
+    NetworkUtil::appendByte(message, 0xAB);
+    NetworkUtil::append2Bytes(message, 0x1234);
+    NetworkUtil::append4Bytes(message, 0xDEADBEEF);
+    NetworkUtil::append8Bytes(message, 0x0102030405060708ULL);
+    NetworkUtil::append2BytesSigned(message, -2);
+    NetworkUtil::append8ByteMaybeEmptyQDateTimeMsSinceEpoch(message, QDateTime());
+    message += "text";
+
+    BinaryCursor cursor(message);
+    QCOMPARE(cursor.readByte(), quint8(0xAB));
+    QCOMPARE(cursor.read2Bytes(), quint16(0x1234));
+    QCOMPARE(cursor.read4Bytes(), quint32(0xDEADBEEF));
+    QCOMPARE(cursor.read8Bytes(), quint64(0x0102030405060708ULL));
+    QCOMPARE(cursor.read2BytesSigned(), qint16(-2));
+    QVERIFY(!cursor.readMaybeEmptyQDateTimeFrom8ByteMsSinceEpoch().isValid());
+    QCOMPARE(cursor.remaining(), 4);
+    QCOMPARE(cursor.readUtf8String(4), QString("text"));
+    QVERIFY(cursor.atEnd());
+    QVERIFY(!cursor.failed());
+}
+
+void TestBinaryFrameReader::cursorFailsBeyondEnd()
+{
+    QByteArray message("\x01\x02\x03", 3);
+
+    BinaryCursor cursor(message, 1);
+    QCOMPARE(cursor.read4Bytes(), 0u);
+    QVERIFY(cursor.failed());
+    QVERIFY(cursor.atEnd());
+
+    /* the error is sticky */
+    QCOMPARE(cursor.readByte(), quint8(0));
+    QVERIFY(cursor.failed());
+
+    BinaryCursor cursor2(message);
+    cursor2.skip(3);
+    QVERIFY(!cursor2.failed());
+    QCOMPARE(cursor2.readBytes(1), QByteArray());
+    QVERIFY(cursor2.failed());
+
+    BinaryCursor cursor3(message, 4);
+    QVERIFY(cursor3.failed());
+}
+
+void TestBinaryFrameReader::benchmarkRandomlySplitSession()
+{
+    QRandomGenerator random(54321);
+
+    auto messages = makeMessages(random, 5000);
+
+    QByteArray stream;
+    for (auto const& message : qAsConst(messages))
+        stream += makeFrame(message);
+
+    auto chunks = splitRandomly(random, stream);
+
+    int frameCount = 0;
+    QBENCHMARK
+    {
+        BinaryFrameReader reader;
+        BinaryFrame frame;
+        frameCount = 0;
+
+        for (auto const& chunk : qAsConst(chunks))
+        {
+            reader.append(chunk);
+
+            while (reader.nextFrame(frame))
+            {
+                BinaryCursor cursor(frame.message());
+                cursor.read2Bytes();
+                ++frameCount;
+            }
+        }
+    }
+
+    QCOMPARE(frameCount, messages.size());
+}
+
+QTEST_MAIN(TestBinaryFrameReader)
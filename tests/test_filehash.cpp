@@ -21,10 +21,47 @@
 
 #include "common/filehash.h"
 
+#include <QHash>
 #include <QtTest/QTest>
+#include <QVector>
 
 using namespace PMP;
 
+namespace
+{
+    /* the layout FileHash used to have, kept for comparison in the benchmarks */
+    struct LegacyFileHash
+    {
+        uint length;
+        QByteArray sha1;
+        QByteArray md5;
+    };
+
+    bool operator==(LegacyFileHash const& me, LegacyFileHash const& other)
+    {
+        return me.length == other.length && me.sha1 == other.sha1
+            && me.md5 == other.md5;
+    }
+
+    uint qHash(LegacyFileHash const& hash)
+    {
+        return hash.length ^ qHash(hash.sha1) ^ qHash(hash.md5);
+    }
+
+    const int benchmarkHashCount = 100000;
+
+    QVector<FileHash> createHashesForBenchmark()
+    {
+        QVector<FileHash> hashes;
+        hashes.reserve(benchmarkHashCount);
+
+        for (int i = 0; i < benchmarkHashCount; ++i)
+            hashes.append(FileHash::create(QByteArray::number(i)));
+
+        return hashes;
+    }
+}
+
 void TestFileHash::defaultConstructorCreatesNullHash()
 {
     FileHash hash;
@@ -44,6 +81,17 @@ void TestFileHash::hashOfEmptyDataNotConsideredNull()
     QCOMPARE(hash.isNull(), false);
 }
 
+void TestFileHash::hashOfZeroBytesConsideredNull()
+{
+    FileHash hash(0, QByteArray(20, '\0'), QByteArray(16, '\0'));
+    QCOMPARE(hash.isNull(), true);
+    QVERIFY(hash == FileHash());
+
+    FileHash hashWithEmptyArrays(0, QByteArray(), QByteArray());
+    QCOMPARE(hashWithEmptyArrays.isNull(), true);
+    QVERIFY(hashWithEmptyArrays == FileHash());
+}
+
 void TestFileHash::hashOfEmptyDataHasKnownValues()
 {
     QByteArray emptyData;
@@ -95,6 +143,86 @@ void TestFileHash::knownHash4()
     QCOMPARE(toString(hash), "4;EjEkmxYqMjEqfhvetDQlr+DXrUs;qrCXRS1P2DtxFCLT/Yfo0A");
 }
 
+void TestFileHash::constructedFromBytesReturnsSameBytes()
+{
+    auto original = FileHash::create("PMP");
+    FileHash copy(original.length(), original.SHA1(), original.MD5());
+
+    QCOMPARE(copy.length(), original.length());
+    QCOMPARE(copy.SHA1(), original.SHA1());
+    QCOMPARE(copy.MD5(), original.MD5());
+    QCOMPARE(copy.SHA1().size(), 20);
+    QCOMPARE(copy.MD5().size(), 16);
+    QVERIFY(copy == original);
+    QCOMPARE(qHash(copy), qHash(original));
+    QCOMPARE(copy.toString(), original.toString());
+    QCOMPARE(FileHash::tryParse(original.toString()), original);
+}
+
+void TestFileHash::equalityAndOrdering()
+{
+    auto hash1 = FileHash::create("PMP");
+    auto hash2 = FileHash::create("PMQ");
+    auto hash3 = FileHash::create("PMP2");
+    FileHash null;
+
+    QVERIFY(hash1 != hash2);
+    QVERIFY(hash1 != null);
+    QVERIFY(null == FileHash());
+
+    /* the length comes first */
+    QVERIFY(hash1 < hash3);
+    QVERIFY(hash2 < hash3);
+    QVERIFY(null < hash1);
+
+    QCOMPARE(compare(hash1, hash1), 0);
+    QCOMPARE(compare(hash1, hash2), -compare(hash2, hash1));
+    QCOMPARE(hash1 < hash2, hash1.SHA1() < hash2.SHA1());
+}
+
+void TestFileHash::benchmarkLookupWithLegacyLayout()
+{
+    auto const hashes = createHashesForBenchmark();
+
+    QVector<LegacyFileHash> legacyHashes;
+    legacyHashes.reserve(hashes.size());
+    for (auto const& hash : hashes)
+        legacyHashes.append(LegacyFileHash { hash.length(), hash.SHA1(), hash.MD5() });
+
+    QHash<LegacyFileHash, int> map;
+    for (int i = 0; i < legacyHashes.size(); ++i)
+        map.insert(legacyHashes[i], i);
+
+    int found = 0;
+    QBENCHMARK
+    {
+        found = 0;
+        for (auto const& hash : qAsConst(legacyHashes))
+            found += map.contains(hash) ? 1 : 0;
+    }
+
+    QCOMPARE(found, benchmarkHashCount);
+}
+
+void TestFileHash::benchmarkLookup()
+{
+    auto const hashes = createHashesForBenchmark();
+
+    QHash<FileHash, int> map;
+    for (int i = 0; i < hashes.size(); ++i)
+        map.insert(hashes[i], i);
+
+    int found = 0;
+    QBENCHMARK
+    {
+        found = 0;
+        for (auto const& hash : hashes)
+            found += map.contains(hash) ? 1 : 0;
+    }
+
+    QCOMPARE(found, benchmarkHashCount);
+}
+
 QString TestFileHash::toString(const PMP::FileHash& hash)
 {
     return QString::number(hash.length())
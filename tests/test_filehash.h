@@ -35,11 +35,16 @@ private Q_SLOTS:
     void defaultConstructorCreatesNullHash();
     void realHashNotConsideredNull();
     void hashOfEmptyDataNotConsideredNull();
+    void hashOfZeroBytesConsideredNull();
     void hashOfEmptyDataHasKnownValues();
     void knownHash1();
     void knownHash2();
     void knownHash3();
     void knownHash4();
+    void constructedFromBytesReturnsSameBytes();
+    void equalityAndOrdering();
+    void benchmarkLookupWithLegacyLayout();
+    void benchmarkLookup();
 
 private:
     static QString toString(PMP::FileHash const& hash);
@@ -0,0 +1,141 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_filesystemindex.h"
+
+#include "server/filesystemindex.h"
+
+#include <QtTest/QTest>
+
+using namespace PMP::Server;
+
+void TestFileSystemIndex::insert_findsPathByFileNameAndSize()
+{
+    FileSystemIndex index;
+    index.insert("/music/a/song.mp3", 1000);
+    index.insert("/music/b/song.mp3", 2000);
+    index.insert("/music/b/other.flac", 1000);
+
+    auto byName = index.getPathsByFileName("song.mp3");
+    QCOMPARE(byName.size(), 2);
+    QVERIFY(byName.contains("/music/a/song.mp3"));
+    QVERIFY(byName.contains("/music/b/song.mp3"));
+
+    auto bySize = index.getPathsBySize(1000);
+    QCOMPARE(bySize.size(), 2);
+    QVERIFY(bySize.contains("/music/a/song.mp3"));
+    QVERIFY(bySize.contains("/music/b/other.flac"));
+
+    QVERIFY(index.getPathsByFileName("missing.mp3").isEmpty());
+    QVERIFY(index.getPathsBySize(3000).isEmpty());
+    QCOMPARE(index.fileCount(), 3);
+}
+
+void TestFileSystemIndex::insert_updatesSizeOfKnownPath()
+{
+    FileSystemIndex index;
+    index.insert("/music/song.mp3", 1000);
+    index.insert("/music/song.mp3", 1500);
+
+    QVERIFY(index.getPathsBySize(1000).isEmpty());
+    QCOMPARE(index.getPathsBySize(1500), QStringList { "/music/song.mp3" });
+    QCOMPARE(index.getPathsByFileName("song.mp3"), QStringList { "/music/song.mp3" });
+    QCOMPARE(index.fileCount(), 1);
+}
+
+void TestFileSystemIndex::removePathOrTree_removesSingleFile()
+{
+    FileSystemIndex index;
+    index.insert("/music/a/song.mp3", 1000);
+    index.insert("/music/b/song.mp3", 1000);
+
+    index.removePathOrTree("/music/a/song.mp3");
+
+    QCOMPARE(index.getPathsByFileName("song.mp3"), QStringList { "/music/b/song.mp3" });
+    QCOMPARE(index.getPathsBySize(1000), QStringList { "/music/b/song.mp3" });
+    QCOMPARE(index.fileCount(), 1);
+}
+
+void TestFileSystemIndex::removePathOrTree_removesDirectoryContents()
+{
+    FileSystemIndex index;
+    index.insert("/music/album/one.mp3", 1000);
+    index.insert("/music/album/cd2/two.mp3", 2000);
+    index.insert("/music/album2/three.mp3", 3000);
+    index.insert("/music/album - live/four.mp3", 4000);
+
+    index.removePathOrTree("/music/album");
+
+    QVERIFY(index.getPathsByFileName("one.mp3").isEmpty());
+    QVERIFY(index.getPathsByFileName("two.mp3").isEmpty());
+    QCOMPARE(index.getPathsByFileName("three.mp3"),
+             QStringList { "/music/album2/three.mp3" });
+    QCOMPARE(index.getPathsByFileName("four.mp3"),
+             QStringList { "/music/album - live/four.mp3" });
+    QCOMPARE(index.fileCount(), 2);
+}
+
+void TestFileSystemIndex::finishRefresh_removesFilesNotEncountered()
+{
+    FileSystemIndex index;
+    index.insert("/music/old.mp3", 1000);
+    index.insert("/music/kept.mp3", 2000);
+    QVERIFY(!index.isComplete());
+
+    auto refresh = index.startRefresh();
+    index.insert("/music/kept.mp3", 2000);
+    index.insert("/music/new.mp3", 3000);
+    index.finishRefresh(refresh);
+
+    QVERIFY(index.isComplete());
+    QVERIFY(index.getPathsByFileName("old.mp3").isEmpty());
+    QVERIFY(index.getPathsBySize(1000).isEmpty());
+    QCOMPARE(index.getPathsByFileName("kept.mp3"), QStringList { "/music/kept.mp3" });
+    QCOMPARE(index.getPathsByFileName("new.mp3"), QStringList { "/music/new.mp3" });
+    QCOMPARE(index.fileCount(), 2);
+}
+
+void TestFileSystemIndex::finishRefresh_supersededRefreshDoesNotComplete()
+{
+    FileSystemIndex index;
+
+    auto refresh = index.startRefresh();
+    index.insert("/music/song.mp3", 1000);
+    index.clear();
+    index.finishRefresh(refresh);
+
+    QVERIFY(!index.isComplete());
+    QCOMPARE(index.fileCount(), 0);
+}
+
+void TestFileSystemIndex::clear_makesIndexIncomplete()
+{
+    FileSystemIndex index;
+    index.finishRefresh(index.startRefresh());
+    QVERIFY(index.isComplete());
+
+    index.insert("/music/song.mp3", 1000);
+    index.clear();
+
+    QVERIFY(!index.isComplete());
+    QVERIFY(index.getPathsByFileName("song.mp3").isEmpty());
+    QCOMPARE(index.fileCount(), 0);
+}
+
+QTEST_MAIN(TestFileSystemIndex)
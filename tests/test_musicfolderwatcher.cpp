@@ -0,0 +1,175 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "test_musicfolderwatcher.h"
+
+#include "server/musicfolderwatcher.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtTest/QTest>
+
+using namespace PMP::Server;
+
+namespace
+{
+    /* changes are reported after a delay of two seconds */
+    const int reportTimeoutMilliseconds = 10000;
+
+    QStringList allPathsReported(QSignalSpy const& spy)
+    {
+        QStringList paths;
+        for (auto const& arguments : spy)
+            paths += arguments.at(0).toStringList();
+
+        return paths;
+    }
+
+    bool createFile(QString const& path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+
+        return file.write("not really audio") > 0;
+    }
+
+    bool startWatching(MusicFolderWatcher& watcher, QString const& path)
+    {
+        watcher.setMusicPaths({ path });
+
+        if (!watcher.isWatchingEverything())
+            return false;
+
+        /* the watches are added after the folder was listed in the background */
+        QTest::qWait(500);
+        return true;
+    }
+}
+
+void TestMusicFolderWatcher::fileCreated_isReportedAsChanged()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto root = QFileInfo(dir.path()).absoluteFilePath();
+
+    MusicFolderWatcher watcher(nullptr);
+    QSignalSpy changedSpy(&watcher, &MusicFolderWatcher::filesChanged);
+    if (!startWatching(watcher, root))
+        QSKIP("watching folders is not available on this system");
+
+    auto path = root + "/song.mp3";
+    QVERIFY(createFile(path));
+
+    QTRY_VERIFY_WITH_TIMEOUT(allPathsReported(changedSpy).contains(path),
+                             reportTimeoutMilliseconds);
+}
+
+void TestMusicFolderWatcher::fileCreated_unsupportedExtensionIsNotReported()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto root = QFileInfo(dir.path()).absoluteFilePath();
+
+    MusicFolderWatcher watcher(nullptr);
+    QSignalSpy changedSpy(&watcher, &MusicFolderWatcher::filesChanged);
+    if (!startWatching(watcher, root))
+        QSKIP("watching folders is not available on this system");
+
+    QVERIFY(createFile(root + "/notes.txt"));
+    QVERIFY(createFile(root + "/song.flac"));
+
+    QTRY_VERIFY_WITH_TIMEOUT(allPathsReported(changedSpy).contains(root + "/song.flac"),
+                             reportTimeoutMilliseconds);
+    QVERIFY(!allPathsReported(changedSpy).contains(root + "/notes.txt"));
+}
+
+void TestMusicFolderWatcher::fileDeleted_isReportedAsRemoved()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto root = QFileInfo(dir.path()).absoluteFilePath();
+    auto path = root + "/song.mp3";
+    QVERIFY(createFile(path));
+
+    MusicFolderWatcher watcher(nullptr);
+    QSignalSpy changedSpy(&watcher, &MusicFolderWatcher::filesChanged);
+    QSignalSpy removedSpy(&watcher, &MusicFolderWatcher::pathsRemoved);
+    if (!startWatching(watcher, root))
+        QSKIP("watching folders is not available on this system");
+
+    QVERIFY(QFile::remove(path));
+
+    QTRY_VERIFY_WITH_TIMEOUT(allPathsReported(removedSpy).contains(path),
+                             reportTimeoutMilliseconds);
+    QVERIFY(!allPathsReported(changedSpy).contains(path));
+}
+
+void TestMusicFolderWatcher::directoryCreated_itsFilesAreReportedAndWatched()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto root = QFileInfo(dir.path()).absoluteFilePath();
+
+    MusicFolderWatcher watcher(nullptr);
+    QSignalSpy changedSpy(&watcher, &MusicFolderWatcher::filesChanged);
+    if (!startWatching(watcher, root))
+        QSKIP("watching folders is not available on this system");
+
+    auto subdirectory = root + "/album";
+    QVERIFY(QDir(root).mkdir("album"));
+    QVERIFY(createFile(subdirectory + "/track1.mp3"));
+
+    QTRY_VERIFY_WITH_TIMEOUT(
+        allPathsReported(changedSpy).contains(subdirectory + "/track1.mp3"),
+        reportTimeoutMilliseconds);
+
+    /* the new directory is now watched as well */
+    QVERIFY(createFile(subdirectory + "/track2.mp3"));
+
+    QTRY_VERIFY_WITH_TIMEOUT(
+        allPathsReported(changedSpy).contains(subdirectory + "/track2.mp3"),
+        reportTimeoutMilliseconds);
+}
+
+void TestMusicFolderWatcher::directoryDeleted_isReportedAsRemoved()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto root = QFileInfo(dir.path()).absoluteFilePath();
+    auto subdirectory = root + "/album";
+    QVERIFY(QDir(root).mkdir("album"));
+    QVERIFY(createFile(subdirectory + "/track1.mp3"));
+
+    MusicFolderWatcher watcher(nullptr);
+    QSignalSpy removedSpy(&watcher, &MusicFolderWatcher::pathsRemoved);
+    if (!startWatching(watcher, root))
+        QSKIP("watching folders is not available on this system");
+
+    QVERIFY(QDir(subdirectory).removeRecursively());
+
+    QTRY_VERIFY_WITH_TIMEOUT(allPathsReported(removedSpy).contains(subdirectory),
+                             reportTimeoutMilliseconds);
+}
+
+QTEST_MAIN(TestMusicFolderWatcher)
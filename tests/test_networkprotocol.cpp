@@ -21,6 +21,8 @@
 
 #include "common/filehash.h"
 #include "common/networkprotocol.h"
+#include "common/networkprotocolextensions.h"
+#include "common/networkutil.h"
 
 #include <QtTest/QTest>
 
@@ -95,4 +97,92 @@ void TestNetworkProtocol::getEmptyHash()
     QCOMPARE(result.MD5(), emptyHash.MD5());
 }
 
+namespace
+{
+    const quint32 sizeLimit = 1024 * 1024;
+
+    NetworkProtocolExtensionSupportMap compressionSupport()
+    {
+        NetworkProtocolExtensionSupportMap extensionSupport;
+        extensionSupport.registerExtensionSupport(
+            {NetworkProtocolExtension::Compression, 200, 1}
+        );
+        return extensionSupport;
+    }
+
+    QByteArray createRepetitiveMessage()
+    {
+        QByteArray message;
+        NetworkProtocol::append2Bytes(message,
+                                      ServerMessageType::CollectionFetchResponseMessage);
+        NetworkUtil::append2Bytes(message, 0);
+
+        for (int i = 0; i < 500; ++i)
+        {
+            NetworkUtil::append4Bytes(message, static_cast<quint32>(i));
+            message += "Some Artist - Some Album";
+        }
+
+        return message;
+    }
+}
+
+void TestNetworkProtocol::compressedMessageRoundTrip()
+{
+    auto message = createRepetitiveMessage();
+
+    auto compressed =
+        NetworkProtocolExtensionMessages::generateCompressedMessage(compressionSupport(),
+                                                                    message);
+
+    QVERIFY(!compressed.isEmpty());
+    QVERIFY(compressed.size() < message.size());
+
+    /* extension message type with extension ID 200 and message type 1 */
+    QCOMPARE(NetworkUtil::get2Bytes(compressed, 0), quint16((1u << 15) + (200 << 7) + 1));
+
+    auto decompressed =
+        NetworkProtocolExtensionMessages::decompressMessage(compressed, sizeLimit);
+    QVERIFY(decompressed != null);
+    QCOMPARE(decompressed.value(), message);
+}
+
+void TestNetworkProtocol::smallMessageNotCompressed()
+{
+    QByteArray message(NetworkProtocolExtensionMessages::CompressionThreshold - 1, 'a');
+
+    auto compressed =
+        NetworkProtocolExtensionMessages::generateCompressedMessage(compressionSupport(),
+                                                                    message);
+
+    QVERIFY(compressed.isEmpty());
+}
+
+void TestNetworkProtocol::invalidCompressedMessageRejected()
+{
+    auto compressed =
+        NetworkProtocolExtensionMessages::generateCompressedMessage(
+            compressionSupport(), createRepetitiveMessage()
+        );
+
+    auto truncated = compressed.left(compressed.size() / 2);
+    QVERIFY(NetworkProtocolExtensionMessages::decompressMessage(truncated, sizeLimit)
+                == null);
+
+    auto tooShort = compressed.left(4);
+    QVERIFY(NetworkProtocolExtensionMessages::decompressMessage(tooShort, sizeLimit)
+                == null);
+
+    /* claims to decompress to a huge message */
+    auto hugeSize = compressed;
+    hugeSize[2] = char(0x7F);
+    QVERIFY(NetworkProtocolExtensionMessages::decompressMessage(hugeSize, sizeLimit)
+                == null);
+
+    /* decompresses fine, but is larger than the limit */
+    quint32 tooSmallLimit = createRepetitiveMessage().size() - 1;
+    QVERIFY(NetworkProtocolExtensionMessages::decompressMessage(compressed, tooSmallLimit)
+                == null);
+}
+
 QTEST_MAIN(TestNetworkProtocol)
@@ -31,5 +31,8 @@ private Q_SLOTS:
     void getHash();
     void appendEmptyHash();
     void getEmptyHash();
+    void compressedMessageRoundTrip();
+    void smallMessageNotCompressed();
+    void invalidCompressedMessageRejected();
 };
 #endif
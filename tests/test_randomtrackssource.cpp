@@ -0,0 +1,169 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "test_randomtrackssource.h"
+
+#include "server/hashidregistrar.h"
+#include "server/hashrelations.h"
+#include "server/randomtrackssource.h"
+#include "server/resolver.h"
+#include "server/resolversnapshot.h"
+
+#include <QSet>
+#include <QtTest/QTest>
+
+using namespace PMP;
+using namespace PMP::Server;
+
+namespace
+{
+    const int trackCount = 5;
+
+    QVector<FileHash> createHashes()
+    {
+        QVector<FileHash> hashes;
+        for (int i = 0; i < trackCount; ++i)
+            hashes.append(FileHash::create("track " + QByteArray::number(i)));
+
+        return hashes;
+    }
+
+    /* the source gets its tracks from the Resolver */
+    void addTracks(Resolver& resolver, QVector<FileHash> const& hashes)
+    {
+        ResolverSnapshot snapshot(QUuid::createUuid());
+        for (int i = 0; i < hashes.size(); ++i)
+        {
+            ResolverSnapshot::Track track;
+            track.hashId = uint(i + 1);
+            track.hash = hashes[i];
+            snapshot.addTrack(track);
+        }
+
+        resolver.restoreFromSnapshot(snapshot);
+    }
+
+    QVector<FileHash> takeAllUnusedTracks(RandomTracksSource& source)
+    {
+        QVector<FileHash> taken;
+        while (source.unusedTrackCount() > 0)
+            taken.append(source.takeTrack());
+
+        return taken;
+    }
+}
+
+void TestRandomTracksSource::takeSpecificTrack_removesTrackFromUnusedTracks()
+{
+    HashIdRegistrar hashIdRegistrar;
+    HashRelations hashRelations;
+    Resolver resolver(&hashIdRegistrar, &hashRelations, nullptr);
+    auto hashes = createHashes();
+    addTracks(resolver, hashes);
+
+    RandomTracksSource source(nullptr, &resolver);
+    QCOMPARE(source.unusedTrackCount(), trackCount);
+
+    QVERIFY(source.takeSpecificTrack(hashes[2]));
+    QVERIFY(!source.takeSpecificTrack(hashes[2])); /* taken already */
+    QCOMPARE(source.unusedTrackCount(), trackCount - 1);
+    QCOMPARE(source.takenTrackCount(), 1);
+    QCOMPARE(source.totalTrackCount(), trackCount);
+
+    auto taken = takeAllUnusedTracks(source);
+    QCOMPARE(taken.size(), trackCount - 1);
+    QVERIFY(!taken.contains(hashes[2]));
+    QCOMPARE(source.takenTrackCount(), trackCount);
+}
+
+void TestRandomTracksSource::takeSpecificTrack_putBackUnused_trackIsTakenOnlyOnce()
+{
+    HashIdRegistrar hashIdRegistrar;
+    HashRelations hashRelations;
+    Resolver resolver(&hashIdRegistrar, &hashRelations, nullptr);
+    auto hashes = createHashes();
+    addTracks(resolver, hashes);
+
+    RandomTracksSource source(nullptr, &resolver);
+
+    QVERIFY(source.takeSpecificTrack(hashes[0]));
+    source.putBackUnusedTrack(hashes[0]);
+    QCOMPARE(source.unusedTrackCount(), trackCount);
+    QCOMPARE(source.takenTrackCount(), 0);
+
+    auto taken = takeAllUnusedTracks(source);
+    QCOMPARE(taken.size(), trackCount);
+    QCOMPARE(taken.count(hashes[0]), 1);
+    QCOMPARE(QSet<FileHash>(taken.begin(), taken.end()).size(), trackCount);
+}
+
+void TestRandomTracksSource::takeSpecificTrack_putBackAll_noDuplicates()
+{
+    HashIdRegistrar hashIdRegistrar;
+    HashRelations hashRelations;
+    Resolver resolver(&hashIdRegistrar, &hashRelations, nullptr);
+    auto hashes = createHashes();
+    addTracks(resolver, hashes);
+
+    RandomTracksSource source(nullptr, &resolver);
+
+    QVERIFY(source.takeSpecificTrack(hashes[1]));
+    QVERIFY(source.takeSpecificTrack(hashes[3]));
+    QVERIFY(!source.takeTrack().isNull());
+    QCOMPARE(source.unusedTrackCount(), trackCount - 3);
+    QCOMPARE(source.takenTrackCount(), 3);
+
+    source.putBackAllTracksTakenAsUnused();
+    QCOMPARE(source.unusedTrackCount(), trackCount);
+    QCOMPARE(source.takenTrackCount(), 0);
+
+    auto taken = takeAllUnusedTracks(source);
+    QCOMPARE(QSet<FileHash>(taken.begin(), taken.end()).size(), trackCount);
+}
+
+void TestRandomTracksSource::takeSpecificTrack_putBackUsed_returnsInNextCycle()
+{
+    HashIdRegistrar hashIdRegistrar;
+    HashRelations hashRelations;
+    Resolver resolver(&hashIdRegistrar, &hashRelations, nullptr);
+    auto hashes = createHashes();
+    addTracks(resolver, hashes);
+
+    RandomTracksSource source(nullptr, &resolver);
+
+    QVERIFY(source.takeSpecificTrack(hashes[4]));
+    source.putBackUsedTrack(hashes[4]);
+    QCOMPARE(source.unusedTrackCount(), trackCount - 1);
+    QCOMPARE(source.takenTrackCount(), 0);
+
+    /* a used track can be taken specifically again */
+    QVERIFY(source.takeSpecificTrack(hashes[4]));
+    source.putBackUsedTrack(hashes[4]);
+
+    for (auto const& hash : takeAllUnusedTracks(source))
+        source.putBackUsedTrack(hash);
+
+    /* the next cycle has every track exactly once */
+    QVERIFY(!source.takeTrack().isNull());
+    QCOMPARE(source.unusedTrackCount(), trackCount - 1);
+    QCOMPARE(source.takenTrackCount(), 1);
+}
+
+QTEST_MAIN(TestRandomTracksSource)
@@ -0,0 +1,195 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "test_resolverlocking.h"
+
+#include "common/filehash.h"
+
+#include "server/hashidregistrar.h"
+#include "server/hashrelations.h"
+#include "server/resolver.h"
+#include "server/resolversnapshot.h"
+
+#include <QAtomicInt>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QThreadPool>
+#include <QtTest/QTest>
+
+using namespace PMP;
+using namespace PMP::Server;
+
+/* The Resolver signals are received by objects that query the Resolver right away
+   (the random tracks source, the generators, the collection monitor).  These tests
+   connect such a receiver directly and check that its queries do not deadlock. */
+
+namespace
+{
+    const uint testHashId = 7;
+
+    /* the Resolver verifies restored paths in the background */
+    class BackgroundWorkWaiter
+    {
+    public:
+        ~BackgroundWorkWaiter() { QThreadPool::globalInstance()->waitForDone(); }
+    };
+
+    FileHash createTestHash()
+    {
+        return FileHash::create("not really audio");
+    }
+
+    bool createFile(QString const& path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+
+        return file.write("not really audio") > 0;
+    }
+
+    ResolverSnapshot createSnapshotWithFile(QString const& path,
+                                            QVector<TagData> const& tags = {})
+    {
+        QFileInfo info(path);
+
+        ResolverSnapshot::Track track;
+        track.hashId = testHashId;
+        track.hash = createTestHash();
+        track.audio = AudioData(AudioData::MP3, 180000);
+        track.tags = tags;
+        track.files.append(
+            ResolverSnapshot::File { path, info.size(), info.lastModified().toUTC() }
+        );
+
+        ResolverSnapshot snapshot(QUuid::createUuid());
+        snapshot.addTrack(track);
+        return snapshot;
+    }
+}
+
+void TestResolverLocking::hashBecameAvailable_receiverCanQueryResolver()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto path = dir.path() + "/song.mp3";
+    QVERIFY(createFile(path));
+
+    HashIdRegistrar hashIdRegistrar;
+    HashRelations hashRelations;
+    Resolver resolver(&hashIdRegistrar, &hashRelations, nullptr);
+    BackgroundWorkWaiter backgroundWorkWaiter;
+
+    int signalCount = 0;
+    uint idSeenByReceiver = 0;
+    bool availableForReceiver = false;
+    connect(
+        &resolver, &Resolver::hashBecameAvailable,
+        this,
+        [&](FileHash changedHash)
+        {
+            signalCount++;
+            idSeenByReceiver = resolver.getID(changedHash);
+            availableForReceiver = resolver.haveFileForHash(changedHash);
+        },
+        Qt::DirectConnection
+    );
+
+    resolver.restoreFromSnapshot(createSnapshotWithFile(path));
+
+    QCOMPARE(signalCount, 1);
+    QCOMPARE(idSeenByReceiver, testHashId);
+    QVERIFY(availableForReceiver);
+}
+
+void TestResolverLocking::hashBecameUnavailable_receiverCanQueryResolver()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto path = dir.path() + "/song.mp3";
+    QVERIFY(createFile(path));
+
+    HashIdRegistrar hashIdRegistrar;
+    HashRelations hashRelations;
+    Resolver resolver(&hashIdRegistrar, &hashRelations, nullptr);
+    BackgroundWorkWaiter backgroundWorkWaiter;
+
+    auto hash = createTestHash();
+    resolver.restoreFromSnapshot(createSnapshotWithFile(path));
+    QVERIFY(resolver.haveFileForHash(hash));
+
+    /* the background verification of restored paths could notice the removal too */
+    QAtomicInt signalCount { 0 };
+    QAtomicInt availableForReceiver { 1 };
+    connect(
+        &resolver, &Resolver::hashBecameUnavailable,
+        this,
+        [&](FileHash changedHash)
+        {
+            bool available = resolver.haveFileForHash(changedHash);
+            availableForReceiver.storeRelease(available ? 1 : 0);
+            signalCount.fetchAndAddOrdered(1);
+        },
+        Qt::DirectConnection
+    );
+
+    /* the removal of the path is done on the event loop */
+    QVERIFY(QFile::remove(path));
+    QVERIFY(!resolver.pathStillValid(hash, path));
+
+    QTRY_COMPARE(signalCount.loadAcquire(), 1);
+    QCOMPARE(availableForReceiver.loadAcquire(), 0);
+}
+
+void TestResolverLocking::hashTagInfoChanged_receiverCanQueryResolver()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    auto path = dir.path() + "/song.mp3";
+    QVERIFY(createFile(path));
+
+    HashIdRegistrar hashIdRegistrar;
+    HashRelations hashRelations;
+    Resolver resolver(&hashIdRegistrar, &hashRelations, nullptr);
+    BackgroundWorkWaiter backgroundWorkWaiter;
+
+    int signalCount = 0;
+    QString titleSeenByReceiver;
+    connect(
+        &resolver, &Resolver::hashTagInfoChanged,
+        this,
+        [&](FileHash changedHash)
+        {
+            signalCount++;
+            auto id = resolver.getID(changedHash);
+            titleSeenByReceiver = resolver.getHashTrackInfo(id).title();
+        },
+        Qt::DirectConnection
+    );
+
+    TagData tag("Artist", "Title", "Album", "Album Artist", "");
+    resolver.restoreFromSnapshot(createSnapshotWithFile(path, { tag }));
+
+    QCOMPARE(signalCount, 1);
+    QCOMPARE(titleSeenByReceiver, QString("Title"));
+}
+
+QTEST_MAIN(TestResolverLocking)
@@ -0,0 +1,134 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_resolversnapshot.h"
+
+#include "server/resolversnapshot.h"
+
+#include <QtTest/QTest>
+
+using namespace PMP;
+using namespace PMP::Server;
+
+namespace
+{
+    ResolverSnapshot createTestSnapshot(QUuid databaseUuid)
+    {
+        ResolverSnapshot snapshot(databaseUuid);
+
+        ResolverSnapshot::Track track1;
+        track1.hashId = 7;
+        track1.hash = FileHash::create("track one");
+        track1.audio = AudioData(AudioData::MP3, 215000);
+        track1.tags.append(TagData("Artist", "Title", "Album", "Album Artist", ""));
+        track1.files.append(
+            ResolverSnapshot::File
+            {
+                "/music/one.mp3", 3456789,
+                QDateTime::fromMSecsSinceEpoch(1700000000123, Qt::UTC)
+            }
+        );
+        track1.files.append(
+            ResolverSnapshot::File
+            {
+                "/music/copy of one.mp3", 3456789,
+                QDateTime::fromMSecsSinceEpoch(1700000100456, Qt::UTC)
+            }
+        );
+        snapshot.addTrack(track1);
+
+        ResolverSnapshot::Track track2;
+        track2.hashId = 12;
+        track2.hash = FileHash::create("track two");
+        track2.audio = AudioData(AudioData::FLAC, 60000);
+        track2.tags.append(TagData("Ärtist", "Títle", "", "", "comment"));
+        track2.tags.append(TagData("Other artist", "Other title", "", "", ""));
+        snapshot.addTrack(track2);
+
+        return snapshot;
+    }
+}
+
+void TestResolverSnapshot::serializeAndDeserialize()
+{
+    auto uuid = QUuid::createUuid();
+    auto original = createTestSnapshot(uuid);
+
+    auto maybeSnapshot = ResolverSnapshot::deserialize(original.serialize());
+    QVERIFY(maybeSnapshot.succeeded());
+
+    auto snapshot = maybeSnapshot.result();
+    QCOMPARE(snapshot.databaseUuid(), uuid);
+    QCOMPARE(snapshot.tracks().size(), 2);
+
+    auto const& track1 = snapshot.tracks()[0];
+    QCOMPARE(track1.hashId, 7u);
+    QCOMPARE(track1.hash, FileHash::create("track one"));
+    QCOMPARE(track1.audio.format(), AudioData::MP3);
+    QCOMPARE(track1.audio.trackLengthMilliseconds(), qint64(215000));
+    QCOMPARE(track1.tags.size(), 1);
+    QVERIFY(track1.tags[0]
+                == TagData("Artist", "Title", "Album", "Album Artist", ""));
+    QCOMPARE(track1.files.size(), 2);
+    QCOMPARE(track1.files[0].path, QString("/music/one.mp3"));
+    QCOMPARE(track1.files[0].size, qint64(3456789));
+    QCOMPARE(track1.files[0].lastModifiedUtc,
+             QDateTime::fromMSecsSinceEpoch(1700000000123, Qt::UTC));
+    QCOMPARE(track1.files[1].path, QString("/music/copy of one.mp3"));
+
+    auto const& track2 = snapshot.tracks()[1];
+    QCOMPARE(track2.hashId, 12u);
+    QCOMPARE(track2.hash, FileHash::create("track two"));
+    QCOMPARE(track2.audio.format(), AudioData::FLAC);
+    QCOMPARE(track2.tags.size(), 2);
+    QVERIFY(track2.tags[0] == TagData("Ärtist", "Títle", "", "", "comment"));
+    QVERIFY(track2.tags[1] == TagData("Other artist", "Other title", "", "", ""));
+    QVERIFY(track2.files.isEmpty());
+}
+
+void TestResolverSnapshot::serializeAndDeserialize_emptySnapshot()
+{
+    auto uuid = QUuid::createUuid();
+    ResolverSnapshot original(uuid);
+
+    auto maybeSnapshot = ResolverSnapshot::deserialize(original.serialize());
+    QVERIFY(maybeSnapshot.succeeded());
+    QCOMPARE(maybeSnapshot.result().databaseUuid(), uuid);
+    QVERIFY(maybeSnapshot.result().tracks().isEmpty());
+}
+
+void TestResolverSnapshot::deserialize_rejectsGarbage()
+{
+    QVERIFY(ResolverSnapshot::deserialize({}).failed());
+    QVERIFY(ResolverSnapshot::deserialize("not a snapshot at all").failed());
+
+    auto data = createTestSnapshot(QUuid::createUuid()).serialize();
+    data[0] = data[0] ^ 0x20; /* damage the magic number */
+    QVERIFY(ResolverSnapshot::deserialize(data).failed());
+}
+
+void TestResolverSnapshot::deserialize_rejectsTruncatedData()
+{
+    auto data = createTestSnapshot(QUuid::createUuid()).serialize();
+
+    QVERIFY(ResolverSnapshot::deserialize(data.left(8)).failed());
+    QVERIFY(ResolverSnapshot::deserialize(data.left(data.size() / 2)).failed());
+}
+
+QTEST_MAIN(TestResolverSnapshot)
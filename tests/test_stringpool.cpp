@@ -0,0 +1,89 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_stringpool.h"
+
+#include "common/stringpool.h"
+
+#include <QtTest/QTest>
+
+using namespace PMP;
+
+void TestStringPool::intern_returnsEqualString()
+{
+    StringPool pool;
+
+    auto interned = pool.intern("Daft Punk");
+
+    QCOMPARE(interned, QString("Daft Punk"));
+}
+
+void TestStringPool::intern_equalStringsShareData()
+{
+    StringPool pool;
+
+    /* two strings with the same text that don't share their data */
+    QString artist1 = QString("Daft") + " Punk";
+    QString artist2 = QString("Daft ") + "Punk";
+    QVERIFY(artist1.constData() != artist2.constData());
+
+    auto interned1 = pool.intern(artist1);
+    auto interned2 = pool.intern(artist2);
+
+    QVERIFY(StringPool::isSameInternedString(interned1, interned2));
+    QCOMPARE(interned1.constData(), interned2.constData());
+}
+
+void TestStringPool::intern_differentStringsAreNotTheSame()
+{
+    StringPool pool;
+
+    auto interned1 = pool.intern("Discovery");
+    auto interned2 = pool.intern("Homework");
+    auto interned3 = pool.intern("discovery");
+
+    QVERIFY(!StringPool::isSameInternedString(interned1, interned2));
+    QVERIFY(!StringPool::isSameInternedString(interned1, interned3));
+}
+
+void TestStringPool::intern_emptyStringsBecomeTheSameNullString()
+{
+    StringPool pool;
+
+    auto interned1 = pool.intern(QString());
+    auto interned2 = pool.intern(QString(""));
+
+    QVERIFY(interned1.isNull());
+    QVERIFY(interned2.isNull());
+    QVERIFY(StringPool::isSameInternedString(interned1, interned2));
+    QCOMPARE(pool.size(), 0);
+}
+
+void TestStringPool::size_countsDistinctStrings()
+{
+    StringPool pool;
+
+    (void)pool.intern("One More Time");
+    (void)pool.intern("Aerodynamic");
+    (void)pool.intern(QString("One More ") + "Time");
+
+    QCOMPARE(pool.size(), 2);
+}
+
+QTEST_MAIN(TestStringPool)
@@ -0,0 +1,123 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "test_weightedsampler.h"
+
+#include "server/weightedsampler.h"
+
+#include <QHash>
+#include <QtTest/QTest>
+
+using namespace PMP::Server;
+
+void TestWeightedSampler::pick_returnsZeroWhenEmpty()
+{
+    WeightedSampler sampler;
+    std::mt19937 randomEngine(42);
+
+    QCOMPARE(sampler.isEmpty(), true);
+    QCOMPARE(sampler.pick(randomEngine), 0u);
+
+    sampler.setWeight(5, 0);
+    QCOMPARE(sampler.pick(randomEngine), 0u);
+}
+
+void TestWeightedSampler::pick_returnsOnlyItemWithNonZeroWeight()
+{
+    WeightedSampler sampler;
+    std::mt19937 randomEngine(42);
+
+    for (uint item = 1; item <= 20; ++item)
+        sampler.setWeight(item, item == 13 ? 7 : 0);
+
+    for (int i = 0; i < 100; ++i)
+        QCOMPARE(sampler.pick(randomEngine), 13u);
+}
+
+void TestWeightedSampler::pick_followsWeights()
+{
+    WeightedSampler sampler;
+    std::mt19937 randomEngine(42);
+
+    sampler.setWeight(1, 100);
+    sampler.setWeight(2, 300);
+    sampler.setWeight(3, 0);
+    sampler.setWeight(4, 600);
+
+    QHash<uint, int> counts;
+    const int pickCount = 100000;
+    for (int i = 0; i < pickCount; ++i)
+        counts[sampler.pick(randomEngine)]++;
+
+    QCOMPARE(counts.value(3), 0);
+
+    /* allow a margin of one percent */
+    QVERIFY(qAbs(counts.value(1) - pickCount / 10) < pickCount / 100);
+    QVERIFY(qAbs(counts.value(2) - pickCount * 3 / 10) < pickCount / 100);
+    QVERIFY(qAbs(counts.value(4) - pickCount * 6 / 10) < pickCount / 100);
+}
+
+void TestWeightedSampler::setWeight_updatesTotalWeight()
+{
+    WeightedSampler sampler;
+
+    for (uint item = 1; item <= 10; ++item)
+        sampler.setWeight(item, item);
+
+    QCOMPARE(sampler.totalWeight(), qint64(55));
+
+    sampler.setWeight(4, 10); /* +6 */
+    sampler.setWeight(7, 2); /* -5 */
+
+    QCOMPARE(sampler.totalWeight(), qint64(56));
+    QCOMPARE(sampler.weight(4), 10u);
+    QCOMPARE(sampler.weight(7), 2u);
+    QCOMPARE(sampler.weight(99), 0u);
+}
+
+void TestWeightedSampler::setWeight_zeroMakesItemUnpickable()
+{
+    WeightedSampler sampler;
+    std::mt19937 randomEngine(42);
+
+    sampler.setWeight(1, 500);
+    sampler.setWeight(2, 500);
+    sampler.setWeight(1, 0);
+
+    for (int i = 0; i < 100; ++i)
+        QCOMPARE(sampler.pick(randomEngine), 2u);
+
+    QCOMPARE(sampler.totalWeight(), qint64(500));
+}
+
+void TestWeightedSampler::clear_removesAllItems()
+{
+    WeightedSampler sampler;
+    std::mt19937 randomEngine(42);
+
+    sampler.setWeight(1, 500);
+    sampler.setWeight(2, 500);
+    sampler.clear();
+
+    QCOMPARE(sampler.isEmpty(), true);
+    QCOMPARE(sampler.weight(1), 0u);
+    QCOMPARE(sampler.pick(randomEngine), 0u);
+}
+
+QTEST_MAIN(TestWeightedSampler)
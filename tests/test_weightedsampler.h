@@ -0,0 +1,36 @@
+/*
+    Copyright (C) 2024, Kevin Andre <hyperquantum@gmail.com>
+
+    This file is part of PMP (Party Music Player).
+
+    PMP is free software: you can redistribute it and/or modify it under the
+    terms of the GNU General Public License as published by the Free Software
+    Foundation, either version 3 of the License, or (at your option) any later
+    version.
+
+    PMP is distributed in the hope that it will be useful, but WITHOUT ANY
+    WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+    FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+    details.
+
+    You should have received a copy of the GNU General Public License along
+    with PMP.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PMP_TESTWEIGHTEDSAMPLER_H
+#define PMP_TESTWEIGHTEDSAMPLER_H
+
+#include <QObject>
+
+class TestWeightedSampler : public QObject
+{
+    Q_OBJECT
+private Q_SLOTS:
+    void pick_returnsZeroWhenEmpty();
+    void pick_returnsOnlyItemWithNonZeroWeight();
+    void pick_followsWeights();
+    void setWeight_updatesTotalWeight();
+    void setWeight_zeroMakesItemUnpickable();
+    void clear_removesAllItems();
+};
+#endif